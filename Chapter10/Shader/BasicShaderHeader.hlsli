@@ -17,10 +17,16 @@ cbuffer Matrix : register(b0)
 	float3 eye;
 };
 
+// ボーン番号は描画範囲のボーンパレット上の位置（要素数はMaxPaletteBonesと合わせる）
 cbuffer Transform : register(b1)
 {
 	matrix world;
+#if defined(DUAL_QUATERNION_SKINNING)
+	// ボーンごとに回転（実部）と平行移動（双対部）の2要素
+	float4 boneDualQuaternions[256 * 2];
+#else
 	matrix bones[256];
+#endif
 };
 
 cbuffer Material : register(b2)
@@ -30,6 +36,31 @@ cbuffer Material : register(b2)
 	float3 ambient;
 };
 
+// 2つのボーンで座標を変換する（weightはbone_no[0]の重み（%））
+float4 SkinPosition(float4 pos, min16uint2 bone_no, min16uint weight)
+{
+	float w = weight / 100.0f;
+#if defined(DUAL_QUATERNION_SKINNING)
+	float4 real0 = boneDualQuaternions[bone_no[0] * 2];
+	float4 dual0 = boneDualQuaternions[bone_no[0] * 2 + 1];
+	float4 real1 = boneDualQuaternions[bone_no[1] * 2];
+	float4 dual1 = boneDualQuaternions[bone_no[1] * 2 + 1];
+	// 短い方の回転で補間するように符号を揃える
+	float w1 = dot(real0, real1) < 0.0f ? w - 1.0f : 1.0f - w;
+	float4 real = real0 * w + real1 * w1;
+	float4 dual = dual0 * w + dual1 * w1;
+	float len = length(real);
+	real /= len;
+	dual /= len;
+	float3 p = pos.xyz + 2.0f * cross(real.xyz, cross(real.xyz, pos.xyz) + real.w * pos.xyz);
+	p += 2.0f * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+	return float4(p, 1.0f);
+#else
+	matrix bm = bones[bone_no[0]] * w + bones[bone_no[1]] * (1 - w);
+	return mul(bm, pos);
+#endif
+}
+
 // シェーダーステージ間受け渡し用構造体
 struct VSOutput {
 	float4 svpos : SV_POSITION;
@@ -5,12 +5,13 @@ VSOutput BasicVS(
 	float4 normal : NORMAL,
 	float2 uv : TEXCOORD,
 	min16uint2 bone_no : BONE_NO,
-	min16uint weight : WEIGHT
+	min16uint weight : WEIGHT,
+	float3 morph : MORPH
 ) {
 	VSOutput output;
-	float w = weight / 100.0f;
-	matrix bm = bones[bone_no[0]] * w + bones[bone_no[1]] * (1 - w);
-	pos = mul(bm, pos);
+	// 表情のオフセットはボーン変形の前に足す
+	pos.xyz += morph;
+	pos = SkinPosition(pos, bone_no, weight);
 	pos = mul(world, pos);
 	output.svpos = mul(viewproj, pos);
 	output.normal = mul(world, float4(normal.xyz, 0));
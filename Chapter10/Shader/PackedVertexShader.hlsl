@@ -0,0 +1,31 @@
+#include "BasicShaderHeader.hlsli"
+
+// 八面体写像された法線を復元
+float3 DecodeOctahedron(float2 e)
+{
+	float3 n = float3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += (n.xy >= 0.0f) ? -t : t;
+	return normalize(n);
+}
+
+VSOutput PackedVS(
+	float4 pos : POSITION,
+	float2 octNormal : NORMAL,
+	float2 uv : TEXCOORD,
+	min16uint2 bone_no : BONE_NO,
+	min16uint weight : WEIGHT,
+	float3 morph : MORPH
+) {
+	VSOutput output;
+	// 表情のオフセットはボーン変形の前に足す
+	pos.xyz += morph;
+	pos = SkinPosition(pos, bone_no, weight);
+	pos = mul(world, pos);
+	output.svpos = mul(viewproj, pos);
+	output.normal = mul(world, float4(DecodeOctahedron(octNormal), 0));
+	output.vnormal = mul(view, output.normal);
+	output.uv = uv;
+	output.ray = normalize(pos.xyz - eye);
+	return output;
+}
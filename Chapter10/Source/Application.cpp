@@ -1,5 +1,11 @@
 ﻿#include "Application.h"
 
+// std
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <utility>
+
 // Windows
 #include <Windows.h>
 
@@ -21,13 +27,37 @@ const std::wstring ModelFile = ModelPath + L"/初音ミク.pmd";
 //const std::wstring ModelFile = ModelPath + L"/MMD-Nanami/Nanami.pmd";
 //const std::wstring ModelFile = ModelPath + L"/MMD-Claudia/Claudia.pmd";
 
+// VMDモーションファイル名（読み込めなければモーションなしで表示する）
+const std::wstring MotionPath = L"MMD/UserFile/Motion";
+const std::wstring MotionFile = MotionPath + L"/motion.vmd";
+
 // トゥーンシェーディング用テクスチャー読み込みパス
 const std::wstring ToonBmpPath = L"MMD/Data";
 
+// モデルの読み込みに回すワーカースレッドの割合（呼び出し元を除くハードウェアスレッドのうち1/LoaderThreadDivisor、最低1）
+// 残りをアクターの更新に回し、2つのスレッドプールの合計がハードウェアスレッド数を超えないようにする（少なければどちらにも1つ回す）
+const size_t LoaderThreadDivisor = 4;
+
+// 配置するアクターの数と間隔（正方形の格子状に並べる）
+const size_t NumberOfActors = 1;
+const float ActorSpacing = 10.0f;
+
+// 1フレームの経過時間（垂直同期で60fps）
+const float FrameTime = 1.0f / 60.0f;
+
+// 詳細度を下げてよい画面上の誤差（画素）
+const float MaxLodPixelError = 1.0f;
+
+// モデルの頂点形式（Packedなら表現できるモデルは24バイトの圧縮頂点にする）
+const pmd::PMDVertexFormat ModelVertexFormat = pmd::PMDVertexFormat::Packed;
+
+// アクターのスキニングの方式（DualQuaternionならボーンの定数バッファーが半分になり、ねじれた関節も痩せない）
+const pmd::PMDSkinningMode ActorSkinningMode = pmd::PMDSkinningMode::Linear;
+
 // コンストラクター
 Application::Application() :
 	_hWnd(nullptr), _wndClass(), _d3d12Env(nullptr), _sceneMatrixDescHeap(nullptr),
-	_sceneMatrixConstantBuffer(nullptr), _mappedMatrix(nullptr), _pmdRenderer(nullptr)
+	_sceneMatrixConstantBuffer(nullptr), _mappedMatrix(nullptr), _pmdRenderer(nullptr), _pmdModelLibrary(nullptr)
 {
 }
 
@@ -96,14 +126,52 @@ Application::Initialize()
 	// PMD共通描画環境の初期化
 	_pmdRenderer.reset(new pmd::PMDRenderer(_d3d12Env->GetDevice().Get()));
 
-	// PMDモデルの初期化
-	_pmdActor.reset(new pmd::PMDActor());
-	result = _pmdActor->LoadFromFile(pDevice.Get(), _resourceCache.get(), ModelFile, ToonBmpPath);
-	if (FAILED(result))
+	// ワーカースレッドをモデルの読み込みとアクターの更新で分け合う
+	auto workerThreads = std::max<size_t>(std::thread::hardware_concurrency(), 2) - 1;
+	auto loaderThreads = std::max<size_t>(workerThreads / LoaderThreadDivisor, 1);
+	auto sceneThreads = std::max<size_t>(workerThreads - std::min(loaderThreads, workerThreads), 1);
+
+	// PMDモデルの初期化（同じファイルのモデルはアクター間で共有する）
+	_pmdModelLibrary.reset(new pmd::PMDModelLibrary(pDevice.Get(), _resourceCache.get(), loaderThreads, ModelVertexFormat));
+	// ファイルの解釈とテクスチャーのデコードは並列に行い、GPUリソースはこのスレッドで生成する
+	auto modelFutures = _pmdModelLibrary->LoadBatch({ ModelFile }, ToonBmpPath);
+	_pmdModelLibrary->WaitAll();
+	auto model = modelFutures[0].get();
+	if (!model)
 	{
 		std::wstring errMsg = L"\"" + ModelFile + L"\":\nファイルの読み込みに失敗しました。\n\nMMD/以下にファイルを正しく配置してください。";
 		MessageBox(_hWnd, errMsg.c_str(), L"読み込みエラー", MB_ICONERROR);
-		return result;
+		return E_FAIL;
+	}
+
+	// モーションの読み込み（ボーン名をモデルのボーン番号に解決し、全アクターで共有する）
+	std::shared_ptr<pmd::PMDMotion> motion(new pmd::PMDMotion());
+	if (!motion->Load(MotionFile, model->GetBoneNameTable(), model->GetNumberOfBone())) {
+		motion.reset();
+	}
+	else {
+		// 誤差の上限内でキーを間引いて圧縮する（できなければ圧縮前のまま使う）
+		motion->Compress();
+	}
+
+	// アクターの更新はワーカースレッドで並列に行う
+	_pmdScene.reset(new pmd::PMDScene(sceneThreads));
+	auto columns = static_cast<size_t>(std::ceil(std::sqrt(static_cast<float>(NumberOfActors))));
+	for (size_t i = 0; i < NumberOfActors; i++) {
+		std::unique_ptr<pmd::PMDActor> actor(new pmd::PMDActor());
+		result = actor->Create(pDevice.Get(), model, ActorSkinningMode);
+		if (FAILED(result))
+		{
+			return result;
+		}
+		actor->SetPosition(DirectX::XMFLOAT3(
+			(static_cast<float>(i % columns) - (columns - 1) * 0.5f) * ActorSpacing,
+			0.0f,
+			static_cast<float>(i / columns) * ActorSpacing));
+		if (motion) {
+			actor->SetMotion(motion);
+		}
+		_pmdScene->AddActor(std::move(actor));
 	}
 
 	return S_OK;
@@ -125,10 +193,12 @@ Application::Run()
 	auto viewMatrix = DirectX::XMMatrixLookAtLH(DirectX::XMLoadFloat3(&eye), DirectX::XMLoadFloat3(&target), DirectX::XMLoadFloat3(&up));
 	auto aspectRatio = static_cast<float>(DefaultWindowWidth) / DefaultWindowHeight;
 	auto projectionMatrix = DirectX::XMMatrixPerspectiveFovLH(DirectX::XM_PIDIV4, aspectRatio, 1.0f, 100.f);
+	auto viewProjectionMatrix = viewMatrix * projectionMatrix;
+	auto lodProjectionScale = DefaultWindowHeight * 0.5f / std::tan(DirectX::XM_PIDIV4 * 0.5f);
 
 	_mappedMatrix->view = viewMatrix;
 	_mappedMatrix->proj = projectionMatrix;
-	_mappedMatrix->viewProj = viewMatrix * projectionMatrix;
+	_mappedMatrix->viewProj = viewProjectionMatrix;
 	_mappedMatrix->eye = eye;
 
 	auto commandList = _d3d12Env->GetCommandList();
@@ -148,10 +218,9 @@ Application::Run()
 		ID3D12DescriptorHeap* descHeaps[] = { _sceneMatrixDescHeap.Get() };
 		commandList->SetDescriptorHeaps(1, descHeaps);
 		commandList->SetGraphicsRootSignature(_pmdRenderer->GetRootSingnature());
-		commandList->SetPipelineState(_pmdRenderer->GetPipelineState());
 		commandList->SetGraphicsRootDescriptorTable(0, _sceneMatrixDescHeap->GetGPUDescriptorHandleForHeapStart());
-		_pmdActor->Update();
-		_pmdActor->Draw(pDevice.Get(), commandList.Get());
+		_pmdScene->Update(FrameTime, viewProjectionMatrix, eye, lodProjectionScale, MaxLodPixelError);
+		_pmdScene->Draw(pDevice.Get(), commandList.Get(), _pmdRenderer.get());
 
 		_d3d12Env->EndDraw();
 	}
@@ -6,7 +6,9 @@
 #include "D3D12/D3D12Environment.h"
 #include "D3D12/D3D12ResourceCache.h"
 #include "PMD/PMDActor.h"
+#include "PMD/PMDModelLibrary.h"
 #include "PMD/PMDRenderer.h"
+#include "PMD/PMDScene.h"
 
 // シェーダーに渡す行列
 struct SceneMatrix
@@ -64,7 +66,8 @@ private:
 
 	// PMDモデル描画オブジェクト
 	std::unique_ptr<pmd::PMDRenderer> _pmdRenderer;
-	std::unique_ptr<pmd::PMDActor> _pmdActor;
+	std::unique_ptr<pmd::PMDModelLibrary> _pmdModelLibrary;
+	std::unique_ptr<pmd::PMDScene> _pmdScene;
 
 private:
 	// ウィンドウの初期化
@@ -0,0 +1,59 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+
+// 連続したメモリー領域を所有せずに参照する読み取り専用ビュー
+// メモリーマップしたファイル上のデータをコピーせずに型付きで扱うために使う
+template<typename T>
+class ArrayView
+{
+public:
+	ArrayView() : _data(nullptr), _size(0)
+	{
+	}
+
+	ArrayView(const T* data, size_t size) : _data(data), _size(size)
+	{
+	}
+
+	const T* data() const
+	{
+		return _data;
+	}
+
+	size_t size() const
+	{
+		return _size;
+	}
+
+	// 参照している領域のバイト数
+	size_t size_bytes() const
+	{
+		return _size * sizeof(T);
+	}
+
+	bool empty() const
+	{
+		return _size == 0;
+	}
+
+	const T* begin() const
+	{
+		return _data;
+	}
+
+	const T* end() const
+	{
+		return _data + _size;
+	}
+
+	const T& operator[](size_t index) const
+	{
+		return _data[index];
+	}
+
+private:
+	const T* _data;
+	size_t _size;
+};
@@ -68,14 +68,50 @@ ID3D12Resource* D3D12ResourceCache::LoadTextureFromFile(const std::wstring& file
 	HRESULT result;
 
 	// ファイルから読み込み
-	auto ext = GetExtension(filename);
-	result = _textureLoaderTable[ext](filename, &metadata, scratchImg);
+	result = DecodeTextureFile(filename, &metadata, scratchImg);
 	if (FAILED(result))
 	{
 		wprintf(L"load failed. : %s\n", filename.c_str());
 		return nullptr;
 	}
 
+	return CreateTextureFromImage(filename, metadata, scratchImg);
+}
+
+// 生成済みのテクスチャーリソースを取得
+ID3D12Resource* D3D12ResourceCache::FindTexture(const std::wstring& filename) const
+{
+	auto it = _loadedTextures.find(filename);
+	return it != _loadedTextures.end() ? it->second.Get() : nullptr;
+}
+
+// 画像ファイルのデコード
+HRESULT D3D12ResourceCache::DecodeTextureFile(
+	const std::wstring& filename,
+	DirectX::TexMetadata* const pMetadata,
+	DirectX::ScratchImage& scratchImg) const
+{
+	auto loader = _textureLoaderTable.find(GetExtension(filename));
+	if (loader == _textureLoaderTable.end())
+	{
+		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+	}
+	return loader->second(filename, pMetadata, scratchImg);
+}
+
+// デコード済みの画像からテクスチャーリソースを生成してキャッシュに追加
+ID3D12Resource* D3D12ResourceCache::CreateTextureFromImage(
+	const std::wstring& filename,
+	const DirectX::TexMetadata& metadata,
+	const DirectX::ScratchImage& scratchImg)
+{
+	auto it = _loadedTextures.find(filename);
+	if (it != _loadedTextures.end()) {
+		return it->second.Get();
+	}
+
+	HRESULT result;
+
 	// リソースのプロパティ定義
 	auto img = scratchImg.GetImage(0, 0, 0);
 	auto heapProp = CD3DX12_HEAP_PROPERTIES(D3D12_CPU_PAGE_PROPERTY_WRITE_BACK, D3D12_MEMORY_POOL_L0);
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 // std
+#include <functional>
 #include <map>
 #include <string>
 #include <unordered_map>
@@ -21,6 +22,21 @@ public:
 	// 画像ファイルからテクスチャーリソースを生成
 	ID3D12Resource* LoadTextureFromFile(const std::wstring& filename);
 
+	// 生成済みのテクスチャーリソースを取得（なければnullptr。読み込みは試みない）
+	ID3D12Resource* FindTexture(const std::wstring& filename) const;
+
+	// 画像ファイルのデコード（デバイスに触れないのでワーカースレッドから呼んでよい）
+	HRESULT DecodeTextureFile(
+		const std::wstring& filename,
+		DirectX::TexMetadata* const pMetadata,
+		DirectX::ScratchImage& scratchImg) const;
+
+	// デコード済みの画像からテクスチャーリソースを生成
+	ID3D12Resource* CreateTextureFromImage(
+		const std::wstring& filename,
+		const DirectX::TexMetadata& metadata,
+		const DirectX::ScratchImage& scratchImg);
+
 	// 中身が空のテクスチャーリソースを生成
 	ID3D12Resource* CreateEmptyTexture(ID3D12Device* const pD3D12Device, UINT64 width, UINT height);
 
@@ -0,0 +1,135 @@
+﻿#include "MappedFile.h"
+
+// std
+#include <utility>
+
+#ifdef _WIN32
+// Windows
+#include <Windows.h>
+#else
+// POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#include "utils.h"
+
+// コンストラクター
+MappedFile::MappedFile() :
+	_data(nullptr), _size(0)
+#ifdef _WIN32
+	, _fileHandle(INVALID_HANDLE_VALUE), _mappingHandle(nullptr)
+#endif // _WIN32
+{
+}
+
+// ムーブコンストラクター
+MappedFile::MappedFile(MappedFile&& other) : MappedFile()
+{
+	*this = std::move(other);
+}
+
+// ムーブ代入
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+	if (this != &other) {
+		Close();
+		std::swap(_data, other._data);
+		std::swap(_size, other._size);
+#ifdef _WIN32
+		std::swap(_fileHandle, other._fileHandle);
+		std::swap(_mappingHandle, other._mappingHandle);
+#endif // _WIN32
+	}
+	return *this;
+}
+
+// デストラクター
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+// ファイルを開いてマップする
+bool MappedFile::Open(const std::wstring& filename)
+{
+	Close();
+
+#ifdef _WIN32
+	_fileHandle = ::CreateFileW(
+		filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (_fileHandle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize = {};
+	if (!::GetFileSizeEx(_fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+		Close();
+		return false;
+	}
+
+	_mappingHandle = ::CreateFileMappingW(_fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_mappingHandle == nullptr) {
+		Close();
+		return false;
+	}
+
+	auto pView = ::MapViewOfFile(_mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (pView == nullptr) {
+		Close();
+		return false;
+	}
+	_data = static_cast<const unsigned char*>(pView);
+	_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	auto fd = ::open(GetUTF8String(filename).c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st = {};
+	if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	auto pView = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	// マップ後はファイルディスクリプターが不要
+	::close(fd);
+	if (pView == MAP_FAILED) {
+		return false;
+	}
+	::madvise(pView, static_cast<size_t>(st.st_size), MADV_WILLNEED);
+	_data = static_cast<const unsigned char*>(pView);
+	_size = static_cast<size_t>(st.st_size);
+#endif // _WIN32
+
+	return true;
+}
+
+// マップを解除してファイルを閉じる
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (_data) {
+		::UnmapViewOfFile(_data);
+	}
+	if (_mappingHandle) {
+		::CloseHandle(_mappingHandle);
+		_mappingHandle = nullptr;
+	}
+	if (_fileHandle != INVALID_HANDLE_VALUE) {
+		::CloseHandle(_fileHandle);
+		_fileHandle = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (_data) {
+		::munmap(const_cast<unsigned char*>(_data), _size);
+	}
+#endif // _WIN32
+	_data = nullptr;
+	_size = 0;
+}
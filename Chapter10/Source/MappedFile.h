@@ -0,0 +1,52 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <string>
+
+// 読み取り専用でメモリーマップしたファイル
+// Windowsではファイルマッピング、それ以外ではmmapを使い、ページキャッシュを直接参照する
+class MappedFile
+{
+public:
+	MappedFile();
+	MappedFile(MappedFile&& other);
+	MappedFile& operator=(MappedFile&& other);
+	virtual ~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// ファイルを開いてマップする
+	bool Open(const std::wstring& filename);
+
+	// マップを解除してファイルを閉じる
+	void Close();
+
+	// マップされているか
+	bool IsOpen() const
+	{
+		return _data != nullptr;
+	}
+
+	// マップされた先頭アドレス
+	const unsigned char* GetData() const
+	{
+		return _data;
+	}
+
+	// ファイルサイズ
+	size_t GetSize() const
+	{
+		return _size;
+	}
+
+private:
+	const unsigned char* _data;
+	size_t _size;
+
+#ifdef _WIN32
+	void* _fileHandle;
+	void* _mappingHandle;
+#endif // _WIN32
+};
@@ -2,9 +2,11 @@
 
 // std
 #include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <functional>
 #include <map>
+#include <utility>
 #include <vector>
 
 // Windows
@@ -15,60 +17,71 @@
 #include <d3dx12.h>
 #include <DirectXTex.h>
 
-#include "utils.h"
-
 namespace pmd
 {
 	using namespace Microsoft::WRL;
 
-	// トランスフォームは16Byte境界でnew()
-	void* Transform::operator new(size_t size)
+	namespace
 	{
-		return _aligned_malloc(size, 16);
-	}
+		// ボーン行列を回転と平行移動に分ける
+		RigidTransform DecomposeRigid(DirectX::FXMMATRIX matrix)
+		{
+			return { DirectX::XMQuaternionRotationMatrix(matrix), matrix.r[3] };
+		}
 
-	// PMD頂点レイアウト
-	const std::vector<D3D12_INPUT_ELEMENT_DESC> PMDActor::InputLayout = {
-		{ // 座標
-			"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,
-			D3D12_APPEND_ALIGNED_ELEMENT,
-			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
-		},
-		{ // 法線
-			"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,
-			D3D12_APPEND_ALIGNED_ELEMENT,
-			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
-		},
-		{ // UV
-			"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0,
-			D3D12_APPEND_ALIGNED_ELEMENT,
-			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
-		},
+		// 回転と平行移動からボーン行列を作る
+		DirectX::XMMATRIX ComposeRigid(const RigidTransform& transform)
 		{
-			"BONE_NO", 0, DXGI_FORMAT_R16G16_UINT, 0,
-			D3D12_APPEND_ALIGNED_ELEMENT,
-			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
-		},
+			auto matrix = DirectX::XMMatrixRotationQuaternion(transform.rotation);
+			matrix.r[3] = DirectX::XMVectorSetW(transform.translation, 1.0f);
+			return matrix;
+		}
+
+		// ボーンの変換を補間する（間引き更新の間を埋める）
+		// 行列を成分ごとに補間すると大きく回る関節で直交しなくなるので、回転はnlerp（内積が負なら短い方の回転）、平行移動は線形に補間する
+		RigidTransform LerpRigid(const RigidTransform& a, const RigidTransform& b, float t)
 		{
-			"WEIGHT", 0, DXGI_FORMAT_R8_UINT, 0,
-			D3D12_APPEND_ALIGNED_ELEMENT,
-			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
-		},
+			auto rotation = b.rotation;
+			if (DirectX::XMVectorGetX(DirectX::XMVector4Dot(a.rotation, rotation)) < 0.0f) {
+				rotation = DirectX::XMVectorNegate(rotation);
+			}
+			return {
+				DirectX::XMQuaternionNormalize(DirectX::XMVectorLerp(a.rotation, rotation, t)),
+				DirectX::XMVectorLerp(a.translation, b.translation, t) };
+		}
+
+		// モーションの平行移動でボーンが初期位置から動く距離の上限の最大
+		// ボーンの原点は親の移動に自分の平行移動（親の回転で向きが変わっても長さは同じ）を足した分だけ動く
+		float ComputeMotionExtent(const PMDMotion& motion, const PMDSkeleton& skeleton)
 		{
-			"EDGE_FLAG", 0, DXGI_FORMAT_R8_UINT, 0,
-			D3D12_APPEND_ALIGNED_ELEMENT,
-			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
-		},
-	};
+			const auto& parents = skeleton.GetParents();
+			std::vector<float> extents(parents.size());
+			auto maxExtent = 0.0f;
+			for (size_t i = 0; i < parents.size(); i++) {
+				auto parent = parents[i];
+				extents[i] = motion.GetMaxTranslation(i) + (parent != InvalidBoneIndex ? extents[parent] : 0.0f);
+				maxExtent = std::max(maxExtent, extents[i]);
+			}
+			return maxExtent;
+		}
+	}
+
+	// トランスフォームは16Byte境界でnew()
+	void* Transform::operator new(size_t size)
+	{
+		return _aligned_malloc(size, 16);
+	}
 
 	// コンストラクター
 	PMDActor::PMDActor() :
-		_pmdSignature{}, _pmdHeader(),
-		_vertexBuffer(nullptr), _vertexBufferView{},
-		_indexBuffer(nullptr), _indexBufferView{},
-		_materialBuffer(nullptr), _materialDescHeap(nullptr), _meshes{},
-		_transformBuff(nullptr), _transformDescHeap(nullptr), _mappedMatrices(nullptr),
-		_angle(0.0f)
+		_model(nullptr),
+		_transformBuff(nullptr), _mappedMatrices(nullptr), _paletteOffsets(), _paletteAddresses(), _skinningMode(PMDSkinningMode::Linear),
+		_position(0.0f, 0.0f, 0.0f), _angle(0.0f), _world(DirectX::XMMatrixIdentity()), _worldCenter(0.0f, 0.0f, 0.0f), _lodLevel(0),
+		_motion(nullptr), _sampler(), _motionFrame(0.0f), _motionExtent(0.0f),
+		_fadeMotion(nullptr), _fadeSampler(), _fadeFrame(0.0f), _fadeElapsed(0.0f), _fadeDuration(0.0f), _fadeExtent(0.0f),
+		_morphEngine(), _morphBindings(), _fadeMorphBindings(), _fadeMorphWeights(),
+		_morphBuff(nullptr), _mappedMorphs(nullptr), _morphBufferView(),
+		_pendingTime(0.0f), _paletteStart(), _updateInterval(1), _paletteStep(0), _morphsPending(false)
 	{
 	}
 
@@ -79,356 +92,379 @@ namespace pmd
 			_transformBuff->Unmap(0, nullptr);
 			_mappedMatrices = nullptr;
 		}
+		if (_morphBuff && _mappedMorphs) {
+			_morphBuff->Unmap(0, nullptr);
+			_mappedMorphs = nullptr;
+		}
 	}
 
-	// PMDファイルからの読み込み
-	HRESULT PMDActor::LoadFromFile(
+	// 共有モデルからアクターを生成
+	HRESULT PMDActor::Create(
 		ID3D12Device* const pD3D12Device,
-		D3D12ResourceCache* const pResourceCache,
-		const std::wstring& filename,
-		const std::wstring& toonTexturePath)
+		const std::shared_ptr<const PMDModel>& model,
+		PMDSkinningMode skinningMode)
 	{
-		HRESULT result;
-		FILE* fp = nullptr;
-
-		auto state = _wfopen_s(&fp, filename.c_str(), TEXT("rb"));
-		if (state != 0) {
-			return E_FAIL;
-		}
-
-		// ファイル内容を全て読み込む
-		fseek(fp, 0, SEEK_END);
-		auto size = ftell(fp);
-		fseek(fp, 0, SEEK_SET);
-		std::vector<unsigned char> buff(size);
-		fread(buff.data(), size, 1, fp);
-		fclose(fp);
-
-		auto pathIndex = filename.rfind('/');
-		if (pathIndex == filename.npos) {
-			pathIndex = filename.rfind('\\');
-		}
-		auto folderPath = filename.substr(0, pathIndex);
-
-		// シグネチャーとヘッダー情報
-		std::memcpy(_pmdSignature, buff.data(), sizeof(_pmdSignature));
-		auto pHeader = reinterpret_cast<PMDHeader*>(buff.data() + sizeof(_pmdSignature));
-		_pmdHeader = *pHeader;
-
-		// 頂点データの読み込みと頂点バッファーの生成
-		auto pNumberOfVertex = reinterpret_cast<unsigned int*>(pHeader + 1);
-		auto numberOfVertex = *pNumberOfVertex;
-		auto vertexDataSize = sizeof(SerializedVertex) * numberOfVertex;
-		auto pVertexData = reinterpret_cast<unsigned char*>(pNumberOfVertex + 1);
-		std::vector<unsigned char> rawVertices(vertexDataSize);
-		std::memcpy(rawVertices.data(), pVertexData, vertexDataSize);
-		result = CreateVertexBuffer(pD3D12Device, rawVertices);
-		if (FAILED(result))
-		{
-			return result;
-		}
-
-		// インデックスデータの読み込みとインデックスバッファーの生成
-		auto pNumberOfIndex = reinterpret_cast<unsigned int*>(pVertexData + vertexDataSize);
-		auto numberOfIndex = *pNumberOfIndex;
-		auto pIndexData = reinterpret_cast<unsigned short*>(pNumberOfIndex + 1);
-		std::vector<unsigned short> rawIndices(numberOfIndex);
-		std::memcpy(rawIndices.data(), pIndexData, sizeof(unsigned short) * numberOfIndex);
-		result = CreateIndexBuffer(pD3D12Device, rawIndices);
-		if (FAILED(result))
-		{
-			return result;
-		}
-
-		// メッシュ情報の読み込み
-		auto pNumberOfMesh = reinterpret_cast<unsigned int*>(pIndexData + numberOfIndex);
-		auto numberOfMesh = *pNumberOfMesh;
-		auto pMeshData = reinterpret_cast<SerializedMeshData*>(pNumberOfMesh + 1);
-		_meshes.resize(numberOfMesh);
-		for (auto i = 0u; i < numberOfMesh; i++) {
-			result = _meshes[i].LoadFromSerializedData(pResourceCache, pMeshData[i], folderPath, toonTexturePath);
-			if (FAILED(result)) {
-				return result;
-			}
-#ifdef _DEBUG
-			printf("mesh[%d]:", i);
-#endif // _DEBUG
-		}
-#ifdef _DEBUG
-		printf("\n");
-#endif // _DEBUG
-
-		// マテリアルのバッファーを作成
-		result = CreateMaterialBuffers(pD3D12Device, pResourceCache, numberOfMesh);
-
-		// ボーン情報の読み込み
-		auto pNumberOfBone = reinterpret_cast<unsigned short*>(pMeshData + numberOfMesh);
-		auto numberOfBone = *pNumberOfBone;
-		auto pBoneData = reinterpret_cast<PMDBone*>(pNumberOfBone + 1);
-		printf("boneNum = %d\n", numberOfBone);
-
-		// ボーンノードマップを作る
-		std::vector<std::string> boneNames(numberOfBone);
-		for (int i = 0; i < numberOfBone; i++)
-		{
-			const auto& bone = pBoneData[i];
-			printf("boneName = %s\n", bone.boneName);
-			boneNames[i] = bone.boneName;
-			auto& node = _boneNodeTable[bone.boneName];
-			node.boneIdx = i;
-			node.startPos = bone.pos;
-		}
-
-		// 親子関係を構築する
-		for (int i = 0; i < numberOfBone; i++){
-			const auto& bone = pBoneData[i];
-			// 親インデックスをチェックしてあり得ない番号なら飛ばす
-			if (bone.parentNo >= numberOfBone) {
-				continue;
-			}
-			const auto parentName = boneNames[bone.parentNo];
-			_boneNodeTable[parentName].children.emplace_back(&_boneNodeTable[bone.boneName]);
+		if (!model) {
+			return E_INVALIDARG;
 		}
+		_model = model;
+		_skinningMode = skinningMode;
 
 		// 全てのボーンを初期化
-		_boneMatrices.resize(numberOfBone);
+		_pose.Reset(_model->GetNumberOfBone());
+		_fadePose.Reset(_model->GetNumberOfBone());
+		_localMatrices.resize(_model->GetNumberOfBone());
+		std::fill(_localMatrices.begin(), _localMatrices.end(), DirectX::XMMatrixIdentity());
+		_boneMatrices.resize(_model->GetNumberOfBone());
 		std::fill(_boneMatrices.begin(), _boneMatrices.end(), DirectX::XMMatrixIdentity());
+		_morphEngine.Reset(_model->GetMorphSet());
+		_fadeMorphWeights.assign(_model->GetMorphSet().size(), 0.0f);
 
-		// 変換行列の定数バッファー
-		result = CreateTransformView(pD3D12Device);
-		if (FAILED(result))
-		{
+		// 表情のオフセットの頂点バッファー
+		auto result = CreateMorphBuffer(pD3D12Device);
+		if (FAILED(result)) {
 			return result;
 		}
 
-		// ロードしたモデルのパスを一応保持
-		m_loadedModelPath = filename;
-
-		return S_OK;
+		// 変換行列の定数バッファー
+		return CreateTransformBuffer(pD3D12Device);
 	}
 
-	// 頂点バッファーの作成
-	HRESULT PMDActor::CreateVertexBuffer(ID3D12Device* const pD3D12Device, const std::vector<unsigned char>& rawVertices)
+	// 表情のオフセットを格納する頂点バッファーの作成
+	// 表情で動く頂点の上限までだけ確保する。範囲外の頂点の読み込みは0になるので、それ以降の頂点はオフセットなしになる
+	HRESULT PMDActor::CreateMorphBuffer(ID3D12Device* const pD3D12Device)
 	{
-		HRESULT result;
+		auto vertexEnd = _model->GetMorphSet().GetVertexEnd();
+		if (vertexEnd == 0) {
+			// 表情がなければ空のビュー（すべて0が読める）を設定する
+			_morphBufferView = {};
+			return S_OK;
+		}
 
-		result = pD3D12Device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(rawVertices.size() * sizeof(rawVertices[0])), D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr, IID_PPV_ARGS(_vertexBuffer.ReleaseAndGetAddressOf())
-		);
+		auto buffSize = sizeof(DirectX::XMFLOAT3) * vertexEnd;
+		auto result = pD3D12Device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(buffSize),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(_morphBuff.ReleaseAndGetAddressOf()));
 		if (FAILED(result)) {
 			return result;
 		}
+		_morphBuff->SetName(L"MorphBuffer(PMDActor)");
 
-		unsigned char* mappedVertex = nullptr;
-		result = _vertexBuffer->Map(0, nullptr, (void**)&mappedVertex);
+		result = _morphBuff->Map(0, nullptr, (void**)&_mappedMorphs);
 		if (FAILED(result)) {
 			return result;
 		}
-		std::copy(std::begin(rawVertices), std::end(rawVertices), mappedVertex);
-		_vertexBuffer->Unmap(0, nullptr);
-		mappedVertex = nullptr;
-
-		_vertexBufferView.BufferLocation = _vertexBuffer->GetGPUVirtualAddress();
-		_vertexBufferView.SizeInBytes = static_cast<UINT>(rawVertices.size());
-		_vertexBufferView.StrideInBytes = sizeof(SerializedVertex);
+		std::fill(_mappedMorphs, _mappedMorphs + vertexEnd, DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f));
 
+		_morphBufferView.BufferLocation = _morphBuff->GetGPUVirtualAddress();
+		_morphBufferView.SizeInBytes = static_cast<UINT>(buffSize);
+		_morphBufferView.StrideInBytes = sizeof(DirectX::XMFLOAT3);
 		return S_OK;
 	}
 
-	// インデックスバッファーの作成
-	HRESULT PMDActor::CreateIndexBuffer(ID3D12Device* const pD3D12Device, const std::vector<unsigned short>& rawIndices)
+	// 座標変換行列を格納する定数バッファーの作成
+	// ボーンパレットごとに、ワールド変換に続けてパレット上の順にボーンの変換を並べ、256バイト境界に置く
+	// ボーンのないモデルも頂点のボーン番号0が単位行列を指すように1つ分は確保する
+	HRESULT PMDActor::CreateTransformBuffer(ID3D12Device* const pD3D12Device)
 	{
 		HRESULT result;
 
+		// 双対クォータニオンならボーン1つあたり半分で済む
+		auto boneStride = _skinningMode == PMDSkinningMode::DualQuaternion ? sizeof(DualQuaternion) : sizeof(DirectX::XMMATRIX);
+		const auto& palettes = _model->GetBonePalettes();
+		_paletteOffsets.resize(_model->GetPaletteCount());
+		size_t buffSize = 0;
+		for (size_t i = 0; i < _paletteOffsets.size(); i++) {
+			auto boneCount = palettes.empty() ? std::max<size_t>(_boneMatrices.size(), 1) : palettes[i].boneCount;
+			_paletteOffsets[i] = buffSize;
+			buffSize += (sizeof(Transform) + boneStride * boneCount + 0xff) & ~0xff;
+		}
+
 		result = pD3D12Device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(rawIndices.size() * sizeof(rawIndices[0])), D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr, IID_PPV_ARGS(_indexBuffer.ReleaseAndGetAddressOf())
-		);
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(buffSize),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(_transformBuff.ReleaseAndGetAddressOf()));
+		_transformBuff->SetName(L"ConstantBuffer(PMDActor)");
 		if (FAILED(result)) {
 			return result;
 		}
 
-		unsigned short* mappedIndex = nullptr;
-		result = _indexBuffer->Map(0, nullptr, (void**)&mappedIndex);
+		// 変換行列の書き込みマップ
+		result = _transformBuff->Map(0, nullptr, (void**)&_mappedMatrices);
 		if (FAILED(result)) {
 			return result;
 		}
-		std::copy(std::begin(rawIndices), std::end(rawIndices), mappedIndex);
-		_indexBuffer->Unmap(0, nullptr);
-		mappedIndex = nullptr;
 
-		_indexBufferView.BufferLocation = _indexBuffer->GetGPUVirtualAddress();
-		_indexBufferView.Format = DXGI_FORMAT_R16_UINT;
-		_indexBufferView.SizeInBytes = static_cast<UINT>(rawIndices.size() * sizeof(rawIndices[0]));
+		// パレットごとの定数バッファーのアドレス（描画時にルートパラメーターへ直接設定する）
+		_paletteAddresses.resize(_paletteOffsets.size());
+		for (size_t i = 0; i < _paletteOffsets.size(); i++) {
+			_paletteAddresses[i] = _transformBuff->GetGPUVirtualAddress() + _paletteOffsets[i];
+		}
+
+		// モーションがなければ特定のノード（左腕）をZ軸周りに90°回転させてみる
+		auto pArmNode = _model->FindBoneNode("左腕");
+		if (pArmNode) {
+			DirectX::XMStoreFloat4(&_pose.rotations[pArmNode->boneIdx],
+				DirectX::XMQuaternionRotationAxis(DirectX::XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), DirectX::XM_PIDIV2));
+		}
+
+		auto pElbowNode = _model->FindBoneNode("左ひじ");
+		if (pElbowNode) {
+			DirectX::XMStoreFloat4(&_pose.rotations[pElbowNode->boneIdx],
+				DirectX::XMQuaternionRotationAxis(DirectX::XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), -DirectX::XM_PIDIV2));
+		}
+
+		// 最初の更新の前に描画しても崩れないように書き込んでおく
+		_model->GetSkeleton().ComputeLocalMatrices(_pose, _localMatrices.data());
+		_model->GetSkeleton().ComputeWorldMatrices(_localMatrices.data(), _boneMatrices.data());
+		WriteTransforms();
 
 		return S_OK;
 	}
 
-	// メッシュ単位で参照されるマテリアルバッファーの作成
-	HRESULT PMDActor::CreateMaterialBuffers(
-		ID3D12Device* const pD3D12Device,
-		D3D12ResourceCache* const pResourceCache,
-		unsigned int numberOfMesh
-	) {
-		HRESULT result;
-		auto materialBufferSize = sizeof(BasicMaterial);
-		materialBufferSize = (materialBufferSize + 0xff) & ~0xff;
-		result = pD3D12Device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(materialBufferSize * numberOfMesh),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr, IID_PPV_ARGS(_materialBuffer.ReleaseAndGetAddressOf())
-		);
-		if (FAILED(result)) {
-			return result;
+	// モーションを設定
+	void PMDActor::SetMotion(const std::shared_ptr<const PMDMotion>& motion, float fadeTime)
+	{
+		// 再生中のモーションを切り替え前のモーションとして引き継ぐ
+		_fadeMotion = nullptr;
+		if (fadeTime > 0.0f && _motion) {
+			_fadeMotion = _motion;
+			std::swap(_fadeSampler, _sampler);
+			std::swap(_fadeMorphBindings, _morphBindings);
+			_fadeFrame = _motionFrame;
+			_fadeElapsed = 0.0f;
+			_fadeDuration = fadeTime;
+			_fadeExtent = _motionExtent;
 		}
 
-		unsigned char* pMappedMaterial = nullptr;
-		result = _materialBuffer->Map(0, nullptr, (void**)&pMappedMaterial);
-		for (auto& mesh : _meshes) {
-			*reinterpret_cast<BasicMaterial*>(pMappedMaterial) = mesh.GetBasicMaterial();
-			pMappedMaterial += materialBufferSize;
+		_motion = motion;
+		_motionFrame = 0.0f;
+		_sampler.Reset(_model ? _model->GetNumberOfBone() : 0);
+		if (_motion && _model) {
+			_model->GetMorphSet().Bind(*_motion, &_morphBindings);
 		}
-		_materialBuffer->Unmap(0, nullptr);
-		pMappedMaterial = nullptr;
-
-		D3D12_DESCRIPTOR_HEAP_DESC matDescHeapDesc = {};
-		matDescHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-		matDescHeapDesc.NodeMask = 0;
-		matDescHeapDesc.NumDescriptors = numberOfMesh * (1 + NUMBER_OF_TEXTURE);
-		matDescHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-		result = pD3D12Device->CreateDescriptorHeap(&matDescHeapDesc, IID_PPV_ARGS(_materialDescHeap.ReleaseAndGetAddressOf()));
-		if (FAILED(result)) {
-			return result;
+		else {
+			_morphBindings.clear();
 		}
-
-		D3D12_CONSTANT_BUFFER_VIEW_DESC matCBVDesc = {};
-		matCBVDesc.BufferLocation = _materialBuffer->GetGPUVirtualAddress();
-		matCBVDesc.SizeInBytes = static_cast<UINT>(materialBufferSize);
-
-		auto matDescHeapH = _materialDescHeap->GetCPUDescriptorHandleForHeapStart();
-		auto incSize = pD3D12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-		for (auto i = 0u; i < numberOfMesh; i++) {
-			pD3D12Device->CreateConstantBufferView(&matCBVDesc, matDescHeapH);
-			matCBVDesc.BufferLocation += materialBufferSize;
-			matDescHeapH.ptr += incSize;
-			_meshes[i].CreateMaterialTextureViews(pD3D12Device, pResourceCache, &matDescHeapH);
+		_motionExtent = (_motion && _model) ? ComputeMotionExtent(*_motion, _model->GetSkeleton()) : 0.0f;
+		if (!_motion && _model) {
+			_pose.Reset(_model->GetNumberOfBone());
+			std::fill_n(_morphEngine.GetWeights(), _model->GetMorphSet().size(), 0.0f);
 		}
+	}
 
-		return S_OK;
+	// フレーム更新
+	void PMDActor::Update(float elapsedTime)
+	{
+		UpdateWorld();
+		UpdatePose(elapsedTime);
+		PMDActor* actors[] = { this };
+		SolveIKBatch(actors, 1);
+		_model->GetSkeleton().ComputeWorldMatrices(_localMatrices.data(), _boneMatrices.data());
+		WriteTransforms();
 	}
 
-	// 座標変換行列を格納する定数バッファービューの作成
-	HRESULT PMDActor::CreateTransformView(ID3D12Device* const pD3D12Device)
+	// ワールド変換を更新する
+	void PMDActor::UpdateWorld()
 	{
-		HRESULT result;
+		_angle += 0.01f;
+		_world = DirectX::XMMatrixRotationY(_angle) * DirectX::XMMatrixTranslation(_position.x, _position.y, _position.z);
+		DirectX::XMStoreFloat3(&_worldCenter, DirectX::XMVector3Transform(DirectX::XMLoadFloat3(&_model->GetBoundingCenter()), _world));
+	}
 
-		auto buffSize = sizeof(Transform) * (1 + _boneMatrices.size());
-		buffSize = (buffSize + 0xff) & ~0xff;
+	// ポーズを更新する
+	void PMDActor::UpdatePose(float elapsedTime, uint32_t interval)
+	{
+		elapsedTime += _pendingTime;
+		_pendingTime = 0.0f;
+
+		// 補間するなら表示中のボーン行列を始点として残す（IKで_boneMatricesを作業用に使う前に）
+		if (interval > 1) {
+			if (_paletteStart.size() != _boneMatrices.size() || _paletteStep >= _updateInterval) {
+				_paletteStart.resize(_boneMatrices.size());
+				for (size_t i = 0; i < _boneMatrices.size(); i++) {
+					_paletteStart[i] = DecomposeRigid(_boneMatrices[i]);
+				}
+			}
+			else {
+				auto weight = static_cast<float>(_paletteStep) / _updateInterval;
+				for (size_t i = 0; i < _boneMatrices.size(); i++) {
+					_paletteStart[i] = LerpRigid(_paletteStart[i], DecomposeRigid(_boneMatrices[i]), weight);
+				}
+			}
+		}
+		_updateInterval = std::max(interval, 1u);
+		_paletteStep = 0;
+		_morphsPending = true;
+
+		auto numberOfMorph = _model->GetMorphSet().size();
+		auto* pMorphWeights = _morphEngine.GetWeights();
+		if (_motion) {
+			AdvanceFrame(*_motion, elapsedTime, &_motionFrame);
+			_sampler.Sample(*_motion, _motionFrame, &_pose);
+			std::fill_n(pMorphWeights, numberOfMorph, 0.0f);
+			_sampler.SampleMorphs(*_motion, _motionFrame, _morphBindings, pMorphWeights);
+		}
 
-		result = pD3D12Device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(buffSize),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(_transformBuff.ReleaseAndGetAddressOf()));
-		_transformBuff->SetName(L"ConstantBuffer(PMDActor)");
-		if (FAILED(result)) {
-			return result;
+		// クロスフェード中は切り替え前のモーションから滑らかに（smoothstepで）移る
+		if (_fadeMotion) {
+			_fadeElapsed += elapsedTime;
+			if (_fadeElapsed >= _fadeDuration) {
+				_fadeMotion = nullptr;
+			}
+			else {
+				if (!_motion) {
+					_pose.Reset(_model->GetNumberOfBone());
+					std::fill_n(pMorphWeights, numberOfMorph, 0.0f);
+				}
+				AdvanceFrame(*_fadeMotion, elapsedTime, &_fadeFrame);
+				_fadeSampler.Sample(*_fadeMotion, _fadeFrame, &_fadePose);
+				auto t = _fadeElapsed / _fadeDuration;
+				auto weight = t * t * (3.0f - 2.0f * t);
+				PMDPoseBlender::Blend(_fadePose, _pose, weight, nullptr, &_pose);
+				std::fill(_fadeMorphWeights.begin(), _fadeMorphWeights.end(), 0.0f);
+				_fadeSampler.SampleMorphs(*_fadeMotion, _fadeFrame, _fadeMorphBindings, _fadeMorphWeights.data());
+				for (size_t i = 0; i < numberOfMorph; i++) {
+					pMorphWeights[i] = _fadeMorphWeights[i] + (pMorphWeights[i] - _fadeMorphWeights[i]) * weight;
+				}
+			}
 		}
+		_morphEngine.Evaluate(_model->GetMorphSet());
 
-		// 変換行列の書き込みマップ
-		result = _transformBuff->Map(0, nullptr, (void**)&_mappedMatrices);
-		if (FAILED(result)) {
-			return result;
+		_model->GetSkeleton().ComputeLocalMatrices(_pose, _localMatrices.data());
+	}
+
+	// 同じモデルのアクターのポーズにまとめてIKを適用する
+	void PMDActor::SolveIKBatch(PMDActor* const* ppActors, size_t actorCount)
+	{
+		if (actorCount == 0) {
+			return;
+		}
+		const auto& model = ppActors[0]->_model;
+		const auto& ikSolver = model->GetIKSolver();
+		if (ikSolver.empty()) {
+			return;
 		}
 
-		// 変換行列のシェーダーリソースビュー
-		D3D12_DESCRIPTOR_HEAP_DESC descHeapDesc = {};
-		descHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-		descHeapDesc.NodeMask = 0;
-		descHeapDesc.NumDescriptors = 1;
-		descHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-		result = pD3D12Device->CreateDescriptorHeap(&descHeapDesc, IID_PPV_ARGS(_transformDescHeap.ReleaseAndGetAddressOf()));
-		if (FAILED(result))
-		{
-			return result;
+		// IKはサンプリングしたポーズに適用する（ワールド変換は後でまとめて求め直すので作業用に使う）
+		constexpr size_t ChunkSize = 16;
+		PMDPose* poses[ChunkSize];
+		DirectX::XMMATRIX* localMatrices[ChunkSize];
+		DirectX::XMMATRIX* boneMatrices[ChunkSize];
+		for (size_t first = 0; first < actorCount; first += ChunkSize) {
+			auto count = std::min(ChunkSize, actorCount - first);
+			for (size_t i = 0; i < count; i++) {
+				auto* pActor = ppActors[first + i];
+				poses[i] = &pActor->_pose;
+				localMatrices[i] = pActor->_localMatrices.data();
+				boneMatrices[i] = pActor->_boneMatrices.data();
+			}
+			ikSolver.SolveBatch(model->GetSkeleton(), poses, localMatrices, boneMatrices, count);
 		}
+	}
 
-		_transformDescHeap->SetName(L"TransformDescHeap(PMDActor)");
-		auto heapHandle = _transformDescHeap->GetCPUDescriptorHandleForHeapStart();
-		D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-		cbvDesc.BufferLocation = _transformBuff->GetGPUVirtualAddress();
-		cbvDesc.SizeInBytes = static_cast<UINT>(_transformBuff->GetDesc().Width);
-		pD3D12Device->CreateConstantBufferView(&cbvDesc, heapHandle);
-
-		// 特定のノード（左腕）をZ軸周りに90°回転させてみる
-		auto armNode = _boneNodeTable["左腕"];
-		auto& armPos = armNode.startPos;
-		auto armMatrix = 
-			DirectX::XMMatrixTranslation(-armPos.x, -armPos.y, -armPos.z)
-			* DirectX::XMMatrixRotationZ(DirectX::XM_PIDIV2)
-			* DirectX::XMMatrixTranslation(armPos.x, armPos.y, armPos.z);
-		_boneMatrices[armNode.boneIdx] = armMatrix;
-
-		auto elbowNode = _boneNodeTable["左ひじ"];
-		auto& elbowPos = elbowNode.startPos;
-		auto elbowMatrix = 
-			DirectX::XMMatrixTranslation(-elbowPos.x, -elbowPos.y, -elbowPos.z)
-			* DirectX::XMMatrixRotationZ(-DirectX::XM_PIDIV2)
-			* DirectX::XMMatrixTranslation(elbowPos.x, elbowPos.y, elbowPos.z);
-		_boneMatrices[elbowNode.boneIdx] = elbowMatrix;
-		RecursiveMatrixMultiply(&_boneNodeTable["センター"], DirectX::XMMatrixIdentity());
-
-		std::copy(_boneMatrices.begin(), _boneMatrices.end(), &_mappedMatrices[1]);
+	// 再生位置を進める
+	void PMDActor::AdvanceFrame(const PMDMotion& motion, float elapsedTime, float* pFrame)
+	{
+		auto& frame = *pFrame;
+		frame += elapsedTime * PMDMotion::FrameRate;
+		auto lastFrame = static_cast<float>(motion.GetLastFrame());
+		if (frame > lastFrame) {
+			frame = lastFrame > 0.0f ? std::fmod(frame, lastFrame) : 0.0f;
+		}
+	}
 
-		return S_OK;
+	// ポーズを更新しないフレーム
+	void PMDActor::SkipUpdate(float elapsedTime, bool visible)
+	{
+		_pendingTime += elapsedTime;
+		if (visible) {
+			WriteTransforms();
+		}
+		else {
+			for (auto offset : _paletteOffsets) {
+				_mappedMatrices[offset / sizeof(DirectX::XMMATRIX)] = _world;
+			}
+		}
 	}
 
-	void PMDActor::RecursiveMatrixMultiply(const BoneNode* const pNode, const DirectX::XMMATRIX& matrix)
+	// 変換行列を定数バッファーへ書き込む（双対クォータニオンならここで変換する）
+	// ボーンパレットに分けたモデルは、パレットごとにそのパレットのボーンだけを書き込む
+	void PMDActor::WriteTransforms()
 	{
-		_boneMatrices[pNode->boneIdx] *= matrix;
-		for (auto& childNode : pNode->children) {
-			RecursiveMatrixMultiply(childNode, _boneMatrices[pNode->boneIdx]);
+		if (_paletteStep < _updateInterval) {
+			_paletteStep++;
 		}
+		auto interpolate = _paletteStep < _updateInterval;
+		auto weight = static_cast<float>(_paletteStep) / _updateInterval;
+
+		const auto& palettes = _model->GetBonePalettes();
+		const auto& paletteBones = _model->GetPaletteBones();
+		for (size_t i = 0; i < _paletteOffsets.size(); i++) {
+			auto* pTransform = _mappedMatrices + _paletteOffsets[i] / sizeof(DirectX::XMMATRIX);
+			pTransform[0] = _world;
+			auto* pDualQuaternions = reinterpret_cast<DualQuaternion*>(&pTransform[1]);
+			if (palettes.empty() && !interpolate && !_boneMatrices.empty()) {
+				if (_skinningMode == PMDSkinningMode::DualQuaternion) {
+					ConvertToDualQuaternions(_boneMatrices.data(), _boneMatrices.size(), pDualQuaternions);
+				}
+				else {
+					std::copy(_boneMatrices.begin(), _boneMatrices.end(), &pTransform[1]);
+				}
+				continue;
+			}
+
+			// 間引き更新の途中は補間の始点から今回の更新で求めたボーン行列へ近づける
+			// ボーンのないモデルは単位行列を1つ書き込む
+			auto boneCount = palettes.empty() ? std::max<size_t>(_boneMatrices.size(), 1) : palettes[i].boneCount;
+			for (size_t j = 0; j < boneCount; j++) {
+				auto boneIdx = palettes.empty() ? j : paletteBones[palettes[i].firstBone + j];
+				auto matrix = DirectX::XMMatrixIdentity();
+				if (boneIdx < _boneMatrices.size()) {
+					matrix = interpolate
+						? ComposeRigid(LerpRigid(_paletteStart[boneIdx], DecomposeRigid(_boneMatrices[boneIdx]), weight))
+						: _boneMatrices[boneIdx];
+				}
+				if (_skinningMode == PMDSkinningMode::DualQuaternion) {
+					ConvertToDualQuaternions(&matrix, 1, &pDualQuaternions[j]);
+				}
+				else {
+					pTransform[1 + j] = matrix;
+				}
+			}
+		}
+
+		// 表情は補間せず、ポーズを更新した後の最初の書き込みで変わった範囲だけ書き込む
+		if (_mappedMorphs && _morphsPending) {
+			const auto* pDeltas = _morphEngine.GetDeltas();
+			for (auto i = _morphEngine.GetDirtyBegin(); i < _morphEngine.GetDirtyEnd(); i++) {
+				DirectX::XMStoreFloat3(&_mappedMorphs[i], pDeltas[i]);
+			}
+		}
+		_morphsPending = false;
 	}
 
-	// フレーム更新
-	void PMDActor::Update()
+	// 画面上の大きさから詳細度を選ぶ
+	void PMDActor::SelectLod(const DirectX::XMFLOAT3& eye, float projectionScale, float maxPixelError)
 	{
-		_angle += 0.01f;
-		_mappedMatrices[0] = DirectX::XMMatrixRotationY(_angle);
+		auto distance = DirectX::XMVectorGetX(DirectX::XMVector3Length(
+			DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&_worldCenter), DirectX::XMLoadFloat3(&eye))));
+		_lodLevel = distance > 0.0f ? _model->SelectLod(projectionScale / distance, maxPixelError) : 0;
 	}
 
 	// 描画
 	void PMDActor::Draw(ID3D12Device* const pD3D12Device, ID3D12GraphicsCommandList* const pCommandList)
 	{
-		ID3D12DescriptorHeap* descHeaps[] = { _transformDescHeap.Get() };
-		pCommandList->SetDescriptorHeaps(1, descHeaps);
-		pCommandList->SetGraphicsRootDescriptorTable(1, _transformDescHeap->GetGPUDescriptorHandleForHeapStart());
-
-		pCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		pCommandList->IASetVertexBuffers(0, 1, &_vertexBufferView);
-		pCommandList->IASetIndexBuffer(&_indexBufferView);
-
-		ID3D12DescriptorHeap* materialDescHeap[] = { _materialDescHeap.Get() };
-		pCommandList->SetDescriptorHeaps(1, materialDescHeap);
-
-		auto gpuDescHandle = materialDescHeap[0]->GetGPUDescriptorHandleForHeapStart();
-		auto handleIncSize = pD3D12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-		handleIncSize *= (1 + pmd::PMDActor::NUMBER_OF_TEXTURE);
-		unsigned int idxOffset = 0;
-		for (const auto& mesh : _meshes) {
-			pCommandList->SetGraphicsRootDescriptorTable(2, gpuDescHandle);
-			pCommandList->DrawIndexedInstanced(mesh.GetIndicesNum(), 1, idxOffset, 0, 0);
-			gpuDescHandle.ptr += handleIncSize;
-			idxOffset += mesh.GetIndicesNum();
-		}
+		pCommandList->IASetVertexBuffers(1, 1, &_morphBufferView);
+
+		_model->Draw(pD3D12Device, pCommandList, _paletteAddresses.data(), _lodLevel);
 	}
 
 } // namespace pmd
\ No newline at end of file
@@ -1,8 +1,8 @@
 ﻿#pragma once;
 
 // std
-#include <map>
-#include <string>
+#include <algorithm>
+#include <memory>
 #include <vector>
 
 // Windows
@@ -13,43 +13,16 @@
 #include <d3d12.h>
 #include <DirectXMath.h>
 
-#include "D3D12/D3D12ResourceCache.h"
-#include "PMDMesh.h"
+#include "PMDModel.h"
+#include "PMDMorphEngine.h"
+#include "PMDMotion.h"
+#include "PMDMotionSampler.h"
+#include "PMDPose.h"
+#include "PMDPoseBlender.h"
+#include "PMDSkinning.h"
 
 namespace pmd
 {
-	// PMDヘッダー構造体
-	struct PMDHeader {
-		float version;			// 例 : 00 00 80 3F == 1.00
-		char model_name[20];	// モデル名
-		char comment[256];		// モデルコメント
-	};
-
-	// ボーン構造体
-#pragma pack(1)
-	struct PMDBone {
-		char boneName[20];
-		unsigned short parentNo;
-		unsigned short nextNo;
-		unsigned char type;
-		unsigned short ikBoneNo;
-		DirectX::XMFLOAT3 pos;
-	};
-#pragma pack()
-
-	// PMD頂点構造体
-#pragma pack(1)
-	struct SerializedVertex
-	{
-		DirectX::XMFLOAT3 pos;
-		DirectX::XMFLOAT3 normal;
-		DirectX::XMFLOAT2 uv;
-		unsigned short boneNo[2];
-		unsigned char boneWeight;
-		unsigned char endflg;
-	};
-#pragma pack()
-
 	// トランスフォーム
 	struct Transform
 	{
@@ -59,83 +32,174 @@ namespace pmd
 		DirectX::XMMATRIX world;
 	};
 
+	// 回転と平行移動に分けたボーン行列（間引き更新の補間用。ボーン行列は拡大縮小を含まない）
+	struct RigidTransform
+	{
+		DirectX::XMVECTOR rotation;		// クォータニオン
+		DirectX::XMVECTOR translation;
+	};
+
+	// モデルの配置単位
+	// 共有モデルを参照し、ワールド変換、ポーズ、ボーン行列だけを持つ
 	class PMDActor
 	{
 	public:
-		// 頂点レイアウト
-		static const std::vector<D3D12_INPUT_ELEMENT_DESC> InputLayout;
-
 		PMDActor();
 		virtual ~PMDActor();
 
-		HRESULT LoadFromFile(
+		// 共有モデルからアクターを生成
+		// skinningModeはボーンの変換を定数バッファーへ書き込む形式（描画にはPMDRendererの対応するパイプラインステートを使う）
+		HRESULT Create(
 			ID3D12Device* const pD3D12Device,
-			D3D12ResourceCache* const resourceCache,
-			const std::wstring& filename,
-			const std::wstring& toonTexturePath);
+			const std::shared_ptr<const PMDModel>& model,
+			PMDSkinningMode skinningMode = PMDSkinningMode::Linear);
+
+		// モーションを設定（nullptrなら止めて初期姿勢に戻す）。モーションはアクター間で共有できる
+		// fadeTime（秒）が正なら、それまでのモーションを再生しながらその時間をかけて切り替える
+		void SetMotion(const std::shared_ptr<const PMDMotion>& motion, float fadeTime = 0.0f);
+
+		// フレーム更新（UpdateWorld、UpdatePose、SolveIKBatch、ボーンの伝播、WriteTransformsを順に行う）
+		// elapsedTimeは前回の更新からの経過時間（秒）
+		void Update(float elapsedTime);
+
+		// ワールド変換を更新する（ポーズを間引くフレームも毎フレーム呼ぶ）
+		// 以下の更新処理は描画コマンドに触れないので、アクターごとに別のスレッドから呼べる
+		void UpdateWorld();
+
+		// ポーズを更新する（ボーンごとのローカル変換。IKはSolveIKBatchで適用する）。SkipUpdateでためた経過時間もまとめて進める
+		// intervalは次に更新するまでのフレーム数。2以上なら、表示中のボーン行列から今回求めるボーン行列へそのフレーム数をかけて補間する
+		// 表示中のボーン行列が古い（視錐台の外から入った、最初の更新）ときは1を渡して補間しないようにする
+		void UpdatePose(float elapsedTime, uint32_t interval = 1);
+
+		// 同じモデルを参照するアクターのポーズにまとめてIKを適用する（UpdatePoseの後、ボーンの伝播の前に呼ぶ）
+		// 連鎖ごとに全アクターを解く（PMDIKSolver::SolveBatch）。ローカル変換を書き換え、ボーンのワールド変換を作業用に使う
+		static void SolveIKBatch(PMDActor* const* ppActors, size_t actorCount);
+
+		// ポーズを更新しないフレーム（PMDAnimationScheduler参照）
+		// 経過時間は次のUpdatePoseまでためておき、visibleなら補間したボーン行列を、そうでなければワールド変換だけを書き込む
+		void SkipUpdate(float elapsedTime, bool visible);
+
+		// ワールド変換とボーンのワールド変換を定数バッファーへ、表情のオフセットの変わった範囲を頂点バッファーへ書き込む
+		void WriteTransforms();
 
-		void Update();
 		void Draw(ID3D12Device* const pD3D12Device, ID3D12GraphicsCommandList* const pCommandList);
 
-	private:
-		struct BoneNode
-		{
-			int boneIdx;
-			DirectX::XMFLOAT3 startPos;
-			DirectX::XMFLOAT3 endPos;
-			std::vector<BoneNode*> children;
-		};
+		// 画面上の大きさから詳細度を選ぶ
+		// projectionScaleは距離1でのモデル空間1単位あたりの画素数（画面の高さ / (2 * tan(視野角 / 2))）
+		void SelectLod(const DirectX::XMFLOAT3& eye, float projectionScale, float maxPixelError);
 
-	private:
-		// シェーダーリソース用テクスチャーの数
-		static constexpr size_t NUMBER_OF_TEXTURE = 4;
+		// 参照しているモデル
+		const std::shared_ptr<const PMDModel>& GetModel() const
+		{
+			return _model;
+		}
 
-		// ロードしたファイル名
-		std::wstring m_loadedModelPath;
+		// スキニングの方式
+		PMDSkinningMode GetSkinningMode() const
+		{
+			return _skinningMode;
+		}
 
-		// シグネチャー情報
-		char _pmdSignature[3];
+		// ワールド空間でのモデルの中心
+		const DirectX::XMFLOAT3& GetWorldCenter() const
+		{
+			return _worldCenter;
+		}
 
-		// ヘッダー情報
-		PMDHeader _pmdHeader;
+		// モーションの平行移動でモデルが初期位置から動く距離の上限（モデル空間。包含球の半径に足して視錐台と比べる）
+		// クロスフェード中は切り替え前のモーションも含める
+		float GetMotionExtent() const
+		{
+			return _fadeMotion ? std::max(_motionExtent, _fadeExtent) : _motionExtent;
+		}
 
-		// 頂点バッファー
-		Microsoft::WRL::ComPtr<ID3D12Resource> _vertexBuffer;
-		D3D12_VERTEX_BUFFER_VIEW _vertexBufferView;
+		// 配置する位置
+		void SetPosition(const DirectX::XMFLOAT3& position)
+		{
+			_position = position;
+		}
 
-		// インデックスバッファー
-		Microsoft::WRL::ComPtr<ID3D12Resource> _indexBuffer;
-		D3D12_INDEX_BUFFER_VIEW _indexBufferView;
+		// ボーンごとのローカル変換（ポーズ）
+		const DirectX::XMMATRIX* GetLocalMatrices() const
+		{
+			return _localMatrices.data();
+		}
 
-		// マテリアルバッファー
-		Microsoft::WRL::ComPtr<ID3D12Resource> _materialBuffer;
-		Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> _materialDescHeap;
+		// ボーンのワールド変換（モデル空間。PMDSkeletonで求めて書き込む）
+		DirectX::XMMATRIX* GetBoneMatrices()
+		{
+			return _boneMatrices.data();
+		}
 
-		// インデックスとマテリアルを参照して描画の単位となるメッシュ
-		std::vector<PMDMesh> _meshes;
+	private:
+		// 共有モデル
+		std::shared_ptr<const PMDModel> _model;
 
-		// 変換行列
+		// 変換行列（ワールド変換に続けて、Linearならボーン行列、DualQuaternionなら双対クォータニオンを並べる）
+		// ボーンパレットごとにパレット上の順で並べ、先頭からのバイト位置とGPU上のアドレスを持つ
 		Microsoft::WRL::ComPtr<ID3D12Resource> _transformBuff;
-		Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> _transformDescHeap;
 		DirectX::XMMATRIX* _mappedMatrices;
+		std::vector<size_t> _paletteOffsets;
+		std::vector<D3D12_GPU_VIRTUAL_ADDRESS> _paletteAddresses;
+		PMDSkinningMode _skinningMode;
 
-		// 動作確認用の回転
+		// 配置とワールド変換（動作確認用に回転させる）
+		DirectX::XMFLOAT3 _position;
 		float _angle;
-
+		DirectX::XMMATRIX _world;
+
+		// ワールド空間でのモデルの中心と選択中の詳細度
+		DirectX::XMFLOAT3 _worldCenter;
+		size_t _lodLevel;
+
+		// 再生中のモーションと再生位置（フレーム番号）
+		std::shared_ptr<const PMDMotion> _motion;
+		PMDMotionSampler _sampler;
+		float _motionFrame;
+		float _motionExtent;
+
+		// 切り替え前のモーション（クロスフェード中だけ再生する）
+		std::shared_ptr<const PMDMotion> _fadeMotion;
+		PMDMotionSampler _fadeSampler;
+		float _fadeFrame;
+		float _fadeElapsed;
+		float _fadeDuration;
+		float _fadeExtent;
+		PMDPose _fadePose;
+
+		// ボーンごとのポーズ
+		PMDPose _pose;
+
+		// 表情（モーションの表情トラックごとの表情番号と、クロスフェード中の切り替え前の重み）
+		PMDMorphEngine _morphEngine;
+		std::vector<uint16_t> _morphBindings;
+		std::vector<uint16_t> _fadeMorphBindings;
+		std::vector<float> _fadeMorphWeights;
+
+		// 表情による頂点ごとの座標オフセット（頂点シェーダーで座標に足す2本目の頂点ストリーム）
+		Microsoft::WRL::ComPtr<ID3D12Resource> _morphBuff;
+		DirectX::XMFLOAT3* _mappedMorphs;
+		D3D12_VERTEX_BUFFER_VIEW _morphBufferView;
+
+		// ボーンごとのローカル変換（ポーズ）とワールド変換（モデル空間）
+		std::vector<DirectX::XMMATRIX> _localMatrices;
 		std::vector<DirectX::XMMATRIX> _boneMatrices;
-		std::map<std::string, BoneNode> _boneNodeTable;
 
-	private:
-		HRESULT CreateVertexBuffer(ID3D12Device* const pD3D12Device, const std::vector<unsigned char>& rawVertices);
-		HRESULT CreateIndexBuffer(ID3D12Device* const pD3D12Device, const std::vector<unsigned short>& rawIndices);
-		HRESULT CreateMaterialBuffers(
-			ID3D12Device* const pD3D12Device,
-			D3D12ResourceCache* const pResourceCache,
-			unsigned int numberOfMesh);
-		HRESULT CreateTransformView(ID3D12Device* const pD3D12Device);
+		// ポーズの間引き更新
+		// まだポーズに反映していない経過時間、補間の始点（更新時に表示していたボーンの変換。間引くまで確保しない）、
+		// 補間にかけるフレーム数と更新してから書き込んだ回数、表情のオフセットを書き込むか
+		float _pendingTime;
+		std::vector<RigidTransform> _paletteStart;
+		uint32_t _updateInterval;
+		uint32_t _paletteStep;
+		bool _morphsPending;
 
 	private:
-		void RecursiveMatrixMultiply(const BoneNode* const pBoneNode, const DirectX::XMMATRIX& matrix);
+		HRESULT CreateTransformBuffer(ID3D12Device* const pD3D12Device);
+		HRESULT CreateMorphBuffer(ID3D12Device* const pD3D12Device);
+
+		// 再生位置を進める（最後まで再生したら先頭に戻す）
+		static void AdvanceFrame(const PMDMotion& motion, float elapsedTime, float* pFrame);
 	};
 
-} // namespace pmd
+} // namespace pmd
\ No newline at end of file
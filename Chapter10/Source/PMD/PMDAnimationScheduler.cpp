@@ -0,0 +1,74 @@
+﻿#include "PMDAnimationScheduler.h"
+
+namespace pmd
+{
+	// コンストラクター
+	PMDAnimationScheduler::PMDAnimationScheduler() :
+		_planes{}, _eye(0.0f, 0.0f, 0.0f), _projectionScale(0.0f), _pixelThresholds{ 200.0f, 100.0f, 50.0f }, _frameCount(0)
+	{
+	}
+
+	// デストラクター
+	PMDAnimationScheduler::~PMDAnimationScheduler()
+	{
+	}
+
+	// 更新間隔を選ぶ画面上の半径の下限を設定
+	void PMDAnimationScheduler::SetPixelThresholds(float everyFrame, float everyTwoFrames, float everyFourFrames)
+	{
+		_pixelThresholds[0] = everyFrame;
+		_pixelThresholds[1] = everyTwoFrames;
+		_pixelThresholds[2] = everyFourFrames;
+	}
+
+	// 今回のフレームのカメラを設定
+	void PMDAnimationScheduler::BeginFrame(DirectX::FXMMATRIX viewProjection, const DirectX::XMFLOAT3& eye, float projectionScale)
+	{
+		// 行ベクトルに掛ける行列なので、クリップ座標の各成分は行列の列との内積になる
+		// -w <= x <= w、-w <= y <= w、0 <= z <= wの各不等式を平面にする
+		auto columns = DirectX::XMMatrixTranspose(viewProjection);
+		DirectX::XMVECTOR planes[] = {
+			DirectX::XMVectorAdd(columns.r[3], columns.r[0]),
+			DirectX::XMVectorSubtract(columns.r[3], columns.r[0]),
+			DirectX::XMVectorAdd(columns.r[3], columns.r[1]),
+			DirectX::XMVectorSubtract(columns.r[3], columns.r[1]),
+			columns.r[2],
+			DirectX::XMVectorSubtract(columns.r[3], columns.r[2]),
+		};
+		for (size_t i = 0; i < 6; i++) {
+			DirectX::XMStoreFloat4(&_planes[i], DirectX::XMPlaneNormalize(planes[i]));
+		}
+
+		_eye = eye;
+		_projectionScale = projectionScale;
+		_frameCount++;
+	}
+
+	// 包含球から更新間隔を選ぶ
+	uint32_t PMDAnimationScheduler::SelectInterval(const DirectX::XMFLOAT3& center, float radius, float margin) const
+	{
+		auto position = DirectX::XMLoadFloat3(&center);
+		auto reach = radius + margin;
+		for (const auto& plane : _planes) {
+			if (DirectX::XMVectorGetX(DirectX::XMPlaneDotCoord(DirectX::XMLoadFloat4(&plane), position)) < -reach) {
+				return Invisible;
+			}
+		}
+
+		// 球の中にカメラがあれば毎フレーム更新する
+		auto distance = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(position, DirectX::XMLoadFloat3(&_eye))));
+		if (distance <= reach) {
+			return 1;
+		}
+
+		auto pixelRadius = _projectionScale * radius / (distance - margin);
+		uint32_t interval = 1;
+		for (auto threshold : _pixelThresholds) {
+			if (pixelRadius >= threshold) {
+				return interval;
+			}
+			interval *= 2;
+		}
+		return MaxInterval;
+	}
+}
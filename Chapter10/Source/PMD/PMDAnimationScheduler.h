@@ -0,0 +1,59 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+// DirectX
+#include <DirectXMath.h>
+
+namespace pmd
+{
+	// アニメーションの更新頻度の詳細度
+	// 画面上の大きさに応じてポーズの更新を2、4、8フレームに1回へ間引き、視錐台の外のアクターは再生位置だけを進める
+	// 間隔ごとにアクターの番号で更新するフレームをずらし、各フレームの更新数が均等になるようにする
+	// 間引いたフレームはアクター側で前後の更新で求めたボーン行列を補間して埋める（PMDActor::SkipUpdate参照）
+	class PMDAnimationScheduler
+	{
+	public:
+		// 更新しない（視錐台の外）
+		static constexpr uint32_t Invisible = 0;
+
+		// 最大の更新間隔（フレーム数）
+		static constexpr uint32_t MaxInterval = 8;
+
+		PMDAnimationScheduler();
+		virtual ~PMDAnimationScheduler();
+
+		// 更新間隔を1、2、4フレームにする画面上の半径（画素）の下限（どれにも満たなければMaxInterval）
+		void SetPixelThresholds(float everyFrame, float everyTwoFrames, float everyFourFrames);
+
+		// 今回のフレームのカメラを設定してフレームを進める
+		// viewProjectionはビュー変換と射影変換の積、projectionScaleは距離1でのモデル空間1単位あたりの画素数
+		void BeginFrame(DirectX::FXMMATRIX viewProjection, const DirectX::XMFLOAT3& eye, float projectionScale);
+
+		// ワールド空間の包含球から更新間隔を選ぶ（視錐台の外ならInvisible）
+		// marginは球が中心から動きうる距離（モーションの平行移動。PMDActor::GetMotionExtent）。視錐台とカメラの判定では半径に足し、
+		// 画面上の大きさは最もカメラに近づいた位置で求める
+		uint32_t SelectInterval(const DirectX::XMFLOAT3& center, float radius, float margin = 0.0f) const;
+
+		// slot（アクターごとに固定の番号）が今回のフレームで更新する番か
+		// 間隔はどれも2のべき乗なので、間隔が変わっても長い間隔の番は短い間隔の番に含まれる
+		bool IsUpdateFrame(size_t slot, uint32_t interval) const
+		{
+			return interval != Invisible && ((_frameCount + slot) & (interval - 1)) == 0;
+		}
+
+	private:
+		// 視錐台の6平面（内側が正）
+		DirectX::XMFLOAT4 _planes[6];
+		DirectX::XMFLOAT3 _eye;
+		float _projectionScale;
+
+		// 更新間隔を1、2、4フレームにする画面上の半径の下限
+		float _pixelThresholds[3];
+
+		// BeginFrameを呼んだ回数
+		size_t _frameCount;
+	};
+}
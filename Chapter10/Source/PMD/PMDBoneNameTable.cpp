@@ -0,0 +1,124 @@
+﻿#include "PMDBoneNameTable.h"
+
+// std
+#include <cstring>
+
+#include "PMDCookedModel.h"
+
+namespace pmd
+{
+	namespace
+	{
+		// ボーン名の長さ（PMDBone::boneName）
+		constexpr size_t BoneNameLength = sizeof(CookedBone::boneName);
+
+		// 名前のハッシュ（FNV-1a）
+		uint32_t HashName(const char* name, size_t length)
+		{
+			uint32_t hash = 0x811c9dc5u;
+			for (size_t i = 0; i < length; i++) {
+				hash = (hash ^ static_cast<unsigned char>(name[i])) * 0x01000193u;
+			}
+			return hash;
+		}
+
+		// 表の大きさ（使用率が半分以下になる2のべき乗）
+		size_t GetSlotCount(size_t boneCount)
+		{
+			if (boneCount == 0) {
+				return 0;
+			}
+			size_t slotCount = 1;
+			while (slotCount < boneCount * 2) {
+				slotCount <<= 1;
+			}
+			return slotCount;
+		}
+	}
+
+	// コンストラクター
+	PMDBoneNameTable::PMDBoneNameTable() :
+		_names(), _slots()
+	{
+	}
+
+	// デストラクター
+	PMDBoneNameTable::~PMDBoneNameTable()
+	{
+	}
+
+	// ボーンの並びから表を作る
+	void PMDBoneNameTable::BuildSlots(const ArrayView<CookedBone>& bones, std::vector<uint16_t>* pSlots)
+	{
+		auto& slots = *pSlots;
+		slots.assign(GetSlotCount(bones.size()), NotFound);
+		auto mask = slots.size() - 1;
+		for (size_t i = 0; i < bones.size(); i++) {
+			const auto& name = bones[i].boneName;
+			auto length = strnlen(name, BoneNameLength);
+			auto slot = HashName(name, length) & mask;
+			while (slots[slot] != NotFound) {
+				const auto& other = bones[slots[slot]].boneName;
+				if (strnlen(other, BoneNameLength) == length && std::memcmp(other, name, length) == 0) {
+					break;
+				}
+				slot = (slot + 1) & mask;
+			}
+			if (slots[slot] == NotFound) {
+				slots[slot] = static_cast<uint16_t>(i);
+			}
+		}
+	}
+
+	// 表がボーンの並びに対して正しい形か
+	bool PMDBoneNameTable::ValidateSlots(const ArrayView<uint16_t>& slots, size_t boneCount)
+	{
+		if (slots.size() != GetSlotCount(boneCount)) {
+			return false;
+		}
+		for (auto slot : slots) {
+			if (slot != NotFound && slot >= boneCount) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// ボーン名と表を取り込む
+	void PMDBoneNameTable::Assign(const ArrayView<CookedBone>& bones, const ArrayView<uint16_t>& slots)
+	{
+		_names.resize(BoneNameLength * bones.size());
+		for (size_t i = 0; i < bones.size(); i++) {
+			std::memcpy(&_names[BoneNameLength * i], bones[i].boneName, BoneNameLength);
+		}
+		_slots.assign(slots.begin(), slots.end());
+	}
+
+	// 名前からボーン番号を検索
+	uint16_t PMDBoneNameTable::Find(const char* name, size_t length) const
+	{
+		if (_slots.empty() || length > BoneNameLength) {
+			return NotFound;
+		}
+		auto mask = _slots.size() - 1;
+		auto slot = HashName(name, length) & mask;
+		for (size_t probe = 0; probe < _slots.size(); probe++) {
+			auto boneIdx = _slots[slot];
+			if (boneIdx == NotFound) {
+				break;
+			}
+			if (NameEquals(boneIdx, name, length)) {
+				return boneIdx;
+			}
+			slot = (slot + 1) & mask;
+		}
+		return NotFound;
+	}
+
+	// ボーン名の比較（固定長の名前はnull終端とは限らない）
+	bool PMDBoneNameTable::NameEquals(uint16_t boneIdx, const char* name, size_t length) const
+	{
+		const auto* boneName = &_names[BoneNameLength * boneIdx];
+		return strnlen(boneName, BoneNameLength) == length && std::memcmp(boneName, name, length) == 0;
+	}
+}
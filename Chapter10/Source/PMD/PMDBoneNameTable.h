@@ -0,0 +1,52 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ArrayView.h"
+
+namespace pmd
+{
+	struct CookedBone;
+
+	// ボーン名からボーン番号を引く表
+	// 名前（Shift-JISのまま）のハッシュによる開番地法の表で、読み込み後は変更しない
+	// 表は調理時に作ってキャッシュに保存し、読み込み時は写すだけにする
+	class PMDBoneNameTable
+	{
+	public:
+		// 見つからない（空きスロット）
+		static constexpr uint16_t NotFound = 0xffff;
+
+		PMDBoneNameTable();
+		virtual ~PMDBoneNameTable();
+
+		// ボーンの並びから表を作る（同じ名前のボーンは先に現れた方を引く）
+		static void BuildSlots(const ArrayView<CookedBone>& bones, std::vector<uint16_t>* pSlots);
+
+		// 表がボーンの並びに対して正しい形か（キャッシュの検証用）
+		static bool ValidateSlots(const ArrayView<uint16_t>& slots, size_t boneCount);
+
+		// ボーン名と表を取り込む
+		void Assign(const ArrayView<CookedBone>& bones, const ArrayView<uint16_t>& slots);
+
+		// 名前からボーン番号を検索（見つからなければNotFound）
+		uint16_t Find(const char* name, size_t length) const;
+
+		uint16_t Find(const std::string& name) const
+		{
+			return Find(name.data(), name.size());
+		}
+
+	private:
+		// ボーン番号順の名前（20バイトごと、null終端とは限らない）
+		std::vector<char> _names;
+		std::vector<uint16_t> _slots;
+
+	private:
+		bool NameEquals(uint16_t boneIdx, const char* name, size_t length) const;
+	};
+}
@@ -0,0 +1,167 @@
+﻿#include "PMDBonePalette.h"
+
+// std
+#include <algorithm>
+#include <array>
+
+namespace pmd
+{
+	namespace
+	{
+		// パレットにないボーン、複製していない頂点
+		constexpr uint16_t NotInPalette = 0xffff;
+		constexpr uint32_t NoPalette = 0xffffffff;
+
+		// 16ビットのインデックスで参照できる頂点数
+		constexpr size_t MaxVertexCount = 0xffff;
+
+		// 重みのない方のボーン番号をもう一方と同じにして、パレットに入れるボーンを減らす
+		void DropUnweightedBone(SerializedVertex* pVertex)
+		{
+			if (pVertex->boneWeight >= 100) {
+				pVertex->boneNo[1] = pVertex->boneNo[0];
+			}
+			else if (pVertex->boneWeight == 0) {
+				pVertex->boneNo[0] = pVertex->boneNo[1];
+			}
+		}
+
+		// 主なボーン（重みの大きい方）
+		uint16_t GetPrimaryBone(const SerializedVertex& vertex)
+		{
+			return vertex.boneWeight >= 50 ? vertex.boneNo[0] : vertex.boneNo[1];
+		}
+	}
+
+	// ボーンがパレットに収まる描画範囲に分ける
+	bool PartitionBonePalettes(
+		std::vector<SerializedVertex>* pVertices,
+		std::vector<unsigned short>* pIndices,
+		const std::vector<uint32_t>& materialIndexCounts,
+		size_t maxPaletteBones,
+		std::vector<BonePaletteRange>* pRanges,
+		std::vector<CookedBonePalette>* pPalettes,
+		std::vector<uint16_t>* pPaletteBones,
+		std::vector<uint32_t>* pDuplicateSources)
+	{
+		// 元の頂点はボーン番号を付け替える前の値を複製元として残しておく
+		std::vector<SerializedVertex> sources(*pVertices);
+		size_t boneLimit = 0;
+		for (auto& vertex : sources) {
+			DropUnweightedBone(&vertex);
+			boneLimit = std::max<size_t>(boneLimit, std::max(vertex.boneNo[0], vertex.boneNo[1]) + 1);
+		}
+
+		// 参照されない頂点はどのパレットでも描画されないので、ボーン番号を0にしておく
+		std::vector<SerializedVertex> vertices(sources);
+		for (auto& vertex : vertices) {
+			vertex.boneNo[0] = 0;
+			vertex.boneNo[1] = 0;
+		}
+
+		std::vector<unsigned short> indices;
+		indices.reserve(pIndices->size());
+		std::vector<BonePaletteRange> ranges;
+		std::vector<CookedBonePalette> palettes(1, CookedBonePalette{ 0, 0 });
+		std::vector<uint16_t> paletteBones;
+		std::vector<uint32_t> duplicateSources;
+
+		// 現在のパレット上のボーンの位置と、元の頂点ごとの現在のパレットでの頂点番号
+		std::vector<uint16_t> slots(boneLimit, NotInPalette);
+		std::vector<uint32_t> vertexPalettes(sources.size(), NoPalette);
+		std::vector<uint16_t> vertexCopies(sources.size(), 0);
+
+		auto closePalette = [&]() {
+			for (auto i = palettes.back().firstBone; i < paletteBones.size(); i++) {
+				slots[paletteBones[i]] = NotInPalette;
+			}
+			palettes.push_back(CookedBonePalette{ static_cast<uint32_t>(paletteBones.size()), 0 });
+		};
+
+		size_t indexOffset = 0;
+		for (size_t materialIdx = 0; materialIdx < materialIndexCounts.size(); materialIdx++) {
+			auto indexCount = materialIndexCounts[materialIdx];
+			if (indexOffset + indexCount > pIndices->size()) {
+				break;
+			}
+
+			// 同じボーンで動く三角形が続くように、主なボーンの順に並べ替える
+			std::vector<std::array<unsigned short, 3>> triangles(indexCount / 3);
+			for (size_t i = 0; i < triangles.size(); i++) {
+				std::copy_n(pIndices->data() + indexOffset + i * 3, 3, triangles[i].data());
+			}
+			indexOffset += indexCount;
+			auto getPrimaryBone = [&](const std::array<unsigned short, 3>& triangle) {
+				return triangle[0] < sources.size() ? GetPrimaryBone(sources[triangle[0]]) : 0;
+			};
+			std::stable_sort(triangles.begin(), triangles.end(), [&](const std::array<unsigned short, 3>& a, const std::array<unsigned short, 3>& b) {
+				return getPrimaryBone(a) < getPrimaryBone(b);
+			});
+
+			for (const auto& triangle : triangles) {
+				if (std::any_of(triangle.begin(), triangle.end(), [&](unsigned short vertexIdx) { return vertexIdx >= sources.size(); })) {
+					continue;
+				}
+
+				// 三角形の頂点が参照するボーンのうちパレットにないもの（重複を除く）
+				uint16_t newBones[6];
+				size_t newBoneCount = 0;
+				for (auto vertexIdx : triangle) {
+					for (auto boneNo : sources[vertexIdx].boneNo) {
+						if (slots[boneNo] == NotInPalette && std::find(newBones, newBones + newBoneCount, boneNo) == newBones + newBoneCount) {
+							newBones[newBoneCount++] = boneNo;
+						}
+					}
+				}
+				if (palettes.back().boneCount + newBoneCount > maxPaletteBones) {
+					closePalette();
+				}
+
+				auto paletteIdx = static_cast<uint32_t>(palettes.size() - 1);
+				auto& palette = palettes.back();
+				for (auto vertexIdx : triangle) {
+					for (auto boneNo : sources[vertexIdx].boneNo) {
+						if (slots[boneNo] == NotInPalette) {
+							slots[boneNo] = static_cast<uint16_t>(palette.boneCount++);
+							paletteBones.push_back(boneNo);
+						}
+					}
+				}
+
+				// 最初に参照したパレットでは元の頂点を、別のパレットでは複製した頂点を使う
+				for (auto vertexIdx : triangle) {
+					if (vertexPalettes[vertexIdx] != paletteIdx) {
+						auto copyIdx = vertexIdx;
+						if (vertexPalettes[vertexIdx] != NoPalette) {
+							if (vertices.size() >= MaxVertexCount) {
+								return false;
+							}
+							copyIdx = static_cast<uint16_t>(vertices.size());
+							vertices.push_back(sources[vertexIdx]);
+							duplicateSources.push_back(vertexIdx);
+						}
+						auto& vertex = vertices[copyIdx];
+						vertex.boneNo[0] = slots[sources[vertexIdx].boneNo[0]];
+						vertex.boneNo[1] = slots[sources[vertexIdx].boneNo[1]];
+						vertexPalettes[vertexIdx] = paletteIdx;
+						vertexCopies[vertexIdx] = copyIdx;
+					}
+					indices.push_back(vertexCopies[vertexIdx]);
+				}
+
+				if (ranges.empty() || ranges.back().materialIdx != materialIdx || ranges.back().paletteIdx != paletteIdx) {
+					ranges.push_back(BonePaletteRange{ static_cast<uint32_t>(materialIdx), 0, paletteIdx });
+				}
+				ranges.back().indexCount += 3;
+			}
+		}
+
+		*pVertices = std::move(vertices);
+		*pIndices = std::move(indices);
+		*pRanges = std::move(ranges);
+		*pPalettes = std::move(palettes);
+		*pPaletteBones = std::move(paletteBones);
+		*pDuplicateSources = std::move(duplicateSources);
+		return true;
+	}
+}
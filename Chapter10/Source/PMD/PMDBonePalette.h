@@ -0,0 +1,44 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "PMDFileFormat.h"
+
+namespace pmd
+{
+	// 1回の描画で参照できるボーン数（シェーダーのTransformのbones[256]と合わせる）
+	constexpr size_t MaxPaletteBones = 256;
+
+	// ボーンパレット（PaletteBones上の範囲。頂点のボーン番号はこの範囲内の位置）
+	struct CookedBonePalette
+	{
+		uint32_t firstBone;
+		uint32_t boneCount;
+	};
+
+	// パレットで分けた描画範囲（マテリアルの三角形のうち、1つのパレットで描画する連続した範囲）
+	struct BonePaletteRange
+	{
+		uint32_t materialIdx;
+		uint32_t indexCount;
+		uint32_t paletteIdx;
+	};
+
+	// マテリアルごとの三角形を、参照するボーンがmaxPaletteBones以下に収まる描画範囲に分ける
+	// 三角形はマテリアル内で主なボーンの順に並べ替えてから順に詰め、パレットは収まる限り後続のマテリアルと共有する
+	// 頂点のボーン番号はパレット上の位置に付け替え、2つ以上のパレットから参照される頂点は末尾に複製する
+	// pDuplicateSourcesには複製した頂点ごとに元の頂点番号を返す（元の頂点数以降に追加した順）
+	// 頂点数が16ビットのインデックスに収まらなくなる場合は何も変更せずfalseを返す
+	bool PartitionBonePalettes(
+		std::vector<SerializedVertex>* pVertices,
+		std::vector<unsigned short>* pIndices,
+		const std::vector<uint32_t>& materialIndexCounts,
+		size_t maxPaletteBones,
+		std::vector<BonePaletteRange>* pRanges,
+		std::vector<CookedBonePalette>* pPalettes,
+		std::vector<uint16_t>* pPaletteBones,
+		std::vector<uint32_t>* pDuplicateSources);
+}
@@ -0,0 +1,962 @@
+﻿#include "PMDCookedModel.h"
+
+// std
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+
+#ifdef _WIN32
+// Windows
+#include <Windows.h>
+#endif // _WIN32
+
+#include "PMDBoneNameTable.h"
+#include "PMDFileView.h"
+#include "PMDMeshOptimizer.h"
+#include "utils.h"
+
+namespace pmd
+{
+	namespace
+	{
+		// ファイル先頭のシグネチャー
+		constexpr char CookedSignature[4] = { 'P', 'M', 'D', 'C' };
+
+		// セクションの配置境界
+		constexpr size_t SectionAlignment = 16;
+
+		// 詳細度ごとに許す誤差（モデルの広がりに対する比率。段ごとに倍にする）
+		constexpr float LodErrorScale = 0.01f;
+
+		// 前の段よりこれだけ減らなければ詳細度を打ち切る
+		constexpr float MinLodReduction = 0.9f;
+
+		// セクションの位置と要素数
+		struct CookedSectionEntry
+		{
+			uint32_t offset;
+			uint32_t count;
+		};
+
+		// キャッシュファイルのヘッダー
+		struct CookedFileHeader
+		{
+			char signature[4];
+			uint32_t version;
+			CookedSourceKey key;		// 照合のキー
+			uint64_t imageSize;			// ファイル全体のサイズ（書き込み途中のファイルを弾く）
+			CookedSectionEntry sections[static_cast<size_t>(CookedSection::Count)];
+		};
+
+		// セクションごとの要素サイズ
+		constexpr size_t SectionStrides[] = {
+			sizeof(PMDHeader),
+			sizeof(SerializedVertex),
+			sizeof(unsigned short),
+			sizeof(CookedMaterial),
+			1,
+			sizeof(CookedBone),
+			sizeof(uint16_t),
+			sizeof(uint16_t),
+			sizeof(CookedMeshlet),
+			sizeof(uint16_t),
+			sizeof(uint8_t),
+			sizeof(CookedLodLevel),
+			sizeof(unsigned short),
+			sizeof(uint16_t),
+			sizeof(uint16_t),
+			sizeof(CookedIKChain),
+			sizeof(CookedIKNode),
+			sizeof(CookedMorph),
+			sizeof(CookedMorphVertex),
+			sizeof(CookedBonePalette),
+			sizeof(uint16_t),
+			1,
+		};
+		static_assert(sizeof(SectionStrides) / sizeof(SectionStrides[0]) == static_cast<size_t>(CookedSection::Count),
+			"SectionStrides must cover every CookedSection");
+
+		size_t AlignUp(size_t value)
+		{
+			return (value + SectionAlignment - 1) & ~(SectionAlignment - 1);
+		}
+
+		// バイト列のハッシュ（FNV-1aを8バイト単位に広げたもの。改ざん検出の強度は不要）
+		uint64_t HashBytes(const unsigned char* pData, size_t size)
+		{
+			constexpr uint64_t Prime = 0x100000001b3ull;
+			uint64_t hash = 0xcbf29ce484222325ull ^ size;
+			size_t i = 0;
+			for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+				uint64_t word;
+				std::memcpy(&word, pData + i, sizeof(word));
+				hash = (hash ^ word) * Prime;
+				hash ^= hash >> 32;
+			}
+			for (; i < size; i++) {
+				hash = (hash ^ pData[i]) * Prime;
+			}
+			return hash;
+		}
+
+		// パスの解決に使ったフォルダーのハッシュ
+		uint64_t HashEnvironment(const std::wstring& folderPath, const std::wstring& toonTexturePath)
+		{
+			auto environment = GetUTF8String(folderPath + L'|' + toonTexturePath);
+			return HashBytes(reinterpret_cast<const unsigned char*>(environment.data()), environment.size());
+		}
+
+		// 調理済みイメージの書き出し
+		class ImageWriter
+		{
+		public:
+			ImageWriter(std::vector<unsigned char>* pImage, const CookedSourceKey& key) :
+				_pImage(pImage), _header{}
+			{
+				std::memcpy(_header.signature, CookedSignature, sizeof(CookedSignature));
+				_header.version = PMDCookedModel::Version;
+				_header.key = key;
+				_pImage->assign(AlignUp(sizeof(CookedFileHeader)), 0);
+			}
+
+			// セクションを16バイト境界に追加
+			template<typename T>
+			void Write(CookedSection section, const T* pData, size_t count)
+			{
+				auto offset = AlignUp(_pImage->size());
+				auto size = sizeof(T) * count;
+				_pImage->resize(offset + size, 0);
+				if (size > 0) {
+					std::memcpy(_pImage->data() + offset, pData, size);
+				}
+				auto& entry = _header.sections[static_cast<size_t>(section)];
+				entry.offset = static_cast<uint32_t>(offset);
+				entry.count = static_cast<uint32_t>(count);
+			}
+
+			// ヘッダーを書き込んで完成させる
+			void Finish()
+			{
+				_pImage->resize(AlignUp(_pImage->size()), 0);
+				_header.imageSize = _pImage->size();
+				std::memcpy(_pImage->data(), &_header, sizeof(_header));
+			}
+
+		private:
+			std::vector<unsigned char>* _pImage;
+			CookedFileHeader _header;
+		};
+
+		// 重複を除いたnull終端文字列のテーブル
+		class StringTable
+		{
+		public:
+			uint32_t Add(const std::string& str)
+			{
+				auto it = _offsets.find(str);
+				if (it != _offsets.end()) {
+					return it->second;
+				}
+				auto offset = static_cast<uint32_t>(_blob.size());
+				_blob.insert(_blob.end(), str.begin(), str.end());
+				_blob.push_back('\0');
+				_offsets.emplace(str, offset);
+				return offset;
+			}
+
+			const std::vector<char>& GetBlob() const
+			{
+				return _blob;
+			}
+
+		private:
+			std::vector<char> _blob;
+			std::unordered_map<std::string, uint32_t> _offsets;
+		};
+
+		// トゥーンテクスチャーのパスを解決（トゥーンなしの場合は空文字列）
+		// モデルがトゥーンテクスチャーリストを持っていればその名前をモデルのフォルダー、共通フォルダーの順に探す
+		// リストを持たない古いファイルでは共通フォルダーのtoon%02d.bmpを使う
+		std::wstring ResolveToonTexturePath(
+			unsigned char toonIdx,
+			const ArrayView<PMDToonTextureName>& toonTextureNames,
+			const std::wstring& folderPath,
+			const std::wstring& toonTexturePath)
+		{
+			if (toonTextureNames.empty()) {
+				wchar_t toonFileName[16];
+				std::swprintf(toonFileName, sizeof(toonFileName) / sizeof(toonFileName[0]), L"/toon%02d.bmp", toonIdx + 1);
+				return toonTexturePath + toonFileName;
+			}
+
+			// 範囲外（0xff）はトゥーンなし
+			if (toonIdx >= toonTextureNames.size()) {
+				return std::wstring();
+			}
+
+			const auto& rawName = toonTextureNames[toonIdx].name;
+			auto len = strnlen(rawName, sizeof(rawName));
+			if (len == 0) {
+				return std::wstring();
+			}
+
+			auto filename = GetWString(rawName, len);
+			auto localPath = folderPath + L'/' + filename;
+			if (FileExists(localPath)) {
+				return localPath;
+			}
+			return toonTexturePath + L'/' + filename;
+		}
+
+		// ひざのボーンか（名前に「ひざ」を含む。Shift-JISの文字単位で探す）
+		bool IsKneeBone(const PMDBone& bone)
+		{
+			constexpr char Knee[] = "\x82\xd0\x82\xb4";
+			constexpr size_t KneeLength = sizeof(Knee) - 1;
+			auto length = strnlen(bone.boneName, sizeof(bone.boneName));
+			size_t i = 0;
+			while (i + KneeLength <= length) {
+				if (std::memcmp(bone.boneName + i, Knee, KneeLength) == 0) {
+					return true;
+				}
+				auto c = static_cast<unsigned char>(bone.boneName[i]);
+				i += ((c >= 0x81 && c <= 0x9f) || (c >= 0xe0 && c <= 0xfc)) ? 2 : 1;
+			}
+			return false;
+		}
+
+		// 親が子より先に来るボーンの並びを作る（深さの浅い順。同じ深さでは元の順序を保つ）
+		// pOrderは調理後の番号から元の番号、pRemapは元の番号から調理後の番号への対応
+		void SortBonesByDepth(const ArrayView<PMDBone>& bones, std::vector<uint16_t>* pOrder, std::vector<uint16_t>* pRemap)
+		{
+			auto numberOfBone = bones.size();
+			std::vector<size_t> depths(numberOfBone, 0);
+			for (size_t i = 0; i < numberOfBone; i++) {
+				// 循環していてもボーン数を超えたところで打ち切る
+				auto parentNo = bones[i].parentNo;
+				while (parentNo < numberOfBone && depths[i] <= numberOfBone) {
+					depths[i]++;
+					parentNo = bones[parentNo].parentNo;
+				}
+			}
+
+			pOrder->resize(numberOfBone);
+			for (size_t i = 0; i < numberOfBone; i++) {
+				(*pOrder)[i] = static_cast<uint16_t>(i);
+			}
+			std::stable_sort(pOrder->begin(), pOrder->end(), [&](uint16_t a, uint16_t b) {
+				return depths[a] < depths[b];
+			});
+
+			pRemap->resize(numberOfBone);
+			for (size_t i = 0; i < numberOfBone; i++) {
+				(*pRemap)[(*pOrder)[i]] = static_cast<uint16_t>(i);
+			}
+		}
+
+		// キャッシュファイルの書き込み（失敗してもよい）
+		bool WriteImage(const std::wstring& path, const std::vector<unsigned char>& image)
+		{
+			FILE* fp = nullptr;
+#ifdef _WIN32
+			if (_wfopen_s(&fp, path.c_str(), L"wb") != 0) {
+				return false;
+			}
+#else
+			fp = std::fopen(GetUTF8String(path).c_str(), "wb");
+			if (fp == nullptr) {
+				return false;
+			}
+#endif // _WIN32
+			auto written = std::fwrite(image.data(), image.size(), 1, fp);
+			std::fclose(fp);
+			return written == 1;
+		}
+	}
+
+	// コンストラクター
+	PMDCookedModel::PMDCookedModel() :
+		_file(), _image(), _header(nullptr),
+		_vertices(), _indices(), _materials(), _materialConstants(),
+		_bones(), _boneChildren(), _boneNameSlots(), _boneRemap(), _ikChains(), _ikNodes(), _morphs(), _morphVertices(),
+		_bonePalettes(), _paletteBones(), _vertexRemap(),
+		_meshlets(), _meshletVertices(), _meshletTriangles(),
+		_lodLevels(), _lodIndices(), _strings()
+	{
+	}
+
+	// デストラクター
+	PMDCookedModel::~PMDCookedModel()
+	{
+	}
+
+	// キャッシュファイルのパス
+	std::wstring PMDCookedModel::GetCachePath(const std::wstring& filename)
+	{
+		return filename + L'c';
+	}
+
+	// キャッシュを読み込む。古いか存在しなければ元ファイルから作り直して保存する
+	bool PMDCookedModel::LoadOrCook(const std::wstring& filename, const std::wstring& toonTexturePath)
+	{
+		auto pathIndex = filename.rfind('/');
+		if (pathIndex == filename.npos) {
+			pathIndex = filename.rfind('\\');
+		}
+		auto folderPath = filename.substr(0, pathIndex);
+
+		// 元ファイルの属性を照合のキーにする（キャッシュが有効なら元ファイルは開かない）
+		CookedSourceKey key;
+		if (!GetFileStamp(filename, &key.sourceSize, &key.sourceWriteTime)) {
+			return false;
+		}
+		key.environmentHash = HashEnvironment(folderPath, toonTexturePath);
+
+		// キャッシュが有効ならマップしたまま使う
+		auto cachePath = GetCachePath(filename);
+		if (_file.Open(cachePath)) {
+			if (Attach(_file.GetData(), _file.GetSize(), key)) {
+				return true;
+			}
+			_file.Close();
+		}
+
+		// 元ファイルから調理し直し、検証を通ったイメージだけを保存する
+		PMDFileView fileView;
+		if (!fileView.Open(filename)) {
+			return false;
+		}
+		if (!Cook(fileView, folderPath, toonTexturePath, key, &_image)) {
+			return false;
+		}
+		if (!Attach(_image.data(), _image.size(), key) || !Validate()) {
+			wprintf(L"invalid cooked model : %s\n", filename.c_str());
+			return false;
+		}
+		if (!WriteImage(cachePath, _image)) {
+			wprintf(L"failed to write model cache : %s\n", cachePath.c_str());
+		}
+
+		return true;
+	}
+
+	// PMDファイルの内容を調理してメモリー上のイメージを作る
+	bool PMDCookedModel::Cook(
+		const PMDFileView& fileView,
+		const std::wstring& folderPath,
+		const std::wstring& toonTexturePath,
+		const CookedSourceKey& key,
+		std::vector<unsigned char>* pImage)
+	{
+		ImageWriter writer(pImage, key);
+		StringTable strings;
+
+		// ヘッダーはそのまま
+		writer.Write(CookedSection::Header, &fileView.GetHeader(), 1);
+
+		// ジオメトリー: マテリアルごとに三角形を頂点キャッシュ向けに並べ替え、頂点を参照順に並べる
+		const auto& meshes = fileView.GetMeshes();
+		std::vector<SerializedVertex> vertices(fileView.GetVertices().begin(), fileView.GetVertices().end());
+		std::vector<unsigned short> indices(fileView.GetIndices().begin(), fileView.GetIndices().end());
+
+		// ボーンは親が子より先に来るように並べ替えるので、頂点のボーン番号も付け替える
+		const auto& bones = fileView.GetBones();
+		auto numberOfBone = bones.size();
+		std::vector<uint16_t> boneOrder;
+		std::vector<uint16_t> boneRemap;
+		SortBonesByDepth(bones, &boneOrder, &boneRemap);
+		// 範囲外のボーン番号は先頭のボーン（親のないボーン）にする
+		// ボーンのないモデルでも0番を使う（アクターはパレットに最低1つ単位行列を置く）
+		for (auto& vertex : vertices) {
+			for (auto& boneNo : vertex.boneNo) {
+				boneNo = boneNo < numberOfBone ? boneRemap[boneNo] : 0;
+			}
+		}
+
+		// ボーンパレット: 全ボーンが1回の描画のパレットに収まらなければ、マテリアルの三角形を参照するボーンが収まる描画範囲に分ける
+		// 以降はマテリアルの代わりに描画範囲ごとに処理する（分けなければ描画範囲とマテリアルは1対1）
+		// 分けられなければ（複製した頂点が16ビットのインデックスに収まらない）パレットの外を読むので調理しない
+		auto originalVertexCount = vertices.size();
+		std::vector<BonePaletteRange> ranges;
+		std::vector<CookedBonePalette> bonePalettes;
+		std::vector<uint16_t> paletteBones;
+		std::vector<uint32_t> duplicateSources;
+		if (numberOfBone > MaxPaletteBones) {
+			std::vector<uint32_t> materialIndexCounts;
+			for (const auto& mesh : meshes) {
+				materialIndexCounts.push_back(mesh.indicesNum);
+			}
+			if (PartitionBonePalettes(
+				&vertices, &indices, materialIndexCounts, MaxPaletteBones,
+				&ranges, &bonePalettes, &paletteBones, &duplicateSources))
+			{
+				printf("bone palettes: %zu, ranges %zu, duplicated vertices %zu\n", bonePalettes.size(), ranges.size(), duplicateSources.size());
+			}
+			else {
+				printf("bone palettes: too many vertices to partition %zu bones\n", numberOfBone);
+				return false;
+			}
+		}
+		if (bonePalettes.empty()) {
+			for (size_t i = 0; i < meshes.size(); i++) {
+				ranges.push_back(BonePaletteRange{ static_cast<uint32_t>(i), meshes[i].indicesNum, 0 });
+			}
+		}
+
+		// 元の頂点番号ごとの複製した頂点（元の頂点番号順）
+		std::vector<std::pair<uint32_t, uint32_t>> duplicates;
+		for (size_t i = 0; i < duplicateSources.size(); i++) {
+			duplicates.emplace_back(duplicateSources[i], static_cast<uint32_t>(originalVertexCount + i));
+		}
+		std::sort(duplicates.begin(), duplicates.end());
+
+		auto before = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+		size_t indexOffset = 0;
+		for (const auto& range : ranges) {
+			if (indexOffset + range.indexCount > indices.size()) {
+				break;
+			}
+			OptimizeVertexCache(indices.data() + indexOffset, range.indexCount, vertices.size());
+			indexOffset += range.indexCount;
+		}
+		std::vector<uint16_t> vertexRemap;
+		OptimizeVertexFetch(vertices.data(), vertices.size(), indices.data(), indices.size(), &vertexRemap);
+
+		// 元の頂点番号から、調理後の頂点（複製した頂点を含む）をすべて列挙する
+		auto forEachCookedVertex = [&](uint32_t vertexIdx, const std::function<void(uint16_t)>& function) {
+			function(vertexRemap[vertexIdx]);
+			auto it = std::lower_bound(duplicates.begin(), duplicates.end(), std::make_pair(vertexIdx, 0u));
+			for (; it != duplicates.end() && it->first == vertexIdx; ++it) {
+				function(vertexRemap[it->second]);
+			}
+		};
+
+		// 表情で動く頂点（base表情の頂点）を先頭へ集め、表情のオフセットを書き換える範囲を狭くする
+		const auto& skins = fileView.GetSkins();
+		auto baseSkin = std::find_if(skins.begin(), skins.end(), [](const PMDSkin& skin) { return skin.type == 0; });
+		if (baseSkin != skins.end()) {
+			std::vector<uint8_t> morphed(vertices.size(), 0);
+			for (const auto& baseVertex : baseSkin->vertices) {
+				if (baseVertex.vertexIdx < originalVertexCount) {
+					forEachCookedVertex(baseVertex.vertexIdx, [&](uint16_t vertexIdx) { morphed[vertexIdx] = 1; });
+				}
+			}
+			MoveVerticesToFront(vertices.data(), vertices.size(), indices.data(), indices.size(), morphed, &vertexRemap);
+		}
+		auto after = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+		printf("vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", before.acmr, after.acmr, before.atvr, after.atvr);
+
+		// 複製した頂点は元の頂点番号を持たないので、対応表は元の頂点数までを書き込む
+		writer.Write(CookedSection::Vertices, vertices.data(), vertices.size());
+		writer.Write(CookedSection::Indices, indices.data(), indices.size());
+		writer.Write(CookedSection::VertexRemap, vertexRemap.data(), originalVertexCount);
+		writer.Write(CookedSection::BonePalettes, bonePalettes.data(), bonePalettes.size());
+		writer.Write(CookedSection::PaletteBones, paletteBones.data(), paletteBones.size());
+
+		// メッシュレット: 並べ替え後のインデックスを描画範囲ごとに分割する
+		std::vector<CookedMeshlet> meshlets;
+		std::vector<uint16_t> meshletVertices;
+		std::vector<uint8_t> meshletTriangles;
+		std::vector<uint32_t> firstMeshlets(ranges.size() + 1, 0);
+		indexOffset = 0;
+		for (size_t i = 0; i < ranges.size(); i++) {
+			firstMeshlets[i] = static_cast<uint32_t>(meshlets.size());
+			if (indexOffset + ranges[i].indexCount <= indices.size()) {
+				BuildMeshlets(
+					vertices.data(), vertices.size(),
+					indices.data() + indexOffset, ranges[i].indexCount,
+					&meshlets, &meshletVertices, &meshletTriangles);
+				indexOffset += ranges[i].indexCount;
+			}
+		}
+		firstMeshlets[ranges.size()] = static_cast<uint32_t>(meshlets.size());
+		auto meshletStatistics = AnalyzeMeshlets(meshlets.data(), meshlets.size());
+		printf("meshlets: %zu, vertex fill %.1f%%, triangle fill %.1f%%\n",
+			meshletStatistics.meshletCount, meshletStatistics.vertexFill * 100.0f, meshletStatistics.triangleFill * 100.0f);
+
+		writer.Write(CookedSection::Meshlets, meshlets.data(), meshlets.size());
+		writer.Write(CookedSection::MeshletVertices, meshletVertices.data(), meshletVertices.size());
+		writer.Write(CookedSection::MeshletTriangles, meshletTriangles.data(), meshletTriangles.size());
+
+		// 詳細度: 描画範囲ごとに元のインデックスから三角形を半分ずつ減らす（頂点は共有する）
+		// 縮約は範囲内の辺に沿って行うので、減らした三角形も同じパレットの頂点だけを参照する
+		std::vector<CookedLodLevel> lodLevels;
+		std::vector<unsigned short> lodIndices;
+		std::vector<uint32_t> lodIndicesNums((MaxLodLevels - 1) * ranges.size(), 0);
+		auto extent = GetMeshExtent(vertices.data(), vertices.size());
+		auto previousCount = indices.size();
+		auto previousError = 0.0f;
+		for (size_t level = 1; level < MaxLodLevels; level++) {
+			CookedLodLevel lodLevel = {};
+			lodLevel.firstIndex = static_cast<uint32_t>(lodIndices.size());
+			lodLevel.error = previousError;
+			auto targetError = extent * LodErrorScale * static_cast<float>(1 << (level - 1));
+			std::vector<unsigned short> simplified;
+			indexOffset = 0;
+			for (size_t i = 0; i < ranges.size(); i++) {
+				if (indexOffset + ranges[i].indexCount > indices.size()) {
+					break;
+				}
+				auto error = SimplifyMesh(
+					vertices.data(), vertices.size(),
+					indices.data() + indexOffset, ranges[i].indexCount,
+					ranges[i].indexCount >> level, targetError, &simplified);
+				OptimizeVertexCache(simplified.data(), simplified.size(), vertices.size());
+				lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.end());
+				lodIndicesNums[(level - 1) * ranges.size() + i] = static_cast<uint32_t>(simplified.size());
+				lodLevel.error = std::max(lodLevel.error, error);
+				indexOffset += ranges[i].indexCount;
+			}
+			lodLevel.indexCount = static_cast<uint32_t>(lodIndices.size() - lodLevel.firstIndex);
+			if (lodLevel.indexCount >= previousCount * MinLodReduction) {
+				lodIndices.resize(lodLevel.firstIndex);
+				break;
+			}
+			printf("lod[%zu]: triangles %zu -> %u, error %.4f\n",
+				level, indices.size() / 3, lodLevel.indexCount / 3, lodLevel.error);
+			lodLevels.emplace_back(lodLevel);
+			previousCount = lodLevel.indexCount;
+			previousError = lodLevel.error;
+		}
+
+		writer.Write(CookedSection::LodLevels, lodLevels.data(), lodLevels.size());
+		writer.Write(CookedSection::LodIndices, lodIndices.data(), lodIndices.size());
+
+		// マテリアル: 描画範囲ごとに定数バッファーの並びに詰め、テクスチャーのパスを解決しておく
+		std::vector<CookedMaterial> materials(ranges.size());
+		std::vector<unsigned char> materialConstants(MaterialConstantsStride * ranges.size(), 0);
+		for (size_t i = 0; i < ranges.size(); i++) {
+			const auto& mesh = meshes[ranges[i].materialIdx];
+			auto& material = materials[i];
+
+			BasicMaterial basicMaterial = {};
+			basicMaterial.diffuse = mesh.diffuse;
+			basicMaterial.alpha = mesh.alpha;
+			basicMaterial.specular = mesh.specular;
+			basicMaterial.specularity = mesh.specularity;
+			basicMaterial.ambient = mesh.ambient;
+			std::memcpy(materialConstants.data() + MaterialConstantsStride * i, &basicMaterial, sizeof(basicMaterial));
+
+			material.indicesNum = ranges[i].indexCount;
+			material.toonIdx = mesh.toonIdx;
+			material.edgeFlg = mesh.edgeFlg;
+			material.paletteIdx = static_cast<uint16_t>(ranges[i].paletteIdx);
+			material.texFileName = InvalidStringOffset;
+			material.firstMeshlet = firstMeshlets[i];
+			material.meshletCount = firstMeshlets[i + 1] - firstMeshlets[i];
+			for (size_t level = 0; level < MaxLodLevels - 1; level++) {
+				material.lodIndicesNum[level] = level < lodLevels.size() ? lodIndicesNums[level * ranges.size() + i] : 0;
+			}
+			for (auto& path : material.texturePaths) {
+				path = InvalidStringOffset;
+			}
+
+			auto len = strnlen(mesh.texFilePath, sizeof(mesh.texFilePath));
+			if (len > 0) {
+				auto texPath = GetWString(mesh.texFilePath, len);
+				material.texFileName = strings.Add(GetUTF8StringFromShiftJIS(mesh.texFilePath, len));
+				for (const auto& filename : Split(texPath, L'*')) {
+					if (filename.empty()) {
+						continue;
+					}
+					auto ext = GetExtension(filename);
+					auto slot = MaterialTexture::Diffuse;
+					if (ext == L"sph") {
+						slot = MaterialTexture::Sphere;
+					}
+					else if (ext == L"spa") {
+						slot = MaterialTexture::SphereAdd;
+					}
+					material.texturePaths[static_cast<size_t>(slot)] = strings.Add(GetUTF8String(folderPath + L'/' + filename));
+				}
+			}
+
+			auto toonPath = ResolveToonTexturePath(mesh.toonIdx, fileView.GetToonTextureNames(), folderPath, toonTexturePath);
+			if (!toonPath.empty()) {
+				material.texturePaths[static_cast<size_t>(MaterialTexture::Toon)] = strings.Add(GetUTF8String(toonPath));
+			}
+		}
+		writer.Write(CookedSection::Materials, materials.data(), materials.size());
+		writer.Write(CookedSection::MaterialConstants, materialConstants.data(), materialConstants.size());
+
+		// ボーン: 親子関係を番号で平坦化する（親が子より先に並ぶ順序）
+		std::vector<CookedBone> cookedBones(numberOfBone);
+		std::vector<uint16_t> childCounts(numberOfBone, 0);
+		for (size_t i = 0; i < numberOfBone; i++) {
+			const auto& bone = bones[boneOrder[i]];
+			auto& cookedBone = cookedBones[i];
+			// 親インデックスがあり得ない番号か、循環していて親が先に並ばなければ親なし
+			cookedBone.parentIdx = InvalidBoneIndex;
+			if (bone.parentNo < numberOfBone && boneRemap[bone.parentNo] < i) {
+				cookedBone.parentIdx = boneRemap[bone.parentNo];
+				childCounts[cookedBone.parentIdx]++;
+			}
+		}
+		uint16_t childOffset = 0;
+		for (size_t i = 0; i < numberOfBone; i++) {
+			const auto& bone = bones[boneOrder[i]];
+			auto& cookedBone = cookedBones[i];
+			std::memcpy(cookedBone.boneName, bone.boneName, sizeof(cookedBone.boneName));
+			cookedBone.firstChild = childOffset;
+			cookedBone.childCount = 0;
+			cookedBone.reserved = 0;
+			cookedBone.pos = bone.pos;
+			childOffset += childCounts[i];
+		}
+		std::vector<uint16_t> boneChildren(childOffset);
+		for (size_t i = 0; i < numberOfBone; i++) {
+			auto parentIdx = cookedBones[i].parentIdx;
+			if (parentIdx != InvalidBoneIndex) {
+				auto& parent = cookedBones[parentIdx];
+				boneChildren[parent.firstChild + parent.childCount++] = static_cast<uint16_t>(i);
+			}
+		}
+		writer.Write(CookedSection::Bones, cookedBones.data(), cookedBones.size());
+		writer.Write(CookedSection::BoneChildren, boneChildren.data(), boneChildren.size());
+		writer.Write(CookedSection::BoneRemap, boneRemap.data(), boneRemap.size());
+
+		// IK: ボーン番号を付け替える（範囲外の番号を含む連鎖は捨てる）
+		std::vector<CookedIKChain> ikChains;
+		std::vector<CookedIKNode> ikNodes;
+		for (const auto& ik : fileView.GetIKs()) {
+			auto valid = ik.boneIdx < numberOfBone && ik.targetIdx < numberOfBone;
+			for (auto nodeIdx : ik.nodeIdxes) {
+				valid = valid && nodeIdx < numberOfBone;
+			}
+			if (!valid) {
+				continue;
+			}
+			CookedIKChain chain;
+			chain.ikBone = boneRemap[ik.boneIdx];
+			chain.targetBone = boneRemap[ik.targetIdx];
+			chain.iterations = ik.iterations;
+			chain.nodeCount = static_cast<uint16_t>(ik.nodeIdxes.size());
+			chain.firstNode = static_cast<uint32_t>(ikNodes.size());
+			chain.limit = ik.limit;
+			for (auto nodeIdx : ik.nodeIdxes) {
+				ikNodes.push_back(CookedIKNode{ boneRemap[nodeIdx], static_cast<uint16_t>(IsKneeBone(bones[nodeIdx]) ? IKNodeKnee : 0) });
+			}
+			ikChains.push_back(chain);
+		}
+		writer.Write(CookedSection::IKChains, ikChains.data(), ikChains.size());
+		writer.Write(CookedSection::IKNodes, ikNodes.data(), ikNodes.size());
+
+		// 表情: base表情内の番号を調理後の頂点番号に解決し、頂点番号順に並べる
+		std::vector<CookedMorph> morphs;
+		std::vector<CookedMorphVertex> morphVertices;
+		if (baseSkin != skins.end()) {
+			const auto& baseVertices = baseSkin->vertices;
+			for (const auto& skin : skins) {
+				if (skin.type == 0) {
+					continue;
+				}
+				CookedMorph morph = {};
+				std::memcpy(morph.morphName, skin.name.data(), std::min(skin.name.size(), sizeof(morph.morphName)));
+				morph.type = skin.type;
+				morph.firstVertex = static_cast<uint32_t>(morphVertices.size());
+				for (const auto& skinVertex : skin.vertices) {
+					if (skinVertex.vertexIdx >= baseVertices.size() || baseVertices[skinVertex.vertexIdx].vertexIdx >= originalVertexCount) {
+						continue;
+					}
+					forEachCookedVertex(baseVertices[skinVertex.vertexIdx].vertexIdx, [&](uint16_t vertexIdx) {
+						morphVertices.push_back(CookedMorphVertex{ skinVertex.pos, vertexIdx });
+					});
+				}
+				morph.vertexCount = static_cast<uint32_t>(morphVertices.size()) - morph.firstVertex;
+				auto first = morphVertices.begin() + morph.firstVertex;
+				std::sort(first, morphVertices.end(), [](const CookedMorphVertex& a, const CookedMorphVertex& b) {
+					return a.vertexIdx < b.vertexIdx;
+				});
+				morph.vertexBegin = morph.vertexCount > 0 ? first->vertexIdx : 0;
+				morph.vertexEnd = morph.vertexCount > 0 ? morphVertices.back().vertexIdx + 1 : 0;
+				morphs.push_back(morph);
+			}
+		}
+		writer.Write(CookedSection::Morphs, morphs.data(), morphs.size());
+		writer.Write(CookedSection::MorphVertices, morphVertices.data(), morphVertices.size());
+
+		// ボーン名のハッシュ表
+		std::vector<uint16_t> boneNameSlots;
+		PMDBoneNameTable::BuildSlots(ArrayView<CookedBone>(cookedBones.data(), cookedBones.size()), &boneNameSlots);
+		writer.Write(CookedSection::BoneNameSlots, boneNameSlots.data(), boneNameSlots.size());
+
+		// 文字列テーブルは最後
+		const auto& blob = strings.GetBlob();
+		writer.Write(CookedSection::Strings, blob.data(), blob.size());
+		writer.Finish();
+
+		return true;
+	}
+
+	// 文字列テーブルから取得
+	const char* PMDCookedModel::GetString(uint32_t offset) const
+	{
+		if (offset >= _strings.size()) {
+			return nullptr;
+		}
+		return _strings.data() + offset;
+	}
+
+	// ヘッダーとセクションの範囲を検証して各セクションのビューを設定
+	bool PMDCookedModel::Attach(const unsigned char* pData, size_t size, const CookedSourceKey& key)
+	{
+		if (size < sizeof(CookedFileHeader)) {
+			return false;
+		}
+
+		CookedFileHeader header;
+		std::memcpy(&header, pData, sizeof(header));
+		if (std::memcmp(header.signature, CookedSignature, sizeof(CookedSignature)) != 0
+			|| header.version != Version
+			|| header.key.sourceSize != key.sourceSize
+			|| header.key.sourceWriteTime != key.sourceWriteTime
+			|| header.key.environmentHash != key.environmentHash
+			|| header.imageSize != size)
+		{
+			return false;
+		}
+
+		// セクションが範囲内に収まっているか（要素単位の解釈はしない）
+		for (size_t i = 0; i < static_cast<size_t>(CookedSection::Count); i++) {
+			const auto& entry = header.sections[i];
+			if (entry.offset % SectionAlignment != 0
+				|| entry.offset > size
+				|| (size - entry.offset) / SectionStrides[i] < entry.count)
+			{
+				return false;
+			}
+		}
+		const auto& headerSection = header.sections[static_cast<size_t>(CookedSection::Header)];
+		const auto& stringSection = header.sections[static_cast<size_t>(CookedSection::Strings)];
+		if (headerSection.count != 1
+			|| (stringSection.count > 0 && pData[stringSection.offset + stringSection.count - 1] != '\0'))
+		{
+			return false;
+		}
+
+		auto section = [&](CookedSection id) {
+			return header.sections[static_cast<size_t>(id)];
+		};
+		_header = reinterpret_cast<const PMDHeader*>(pData + section(CookedSection::Header).offset);
+		_vertices = ArrayView<SerializedVertex>(
+			reinterpret_cast<const SerializedVertex*>(pData + section(CookedSection::Vertices).offset),
+			section(CookedSection::Vertices).count);
+		_indices = ArrayView<unsigned short>(
+			reinterpret_cast<const unsigned short*>(pData + section(CookedSection::Indices).offset),
+			section(CookedSection::Indices).count);
+		_materials = ArrayView<CookedMaterial>(
+			reinterpret_cast<const CookedMaterial*>(pData + section(CookedSection::Materials).offset),
+			section(CookedSection::Materials).count);
+		_materialConstants = ArrayView<unsigned char>(
+			pData + section(CookedSection::MaterialConstants).offset,
+			section(CookedSection::MaterialConstants).count);
+		_bones = ArrayView<CookedBone>(
+			reinterpret_cast<const CookedBone*>(pData + section(CookedSection::Bones).offset),
+			section(CookedSection::Bones).count);
+		_boneChildren = ArrayView<uint16_t>(
+			reinterpret_cast<const uint16_t*>(pData + section(CookedSection::BoneChildren).offset),
+			section(CookedSection::BoneChildren).count);
+		_boneNameSlots = ArrayView<uint16_t>(
+			reinterpret_cast<const uint16_t*>(pData + section(CookedSection::BoneNameSlots).offset),
+			section(CookedSection::BoneNameSlots).count);
+		_boneRemap = ArrayView<uint16_t>(
+			reinterpret_cast<const uint16_t*>(pData + section(CookedSection::BoneRemap).offset),
+			section(CookedSection::BoneRemap).count);
+		_ikChains = ArrayView<CookedIKChain>(
+			reinterpret_cast<const CookedIKChain*>(pData + section(CookedSection::IKChains).offset),
+			section(CookedSection::IKChains).count);
+		_ikNodes = ArrayView<CookedIKNode>(
+			reinterpret_cast<const CookedIKNode*>(pData + section(CookedSection::IKNodes).offset),
+			section(CookedSection::IKNodes).count);
+		_morphs = ArrayView<CookedMorph>(
+			reinterpret_cast<const CookedMorph*>(pData + section(CookedSection::Morphs).offset),
+			section(CookedSection::Morphs).count);
+		_morphVertices = ArrayView<CookedMorphVertex>(
+			reinterpret_cast<const CookedMorphVertex*>(pData + section(CookedSection::MorphVertices).offset),
+			section(CookedSection::MorphVertices).count);
+		_bonePalettes = ArrayView<CookedBonePalette>(
+			reinterpret_cast<const CookedBonePalette*>(pData + section(CookedSection::BonePalettes).offset),
+			section(CookedSection::BonePalettes).count);
+		_paletteBones = ArrayView<uint16_t>(
+			reinterpret_cast<const uint16_t*>(pData + section(CookedSection::PaletteBones).offset),
+			section(CookedSection::PaletteBones).count);
+		_vertexRemap = ArrayView<uint16_t>(
+			reinterpret_cast<const uint16_t*>(pData + section(CookedSection::VertexRemap).offset),
+			section(CookedSection::VertexRemap).count);
+		_meshlets = ArrayView<CookedMeshlet>(
+			reinterpret_cast<const CookedMeshlet*>(pData + section(CookedSection::Meshlets).offset),
+			section(CookedSection::Meshlets).count);
+		_meshletVertices = ArrayView<uint16_t>(
+			reinterpret_cast<const uint16_t*>(pData + section(CookedSection::MeshletVertices).offset),
+			section(CookedSection::MeshletVertices).count);
+		_meshletTriangles = ArrayView<uint8_t>(
+			pData + section(CookedSection::MeshletTriangles).offset,
+			section(CookedSection::MeshletTriangles).count);
+		_lodLevels = ArrayView<CookedLodLevel>(
+			reinterpret_cast<const CookedLodLevel*>(pData + section(CookedSection::LodLevels).offset),
+			section(CookedSection::LodLevels).count);
+		_lodIndices = ArrayView<unsigned short>(
+			reinterpret_cast<const unsigned short*>(pData + section(CookedSection::LodIndices).offset),
+			section(CookedSection::LodIndices).count);
+		_strings = ArrayView<char>(
+			reinterpret_cast<const char*>(pData + section(CookedSection::Strings).offset),
+			section(CookedSection::Strings).count);
+
+		if (_materialConstants.size() != MaterialConstantsStride * _materials.size()
+			|| _vertexRemap.size() > _vertices.size()
+			|| _boneRemap.size() != _bones.size()
+			|| (_bonePalettes.empty() && _bones.size() > MaxPaletteBones)
+			|| _lodLevels.size() > MaxLodLevels - 1)
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+	// セクションの要素が参照する番号の範囲を検証する
+	bool PMDCookedModel::Validate() const
+	{
+		if (!PMDBoneNameTable::ValidateSlots(_boneNameSlots, _bones.size())) {
+			return false;
+		}
+
+		// ボーンの並び（親が子より先）
+		for (size_t i = 0; i < _bones.size(); i++) {
+			auto parentIdx = _bones[i].parentIdx;
+			if (parentIdx != InvalidBoneIndex && parentIdx >= i) {
+				return false;
+			}
+		}
+
+		// IKの参照範囲
+		for (const auto& chain : _ikChains) {
+			if (chain.ikBone >= _bones.size()
+				|| chain.targetBone >= _bones.size()
+				|| chain.firstNode > _ikNodes.size()
+				|| _ikNodes.size() - chain.firstNode < chain.nodeCount)
+			{
+				return false;
+			}
+		}
+		for (const auto& node : _ikNodes) {
+			if (node.boneIdx >= _bones.size()) {
+				return false;
+			}
+		}
+
+		// 表情の参照範囲（頂点は範囲内に頂点番号順）
+		for (const auto& morph : _morphs) {
+			if (morph.firstVertex > _morphVertices.size()
+				|| _morphVertices.size() - morph.firstVertex < morph.vertexCount
+				|| morph.vertexBegin > morph.vertexEnd
+				|| morph.vertexEnd > _vertices.size())
+			{
+				return false;
+			}
+			auto previous = morph.vertexBegin;
+			for (uint32_t i = 0; i < morph.vertexCount; i++) {
+				auto vertexIdx = _morphVertices[morph.firstVertex + i].vertexIdx;
+				if (vertexIdx < previous || vertexIdx >= morph.vertexEnd) {
+					return false;
+				}
+				previous = vertexIdx;
+			}
+		}
+
+		// ボーンパレットの参照範囲
+		for (const auto& palette : _bonePalettes) {
+			if (palette.firstBone > _paletteBones.size()
+				|| _paletteBones.size() - palette.firstBone < palette.boneCount
+				|| palette.boneCount > MaxPaletteBones)
+			{
+				return false;
+			}
+		}
+		for (const auto& material : _materials) {
+			if (material.paletteIdx >= std::max<size_t>(_bonePalettes.size(), 1)) {
+				return false;
+			}
+		}
+
+		// インデックスの参照範囲（GPUが範囲外の頂点やボーンを読まないように）
+		// マテリアルのインデックス数の合計がIndicesに収まり、参照する頂点のボーン番号がそのマテリアルのパレットに収まること
+		// パレットに分けないモデルも定数バッファーのボーン配列（MaxPaletteBones）を超えないこと
+		auto isValidIndices = [&](const unsigned short* pIndices, size_t count, const CookedMaterial& material) {
+			auto boneLimit = _bonePalettes.empty()
+				? std::min(std::max<size_t>(_bones.size(), 1), MaxPaletteBones)
+				: _bonePalettes[material.paletteIdx].boneCount;
+			for (size_t i = 0; i < count; i++) {
+				if (pIndices[i] >= _vertices.size()) {
+					return false;
+				}
+				const auto& vertex = _vertices[pIndices[i]];
+				if (vertex.boneNo[0] >= boneLimit || vertex.boneNo[1] >= boneLimit) {
+					return false;
+				}
+			}
+			return true;
+		};
+		size_t firstIndex = 0;
+		for (const auto& material : _materials) {
+			if (material.indicesNum > _indices.size() - firstIndex
+				|| !isValidIndices(_indices.data() + firstIndex, material.indicesNum, material))
+			{
+				return false;
+			}
+			firstIndex += material.indicesNum;
+		}
+
+		// メッシュレットの参照範囲
+		for (const auto& material : _materials) {
+			if (material.firstMeshlet > _meshlets.size()
+				|| _meshlets.size() - material.firstMeshlet < material.meshletCount)
+			{
+				return false;
+			}
+		}
+		for (const auto& meshlet : _meshlets) {
+			if (meshlet.vertexOffset > _meshletVertices.size()
+				|| _meshletVertices.size() - meshlet.vertexOffset < meshlet.vertexCount
+				|| meshlet.triangleOffset > _meshletTriangles.size()
+				|| (_meshletTriangles.size() - meshlet.triangleOffset) / 3 < meshlet.triangleCount)
+			{
+				return false;
+			}
+		}
+		for (auto vertexIdx : _meshletVertices) {
+			if (vertexIdx >= _vertices.size()) {
+				return false;
+			}
+		}
+
+		// 詳細度の参照範囲（マテリアルごとのインデックス数の合計が段の長さと一致すること）
+		for (size_t level = 0; level < _lodLevels.size(); level++) {
+			const auto& lodLevel = _lodLevels[level];
+			if (lodLevel.firstIndex > _lodIndices.size()
+				|| _lodIndices.size() - lodLevel.firstIndex < lodLevel.indexCount)
+			{
+				return false;
+			}
+			size_t indexCount = 0;
+			for (const auto& material : _materials) {
+				indexCount += material.lodIndicesNum[level];
+			}
+			if (indexCount != lodLevel.indexCount) {
+				return false;
+			}
+			auto pLodIndices = _lodIndices.data() + lodLevel.firstIndex;
+			for (const auto& material : _materials) {
+				if (!isValidIndices(pLodIndices, material.lodIndicesNum[level], material)) {
+					return false;
+				}
+				pLodIndices += material.lodIndicesNum[level];
+			}
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,342 @@
+﻿#pragma once
+
+// std
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ArrayView.h"
+#include "MappedFile.h"
+#include "PMDBonePalette.h"
+#include "PMDFileFormat.h"
+#include "PMDMeshletBuilder.h"
+#include "PMDMeshSimplifier.h"
+
+namespace pmd
+{
+	class PMDFileView;
+
+	// 調理済みキャッシュ（.pmdc）のセクション
+	enum class CookedSection : uint32_t
+	{
+		Header,				// PMDHeader
+		Vertices,			// SerializedVertex[]（そのまま頂点バッファーへ）
+		Indices,			// unsigned short[]（そのままインデックスバッファーへ）
+		Materials,			// CookedMaterial[]
+		MaterialConstants,	// 256バイト境界に配置済みのBasicMaterial（そのまま定数バッファーへ）
+		Bones,				// CookedBone[]（親が子より先に並ぶ）
+		BoneChildren,		// 子ボーン番号（CookedBone::firstChildから参照）
+		VertexRemap,		// uint16_t[]（元の頂点番号から調理後の頂点番号への対応）
+		Meshlets,			// CookedMeshlet[]（マテリアル順）
+		MeshletVertices,	// uint16_t[]（メッシュレットが参照する頂点番号）
+		MeshletTriangles,	// uint8_t[]（メッシュレット内の頂点番号3つで1三角形）
+		LodLevels,			// CookedLodLevel[]（詳細度1以降。0はIndicesそのもの）
+		LodIndices,			// unsigned short[]（詳細度ごと、マテリアル順に連続）
+		BoneNameSlots,		// uint16_t[]（ボーン名のハッシュ表。PMDBoneNameTable参照）
+		BoneRemap,			// uint16_t[]（元のボーン番号から調理後のボーン番号への対応）
+		IKChains,			// CookedIKChain[]（ファイル上の順。この順に解く）
+		IKNodes,			// CookedIKNode[]（CookedIKChain::firstNodeから参照）
+		Morphs,				// CookedMorph[]（base表情を除く、ファイル上の順）
+		MorphVertices,		// CookedMorphVertex[]（表情ごとに調理後の頂点番号順）
+		BonePalettes,		// CookedBonePalette[]（全ボーンが1つのパレットに収まるモデルでは空）
+		PaletteBones,		// uint16_t[]（パレット上の位置ごとの調理後のボーン番号）
+		Strings,			// UTF-8文字列テーブル（null終端）
+		Count
+	};
+
+	// 文字列テーブル上の位置（なし）
+	constexpr uint32_t InvalidStringOffset = 0xffffffff;
+
+	// 親ボーンなし
+	constexpr uint16_t InvalidBoneIndex = 0xffff;
+
+	// マテリアル定数バッファー1つあたりのサイズ
+	constexpr size_t MaterialConstantsStride = 256;
+
+	// テクスチャーの種類
+	enum class MaterialTexture : uint32_t
+	{
+		Diffuse,
+		Sphere,
+		SphereAdd,
+		Toon,
+		Count
+	};
+
+	// 調理済みマテリアル（ボーンパレットで分けたモデルでは、元のマテリアルを分けた描画範囲ごと）
+	struct CookedMaterial
+	{
+		uint32_t indicesNum;
+		uint8_t toonIdx;
+		uint8_t edgeFlg;
+		uint16_t paletteIdx;	// 描画に使うボーンパレット（BonePalettesが空なら0で、全ボーンを番号順に使う）
+		uint32_t texturePaths[static_cast<size_t>(MaterialTexture::Count)];	// 解決済みパス（文字列テーブル上の位置）
+		uint32_t texFileName;	// 元のテクスチャー指定（表示用）
+		uint32_t firstMeshlet;	// Meshlets上の先頭位置
+		uint32_t meshletCount;
+		uint32_t lodIndicesNum[MaxLodLevels - 1];	// 詳細度1以降のインデックス数
+	};
+
+	// 詳細度（元のメッシュから三角形を減らしたインデックス列）
+	struct CookedLodLevel
+	{
+		uint32_t firstIndex;	// LodIndices上の先頭
+		uint32_t indexCount;	// 全マテリアルの合計
+		float error;			// 縮約で生じた誤差の最大値（モデル空間の距離）
+		uint32_t reserved;
+	};
+
+	// 調理済みボーン（親子関係は番号で平坦化済み。親は必ず子より前の番号）
+	struct CookedBone
+	{
+		char boneName[20];		// 元の名前（Shift-JIS）
+		uint16_t parentIdx;		// 親がなければInvalidBoneIndex
+		uint16_t firstChild;	// BoneChildren上の先頭位置
+		uint16_t childCount;
+		uint16_t reserved;
+		DirectX::XMFLOAT3 pos;
+	};
+
+	// 調理済みIK（ボーン番号は調理後の番号）
+	struct CookedIKChain
+	{
+		uint16_t ikBone;		// 目標位置を表すボーン
+		uint16_t targetBone;	// 目標位置に近づけるボーン（エフェクター）
+		uint16_t iterations;	// 試行回数
+		uint16_t nodeCount;
+		uint32_t firstNode;		// IKNodes上の先頭位置（エフェクターに近い順）
+		float limit;			// 1回あたりの回転角の制限（ファイル上の値。ラジアンの1/4）
+	};
+
+	// IKで回転させるボーンの種類
+	constexpr uint16_t IKNodeKnee = 0x0001;	// ひざ（X軸周りに後ろへだけ曲げる）
+
+	// 調理済みIKのノード
+	struct CookedIKNode
+	{
+		uint16_t boneIdx;
+		uint16_t flags;			// IKNodeKneeなど
+	};
+
+	// 調理済み表情
+	struct CookedMorph
+	{
+		char morphName[20];		// 元の名前（Shift-JIS）
+		uint8_t type;			// 1:眉 2:目 3:リップ 4:その他
+		uint8_t reserved[3];
+		uint32_t firstVertex;	// MorphVertices上の先頭位置
+		uint32_t vertexCount;
+		uint32_t vertexBegin;	// 動かす頂点番号の範囲[vertexBegin, vertexEnd)
+		uint32_t vertexEnd;
+	};
+
+	// 表情で動かす頂点（16バイト単位で並ぶ）
+	struct CookedMorphVertex
+	{
+		DirectX::XMFLOAT3 offset;	// 座標のオフセット
+		uint32_t vertexIdx;			// 調理後の頂点番号
+	};
+
+	// キャッシュを照合するキー（元ファイルのサイズと最終更新時刻、パスの解決に使ったフォルダーのハッシュ）
+	// 元ファイルを読まずに照合できるように、中身のハッシュではなくファイルの属性を使う
+	struct CookedSourceKey
+	{
+		uint64_t sourceSize;
+		uint64_t sourceWriteTime;
+		uint64_t environmentHash;
+	};
+
+	// 調理済みモデル
+	// PMDファイルを毎回解釈し直さずに済むように、GPUへ転送できる形に加工したデータを
+	// 16バイト境界に揃えて1つのファイルへ保存し、1回のマップで読み込む。
+	// キャッシュは元ファイルの属性と解決に使ったフォルダーで照合し（CookedSourceKey）、一致しなければ作り直す。
+	// 要素単位の検証（参照する番号の範囲など）は調理した直後に1回だけ行い、キャッシュを読むときはセクションの範囲だけを確かめる
+	class PMDCookedModel
+	{
+	public:
+		// キャッシュファイルの形式バージョン
+		static constexpr uint32_t Version = 10;
+
+		PMDCookedModel();
+		virtual ~PMDCookedModel();
+
+		// キャッシュを読み込む。古いか存在しなければ元ファイルから作り直して保存する
+		bool LoadOrCook(const std::wstring& filename, const std::wstring& toonTexturePath);
+
+		// キャッシュファイルのパス
+		static std::wstring GetCachePath(const std::wstring& filename);
+
+		// PMDファイルの内容を調理してメモリー上のイメージを作る
+		static bool Cook(
+			const PMDFileView& fileView,
+			const std::wstring& folderPath,
+			const std::wstring& toonTexturePath,
+			const CookedSourceKey& key,
+			std::vector<unsigned char>* pImage);
+
+		// ヘッダー情報
+		const PMDHeader& GetHeader() const
+		{
+			return *_header;
+		}
+
+		// 頂点データ
+		const ArrayView<SerializedVertex>& GetVertices() const
+		{
+			return _vertices;
+		}
+
+		// インデックスデータ
+		const ArrayView<unsigned short>& GetIndices() const
+		{
+			return _indices;
+		}
+
+		// マテリアル
+		const ArrayView<CookedMaterial>& GetMaterials() const
+		{
+			return _materials;
+		}
+
+		// 定数バッファーの並びに配置済みのマテリアル
+		const ArrayView<unsigned char>& GetMaterialConstants() const
+		{
+			return _materialConstants;
+		}
+
+		// ボーン
+		const ArrayView<CookedBone>& GetBones() const
+		{
+			return _bones;
+		}
+
+		// 子ボーン番号
+		const ArrayView<uint16_t>& GetBoneChildren() const
+		{
+			return _boneChildren;
+		}
+
+		// ボーン名からボーン番号を引くハッシュ表
+		const ArrayView<uint16_t>& GetBoneNameSlots() const
+		{
+			return _boneNameSlots;
+		}
+
+		// 元のボーン番号から調理後のボーン番号への対応（IKなど元の番号で参照するデータ用）
+		const ArrayView<uint16_t>& GetBoneRemap() const
+		{
+			return _boneRemap;
+		}
+
+		// IKの連鎖（解く順）
+		const ArrayView<CookedIKChain>& GetIKChains() const
+		{
+			return _ikChains;
+		}
+
+		// IKで回転させるボーン
+		const ArrayView<CookedIKNode>& GetIKNodes() const
+		{
+			return _ikNodes;
+		}
+
+		// 表情
+		const ArrayView<CookedMorph>& GetMorphs() const
+		{
+			return _morphs;
+		}
+
+		// 表情で動かす頂点
+		const ArrayView<CookedMorphVertex>& GetMorphVertices() const
+		{
+			return _morphVertices;
+		}
+
+		// ボーンパレット（空なら全ボーンが1つのパレットに番号順で収まる）
+		const ArrayView<CookedBonePalette>& GetBonePalettes() const
+		{
+			return _bonePalettes;
+		}
+
+		// パレット上の位置ごとのボーン番号
+		const ArrayView<uint16_t>& GetPaletteBones() const
+		{
+			return _paletteBones;
+		}
+
+		// 元の頂点番号から調理後の頂点番号への対応（モーフなど元の番号で参照するデータ用）
+		const ArrayView<uint16_t>& GetVertexRemap() const
+		{
+			return _vertexRemap;
+		}
+
+		// メッシュレット（マテリアルごとの範囲はCookedMaterial::firstMeshletから）
+		const ArrayView<CookedMeshlet>& GetMeshlets() const
+		{
+			return _meshlets;
+		}
+
+		// メッシュレットが参照する頂点番号
+		const ArrayView<uint16_t>& GetMeshletVertices() const
+		{
+			return _meshletVertices;
+		}
+
+		// メッシュレットの三角形（メッシュレット内の頂点番号）
+		const ArrayView<uint8_t>& GetMeshletTriangles() const
+		{
+			return _meshletTriangles;
+		}
+
+		// 詳細度1以降（マテリアルごとのインデックス数はCookedMaterial::lodIndicesNum）
+		const ArrayView<CookedLodLevel>& GetLodLevels() const
+		{
+			return _lodLevels;
+		}
+
+		// 詳細度1以降のインデックス
+		const ArrayView<unsigned short>& GetLodIndices() const
+		{
+			return _lodIndices;
+		}
+
+		// 文字列テーブルから取得（なければnullptr）
+		const char* GetString(uint32_t offset) const;
+
+	private:
+		// 読み込み元（キャッシュファイルのマップか、その場で調理したイメージ）
+		MappedFile _file;
+		std::vector<unsigned char> _image;
+
+		// 各セクションのビュー
+		const PMDHeader* _header;
+		ArrayView<SerializedVertex> _vertices;
+		ArrayView<unsigned short> _indices;
+		ArrayView<CookedMaterial> _materials;
+		ArrayView<unsigned char> _materialConstants;
+		ArrayView<CookedBone> _bones;
+		ArrayView<uint16_t> _boneChildren;
+		ArrayView<uint16_t> _boneNameSlots;
+		ArrayView<uint16_t> _boneRemap;
+		ArrayView<CookedIKChain> _ikChains;
+		ArrayView<CookedIKNode> _ikNodes;
+		ArrayView<CookedMorph> _morphs;
+		ArrayView<CookedMorphVertex> _morphVertices;
+		ArrayView<CookedBonePalette> _bonePalettes;
+		ArrayView<uint16_t> _paletteBones;
+		ArrayView<uint16_t> _vertexRemap;
+		ArrayView<CookedMeshlet> _meshlets;
+		ArrayView<uint16_t> _meshletVertices;
+		ArrayView<uint8_t> _meshletTriangles;
+		ArrayView<CookedLodLevel> _lodLevels;
+		ArrayView<unsigned short> _lodIndices;
+		ArrayView<char> _strings;
+
+	private:
+		// ヘッダーとセクションの範囲を検証して各セクションのビューを設定
+		bool Attach(const unsigned char* pData, size_t size, const CookedSourceKey& key);
+
+		// セクションの要素が参照する番号の範囲を検証する（調理した直後に呼ぶ）
+		bool Validate() const;
+	};
+}
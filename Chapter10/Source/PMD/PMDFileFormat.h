@@ -0,0 +1,151 @@
+﻿#pragma once
+
+// DirectX
+#include <DirectXMath.h>
+
+namespace pmd
+{
+	// PMDヘッダー構造体
+	struct PMDHeader {
+		float version;			// 例 : 00 00 80 3F == 1.00
+		char model_name[20];	// モデル名
+		char comment[256];		// モデルコメント
+	};
+
+	// ボーン構造体
+#pragma pack(1)
+	struct PMDBone {
+		char boneName[20];
+		unsigned short parentNo;
+		unsigned short nextNo;
+		unsigned char type;
+		unsigned short ikBoneNo;
+		DirectX::XMFLOAT3 pos;
+	};
+#pragma pack()
+
+	// PMD頂点構造体
+#pragma pack(1)
+	struct SerializedVertex
+	{
+		DirectX::XMFLOAT3 pos;
+		DirectX::XMFLOAT3 normal;
+		DirectX::XMFLOAT2 uv;
+		unsigned short boneNo[2];
+		unsigned char boneWeight;
+		unsigned char endflg;
+	};
+#pragma pack()
+
+	// 描画単位となるメッシュのロード用構造体
+#pragma pack(1)
+	struct SerializedMeshData
+	{
+		DirectX::XMFLOAT3 diffuse;
+		float alpha;
+		float specularity;
+		DirectX::XMFLOAT3 specular;
+		DirectX::XMFLOAT3 ambient;
+		unsigned char toonIdx;
+		unsigned char edgeFlg;
+		// 本来はここにパディング2bytesが入る
+		unsigned int indicesNum;
+		char texFilePath[20];
+	};
+#pragma pack()
+
+	// マテリアル情報構造体（シェーダーのMaterial定数バッファーと同じ並び）
+	struct BasicMaterial
+	{
+		// ディフューズ成分
+		DirectX::XMFLOAT3 diffuse;
+		float alpha;
+
+		// スペキュラー成分
+		DirectX::XMFLOAT3 specular;
+		float specularity;
+
+		// アンビエントカラー
+		DirectX::XMFLOAT3 ambient;
+	};
+
+	// 表情の頂点オフセット
+#pragma pack(1)
+	struct PMDSkinVertex
+	{
+		unsigned int vertexIdx;		// 表情の種類がbaseならモデルの頂点番号、それ以外はbase表情内の番号
+		DirectX::XMFLOAT3 pos;		// baseなら座標、それ以外はbaseからのオフセット
+	};
+#pragma pack()
+
+	// 20バイトの名前（英語名拡張のボーン名、表情名）
+	struct PMDName
+	{
+		char name[20];
+	};
+
+	// 枠表示用のボーン枠名
+	struct PMDBoneDisplayName
+	{
+		char name[50];
+	};
+
+	// 枠表示用のボーン
+#pragma pack(1)
+	struct PMDBoneDisplay
+	{
+		unsigned short boneIdx;
+		unsigned char frameIdx;
+	};
+#pragma pack()
+
+	// トゥーンテクスチャーのファイル名
+	struct PMDToonTextureName
+	{
+		char name[100];
+	};
+
+	// 剛体
+#pragma pack(1)
+	struct PMDRigidBody
+	{
+		char name[20];
+		unsigned short boneIdx;
+		unsigned char group;
+		unsigned short groupMask;
+		unsigned char shapeType;	// 0:球 1:箱 2:カプセル
+		float width;
+		float height;
+		float depth;
+		DirectX::XMFLOAT3 pos;
+		DirectX::XMFLOAT3 rot;
+		float mass;
+		float linearDamping;
+		float angularDamping;
+		float restitution;
+		float friction;
+		unsigned char type;			// 0:ボーン追従 1:物理演算 2:物理演算（ボーン位置合わせ）
+	};
+#pragma pack()
+
+	// ジョイント
+#pragma pack(1)
+	struct PMDJoint
+	{
+		char name[20];
+		unsigned int rigidBodyA;
+		unsigned int rigidBodyB;
+		DirectX::XMFLOAT3 pos;
+		DirectX::XMFLOAT3 rot;
+		DirectX::XMFLOAT3 posLimitLower;
+		DirectX::XMFLOAT3 posLimitUpper;
+		DirectX::XMFLOAT3 rotLimitLower;
+		DirectX::XMFLOAT3 rotLimitUpper;
+		DirectX::XMFLOAT3 springPos;
+		DirectX::XMFLOAT3 springRot;
+	};
+#pragma pack()
+
+	// トゥーンテクスチャーの数
+	constexpr size_t NumberOfToonTexture = 10;
+}
@@ -0,0 +1,324 @@
+﻿#include "PMDFileView.h"
+
+// std
+#include <cstring>
+
+namespace pmd
+{
+	// ファイル上のレイアウトとの一致を確認
+	static_assert(sizeof(PMDHeader) == 280, "PMDHeader size mismatch");
+	static_assert(sizeof(SerializedVertex) == 38, "SerializedVertex size mismatch");
+	static_assert(sizeof(SerializedMeshData) == 70, "SerializedMeshData size mismatch");
+	static_assert(sizeof(PMDBone) == 39, "PMDBone size mismatch");
+	static_assert(sizeof(PMDSkinVertex) == 16, "PMDSkinVertex size mismatch");
+	static_assert(sizeof(PMDBoneDisplay) == 3, "PMDBoneDisplay size mismatch");
+	static_assert(sizeof(PMDRigidBody) == 83, "PMDRigidBody size mismatch");
+	static_assert(sizeof(PMDJoint) == 124, "PMDJoint size mismatch");
+
+	namespace
+	{
+		// ファイル先頭のシグネチャー
+		constexpr char PMDSignature[3] = { 'P', 'm', 'd' };
+
+		// IK1件あたりの固定部分のサイズ（ボーン、ターゲット、チェーン長、試行回数、制限角）
+		constexpr size_t IKHeaderSize = 2 + 2 + 1 + 2 + 4;
+
+		// 表情1件あたりの固定部分のサイズ（名前、頂点数、種類）
+		constexpr size_t SkinHeaderSize = 20 + 4 + 1;
+
+		// 範囲チェック付きでファイルを先頭から読み進めるカーソル
+		class SectionReader
+		{
+		public:
+			SectionReader(const unsigned char* data, size_t size) :
+				_cursor(data), _end(data + size)
+			{
+			}
+
+			// 固定長の値を1つ読む
+			template<typename T>
+			bool Read(T* pValue)
+			{
+				if (GetRemaining() < sizeof(T)) {
+					return false;
+				}
+				std::memcpy(pValue, _cursor, sizeof(T));
+				_cursor += sizeof(T);
+				return true;
+			}
+
+			// 指定バイト数を読み飛ばす
+			bool Skip(size_t size)
+			{
+				if (GetRemaining() < size) {
+					return false;
+				}
+				_cursor += size;
+				return true;
+			}
+
+			// 要素数countの配列をビューとして切り出す
+			template<typename T>
+			bool View(size_t count, ArrayView<T>* pView)
+			{
+				if (GetRemaining() / sizeof(T) < count) {
+					return false;
+				}
+				*pView = ArrayView<T>(reinterpret_cast<const T*>(_cursor), count);
+				_cursor += sizeof(T) * count;
+				return true;
+			}
+
+			// 要素数を先頭に持つ配列をビューとして切り出す
+			template<typename CountType, typename T>
+			bool CountedView(ArrayView<T>* pView)
+			{
+				CountType count;
+				return Read(&count) && View(count, pView);
+			}
+
+			const unsigned char* GetCursor() const
+			{
+				return _cursor;
+			}
+
+			size_t GetRemaining() const
+			{
+				return static_cast<size_t>(_end - _cursor);
+			}
+
+		private:
+			const unsigned char* _cursor;
+			const unsigned char* const _end;
+		};
+
+		// 固定長の名前をnull終端を考慮して文字列にする
+		std::string ToString(const char* name, size_t capacity)
+		{
+			size_t length = 0;
+			while (length < capacity && name[length] != '\0') {
+				length++;
+			}
+			return std::string(name, length);
+		}
+	}
+
+	// コンストラクター
+	PMDFileView::PMDFileView() :
+		_file(), _header(nullptr), _vertices(), _indices(), _meshes(), _bones(),
+		_skinDisplays(), _boneDisplayNames(), _boneDisplays(), _toonTextureNames(),
+		_rigidBodies(), _joints(),
+		_ikSection{}, _skinSection{}, _englishSection(nullptr),
+		_iksDecoded(false), _iks(), _skinsDecoded(false), _skins(),
+		_englishNamesDecoded(false), _englishNames()
+	{
+	}
+
+	// デストラクター
+	PMDFileView::~PMDFileView()
+	{
+	}
+
+	// ファイルをマップしてセクションの位置を確定する
+	bool PMDFileView::Open(const std::wstring& filename)
+	{
+		Close();
+		if (!_file.Open(filename)) {
+			return false;
+		}
+
+		SectionReader reader(_file.GetData(), _file.GetSize());
+
+		// シグネチャーとヘッダー情報
+		char signature[sizeof(PMDSignature)];
+		if (!reader.Read(&signature) || std::memcmp(signature, PMDSignature, sizeof(PMDSignature)) != 0) {
+			Close();
+			return false;
+		}
+		_header = reinterpret_cast<const PMDHeader*>(reader.GetCursor());
+		if (!reader.Skip(sizeof(PMDHeader))) {
+			Close();
+			return false;
+		}
+
+		// 頂点、インデックス、メッシュ、ボーンの順に並んでいる
+		if (!reader.CountedView<unsigned int>(&_vertices)
+			|| !reader.CountedView<unsigned int>(&_indices)
+			|| !reader.CountedView<unsigned int>(&_meshes)
+			|| !reader.CountedView<unsigned short>(&_bones))
+		{
+			Close();
+			return false;
+		}
+
+		// IKリスト: チェーン長だけ読んで位置を記録する
+		unsigned short numberOfIK = 0;
+		if (!reader.Read(&numberOfIK)) {
+			Close();
+			return false;
+		}
+		_ikSection = { reader.GetCursor(), numberOfIK };
+		for (auto i = 0u; i < numberOfIK; i++) {
+			unsigned char chainLength = 0;
+			if (!reader.Skip(2 + 2) || !reader.Read(&chainLength)
+				|| !reader.Skip(2 + 4 + sizeof(unsigned short) * chainLength))
+			{
+				Close();
+				return false;
+			}
+		}
+
+		// 表情リスト: 頂点数だけ読んで位置を記録する
+		unsigned short numberOfSkin = 0;
+		if (!reader.Read(&numberOfSkin)) {
+			Close();
+			return false;
+		}
+		_skinSection = { reader.GetCursor(), numberOfSkin };
+		for (auto i = 0u; i < numberOfSkin; i++) {
+			unsigned int numberOfSkinVertex = 0;
+			if (!reader.Skip(20) || !reader.Read(&numberOfSkinVertex)
+				|| !reader.Skip(1 + sizeof(PMDSkinVertex) * static_cast<size_t>(numberOfSkinVertex)))
+			{
+				Close();
+				return false;
+			}
+		}
+
+		// 表示枠
+		if (!reader.CountedView<unsigned char>(&_skinDisplays)
+			|| !reader.CountedView<unsigned char>(&_boneDisplayNames)
+			|| !reader.CountedView<unsigned int>(&_boneDisplays))
+		{
+			Close();
+			return false;
+		}
+
+		// ここから先は拡張部分なので、古いファイルでは途中で終わっていてもよい
+		unsigned char hasEnglishNames = 0;
+		if (!reader.Read(&hasEnglishNames)) {
+			return true;
+		}
+		if (hasEnglishNames) {
+			auto numberOfEnglishSkin = numberOfSkin > 0 ? numberOfSkin - 1u : 0u;
+			auto englishSectionSize = 20 + 256
+				+ sizeof(PMDName) * (_bones.size() + numberOfEnglishSkin)
+				+ sizeof(PMDBoneDisplayName) * _boneDisplayNames.size();
+			_englishSection = reader.GetCursor();
+			if (!reader.Skip(englishSectionSize)) {
+				_englishSection = nullptr;
+				return true;
+			}
+		}
+
+		// トゥーンテクスチャー、剛体、ジョイント（欠けていれば空のまま）
+		if (reader.View(NumberOfToonTexture, &_toonTextureNames)
+			&& reader.CountedView<unsigned int>(&_rigidBodies))
+		{
+			reader.CountedView<unsigned int>(&_joints);
+		}
+
+		return true;
+	}
+
+	// マップを解除する
+	void PMDFileView::Close()
+	{
+		_file.Close();
+		_header = nullptr;
+		_vertices = ArrayView<SerializedVertex>();
+		_indices = ArrayView<unsigned short>();
+		_meshes = ArrayView<SerializedMeshData>();
+		_bones = ArrayView<PMDBone>();
+		_skinDisplays = ArrayView<unsigned short>();
+		_boneDisplayNames = ArrayView<PMDBoneDisplayName>();
+		_boneDisplays = ArrayView<PMDBoneDisplay>();
+		_toonTextureNames = ArrayView<PMDToonTextureName>();
+		_rigidBodies = ArrayView<PMDRigidBody>();
+		_joints = ArrayView<PMDJoint>();
+		_ikSection = {};
+		_skinSection = {};
+		_englishSection = nullptr;
+		_iksDecoded = false;
+		_iks.clear();
+		_skinsDecoded = false;
+		_skins.clear();
+		_englishNamesDecoded = false;
+		_englishNames = PMDEnglishNames();
+	}
+
+	// IKリスト（初回アクセス時に展開）
+	const std::vector<PMDIK>& PMDFileView::GetIKs() const
+	{
+		if (_iksDecoded) {
+			return _iks;
+		}
+
+		// 範囲はOpen()で確認済み
+		auto pData = _ikSection.pData;
+		_iks.resize(_ikSection.count);
+		for (auto& ik : _iks) {
+			unsigned char chainLength;
+			std::memcpy(&ik.boneIdx, pData, 2);
+			std::memcpy(&ik.targetIdx, pData + 2, 2);
+			std::memcpy(&chainLength, pData + 4, 1);
+			std::memcpy(&ik.iterations, pData + 5, 2);
+			std::memcpy(&ik.limit, pData + 7, 4);
+			ik.nodeIdxes.resize(chainLength);
+			std::memcpy(ik.nodeIdxes.data(), pData + IKHeaderSize, sizeof(unsigned short) * chainLength);
+			pData += IKHeaderSize + sizeof(unsigned short) * chainLength;
+		}
+		_iksDecoded = true;
+
+		return _iks;
+	}
+
+	// 表情リスト（初回アクセス時に展開）
+	const std::vector<PMDSkin>& PMDFileView::GetSkins() const
+	{
+		if (_skinsDecoded) {
+			return _skins;
+		}
+
+		// 範囲はOpen()で確認済み
+		auto pData = _skinSection.pData;
+		_skins.resize(_skinSection.count);
+		for (auto& skin : _skins) {
+			unsigned int numberOfSkinVertex;
+			skin.name = ToString(reinterpret_cast<const char*>(pData), 20);
+			std::memcpy(&numberOfSkinVertex, pData + 20, 4);
+			std::memcpy(&skin.type, pData + 24, 1);
+			skin.vertices = ArrayView<PMDSkinVertex>(
+				reinterpret_cast<const PMDSkinVertex*>(pData + SkinHeaderSize), numberOfSkinVertex);
+			pData += SkinHeaderSize + skin.vertices.size_bytes();
+		}
+		_skinsDecoded = true;
+
+		return _skins;
+	}
+
+	// 英語名拡張（初回アクセス時に展開）
+	const PMDEnglishNames& PMDFileView::GetEnglishNames() const
+	{
+		if (_englishNamesDecoded || _englishSection == nullptr) {
+			return _englishNames;
+		}
+
+		// 範囲はOpen()で確認済み
+		auto pData = _englishSection;
+		_englishNames.modelName = ToString(reinterpret_cast<const char*>(pData), 20);
+		pData += 20;
+		_englishNames.comment = ToString(reinterpret_cast<const char*>(pData), 256);
+		pData += 256;
+		_englishNames.boneNames = ArrayView<PMDName>(reinterpret_cast<const PMDName*>(pData), _bones.size());
+		pData += _englishNames.boneNames.size_bytes();
+		auto numberOfEnglishSkin = _skinSection.count > 0 ? _skinSection.count - 1 : 0;
+		_englishNames.skinNames = ArrayView<PMDName>(reinterpret_cast<const PMDName*>(pData), numberOfEnglishSkin);
+		pData += _englishNames.skinNames.size_bytes();
+		_englishNames.boneDisplayNames = ArrayView<PMDBoneDisplayName>(
+			reinterpret_cast<const PMDBoneDisplayName*>(pData), _boneDisplayNames.size());
+		_englishNamesDecoded = true;
+
+		return _englishNames;
+	}
+}
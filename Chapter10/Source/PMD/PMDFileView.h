@@ -0,0 +1,177 @@
+﻿#pragma once
+
+// std
+#include <string>
+#include <vector>
+
+#include "ArrayView.h"
+#include "MappedFile.h"
+#include "PMDFileFormat.h"
+
+namespace pmd
+{
+	// IKの定義（展開済み）
+	struct PMDIK
+	{
+		unsigned short boneIdx;					// IKボーン
+		unsigned short targetIdx;				// ターゲット（エフェクター）ボーン
+		unsigned short iterations;				// 試行回数
+		float limit;							// 1回あたりの回転制限
+		std::vector<unsigned short> nodeIdxes;	// 間のノード番号
+	};
+
+	// 表情の定義（展開済み）
+	struct PMDSkin
+	{
+		std::string name;						// 表情名（Shift-JIS）
+		unsigned char type;						// 0:base 1:眉 2:目 3:リップ 4:その他
+		ArrayView<PMDSkinVertex> vertices;		// 頂点オフセット（ファイル上を直接参照）
+	};
+
+	// 英語名拡張（展開済み）
+	struct PMDEnglishNames
+	{
+		std::string modelName;
+		std::string comment;
+		ArrayView<PMDName> boneNames;
+		ArrayView<PMDName> skinNames;			// base表情を除く
+		ArrayView<PMDBoneDisplayName> boneDisplayNames;
+	};
+
+	// メモリーマップしたPMDファイルのビュー
+	// Open()で全セクションを1回走査して位置の索引を作り、
+	// 固定長のセクションはコピーせずにファイル上の型付きビューとして公開する。
+	// 可変長のセクション（IK、表情、英語名）は最初にアクセスされたときに展開する。
+	// 展開はスレッドセーフではないため、1つのビューを複数スレッドから同時に使わないこと。
+	class PMDFileView
+	{
+	public:
+		PMDFileView();
+		virtual ~PMDFileView();
+
+		// ファイルをマップしてセクションの位置を確定する
+		bool Open(const std::wstring& filename);
+
+		// マップを解除する（取得済みのビューは無効になる）
+		void Close();
+
+		// ヘッダー情報
+		const PMDHeader& GetHeader() const
+		{
+			return *_header;
+		}
+
+		// 頂点データ
+		const ArrayView<SerializedVertex>& GetVertices() const
+		{
+			return _vertices;
+		}
+
+		// インデックスデータ
+		const ArrayView<unsigned short>& GetIndices() const
+		{
+			return _indices;
+		}
+
+		// マテリアル（メッシュ）データ
+		const ArrayView<SerializedMeshData>& GetMeshes() const
+		{
+			return _meshes;
+		}
+
+		// ボーンデータ
+		const ArrayView<PMDBone>& GetBones() const
+		{
+			return _bones;
+		}
+
+		// IKリスト
+		const std::vector<PMDIK>& GetIKs() const;
+
+		// 表情リスト
+		const std::vector<PMDSkin>& GetSkins() const;
+
+		// 表情枠に表示する表情番号
+		const ArrayView<unsigned short>& GetSkinDisplays() const
+		{
+			return _skinDisplays;
+		}
+
+		// ボーン枠名
+		const ArrayView<PMDBoneDisplayName>& GetBoneDisplayNames() const
+		{
+			return _boneDisplayNames;
+		}
+
+		// ボーン枠に表示するボーン
+		const ArrayView<PMDBoneDisplay>& GetBoneDisplays() const
+		{
+			return _boneDisplays;
+		}
+
+		// 英語名拡張を持っているか
+		bool HasEnglishNames() const
+		{
+			return _englishSection != nullptr;
+		}
+
+		// 英語名拡張
+		const PMDEnglishNames& GetEnglishNames() const;
+
+		// トゥーンテクスチャーのファイル名リスト（古いファイルでは空）
+		const ArrayView<PMDToonTextureName>& GetToonTextureNames() const
+		{
+			return _toonTextureNames;
+		}
+
+		// 剛体
+		const ArrayView<PMDRigidBody>& GetRigidBodies() const
+		{
+			return _rigidBodies;
+		}
+
+		// ジョイント
+		const ArrayView<PMDJoint>& GetJoints() const
+		{
+			return _joints;
+		}
+
+	private:
+		// 可変長セクションの索引
+		struct VariableSection
+		{
+			const unsigned char* pData;
+			size_t count;
+		};
+
+	private:
+		// マップしたファイル
+		MappedFile _file;
+
+		// 固定長セクションのビュー
+		const PMDHeader* _header;
+		ArrayView<SerializedVertex> _vertices;
+		ArrayView<unsigned short> _indices;
+		ArrayView<SerializedMeshData> _meshes;
+		ArrayView<PMDBone> _bones;
+		ArrayView<unsigned short> _skinDisplays;
+		ArrayView<PMDBoneDisplayName> _boneDisplayNames;
+		ArrayView<PMDBoneDisplay> _boneDisplays;
+		ArrayView<PMDToonTextureName> _toonTextureNames;
+		ArrayView<PMDRigidBody> _rigidBodies;
+		ArrayView<PMDJoint> _joints;
+
+		// 可変長セクションの索引
+		VariableSection _ikSection;
+		VariableSection _skinSection;
+		const unsigned char* _englishSection;
+
+		// 展開済みのセクション
+		mutable bool _iksDecoded;
+		mutable std::vector<PMDIK> _iks;
+		mutable bool _skinsDecoded;
+		mutable std::vector<PMDSkin> _skins;
+		mutable bool _englishNamesDecoded;
+		mutable PMDEnglishNames _englishNames;
+	};
+}
@@ -0,0 +1,285 @@
+﻿#include "PMDIKSolver.h"
+
+// std
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "PMDCookedModel.h"
+
+namespace pmd
+{
+	namespace
+	{
+		// ファイル上の回転角の制限は4倍するとラジアンになる
+		constexpr float LimitScale = 4.0f;
+
+		// これより小さい回転は行わない
+		constexpr float MinAngle = 1.0e-5f;
+
+		// ひざを伸ばしきらないようにする角度（真っすぐだと曲げる向きが決まらない）
+		constexpr float MinKneeAngle = 0.002f;
+
+		// boneIdxと祖先を集める
+		void CollectAncestors(const std::vector<uint16_t>& parents, uint16_t boneIdx, std::vector<uint16_t>* pBones)
+		{
+			for (auto bone = boneIdx; bone != InvalidBoneIndex; bone = parents[bone]) {
+				pBones->push_back(bone);
+			}
+		}
+
+		// ワールド変換を求める（親は求め済みであること）
+		void UpdateWorldMatrix(const std::vector<uint16_t>& parents, uint16_t boneIdx, const DirectX::XMMATRIX* pLocal, DirectX::XMMATRIX* pWorld)
+		{
+			auto parent = parents[boneIdx];
+			pWorld[boneIdx] = parent == InvalidBoneIndex ? pLocal[boneIdx] : DirectX::XMMatrixMultiply(pLocal[boneIdx], pWorld[parent]);
+		}
+
+		// ボーンの現在の位置（初期位置をワールド変換で移したもの）
+		DirectX::XMVECTOR GetBonePosition(const PMDSkeleton& skeleton, uint16_t boneIdx, const DirectX::XMMATRIX* pWorld)
+		{
+			return DirectX::XMVector3Transform(DirectX::XMLoadFloat3(&skeleton.GetBindPositions()[boneIdx]), pWorld[boneIdx]);
+		}
+
+		// ひざの回転角（X軸周り）
+		float GetKneeAngle(DirectX::FXMVECTOR rotation)
+		{
+			auto angle = 2.0f * std::atan2(DirectX::XMVectorGetX(rotation), DirectX::XMVectorGetW(rotation));
+			return angle > DirectX::XM_PI ? angle - DirectX::XM_2PI : angle;
+		}
+
+		// ひざを曲げられる範囲に収める
+		float ClampKneeAngle(float angle)
+		{
+			if (angle > DirectX::XM_PI) {
+				angle -= DirectX::XM_2PI;
+			}
+			else if (angle < -DirectX::XM_PI) {
+				angle += DirectX::XM_2PI;
+			}
+			return std::min(std::max(angle, -DirectX::XM_PI), -MinKneeAngle);
+		}
+
+		// ひざのX軸周りの回転量
+		// 向きを合わせるだけでは伸びきった脚がほとんど曲がらないので、
+		// 付け根（連鎖で1つ上のボーン）からエフェクターまでの距離が目標までの距離に等しくなる角度を求める
+		// ひざの座標系で e' = RotX(d) * e として |e' - h|^2 = |e|^2 + |h|^2 - 2 hx ex - 2 (A cos d + B sin d)
+		float SolveKneeDelta(DirectX::FXMVECTOR toEffector, DirectX::FXMVECTOR toPivot, float targetDistanceSq, float currentAngle, float limit)
+		{
+			auto ex = DirectX::XMVectorGetX(toEffector), ey = DirectX::XMVectorGetY(toEffector), ez = DirectX::XMVectorGetZ(toEffector);
+			auto hx = DirectX::XMVectorGetX(toPivot), hy = DirectX::XMVectorGetY(toPivot), hz = DirectX::XMVectorGetZ(toPivot);
+			auto a = hy * ey + hz * ez;
+			auto b = hz * ey - hy * ez;
+			auto r = std::sqrt(a * a + b * b);
+			if (r <= 0.0f) {
+				return 0.0f;
+			}
+			auto k = (ex * ex + ey * ey + ez * ez + hx * hx + hy * hy + hz * hz - 2.0f * hx * ex - targetDistanceSq) * 0.5f;
+			auto phase = std::atan2(b, a);
+			auto spread = std::acos(std::min(std::max(k / r, -1.0f), 1.0f));
+
+			// 解は2つあるので、曲げられる範囲に収まり、回転量の小さい方を選ぶ
+			auto best = 0.0f;
+			auto bestCost = FLT_MAX;
+			for (auto candidate : { phase + spread, phase - spread }) {
+				candidate = std::remainder(candidate, DirectX::XM_2PI);
+				candidate = std::min(std::max(candidate, -limit), limit);
+				auto angle = currentAngle + candidate;
+				auto cost = std::fabs(ClampKneeAngle(angle) - angle) * 4.0f + std::fabs(candidate);
+				if (cost < bestCost) {
+					best = ClampKneeAngle(angle) - currentAngle;
+					bestCost = cost;
+				}
+			}
+			return best;
+		}
+	}
+
+	// コンストラクター
+	PMDIKSolver::PMDIKSolver() :
+		_chains(), _nodes(), _refreshBones(), _pathBones()
+	{
+	}
+
+	// デストラクター
+	PMDIKSolver::~PMDIKSolver()
+	{
+	}
+
+	// 調理済みのIKから作る
+	void PMDIKSolver::Assign(const PMDSkeleton& skeleton, const ArrayView<CookedIKChain>& chains, const ArrayView<CookedIKNode>& nodes)
+	{
+		_chains.clear();
+		_nodes.clear();
+		_refreshBones.clear();
+		_pathBones.clear();
+
+		const auto& parents = skeleton.GetParents();
+		std::vector<uint16_t> effectorAncestors;
+		for (const auto& cookedChain : chains) {
+			effectorAncestors.clear();
+			CollectAncestors(parents, cookedChain.targetBone, &effectorAncestors);
+
+			// エフェクターの祖先でないボーンは回してもエフェクターが動かないので除く
+			Chain chain = {};
+			chain.ikBone = cookedChain.ikBone;
+			chain.targetBone = cookedChain.targetBone;
+			chain.iterations = cookedChain.iterations;
+			chain.limit = cookedChain.limit > 0.0f ? cookedChain.limit * LimitScale : DirectX::XM_PI;
+			chain.firstNode = static_cast<uint32_t>(_nodes.size());
+			auto topBone = cookedChain.targetBone;
+			for (uint32_t i = 0; i < cookedChain.nodeCount; i++) {
+				const auto& cookedNode = nodes[cookedChain.firstNode + i];
+				if (cookedNode.boneIdx == cookedChain.targetBone
+					|| std::find(effectorAncestors.begin(), effectorAncestors.end(), cookedNode.boneIdx) == effectorAncestors.end())
+				{
+					continue;
+				}
+				_nodes.push_back(Node{ cookedNode.boneIdx, cookedNode.flags, InvalidBoneIndex, 0 });
+				topBone = std::min(topBone, cookedNode.boneIdx);
+			}
+			chain.nodeCount = static_cast<uint32_t>(_nodes.size()) - chain.firstNode;
+			if (chain.nodeCount == 0) {
+				continue;
+			}
+			for (uint32_t i = 0; i + 1 < chain.nodeCount; i++) {
+				_nodes[chain.firstNode + i].pivotBone = _nodes[chain.firstNode + i + 1].boneIdx;
+			}
+
+			// 一番根元の回転させるボーンからエフェクターまで（親が子より先に並ぶ番号順）
+			chain.firstPath = static_cast<uint32_t>(_pathBones.size());
+			for (auto it = effectorAncestors.rbegin(); it != effectorAncestors.rend(); ++it) {
+				if (*it >= topBone) {
+					_pathBones.push_back(*it);
+				}
+			}
+			chain.pathCount = static_cast<uint32_t>(_pathBones.size()) - chain.firstPath;
+			for (uint32_t i = 0; i < chain.nodeCount; i++) {
+				auto& node = _nodes[chain.firstNode + i];
+				auto first = _pathBones.begin() + chain.firstPath;
+				node.pathIndex = static_cast<uint32_t>(std::find(first, first + chain.pathCount, node.boneIdx) - _pathBones.begin());
+			}
+
+			// 目標とエフェクターの位置を求めるのに必要なボーン（重複を除いて番号順）
+			std::vector<uint16_t> refreshBones(effectorAncestors);
+			CollectAncestors(parents, cookedChain.ikBone, &refreshBones);
+			std::sort(refreshBones.begin(), refreshBones.end());
+			refreshBones.erase(std::unique(refreshBones.begin(), refreshBones.end()), refreshBones.end());
+			chain.firstRefresh = static_cast<uint32_t>(_refreshBones.size());
+			chain.refreshCount = static_cast<uint32_t>(refreshBones.size());
+			_refreshBones.insert(_refreshBones.end(), refreshBones.begin(), refreshBones.end());
+
+			_chains.push_back(chain);
+		}
+	}
+
+	// ポーズにIKを適用する
+	void PMDIKSolver::Solve(const PMDSkeleton& skeleton, PMDPose* pPose, DirectX::XMMATRIX* pLocal, DirectX::XMMATRIX* pWorld) const
+	{
+		for (const auto& chain : _chains) {
+			SolveChain(skeleton, chain, pPose, pLocal, pWorld);
+		}
+	}
+
+	// 複数アクターのポーズにまとめてIKを適用する
+	void PMDIKSolver::SolveBatch(
+		const PMDSkeleton& skeleton,
+		PMDPose* const* ppPose,
+		DirectX::XMMATRIX* const* ppLocal,
+		DirectX::XMMATRIX* const* ppWorld,
+		size_t actorCount) const
+	{
+		// アクターどうしは独立しているので、連鎖の順さえ守ればアクターごとにSolveしたのと同じ結果になる
+		for (const auto& chain : _chains) {
+			for (size_t a = 0; a < actorCount; a++) {
+				SolveChain(skeleton, chain, ppPose[a], ppLocal[a], ppWorld[a]);
+			}
+		}
+	}
+
+	// 1連鎖分を解く
+	void PMDIKSolver::SolveChain(
+		const PMDSkeleton& skeleton, const Chain& chain, PMDPose* pPose, DirectX::XMMATRIX* pLocal, DirectX::XMMATRIX* pWorld) const
+	{
+		const auto& parents = skeleton.GetParents();
+		auto convergenceSq = ConvergenceDistance * ConvergenceDistance;
+
+		// 前の連鎖で動いたボーンを含めて位置を求め直す
+		for (uint32_t i = 0; i < chain.refreshCount; i++) {
+			UpdateWorldMatrix(parents, _refreshBones[chain.firstRefresh + i], pLocal, pWorld);
+		}
+		auto target = GetBonePosition(skeleton, chain.ikBone, pWorld);
+		auto effector = GetBonePosition(skeleton, chain.targetBone, pWorld);
+		auto distanceSq = DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(DirectX::XMVectorSubtract(target, effector)));
+
+		for (uint32_t iteration = 0; iteration < chain.iterations && distanceSq > convergenceSq; iteration++) {
+			auto previousDistanceSq = distanceSq;
+			for (uint32_t n = 0; n < chain.nodeCount; n++) {
+				const auto& node = _nodes[chain.firstNode + n];
+
+				// ボーンの座標系でエフェクターと目標の向きを求める（回転部分の逆は転置）
+				auto inverseRotation = DirectX::XMMatrixTranspose(pWorld[node.boneIdx]);
+				auto origin = GetBonePosition(skeleton, node.boneIdx, pWorld);
+				auto toEffector = DirectX::XMVector3TransformNormal(DirectX::XMVectorSubtract(effector, origin), inverseRotation);
+				auto toTarget = DirectX::XMVector3TransformNormal(DirectX::XMVectorSubtract(target, origin), inverseRotation);
+				if (DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(toEffector)) <= 0.0f
+					|| DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(toTarget)) <= 0.0f)
+				{
+					continue;
+				}
+
+				auto& rotation = pPose->rotations[node.boneIdx];
+				DirectX::XMVECTOR newRotation;
+				if (node.flags & IKNodeKnee) {
+					// ひざはX軸周りにだけ回し、後ろへ曲げる範囲に制限する
+					auto currentAngle = GetKneeAngle(DirectX::XMLoadFloat4(&rotation));
+					float angle;
+					if (node.pivotBone != InvalidBoneIndex) {
+						auto pivot = GetBonePosition(skeleton, node.pivotBone, pWorld);
+						auto toPivot = DirectX::XMVector3TransformNormal(DirectX::XMVectorSubtract(pivot, origin), inverseRotation);
+						auto targetDistanceSq = DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(DirectX::XMVectorSubtract(target, pivot)));
+						angle = currentAngle + SolveKneeDelta(toEffector, toPivot, targetDistanceSq, currentAngle, chain.limit);
+					}
+					else {
+						// 付け根がなければYZ平面上で向きを合わせる
+						auto delta = std::atan2(
+							DirectX::XMVectorGetY(toEffector) * DirectX::XMVectorGetZ(toTarget) - DirectX::XMVectorGetZ(toEffector) * DirectX::XMVectorGetY(toTarget),
+							DirectX::XMVectorGetY(toEffector) * DirectX::XMVectorGetY(toTarget) + DirectX::XMVectorGetZ(toEffector) * DirectX::XMVectorGetZ(toTarget));
+						angle = ClampKneeAngle(currentAngle + std::min(std::max(delta, -chain.limit), chain.limit));
+					}
+					newRotation = DirectX::XMVectorSet(std::sin(angle * 0.5f), 0.0f, 0.0f, std::cos(angle * 0.5f));
+				}
+				else {
+					// エフェクターの向きを目標の向きへ回す（1回あたりの角度は制限する）
+					toEffector = DirectX::XMVector3Normalize(toEffector);
+					toTarget = DirectX::XMVector3Normalize(toTarget);
+					auto cosine = std::min(std::max(DirectX::XMVectorGetX(DirectX::XMVector3Dot(toEffector, toTarget)), -1.0f), 1.0f);
+					auto angle = std::min(std::acos(cosine), chain.limit);
+					auto axis = DirectX::XMVector3Cross(toEffector, toTarget);
+					if (angle < MinAngle || DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(axis)) <= 0.0f) {
+						continue;
+					}
+					auto delta = DirectX::XMQuaternionRotationNormal(DirectX::XMVector3Normalize(axis), angle);
+					newRotation = DirectX::XMQuaternionNormalize(DirectX::XMQuaternionMultiply(delta, DirectX::XMLoadFloat4(&rotation)));
+				}
+				DirectX::XMStoreFloat4(&rotation, newRotation);
+
+				// このボーンからエフェクターまでを求め直す
+				pLocal[node.boneIdx] = skeleton.ComputeLocalMatrix(*pPose, node.boneIdx);
+				for (auto i = node.pathIndex; i < chain.firstPath + chain.pathCount; i++) {
+					UpdateWorldMatrix(parents, _pathBones[i], pLocal, pWorld);
+				}
+				effector = GetBonePosition(skeleton, chain.targetBone, pWorld);
+				distanceSq = DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(DirectX::XMVectorSubtract(target, effector)));
+				if (distanceSq <= convergenceSq) {
+					break;
+				}
+			}
+
+			// 縮まらなくなったら（届かない目標など）打ち切る
+			if (distanceSq > previousDistanceSq * (1.0f - MinImprovement)) {
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,93 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// DirectX
+#include <DirectXMath.h>
+
+#include "ArrayView.h"
+#include "PMDPose.h"
+#include "PMDSkeleton.h"
+
+namespace pmd
+{
+	struct CookedIKChain;
+	struct CookedIKNode;
+
+	// CCD（Cyclic Coordinate Descent）によるIK
+	// モデルごとに1つ持ち、連鎖ごとに更新が必要なボーンの並びを読み込み時に求めておく
+	// 解くときはその並びだけワールド変換を求め直すので、全ボーンをたどり直さずに済む
+	class PMDIKSolver
+	{
+	public:
+		// エフェクターが目標位置にこの距離（モデル空間）まで近づいたら打ち切る
+		static constexpr float ConvergenceDistance = 1.0e-3f;
+
+		// 1回の試行で距離がこの割合より縮まなければ打ち切る（届かない目標で試行回数を使い切らないように）
+		static constexpr float MinImprovement = 1.0e-3f;
+
+		PMDIKSolver();
+		virtual ~PMDIKSolver();
+
+		// 調理済みのIKから作る
+		void Assign(const PMDSkeleton& skeleton, const ArrayView<CookedIKChain>& chains, const ArrayView<CookedIKNode>& nodes);
+
+		// IKがないか
+		bool empty() const
+		{
+			return _chains.empty();
+		}
+
+		// サンプリング済みのポーズにIKを適用する
+		// pLocalはposeから求めたローカル変換で、回転させたボーンの分を書き換える
+		// pWorldは作業用（ボーン数分）。IKに関係するボーンだけ書き込む
+		void Solve(const PMDSkeleton& skeleton, PMDPose* pPose, DirectX::XMMATRIX* pLocal, DirectX::XMMATRIX* pWorld) const;
+
+		// このモデルを共有する複数アクターのポーズにまとめてIKを適用する
+		// 連鎖ごとに全アクターを解くので、連鎖の並びやボーンの初期位置を読み直さずに済む。結果はアクターごとのSolveと一致する
+		// ppPose[a]、ppLocal[a]、ppWorld[a]はアクターaについてSolveに渡すもの
+		void SolveBatch(
+			const PMDSkeleton& skeleton,
+			PMDPose* const* ppPose,
+			DirectX::XMMATRIX* const* ppLocal,
+			DirectX::XMMATRIX* const* ppWorld,
+			size_t actorCount) const;
+
+	private:
+		// 連鎖
+		struct Chain
+		{
+			uint16_t ikBone;
+			uint16_t targetBone;
+			uint16_t iterations;
+			float limit;				// 1回あたりの回転角の制限（ラジアン）
+			uint32_t firstNode;
+			uint32_t nodeCount;
+			uint32_t firstRefresh;		// 解き始める前にワールド変換を求めるボーン（ikBoneとtargetBoneの祖先）
+			uint32_t refreshCount;
+			uint32_t firstPath;			// 回転させるボーンからエフェクターまでのボーン（番号順）
+			uint32_t pathCount;
+		};
+
+		// 回転させるボーン
+		struct Node
+		{
+			uint16_t boneIdx;
+			uint16_t flags;
+			uint16_t pivotBone;		// 連鎖で1つ上のボーン（ひざの曲げ角を求めるのに使う）
+			uint32_t pathIndex;		// _pathBones上の位置（ここから連鎖の終わりまでを求め直す）
+		};
+
+		// 1連鎖分を解く
+		void SolveChain(
+			const PMDSkeleton& skeleton, const Chain& chain, PMDPose* pPose, DirectX::XMMATRIX* pLocal, DirectX::XMMATRIX* pWorld) const;
+
+		std::vector<Chain> _chains;
+		std::vector<Node> _nodes;
+		std::vector<uint16_t> _refreshBones;
+		std::vector<uint16_t> _pathBones;
+	};
+}
@@ -2,14 +2,17 @@
 
 #include <d3dx12.h>
 #include <DirectXTex.h>
+#include <algorithm>
+#include <cstring>
 #include <functional>
+#include <iterator>
 #include "utils.h"
 
 namespace pmd
 {
 	// コンストラクター
 	PMDMesh::PMDMesh() :
-		indicesNum(0), basicMaterial(), additionalMaterial(),
+		indicesNum(0), paletteIdx(0), lodIndicesNum{}, basicMaterial(), additionalMaterial(),
 		pTextureResource(nullptr), pSPHResource(nullptr), pSPAResource(nullptr),
 		pToonResource(nullptr)
 	{
@@ -20,43 +23,27 @@ namespace pmd
 	{
 	}
 
-	// ファイルから読み込んだシリアライズ済みデータを展開
-	HRESULT PMDMesh::LoadFromSerializedData(
+	// 調理済みモデルのマテリアルを展開
+	HRESULT PMDMesh::LoadFromCookedData(
 		D3D12ResourceCache* const pResourceCache,
-		const SerializedMeshData& serializedData,
-		const std::wstring& folderPath,
-		const std::wstring& toonTexturePath
+		const PMDCookedModel& cookedModel,
+		size_t materialIdx
 	) {
 
 		HRESULT result = S_OK;
-		indicesNum = serializedData.indicesNum;
-		basicMaterial.diffuse = serializedData.diffuse;
-		basicMaterial.alpha = serializedData.alpha;
-		basicMaterial.specular = serializedData.specular;
-		basicMaterial.specularity = serializedData.specularity;
-		basicMaterial.ambient = serializedData.ambient;
+		const auto& cookedMaterial = cookedModel.GetMaterials()[materialIdx];
+		indicesNum = cookedMaterial.indicesNum;
+		paletteIdx = cookedMaterial.paletteIdx;
+		std::copy(std::begin(cookedMaterial.lodIndicesNum), std::end(cookedMaterial.lodIndicesNum), lodIndicesNum);
+		std::memcpy(&basicMaterial, cookedModel.GetMaterialConstants().data() + MaterialConstantsStride * materialIdx, sizeof(basicMaterial));
 
-		additionalMaterial.toonIdx = serializedData.toonIdx;
-		additionalMaterial.edgeFlg = serializedData.edgeFlg;
-		auto len = std::strlen(serializedData.texFilePath);
-		if (len > 0) {
-			std::wstring texPath = GetWString(serializedData.texFilePath, len);
-			auto filenames = Split(texPath, L'*');
-			for (auto filename : filenames) {
-				auto path = folderPath + L'/' + filename;
-				auto ext = ::GetExtension(filename);
-				if (ext == L"sph") {
-					pSPHResource = pResourceCache->LoadTextureFromFile(path);
-				}
-				else if (ext == L"spa") {
-					pSPAResource = pResourceCache->LoadTextureFromFile(path);
-				}
-				else {
-					pTextureResource = pResourceCache->LoadTextureFromFile(path);
-				}
-			}
+		additionalMaterial.toonIdx = cookedMaterial.toonIdx;
+		additionalMaterial.edgeFlg = cookedMaterial.edgeFlg != 0;
+		auto texFileName = cookedModel.GetString(cookedMaterial.texFileName);
+		if (texFileName) {
+			additionalMaterial.texPath = GetWStringFromUTF8(texFileName, std::strlen(texFileName));
 #ifdef _DEBUG
-			wprintf(L" texture = \"%s\"\n", texPath.c_str());
+			wprintf(L" texture = \"%s\"\n", additionalMaterial.texPath.c_str());
 #endif // _DEBUG
 		}
 		else {
@@ -65,9 +52,19 @@ namespace pmd
 #endif // _DEBUG
 		}
 
-		wchar_t toonFileName[16];
-		swprintf_s(toonFileName, L"/toon%02d.bmp", serializedData.toonIdx + 1);
-		pToonResource = pResourceCache->LoadTextureFromFile(toonTexturePath + toonFileName);
+		// パスは調理時に解決済み
+		// テクスチャーはPMDModel::Prepareでデコードしてキャッシュに登録済みなので引くだけにする（デコードに失敗したものは読み直さない）
+		auto loadTexture = [&](MaterialTexture slot) -> Microsoft::WRL::ComPtr<ID3D12Resource> {
+			auto path = cookedModel.GetString(cookedMaterial.texturePaths[static_cast<size_t>(slot)]);
+			if (path == nullptr) {
+				return nullptr;
+			}
+			return pResourceCache->FindTexture(GetWStringFromUTF8(path, std::strlen(path)));
+		};
+		pTextureResource = loadTexture(MaterialTexture::Diffuse);
+		pSPHResource = loadTexture(MaterialTexture::Sphere);
+		pSPAResource = loadTexture(MaterialTexture::SphereAdd);
+		pToonResource = loadTexture(MaterialTexture::Toon);
 
 		return result;
 	}
@@ -6,42 +6,13 @@
 #include <string>
 #include <map>
 
+#include "ArrayView.h"
 #include "D3D12/D3D12ResourceCache.h"
+#include "PMDCookedModel.h"
+#include "PMDFileFormat.h"
 
 namespace pmd
 {
-	// 描画単位となるメッシュのロード用構造体
-#pragma pack(1)
-	struct SerializedMeshData
-	{
-		DirectX::XMFLOAT3 diffuse;
-		float alpha;
-		float specularity;
-		DirectX::XMFLOAT3 specular;
-		DirectX::XMFLOAT3 ambient;
-		unsigned char toonIdx;
-		unsigned char edgeFlg;
-		// 本来はここにパディング2bytesが入る
-		unsigned int indicesNum;
-		char texFilePath[20];
-	};
-#pragma pack()
-
-	// マテリアル情報構造体
-	struct BasicMaterial
-	{
-		// ディフューズ成分
-		DirectX::XMFLOAT3 diffuse;
-		float alpha;
-
-		// スペキュラー成分
-		DirectX::XMFLOAT3 specular;
-		float specularity;
-
-		// アンビエントカラー
-		DirectX::XMFLOAT3 ambient;
-	};
-
 	// 追加のマテリアル情報構造体
 	struct AdditionalMaterial
 	{
@@ -58,12 +29,11 @@ namespace pmd
 		PMDMesh();
 		virtual ~PMDMesh();
 
-		// ファイルから読み込んだシリアライズ済みデータの展開
-		HRESULT LoadFromSerializedData(
+		// 調理済みモデルのマテリアルを展開
+		HRESULT LoadFromCookedData(
 			D3D12ResourceCache* const pResourceCache,
-			const SerializedMeshData& serealizedData,
-			const std::wstring& folderPath,
-			const std::wstring& toonTexturePath);
+			const PMDCookedModel& cookedModel,
+			size_t materialIdx);
 
 		// マテリアルに適用するテクスチャーリソースの生成
 		void CreateMaterialTextureViews(
@@ -71,10 +41,10 @@ namespace pmd
 			D3D12ResourceCache* const pResourceCache,
 			D3D12_CPU_DESCRIPTOR_HANDLE* const pDescriptorHeapHandle);
 
-		// 描画命令の発効時に参照するインデックス数
-		unsigned int GetIndicesNum() const
+		// 描画命令の発効時に参照するインデックス数（詳細度0が元のメッシュ）
+		unsigned int GetIndicesNum(size_t lodLevel = 0) const
 		{
-			return indicesNum;
+			return lodLevel == 0 ? indicesNum : lodIndicesNum[lodLevel - 1];
 		}
 
 		// マテリアル情報の取得
@@ -83,8 +53,16 @@ namespace pmd
 			return basicMaterial;
 		}
 
+		// 描画に使うボーンパレット（PMDModel::GetBonePalettes参照）
+		size_t GetPaletteIdx() const
+		{
+			return paletteIdx;
+		}
+
 	private:
 		UINT indicesNum;
+		size_t paletteIdx;
+		UINT lodIndicesNum[MaxLodLevels - 1];
 		BasicMaterial basicMaterial;
 		AdditionalMaterial additionalMaterial;
 		Microsoft::WRL::ComPtr<ID3D12Resource> pTextureResource;
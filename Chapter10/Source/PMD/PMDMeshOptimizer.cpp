@@ -0,0 +1,311 @@
+﻿#include "PMDMeshOptimizer.h"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+namespace pmd
+{
+	namespace
+	{
+		// Forsythの手法で模擬するLRUキャッシュの大きさ
+		constexpr int ScoringCacheSize = 32;
+
+		// スコア計算の係数（Forsythの推奨値）
+		constexpr float CacheDecayPower = 1.5f;
+		constexpr float LastTriangleScore = 0.75f;
+		constexpr float ValenceBoostScale = 2.0f;
+		constexpr float ValenceBoostPower = 0.5f;
+
+		// 未処理の三角形を持つ数の上限（それ以上は同じスコア）
+		constexpr int MaxValence = 32;
+
+		// キャッシュ位置と残り三角形数から決まる頂点スコアの表
+		struct ScoreTable
+		{
+			float cache[ScoringCacheSize];
+			float valence[MaxValence + 1];
+
+			ScoreTable()
+			{
+				for (int i = 0; i < ScoringCacheSize; i++) {
+					if (i < 3) {
+						// 直前の三角形の頂点は、同じ辺を連続して使わないように少し下げる
+						cache[i] = LastTriangleScore;
+					}
+					else {
+						auto scaler = 1.0f / (ScoringCacheSize - 3);
+						cache[i] = std::pow(1.0f - (i - 3) * scaler, CacheDecayPower);
+					}
+				}
+				valence[0] = 0.0f;
+				for (int i = 1; i <= MaxValence; i++) {
+					// 残りの少ない頂点を優先して片付ける
+					valence[i] = ValenceBoostScale * std::pow(static_cast<float>(i), -ValenceBoostPower);
+				}
+			}
+
+			float GetVertexScore(int cachePosition, int activeTriangles) const
+			{
+				if (activeTriangles == 0) {
+					return -1.0f;
+				}
+				auto score = cachePosition < 0 ? 0.0f : cache[cachePosition];
+				return score + valence[std::min(activeTriangles, MaxValence)];
+			}
+		};
+	}
+
+	// FIFOの頂点キャッシュを模擬して効率を計測
+	VertexCacheStatistics AnalyzeVertexCache(
+		const unsigned short* pIndices,
+		size_t indexCount,
+		size_t vertexCount,
+		size_t cacheSize)
+	{
+		VertexCacheStatistics statistics = {};
+		auto triangleCount = indexCount / 3;
+		if (triangleCount == 0) {
+			return statistics;
+		}
+
+		// 各頂点がキャッシュに入った時刻で判定する
+		std::vector<size_t> cachedAt(vertexCount, 0);
+		std::vector<bool> used(vertexCount, false);
+		size_t time = cacheSize + 1;
+		size_t misses = 0;
+		size_t uniqueVertices = 0;
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			auto index = pIndices[i];
+			if (index >= vertexCount) {
+				continue;
+			}
+			if (!used[index]) {
+				used[index] = true;
+				uniqueVertices++;
+			}
+			if (time - cachedAt[index] > cacheSize) {
+				cachedAt[index] = time++;
+				misses++;
+			}
+		}
+
+		statistics.acmr = static_cast<float>(misses) / triangleCount;
+		statistics.atvr = uniqueVertices > 0 ? static_cast<float>(misses) / uniqueVertices : 0.0f;
+		return statistics;
+	}
+
+	// 頂点キャッシュに合わせて三角形を並べ替える
+	void OptimizeVertexCache(
+		unsigned short* pIndices,
+		size_t indexCount,
+		size_t vertexCount)
+	{
+		static const ScoreTable scoreTable;
+
+		auto triangleCount = indexCount / 3;
+		if (triangleCount < 2) {
+			return;
+		}
+
+		// 頂点ごとに未処理の三角形の一覧を作る（CSR形式）
+		std::vector<int> activeTriangles(vertexCount, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			if (pIndices[i] >= vertexCount) {
+				// 範囲外の頂点を参照しているデータは触らない
+				return;
+			}
+			activeTriangles[pIndices[i]]++;
+		}
+		std::vector<size_t> triangleOffsets(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; v++) {
+			triangleOffsets[v + 1] = triangleOffsets[v] + activeTriangles[v];
+		}
+		std::vector<uint32_t> vertexTriangles(triangleOffsets[vertexCount]);
+		{
+			std::vector<size_t> cursor(triangleOffsets.begin(), triangleOffsets.end() - 1);
+			for (size_t t = 0; t < triangleCount; t++) {
+				for (size_t k = 0; k < 3; k++) {
+					vertexTriangles[cursor[pIndices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+				}
+			}
+		}
+
+		// 初期スコア
+		std::vector<int> cachePositions(vertexCount, -1);
+		std::vector<float> vertexScores(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			vertexScores[v] = scoreTable.GetVertexScore(-1, activeTriangles[v]);
+		}
+		std::vector<float> triangleScores(triangleCount);
+		std::vector<bool> emitted(triangleCount, false);
+		for (size_t t = 0; t < triangleCount; t++) {
+			triangleScores[t] =
+				vertexScores[pIndices[t * 3]] + vertexScores[pIndices[t * 3 + 1]] + vertexScores[pIndices[t * 3 + 2]];
+		}
+
+		std::vector<unsigned short> output;
+		output.reserve(triangleCount * 3);
+
+		// キャッシュは追い出された頂点を扱うため3つ余分に持つ
+		int cache[ScoringCacheSize + 3];
+		int cacheCount = 0;
+		int newCache[ScoringCacheSize + 3];
+
+		long long bestTriangle = -1;
+		size_t scanCursor = 0;
+		for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+			// キャッシュから候補が出ない場合は未処理の三角形全体から探す
+			if (bestTriangle < 0) {
+				auto bestScore = -1.0f;
+				while (emitted[scanCursor]) {
+					scanCursor++;
+				}
+				for (size_t t = scanCursor; t < triangleCount; t++) {
+					if (!emitted[t] && triangleScores[t] > bestScore) {
+						bestScore = triangleScores[t];
+						bestTriangle = static_cast<long long>(t);
+					}
+				}
+			}
+
+			// 三角形を出力
+			auto triangle = static_cast<size_t>(bestTriangle);
+			emitted[triangle] = true;
+			const unsigned short triangleVertices[3] = {
+				pIndices[triangle * 3], pIndices[triangle * 3 + 1], pIndices[triangle * 3 + 2]
+			};
+			output.insert(output.end(), triangleVertices, triangleVertices + 3);
+
+			// 頂点の未処理一覧から外す
+			for (auto v : triangleVertices) {
+				auto begin = vertexTriangles.begin() + triangleOffsets[v];
+				auto end = begin + activeTriangles[v];
+				auto found = std::find(begin, end, static_cast<uint32_t>(triangle));
+				if (found != end) {
+					std::iter_swap(found, end - 1);
+					activeTriangles[v]--;
+				}
+			}
+
+			// 出力した頂点をキャッシュの先頭へ
+			int newCacheCount = 0;
+			for (auto v : triangleVertices) {
+				if (std::find(newCache, newCache + newCacheCount, static_cast<int>(v)) == newCache + newCacheCount) {
+					newCache[newCacheCount++] = v;
+				}
+			}
+			for (int i = 0; i < cacheCount; i++) {
+				auto v = cache[i];
+				if (std::find(newCache, newCache + newCacheCount, v) == newCache + newCacheCount) {
+					newCache[newCacheCount++] = v;
+				}
+			}
+
+			// キャッシュ内の頂点のスコアを更新し、関係する三角形から次の候補を選ぶ
+			bestTriangle = -1;
+			auto bestScore = -1.0f;
+			for (int i = 0; i < newCacheCount; i++) {
+				auto v = newCache[i];
+				cachePositions[v] = i < ScoringCacheSize ? i : -1;
+				vertexScores[v] = scoreTable.GetVertexScore(cachePositions[v], activeTriangles[v]);
+			}
+			for (int i = 0; i < newCacheCount; i++) {
+				auto v = newCache[i];
+				for (int k = 0; k < activeTriangles[v]; k++) {
+					auto t = vertexTriangles[triangleOffsets[v] + k];
+					auto score =
+						vertexScores[pIndices[t * 3]] + vertexScores[pIndices[t * 3 + 1]] + vertexScores[pIndices[t * 3 + 2]];
+					triangleScores[t] = score;
+					if (score > bestScore) {
+						bestScore = score;
+						bestTriangle = t;
+					}
+				}
+			}
+
+			cacheCount = std::min(newCacheCount, ScoringCacheSize);
+			std::copy(newCache, newCache + cacheCount, cache);
+		}
+
+		std::copy(output.begin(), output.end(), pIndices);
+	}
+
+	// 頂点を最初に参照される順に並べ替え、インデックスを付け替える
+	void OptimizeVertexFetch(
+		SerializedVertex* pVertices,
+		size_t vertexCount,
+		unsigned short* pIndices,
+		size_t indexCount,
+		std::vector<uint16_t>* pRemap)
+	{
+		constexpr uint16_t Unassigned = 0xffff;
+		auto& remap = *pRemap;
+		remap.assign(vertexCount, Unassigned);
+
+		uint16_t next = 0;
+		for (size_t i = 0; i < indexCount; i++) {
+			auto index = pIndices[i];
+			if (index >= vertexCount) {
+				continue;
+			}
+			if (remap[index] == Unassigned) {
+				remap[index] = next++;
+			}
+			pIndices[i] = remap[index];
+		}
+
+		// 参照されない頂点も番号を振って残す（モーフなどが元の番号で参照するため）
+		for (auto& newIndex : remap) {
+			if (newIndex == Unassigned) {
+				newIndex = next++;
+			}
+		}
+
+		std::vector<SerializedVertex> vertices(pVertices, pVertices + vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			pVertices[remap[v]] = vertices[v];
+		}
+	}
+
+	// 指定した頂点を先頭へ集める
+	size_t MoveVerticesToFront(
+		SerializedVertex* pVertices,
+		size_t vertexCount,
+		unsigned short* pIndices,
+		size_t indexCount,
+		const std::vector<uint8_t>& front,
+		std::vector<uint16_t>* pRemap)
+	{
+		// 新しい番号（先頭へ集める頂点、残りの頂点の順）
+		std::vector<uint16_t> order(vertexCount);
+		uint16_t next = 0;
+		for (size_t v = 0; v < vertexCount; v++) {
+			if (front[v]) {
+				order[v] = next++;
+			}
+		}
+		size_t frontCount = next;
+		for (size_t v = 0; v < vertexCount; v++) {
+			if (!front[v]) {
+				order[v] = next++;
+			}
+		}
+
+		for (size_t i = 0; i < indexCount; i++) {
+			if (pIndices[i] < vertexCount) {
+				pIndices[i] = order[pIndices[i]];
+			}
+		}
+		for (auto& index : *pRemap) {
+			if (index < vertexCount) {
+				index = order[index];
+			}
+		}
+		std::vector<SerializedVertex> vertices(pVertices, pVertices + vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			pVertices[order[v]] = vertices[v];
+		}
+		return frontCount;
+	}
+}
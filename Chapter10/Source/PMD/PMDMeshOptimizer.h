@@ -0,0 +1,52 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "PMDFileFormat.h"
+
+namespace pmd
+{
+	// 頂点キャッシュの効率
+	struct VertexCacheStatistics
+	{
+		float acmr;	// 三角形あたりの頂点シェーダー実行数（0.5～3.0、小さいほど良い）
+		float atvr;	// 頂点あたりの頂点シェーダー実行数（1.0が理想）
+	};
+
+	// FIFOの頂点キャッシュを模擬して効率を計測
+	VertexCacheStatistics AnalyzeVertexCache(
+		const unsigned short* pIndices,
+		size_t indexCount,
+		size_t vertexCount,
+		size_t cacheSize = 16);
+
+	// 頂点キャッシュに合わせて三角形を並べ替える（Forsythの手法）
+	// 範囲内の三角形を入れ替えるだけなので、マテリアルごとに呼べばインデックス範囲は保たれる
+	void OptimizeVertexCache(
+		unsigned short* pIndices,
+		size_t indexCount,
+		size_t vertexCount);
+
+	// 頂点を最初に参照される順に並べ替え、インデックスを付け替える
+	// pRemapには元の頂点番号から新しい頂点番号への対応を返す（参照されない頂点は末尾に残す）
+	void OptimizeVertexFetch(
+		SerializedVertex* pVertices,
+		size_t vertexCount,
+		unsigned short* pIndices,
+		size_t indexCount,
+		std::vector<uint16_t>* pRemap);
+
+	// 指定した頂点を順序を保ったまま先頭へ集め、インデックスと対応表（元の頂点番号から現在の番号）を付け替える
+	// 表情で動く頂点を連続させ、書き換える範囲を狭くするのに使う。frontは現在の頂点番号ごとのフラグ
+	// 戻り値は先頭へ集めた頂点の数
+	size_t MoveVerticesToFront(
+		SerializedVertex* pVertices,
+		size_t vertexCount,
+		unsigned short* pIndices,
+		size_t indexCount,
+		const std::vector<uint8_t>& front,
+		std::vector<uint16_t>* pRemap);
+}
@@ -0,0 +1,394 @@
+﻿#include "PMDMeshSimplifier.h"
+
+// std
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_set>
+
+namespace pmd
+{
+	using namespace DirectX;
+
+	namespace
+	{
+		// 縮約してよいボーンの重みの差（0～100）
+		constexpr int MaxWeightDifference = 10;
+
+		// 折り返しとみなす面法線の変化（縮約前後の法線の内積）
+		constexpr double MinNormalDot = 0.2;
+
+		// 二次誤差（対称4x4行列の上三角と重みの合計）
+		struct Quadric
+		{
+			double a00, a01, a02, a03;
+			double a11, a12, a13;
+			double a22, a23;
+			double a33;
+			double weight;
+
+			void AddPlane(double nx, double ny, double nz, double d, double w)
+			{
+				a00 += w * nx * nx; a01 += w * nx * ny; a02 += w * nx * nz; a03 += w * nx * d;
+				a11 += w * ny * ny; a12 += w * ny * nz; a13 += w * ny * d;
+				a22 += w * nz * nz; a23 += w * nz * d;
+				a33 += w * d * d;
+				weight += w;
+			}
+
+			void Add(const Quadric& q)
+			{
+				a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+				a11 += q.a11; a12 += q.a12; a13 += q.a13;
+				a22 += q.a22; a23 += q.a23;
+				a33 += q.a33;
+				weight += q.weight;
+			}
+
+			// 平面までの二乗距離の総和
+			double Evaluate(const XMFLOAT3& p) const
+			{
+				double x = p.x, y = p.y, z = p.z;
+				return a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x
+					+ a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y
+					+ a22 * z * z + 2.0 * a23 * z
+					+ a33;
+			}
+		};
+
+		// 縮約の候補（頂点fromを頂点toへ寄せる）
+		struct Collapse
+		{
+			unsigned short from;
+			unsigned short to;
+			float error;
+		};
+
+		// ボーンの割り当て（1本だけのボーンは重み100に揃え、番号の小さい方を先にする）
+		struct SkinKey
+		{
+			unsigned short bone0;
+			unsigned short bone1;
+			int weight;
+
+			explicit SkinKey(const SerializedVertex& vertex)
+			{
+				bone0 = vertex.boneNo[0];
+				bone1 = vertex.boneNo[1];
+				weight = std::min<int>(vertex.boneWeight, 100);
+				if (weight == 0) {
+					bone0 = bone1;
+					weight = 100;
+				}
+				if (weight == 100 || bone0 == bone1) {
+					bone1 = bone0;
+					weight = 100;
+				}
+				else if (bone0 > bone1) {
+					std::swap(bone0, bone1);
+					weight = 100 - weight;
+				}
+			}
+		};
+
+		// 同じように変形する頂点か（違えば縮約でボーンの境界が動く）
+		bool IsSkinCompatible(const SerializedVertex& a, const SerializedVertex& b)
+		{
+			SkinKey keyA(a);
+			SkinKey keyB(b);
+			return keyA.bone0 == keyB.bone0
+				&& keyA.bone1 == keyB.bone1
+				&& std::abs(keyA.weight - keyB.weight) <= MaxWeightDifference
+				&& a.endflg == b.endflg;
+		}
+
+		double Dot(const double* a, const double* b)
+		{
+			return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+		}
+
+		// 面法線（正規化しない）
+		void TriangleNormal(const XMFLOAT3& p0, const XMFLOAT3& p1, const XMFLOAT3& p2, double* pNormal)
+		{
+			double e1[3] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+			double e2[3] = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+			pNormal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+			pNormal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+			pNormal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+		}
+
+		// 縮約しない頂点を調べる
+		// 同じ座標に別の頂点がある（属性の継ぎ目）か、開いた縁の上にある頂点は動かさない
+		std::vector<bool> FindLockedVertices(
+			const SerializedVertex* pVertices,
+			size_t vertexCount,
+			const unsigned short* pIndices,
+			size_t indexCount)
+		{
+			// 座標ごとの代表頂点
+			std::vector<unsigned short> order(vertexCount);
+			for (size_t i = 0; i < vertexCount; i++) {
+				order[i] = static_cast<unsigned short>(i);
+			}
+			auto less = [&](unsigned short a, unsigned short b) {
+				const auto& pa = pVertices[a].pos;
+				const auto& pb = pVertices[b].pos;
+				if (pa.x != pb.x) return pa.x < pb.x;
+				if (pa.y != pb.y) return pa.y < pb.y;
+				return pa.z < pb.z;
+			};
+			std::sort(order.begin(), order.end(), less);
+
+			std::vector<unsigned short> positionIds(vertexCount);
+			std::vector<bool> locked(vertexCount, false);
+			for (size_t begin = 0; begin < vertexCount;) {
+				auto end = begin + 1;
+				while (end < vertexCount && !less(order[begin], order[end])) {
+					end++;
+				}
+				for (auto i = begin; i < end; i++) {
+					positionIds[order[i]] = order[begin];
+					locked[order[i]] = end - begin > 1;
+				}
+				begin = end;
+			}
+
+			// 逆向きの辺を持たない辺は縁（マテリアルの境界もここに含まれる）
+			std::unordered_set<uint32_t> edges;
+			edges.reserve(indexCount);
+			for (size_t i = 0; i + 3 <= indexCount; i += 3) {
+				for (size_t k = 0; k < 3; k++) {
+					uint32_t a = positionIds[pIndices[i + k]];
+					uint32_t b = positionIds[pIndices[i + (k + 1) % 3]];
+					edges.insert((a << 16) | b);
+				}
+			}
+			for (size_t i = 0; i + 3 <= indexCount; i += 3) {
+				for (size_t k = 0; k < 3; k++) {
+					auto a = pIndices[i + k];
+					auto b = pIndices[i + (k + 1) % 3];
+					uint32_t positionA = positionIds[a];
+					uint32_t positionB = positionIds[b];
+					if (edges.find((positionB << 16) | positionA) == edges.end()) {
+						locked[a] = true;
+						locked[b] = true;
+					}
+				}
+			}
+
+			return locked;
+		}
+
+		// 縮約で同じ頂点を2つ以上参照するようになった三角形を取り除く
+		void RemoveDegenerateTriangles(std::vector<unsigned short>* pIndices)
+		{
+			auto& indices = *pIndices;
+			size_t count = 0;
+			for (size_t i = 0; i + 3 <= indices.size(); i += 3) {
+				auto a = indices[i];
+				auto b = indices[i + 1];
+				auto c = indices[i + 2];
+				if (a == b || b == c || c == a) {
+					continue;
+				}
+				indices[count++] = a;
+				indices[count++] = b;
+				indices[count++] = c;
+			}
+			indices.resize(count);
+		}
+	}
+
+	// 三角形を減らしたインデックス列を作る
+	float SimplifyMesh(
+		const SerializedVertex* pVertices,
+		size_t vertexCount,
+		const unsigned short* pIndices,
+		size_t indexCount,
+		size_t targetIndexCount,
+		float targetError,
+		std::vector<unsigned short>* pResult)
+	{
+		auto& indices = *pResult;
+		indices.assign(pIndices, pIndices + indexCount / 3 * 3);
+		for (auto index : indices) {
+			if (index >= vertexCount) {
+				// 範囲外の頂点を参照しているデータは触らない
+				return 0.0f;
+			}
+		}
+
+		auto locked = FindLockedVertices(pVertices, vertexCount, indices.data(), indices.size());
+
+		// 頂点ごとに周囲の面の平面を面積で重み付けして集める
+		std::vector<Quadric> quadrics(vertexCount, Quadric{});
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			const auto& p0 = pVertices[indices[i]].pos;
+			double normal[3];
+			TriangleNormal(p0, pVertices[indices[i + 1]].pos, pVertices[indices[i + 2]].pos, normal);
+			auto length = std::sqrt(Dot(normal, normal));
+			if (length <= 0.0) {
+				continue;
+			}
+			auto area = length * 0.5;
+			normal[0] /= length;
+			normal[1] /= length;
+			normal[2] /= length;
+			auto d = -(normal[0] * p0.x + normal[1] * p0.y + normal[2] * p0.z);
+			for (size_t k = 0; k < 3; k++) {
+				quadrics[indices[i + k]].AddPlane(normal[0], normal[1], normal[2], d, area);
+			}
+		}
+
+		auto collapseError = [&](unsigned short from, unsigned short to) {
+			auto quadric = quadrics[from];
+			quadric.Add(quadrics[to]);
+			if (quadric.weight <= 0.0) {
+				return 0.0f;
+			}
+			auto error = quadric.Evaluate(pVertices[to].pos) / quadric.weight;
+			return static_cast<float>(std::sqrt(std::max(error, 0.0)));
+		};
+
+		float maxError = 0.0f;
+		std::vector<size_t> triangleOffsets(vertexCount + 1);
+		std::vector<size_t> vertexTriangles;
+		std::vector<Collapse> collapses;
+		std::vector<bool> touched(vertexCount);
+		while (indices.size() > targetIndexCount) {
+			// 頂点ごとの三角形の一覧（CSR形式）
+			std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+			for (auto index : indices) {
+				triangleOffsets[index + 1]++;
+			}
+			for (size_t v = 0; v < vertexCount; v++) {
+				triangleOffsets[v + 1] += triangleOffsets[v];
+			}
+			vertexTriangles.resize(indices.size());
+			{
+				auto fill = triangleOffsets;
+				for (size_t i = 0; i < indices.size(); i++) {
+					vertexTriangles[fill[indices[i]]++] = i / 3;
+				}
+			}
+
+			// 辺ごとの縮約候補を誤差の小さい順に並べる
+			collapses.clear();
+			for (size_t i = 0; i < indices.size(); i += 3) {
+				for (size_t k = 0; k < 3; k++) {
+					auto a = indices[i + k];
+					auto b = indices[i + (k + 1) % 3];
+					for (auto pair : { std::make_pair(a, b), std::make_pair(b, a) }) {
+						if (locked[pair.first] || !IsSkinCompatible(pVertices[pair.first], pVertices[pair.second])) {
+							continue;
+						}
+						auto error = collapseError(pair.first, pair.second);
+						if (error <= targetError) {
+							collapses.push_back({ pair.first, pair.second, error });
+						}
+					}
+				}
+			}
+			if (collapses.empty()) {
+				break;
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+				return a.error < b.error;
+			});
+
+			// 周囲の三角形が重ならない縮約だけを1回の走査でまとめて行う
+			std::fill(touched.begin(), touched.end(), false);
+			auto remainingIndices = indices.size();
+			size_t collapsed = 0;
+			for (const auto& collapse : collapses) {
+				if (remainingIndices <= targetIndexCount) {
+					break;
+				}
+				auto from = collapse.from;
+				auto to = collapse.to;
+				if (touched[from] || touched[to]) {
+					continue;
+				}
+
+				// 寄せた後に裏返る三角形や潰れる三角形があれば縮約しない
+				auto flips = false;
+				size_t removedTriangles = 0;
+				for (auto t = triangleOffsets[from]; t < triangleOffsets[from + 1] && !flips; t++) {
+					const auto* triangle = &indices[vertexTriangles[t] * 3];
+					if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+						removedTriangles++;
+						continue;
+					}
+					XMFLOAT3 before[3];
+					XMFLOAT3 after[3];
+					for (size_t k = 0; k < 3; k++) {
+						before[k] = pVertices[triangle[k]].pos;
+						after[k] = triangle[k] == from ? pVertices[to].pos : before[k];
+					}
+					double normalBefore[3];
+					double normalAfter[3];
+					TriangleNormal(before[0], before[1], before[2], normalBefore);
+					TriangleNormal(after[0], after[1], after[2], normalAfter);
+					auto lengths = std::sqrt(Dot(normalBefore, normalBefore) * Dot(normalAfter, normalAfter));
+					if (Dot(normalBefore, normalAfter) <= MinNormalDot * lengths) {
+						flips = true;
+					}
+				}
+				if (flips || removedTriangles == 0) {
+					continue;
+				}
+
+				for (auto t = triangleOffsets[from]; t < triangleOffsets[from + 1]; t++) {
+					auto* triangle = &indices[vertexTriangles[t] * 3];
+					for (size_t k = 0; k < 3; k++) {
+						touched[triangle[k]] = true;
+						if (triangle[k] == from) {
+							triangle[k] = to;
+						}
+					}
+				}
+				quadrics[to].Add(quadrics[from]);
+				maxError = std::max(maxError, collapse.error);
+				remainingIndices -= removedTriangles * 3;
+				collapsed++;
+			}
+
+			RemoveDegenerateTriangles(&indices);
+			if (collapsed == 0) {
+				break;
+			}
+		}
+
+		return maxError;
+	}
+
+	// 頂点の広がり
+	float GetMeshExtent(const SerializedVertex* pVertices, size_t vertexCount)
+	{
+		if (vertexCount == 0) {
+			return 0.0f;
+		}
+		auto minimum = XMVectorReplicate(FLT_MAX);
+		auto maximum = XMVectorReplicate(-FLT_MAX);
+		for (size_t i = 0; i < vertexCount; i++) {
+			auto position = XMLoadFloat3(&pVertices[i].pos);
+			minimum = XMVectorMin(minimum, position);
+			maximum = XMVectorMax(maximum, position);
+		}
+		return XMVectorGetX(XMVector3Length(XMVectorSubtract(maximum, minimum)));
+	}
+
+	// 投影後の誤差が許容値に収まる最も粗い詳細度を選ぶ
+	size_t SelectLodLevel(const float* pErrors, size_t levelCount, float pixelsPerUnit, float maxPixelError)
+	{
+		size_t level = 0;
+		for (size_t i = 1; i < levelCount; i++) {
+			if (pErrors[i] * pixelsPerUnit > maxPixelError) {
+				break;
+			}
+			level = i;
+		}
+		return level;
+	}
+}
@@ -0,0 +1,34 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "PMDFileFormat.h"
+
+namespace pmd
+{
+	// 詳細度の段数（元のメッシュを含む）
+	constexpr size_t MaxLodLevels = 4;
+
+	// 三角形を減らしたインデックス列を作る（二次誤差による辺の縮約）
+	// 頂点は既存の頂点へ寄せるだけなので、元の頂点バッファーをそのまま使える
+	// 開いた縁、UVなど属性の継ぎ目、ボーンの割り当てが異なる頂点どうしは縮約しない
+	// 戻り値は縮約で生じた誤差の最大値（モデル空間の距離）
+	float SimplifyMesh(
+		const SerializedVertex* pVertices,
+		size_t vertexCount,
+		const unsigned short* pIndices,
+		size_t indexCount,
+		size_t targetIndexCount,
+		float targetError,
+		std::vector<unsigned short>* pResult);
+
+	// 頂点の広がり（包含する軸平行箱の対角線の長さ）
+	float GetMeshExtent(const SerializedVertex* pVertices, size_t vertexCount);
+
+	// 投影後の誤差が許容値に収まる最も粗い詳細度を選ぶ
+	// pixelsPerUnitはモデルの位置でのモデル空間1単位あたりの画素数、pErrorsは段ごとの誤差（昇順）
+	size_t SelectLodLevel(const float* pErrors, size_t levelCount, float pixelsPerUnit, float maxPixelError);
+}
@@ -0,0 +1,197 @@
+﻿#include "PMDMeshletBuilder.h"
+
+// std
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace pmd
+{
+	using namespace DirectX;
+
+	namespace
+	{
+		// 包含球と法線コーンを計算する
+		void ComputeMeshletBounds(
+			const SerializedVertex* pVertices,
+			const uint16_t* pMeshletVertices,
+			const uint8_t* pMeshletTriangles,
+			CookedMeshlet* pMeshlet)
+		{
+			auto& meshlet = *pMeshlet;
+
+			// 包含球: AABBの中心から最も遠い頂点まで
+			auto minimum = XMVectorReplicate(FLT_MAX);
+			auto maximum = XMVectorReplicate(-FLT_MAX);
+			for (size_t i = 0; i < meshlet.vertexCount; i++) {
+				auto position = XMLoadFloat3(&pVertices[pMeshletVertices[i]].pos);
+				minimum = XMVectorMin(minimum, position);
+				maximum = XMVectorMax(maximum, position);
+			}
+			auto center = XMVectorScale(XMVectorAdd(minimum, maximum), 0.5f);
+			auto radius = 0.0f;
+			for (size_t i = 0; i < meshlet.vertexCount; i++) {
+				auto position = XMLoadFloat3(&pVertices[pMeshletVertices[i]].pos);
+				radius = std::max(radius, XMVectorGetX(XMVector3Length(XMVectorSubtract(position, center))));
+			}
+			XMStoreFloat3(&meshlet.center, center);
+			meshlet.radius = radius;
+
+			// 法線コーン: 面法線の平均を軸にし、最も開いた面との角度を求める
+			std::vector<XMVECTOR> normals;
+			normals.reserve(meshlet.triangleCount);
+			std::vector<XMVECTOR> corners;
+			corners.reserve(meshlet.triangleCount);
+			auto axis = XMVectorZero();
+			for (size_t t = 0; t < meshlet.triangleCount; t++) {
+				const auto* triangle = pMeshletTriangles + t * 3;
+				auto p0 = XMLoadFloat3(&pVertices[pMeshletVertices[triangle[0]]].pos);
+				auto p1 = XMLoadFloat3(&pVertices[pMeshletVertices[triangle[1]]].pos);
+				auto p2 = XMLoadFloat3(&pVertices[pMeshletVertices[triangle[2]]].pos);
+				auto normal = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+				auto length = XMVectorGetX(XMVector3Length(normal));
+				if (length <= 0.0f) {
+					// 縮退した三角形は向きを持たない
+					continue;
+				}
+				normal = XMVectorScale(normal, 1.0f / length);
+				normals.emplace_back(normal);
+				corners.emplace_back(p0);
+				axis = XMVectorAdd(axis, normal);
+			}
+
+			meshlet.coneAxis = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			meshlet.coneCutoff = 1.0f;
+			meshlet.coneApex = meshlet.center;
+			auto axisLength = XMVectorGetX(XMVector3Length(axis));
+			if (normals.empty() || axisLength <= 0.0f) {
+				return;
+			}
+			axis = XMVectorScale(axis, 1.0f / axisLength);
+
+			auto minDot = 1.0f;
+			for (const auto& normal : normals) {
+				minDot = std::min(minDot, XMVectorGetX(XMVector3Dot(axis, normal)));
+			}
+			XMStoreFloat3(&meshlet.coneAxis, axis);
+
+			// 90°近く開いたコーンでは裏面判定がほとんど成立しないので使わない
+			if (minDot <= 0.1f) {
+				return;
+			}
+
+			// 頂点はすべての面の平面より軸の後ろ側に置く
+			auto maxT = 0.0f;
+			for (size_t i = 0; i < normals.size(); i++) {
+				auto distance = XMVectorGetX(XMVector3Dot(XMVectorSubtract(center, corners[i]), normals[i]));
+				auto along = XMVectorGetX(XMVector3Dot(axis, normals[i]));
+				maxT = std::max(maxT, distance / along);
+			}
+			XMStoreFloat3(&meshlet.coneApex, XMVectorSubtract(center, XMVectorScale(axis, maxT)));
+
+			// 法線コーンの半角aに対して、視線コーンの判定値はcos(a + 90°)の符号反転 = sin(a)
+			meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+		}
+	}
+
+	// インデックス範囲をメッシュレットに分割して末尾に追加する
+	void BuildMeshlets(
+		const SerializedVertex* pVertices,
+		size_t vertexCount,
+		const unsigned short* pIndices,
+		size_t indexCount,
+		std::vector<CookedMeshlet>* pMeshlets,
+		std::vector<uint16_t>* pMeshletVertices,
+		std::vector<uint8_t>* pMeshletTriangles)
+	{
+		constexpr uint8_t Unused = 0xff;
+		std::vector<uint8_t> localIndices(vertexCount, Unused);
+
+		CookedMeshlet meshlet = {};
+		auto beginMeshlet = [&]() {
+			meshlet = {};
+			meshlet.vertexOffset = static_cast<uint32_t>(pMeshletVertices->size());
+			meshlet.triangleOffset = static_cast<uint32_t>(pMeshletTriangles->size());
+		};
+		auto endMeshlet = [&]() {
+			if (meshlet.triangleCount == 0) {
+				return;
+			}
+			ComputeMeshletBounds(
+				pVertices,
+				pMeshletVertices->data() + meshlet.vertexOffset,
+				pMeshletTriangles->data() + meshlet.triangleOffset,
+				&meshlet);
+			pMeshlets->emplace_back(meshlet);
+			for (size_t i = 0; i < meshlet.vertexCount; i++) {
+				localIndices[(*pMeshletVertices)[meshlet.vertexOffset + i]] = Unused;
+			}
+		};
+
+		beginMeshlet();
+		for (size_t t = 0; t + 3 <= indexCount; t += 3) {
+			const auto* triangle = pIndices + t;
+			if (triangle[0] >= vertexCount || triangle[1] >= vertexCount || triangle[2] >= vertexCount) {
+				continue;
+			}
+
+			// 入りきらなければ新しいメッシュレットへ
+			size_t newVertices = 0;
+			for (size_t k = 0; k < 3; k++) {
+				if (localIndices[triangle[k]] == Unused
+					&& (k < 1 || triangle[k] != triangle[0])
+					&& (k < 2 || triangle[k] != triangle[1]))
+				{
+					newVertices++;
+				}
+			}
+			if (meshlet.vertexCount + newVertices > MaxMeshletVertices
+				|| meshlet.triangleCount + 1u > MaxMeshletTriangles)
+			{
+				endMeshlet();
+				beginMeshlet();
+			}
+
+			for (size_t k = 0; k < 3; k++) {
+				auto& local = localIndices[triangle[k]];
+				if (local == Unused) {
+					local = static_cast<uint8_t>(meshlet.vertexCount++);
+					pMeshletVertices->emplace_back(triangle[k]);
+				}
+				pMeshletTriangles->emplace_back(local);
+			}
+			meshlet.triangleCount++;
+		}
+		endMeshlet();
+	}
+
+	// メッシュレットの充填率を集計
+	MeshletStatistics AnalyzeMeshlets(const CookedMeshlet* pMeshlets, size_t meshletCount)
+	{
+		MeshletStatistics statistics = {};
+		statistics.meshletCount = meshletCount;
+		if (meshletCount == 0) {
+			return statistics;
+		}
+
+		size_t vertices = 0;
+		size_t triangles = 0;
+		for (size_t i = 0; i < meshletCount; i++) {
+			vertices += pMeshlets[i].vertexCount;
+			triangles += pMeshlets[i].triangleCount;
+		}
+		statistics.vertexFill = static_cast<float>(vertices) / (MaxMeshletVertices * meshletCount);
+		statistics.triangleFill = static_cast<float>(triangles) / (MaxMeshletTriangles * meshletCount);
+		return statistics;
+	}
+
+	// 法線コーンによる裏面判定
+	bool IsMeshletBackfacing(const CookedMeshlet& meshlet, const DirectX::XMFLOAT3& cameraPosition)
+	{
+		if (meshlet.coneCutoff >= 1.0f) {
+			return false;
+		}
+		auto view = XMVector3Normalize(XMVectorSubtract(XMLoadFloat3(&meshlet.coneApex), XMLoadFloat3(&cameraPosition)));
+		return XMVectorGetX(XMVector3Dot(view, XMLoadFloat3(&meshlet.coneAxis))) >= meshlet.coneCutoff;
+	}
+}
@@ -0,0 +1,60 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// DirectX
+#include <DirectXMath.h>
+
+#include "PMDFileFormat.h"
+
+namespace pmd
+{
+	// メッシュレットの上限（メッシュシェーダーで一般的な値）
+	constexpr size_t MaxMeshletVertices = 64;
+	constexpr size_t MaxMeshletTriangles = 124;
+
+	// メッシュレット
+	// 頂点はMeshletVertices、三角形はMeshletTriangles（メッシュレット内の頂点番号3つ）を参照する
+	struct CookedMeshlet
+	{
+		DirectX::XMFLOAT3 center;		// 包含球
+		float radius;
+		DirectX::XMFLOAT3 coneAxis;		// 法線コーン
+		float coneCutoff;				// 法線がまとまっていなければ1（裏面判定に使えない）
+		DirectX::XMFLOAT3 coneApex;
+		uint32_t vertexOffset;			// MeshletVertices上の先頭
+		uint32_t triangleOffset;		// MeshletTriangles上の先頭（バイト単位）
+		uint16_t vertexCount;
+		uint16_t triangleCount;
+		uint32_t reserved[2];
+	};
+	static_assert(sizeof(CookedMeshlet) == 64, "CookedMeshlet must be 64 bytes");
+
+	// メッシュレットの充填率
+	struct MeshletStatistics
+	{
+		size_t meshletCount;
+		float vertexFill;	// 平均頂点数 / MaxMeshletVertices
+		float triangleFill;	// 平均三角形数 / MaxMeshletTriangles
+	};
+
+	// インデックス範囲をメッシュレットに分割して末尾に追加する
+	// 三角形は渡された順に詰めるので、頂点キャッシュ最適化済みの並びで呼ぶと局所性が良くなる
+	void BuildMeshlets(
+		const SerializedVertex* pVertices,
+		size_t vertexCount,
+		const unsigned short* pIndices,
+		size_t indexCount,
+		std::vector<CookedMeshlet>* pMeshlets,
+		std::vector<uint16_t>* pMeshletVertices,
+		std::vector<uint8_t>* pMeshletTriangles);
+
+	// メッシュレットの充填率を集計
+	MeshletStatistics AnalyzeMeshlets(const CookedMeshlet* pMeshlets, size_t meshletCount);
+
+	// 法線コーンによる裏面判定（両面描画のマテリアルには使えない）
+	bool IsMeshletBackfacing(const CookedMeshlet& meshlet, const DirectX::XMFLOAT3& cameraPosition);
+}
@@ -0,0 +1,433 @@
+﻿#include "PMDModel.h"
+
+// std
+#include <cfloat>
+#include <cstring>
+#include <set>
+#include <vector>
+
+// DirectX
+#include <d3dx12.h>
+
+#include "utils.h"
+
+namespace pmd
+{
+	using namespace Microsoft::WRL;
+
+	// PMD頂点レイアウト
+	const std::vector<D3D12_INPUT_ELEMENT_DESC> PMDModel::InputLayout = {
+		{ // 座標
+			"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,
+			D3D12_APPEND_ALIGNED_ELEMENT,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
+		},
+		{ // 法線
+			"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,
+			D3D12_APPEND_ALIGNED_ELEMENT,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
+		},
+		{ // UV
+			"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0,
+			D3D12_APPEND_ALIGNED_ELEMENT,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
+		},
+		{
+			"BONE_NO", 0, DXGI_FORMAT_R16G16_UINT, 0,
+			D3D12_APPEND_ALIGNED_ELEMENT,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
+		},
+		{
+			"WEIGHT", 0, DXGI_FORMAT_R8_UINT, 0,
+			D3D12_APPEND_ALIGNED_ELEMENT,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
+		},
+		{
+			"EDGE_FLAG", 0, DXGI_FORMAT_R8_UINT, 0,
+			D3D12_APPEND_ALIGNED_ELEMENT,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
+		},
+	};
+
+	// コンストラクター
+	PMDModel::PMDModel() :
+		_pmdSignature{}, _pmdHeader(),
+		_vertexBuffer(nullptr), _vertexBufferView{}, _vertexFormat(PMDVertexFormat::Standard),
+		_indexBuffer(nullptr), _indexBufferView{},
+		_lodFirstIndices{}, _lodErrors{}, _boundingCenter(0.0f, 0.0f, 0.0f), _boundingRadius(0.0f),
+		_materialBuffer(nullptr), _materialDescHeap(nullptr), _meshes{}, _bonePalettes(), _paletteBones(),
+		_numberOfBone(0), _boneNodes(), _boneNameTable(), _skeleton(), _ikSolver(), _morphSet()
+	{
+	}
+
+	// デストラクター
+	PMDModel::~PMDModel()
+	{
+	}
+
+	// PMDファイルからの読み込み
+	HRESULT PMDModel::LoadFromFile(
+		ID3D12Device* const pD3D12Device,
+		D3D12ResourceCache* const pResourceCache,
+		const std::wstring& filename,
+		const std::wstring& toonTexturePath,
+		PMDVertexFormat preferredVertexFormat)
+	{
+		PreparedData data;
+		auto result = Prepare(pResourceCache, filename, toonTexturePath, preferredVertexFormat, &data);
+		if (FAILED(result))
+		{
+			return result;
+		}
+		return CreateFromPreparedData(pD3D12Device, pResourceCache, data);
+	}
+
+	// 読み込みの前半
+	HRESULT PMDModel::Prepare(
+		const D3D12ResourceCache* const pResourceCache,
+		const std::wstring& filename,
+		const std::wstring& toonTexturePath,
+		PMDVertexFormat preferredVertexFormat,
+		PreparedData* const pData)
+	{
+		pData->filename = filename;
+
+		// 調理済みキャッシュを読み込む（古いか存在しなければPMDファイルから作り直す）
+		auto& cookedModel = pData->cookedModel;
+		if (!cookedModel.LoadOrCook(filename, toonTexturePath)) {
+			return E_FAIL;
+		}
+
+		// 頂点の圧縮（パレットに分けたモデルのボーン番号はパレット上の位置）
+		const auto& vertices = cookedModel.GetVertices();
+		auto numberOfPaletteBone = cookedModel.GetBonePalettes().empty() ? cookedModel.GetBones().size() : MaxPaletteBones;
+		pData->vertexFormat = PMDVertexFormat::Standard;
+		if (preferredVertexFormat == PMDVertexFormat::Packed
+			&& CanPackVertices(vertices, numberOfPaletteBone))
+		{
+			pData->vertexFormat = PMDVertexFormat::Packed;
+			pData->packedVertices.resize(vertices.size());
+			PackVertices(vertices.data(), vertices.size(), pData->packedVertices.data());
+		}
+
+		// マテリアルが参照するテクスチャーをデコードしておく
+		std::set<std::wstring> paths;
+		for (const auto& material : cookedModel.GetMaterials()) {
+			for (auto offset : material.texturePaths) {
+				auto path = cookedModel.GetString(offset);
+				if (path) {
+					paths.insert(GetWStringFromUTF8(path, std::strlen(path)));
+				}
+			}
+		}
+		for (const auto& path : paths) {
+			std::unique_ptr<DecodedTexture> texture(new DecodedTexture());
+			texture->path = path;
+			texture->metadata = {};
+			texture->result = pResourceCache->DecodeTextureFile(path, &texture->metadata, texture->image);
+			pData->textures.emplace_back(std::move(texture));
+		}
+
+		return S_OK;
+	}
+
+	// 読み込みの後半
+	HRESULT PMDModel::CreateFromPreparedData(
+		ID3D12Device* const pD3D12Device,
+		D3D12ResourceCache* const pResourceCache,
+		const PreparedData& data)
+	{
+		HRESULT result;
+		const auto& cookedModel = data.cookedModel;
+
+		// デコード済みのテクスチャーをキャッシュに登録（メッシュはキャッシュから引く）
+		for (const auto& texture : data.textures) {
+			if (FAILED(texture->result)) {
+				wprintf(L"load failed. : %s\n", texture->path.c_str());
+				continue;
+			}
+			pResourceCache->CreateTextureFromImage(texture->path, texture->metadata, texture->image);
+		}
+
+		// シグネチャーとヘッダー情報
+		std::memcpy(_pmdSignature, "Pmd", sizeof(_pmdSignature));
+		_pmdHeader = cookedModel.GetHeader();
+
+		// 頂点バッファーの生成（マップしたファイルからアップロードヒープへ直接コピー）
+		_vertexFormat = data.vertexFormat;
+		if (_vertexFormat == PMDVertexFormat::Packed) {
+			result = CreateVertexBuffer(
+				pD3D12Device, data.packedVertices.data(),
+				sizeof(PackedVertex) * data.packedVertices.size(), sizeof(PackedVertex));
+		}
+		else {
+			const auto& vertices = cookedModel.GetVertices();
+			result = CreateVertexBuffer(pD3D12Device, vertices.data(), vertices.size_bytes(), sizeof(SerializedVertex));
+		}
+		if (FAILED(result))
+		{
+			return result;
+		}
+
+		// インデックスバッファーの生成（元のメッシュの後ろに詳細度1以降を並べる）
+		const auto& indices = cookedModel.GetIndices();
+		result = CreateIndexBuffer(pD3D12Device, indices, cookedModel.GetLodIndices());
+		if (FAILED(result))
+		{
+			return result;
+		}
+		_lodFirstIndices.assign(1, 0);
+		_lodErrors.assign(1, 0.0f);
+		for (const auto& lodLevel : cookedModel.GetLodLevels()) {
+			_lodFirstIndices.emplace_back(static_cast<UINT>(indices.size() + lodLevel.firstIndex));
+			_lodErrors.emplace_back(lodLevel.error);
+		}
+
+		// 詳細度の選択と可視判定に使う中心と半径
+		{
+			const auto& vertices = cookedModel.GetVertices();
+			auto minimum = DirectX::XMVectorReplicate(FLT_MAX);
+			auto maximum = DirectX::XMVectorReplicate(-FLT_MAX);
+			for (const auto& vertex : vertices) {
+				auto position = DirectX::XMLoadFloat3(&vertex.pos);
+				minimum = DirectX::XMVectorMin(minimum, position);
+				maximum = DirectX::XMVectorMax(maximum, position);
+			}
+			if (!vertices.empty()) {
+				DirectX::XMStoreFloat3(&_boundingCenter, DirectX::XMVectorScale(DirectX::XMVectorAdd(minimum, maximum), 0.5f));
+				_boundingRadius = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(maximum, minimum))) * 0.5f;
+			}
+		}
+
+		// メッシュ情報の読み込み
+		auto numberOfMesh = static_cast<unsigned int>(cookedModel.GetMaterials().size());
+		_meshes.resize(numberOfMesh);
+		for (auto i = 0u; i < numberOfMesh; i++) {
+			result = _meshes[i].LoadFromCookedData(pResourceCache, cookedModel, i);
+			if (FAILED(result)) {
+				return result;
+			}
+#ifdef _DEBUG
+			printf("mesh[%d]:", i);
+#endif // _DEBUG
+		}
+#ifdef _DEBUG
+		printf("\n");
+#endif // _DEBUG
+
+		// ボーンパレット
+		_bonePalettes.assign(cookedModel.GetBonePalettes().begin(), cookedModel.GetBonePalettes().end());
+		_paletteBones.assign(cookedModel.GetPaletteBones().begin(), cookedModel.GetPaletteBones().end());
+
+		// マテリアルのバッファーを作成
+		result = CreateMaterialBuffers(pD3D12Device, pResourceCache, cookedModel.GetMaterialConstants(), numberOfMesh);
+		if (FAILED(result))
+		{
+			return result;
+		}
+
+		// ボーン情報の読み込み
+		const auto& boneData = cookedModel.GetBones();
+		auto numberOfBone = static_cast<unsigned short>(boneData.size());
+		printf("boneNum = %d\n", numberOfBone);
+
+		// ボーンノードをボーン番号順に並べる（名前からは調理済みのハッシュ表で引く）
+		_boneNodes.resize(numberOfBone);
+		for (int i = 0; i < numberOfBone; i++)
+		{
+			const auto& bone = boneData[i];
+			std::string boneName(bone.boneName, strnlen(bone.boneName, sizeof(bone.boneName)));
+			printf("boneName = %s\n", boneName.c_str());
+			auto& node = _boneNodes[i];
+			node.boneIdx = i;
+			node.startPos = bone.pos;
+		}
+		_boneNameTable.Assign(boneData, cookedModel.GetBoneNameSlots());
+
+		// 親子関係（調理時に親が子より先に並べてある）
+		_skeleton.Assign(boneData);
+
+		// IK（ボーン番号は調理時に付け替えてある）
+		_ikSolver.Assign(_skeleton, cookedModel.GetIKChains(), cookedModel.GetIKNodes());
+
+		// 表情（頂点番号は調理時に付け替えてある）
+		_morphSet.Assign(cookedModel.GetMorphs(), cookedModel.GetMorphVertices());
+
+		_numberOfBone = numberOfBone;
+
+		// ロードしたモデルのパスを一応保持
+		m_loadedModelPath = data.filename;
+
+		return S_OK;
+	}
+
+	// 頂点バッファーの作成
+	HRESULT PMDModel::CreateVertexBuffer(ID3D12Device* const pD3D12Device, const void* pVertices, size_t sizeInBytes, UINT strideInBytes)
+	{
+		HRESULT result;
+
+		result = pD3D12Device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(sizeInBytes), D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr, IID_PPV_ARGS(_vertexBuffer.ReleaseAndGetAddressOf())
+		);
+		if (FAILED(result)) {
+			return result;
+		}
+
+		unsigned char* mappedVertex = nullptr;
+		result = _vertexBuffer->Map(0, nullptr, (void**)&mappedVertex);
+		if (FAILED(result)) {
+			return result;
+		}
+		std::memcpy(mappedVertex, pVertices, sizeInBytes);
+		_vertexBuffer->Unmap(0, nullptr);
+		mappedVertex = nullptr;
+
+		_vertexBufferView.BufferLocation = _vertexBuffer->GetGPUVirtualAddress();
+		_vertexBufferView.SizeInBytes = static_cast<UINT>(sizeInBytes);
+		_vertexBufferView.StrideInBytes = strideInBytes;
+
+		return S_OK;
+	}
+
+	// インデックスバッファーの作成
+	HRESULT PMDModel::CreateIndexBuffer(
+		ID3D12Device* const pD3D12Device,
+		const ArrayView<unsigned short>& indices,
+		const ArrayView<unsigned short>& lodIndices)
+	{
+		HRESULT result;
+
+		auto sizeInBytes = indices.size_bytes() + lodIndices.size_bytes();
+		result = pD3D12Device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(sizeInBytes), D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr, IID_PPV_ARGS(_indexBuffer.ReleaseAndGetAddressOf())
+		);
+		if (FAILED(result)) {
+			return result;
+		}
+
+		unsigned short* mappedIndex = nullptr;
+		result = _indexBuffer->Map(0, nullptr, (void**)&mappedIndex);
+		if (FAILED(result)) {
+			return result;
+		}
+		std::memcpy(mappedIndex, indices.data(), indices.size_bytes());
+		std::memcpy(mappedIndex + indices.size(), lodIndices.data(), lodIndices.size_bytes());
+		_indexBuffer->Unmap(0, nullptr);
+		mappedIndex = nullptr;
+
+		_indexBufferView.BufferLocation = _indexBuffer->GetGPUVirtualAddress();
+		_indexBufferView.Format = DXGI_FORMAT_R16_UINT;
+		_indexBufferView.SizeInBytes = static_cast<UINT>(sizeInBytes);
+
+		return S_OK;
+	}
+
+	// メッシュ単位で参照されるマテリアルバッファーの作成
+	HRESULT PMDModel::CreateMaterialBuffers(
+		ID3D12Device* const pD3D12Device,
+		D3D12ResourceCache* const pResourceCache,
+		const ArrayView<unsigned char>& materialConstants,
+		unsigned int numberOfMesh
+	) {
+		HRESULT result;
+		// 調理済みの定数は256バイト境界に並んでいる
+		auto materialBufferSize = MaterialConstantsStride;
+		result = pD3D12Device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(materialBufferSize * numberOfMesh),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr, IID_PPV_ARGS(_materialBuffer.ReleaseAndGetAddressOf())
+		);
+		if (FAILED(result)) {
+			return result;
+		}
+
+		unsigned char* pMappedMaterial = nullptr;
+		result = _materialBuffer->Map(0, nullptr, (void**)&pMappedMaterial);
+		if (FAILED(result)) {
+			return result;
+		}
+		std::memcpy(pMappedMaterial, materialConstants.data(), materialConstants.size_bytes());
+		_materialBuffer->Unmap(0, nullptr);
+		pMappedMaterial = nullptr;
+
+		D3D12_DESCRIPTOR_HEAP_DESC matDescHeapDesc = {};
+		matDescHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+		matDescHeapDesc.NodeMask = 0;
+		matDescHeapDesc.NumDescriptors = numberOfMesh * (1 + NUMBER_OF_TEXTURE);
+		matDescHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+		result = pD3D12Device->CreateDescriptorHeap(&matDescHeapDesc, IID_PPV_ARGS(_materialDescHeap.ReleaseAndGetAddressOf()));
+		if (FAILED(result)) {
+			return result;
+		}
+
+		D3D12_CONSTANT_BUFFER_VIEW_DESC matCBVDesc = {};
+		matCBVDesc.BufferLocation = _materialBuffer->GetGPUVirtualAddress();
+		matCBVDesc.SizeInBytes = static_cast<UINT>(materialBufferSize);
+
+		auto matDescHeapH = _materialDescHeap->GetCPUDescriptorHandleForHeapStart();
+		auto incSize = pD3D12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		for (auto i = 0u; i < numberOfMesh; i++) {
+			pD3D12Device->CreateConstantBufferView(&matCBVDesc, matDescHeapH);
+			matCBVDesc.BufferLocation += materialBufferSize;
+			matDescHeapH.ptr += incSize;
+			_meshes[i].CreateMaterialTextureViews(pD3D12Device, pResourceCache, &matDescHeapH);
+		}
+
+		return S_OK;
+	}
+
+	// 名前からボーンを検索
+	const PMDModel::BoneNode* PMDModel::FindBoneNode(const std::string& boneName) const
+	{
+		auto boneIdx = _boneNameTable.Find(boneName);
+		if (boneIdx == PMDBoneNameTable::NotFound) {
+			return nullptr;
+		}
+		return &_boneNodes[boneIdx];
+	}
+
+	// メッシュの描画
+	void PMDModel::Draw(
+		ID3D12Device* const pD3D12Device,
+		ID3D12GraphicsCommandList* const pCommandList,
+		const D3D12_GPU_VIRTUAL_ADDRESS* pPaletteAddresses,
+		size_t lodLevel) const
+	{
+		if (lodLevel >= _lodFirstIndices.size()) {
+			lodLevel = 0;
+		}
+
+		pCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		pCommandList->IASetVertexBuffers(0, 1, &_vertexBufferView);
+		pCommandList->IASetIndexBuffer(&_indexBufferView);
+
+		ID3D12DescriptorHeap* materialDescHeap[] = { _materialDescHeap.Get() };
+		pCommandList->SetDescriptorHeaps(1, materialDescHeap);
+
+		auto gpuDescHandle = materialDescHeap[0]->GetGPUDescriptorHandleForHeapStart();
+		auto handleIncSize = pD3D12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		handleIncSize *= (1 + NUMBER_OF_TEXTURE);
+		unsigned int idxOffset = _lodFirstIndices[lodLevel];
+		auto currentPalette = GetPaletteCount();
+		for (const auto& mesh : _meshes) {
+			auto indicesNum = mesh.GetIndicesNum(lodLevel);
+			if (indicesNum > 0) {
+				if (mesh.GetPaletteIdx() != currentPalette) {
+					currentPalette = mesh.GetPaletteIdx();
+					pCommandList->SetGraphicsRootConstantBufferView(1, pPaletteAddresses[currentPalette]);
+				}
+				pCommandList->SetGraphicsRootDescriptorTable(2, gpuDescHandle);
+				pCommandList->DrawIndexedInstanced(indicesNum, 1, idxOffset, 0, 0);
+			}
+			gpuDescHandle.ptr += handleIncSize;
+			idxOffset += indicesNum;
+		}
+	}
+
+}
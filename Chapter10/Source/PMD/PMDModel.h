@@ -0,0 +1,263 @@
+﻿#pragma once
+
+// std
+#include <memory>
+#include <string>
+#include <vector>
+
+// Windows
+#include <Windows.h>
+#include <wrl.h>
+
+// DirectX
+#include <d3d12.h>
+#include <DirectXMath.h>
+#include <DirectXTex.h>
+
+#include "ArrayView.h"
+#include "D3D12/D3D12ResourceCache.h"
+#include "PMDBoneNameTable.h"
+#include "PMDCookedModel.h"
+#include "PMDFileFormat.h"
+#include "PMDIKSolver.h"
+#include "PMDMesh.h"
+#include "PMDMorphEngine.h"
+#include "PMDSkeleton.h"
+#include "PMDVertexPacking.h"
+
+namespace pmd
+{
+	// 複数のアクターで共有するモデルデータ
+	// ジオメトリー、マテリアル、スケルトンを持ち、読み込み後は変更しない
+	class PMDModel
+	{
+	public:
+		// 頂点レイアウト
+		static const std::vector<D3D12_INPUT_ELEMENT_DESC> InputLayout;
+
+		// シェーダーリソース用テクスチャーの数
+		static constexpr size_t NUMBER_OF_TEXTURE = 4;
+
+		// ボーン（階層はPMDSkeletonが持つ）
+		struct BoneNode
+		{
+			int boneIdx;
+			DirectX::XMFLOAT3 startPos;
+			DirectX::XMFLOAT3 endPos;
+		};
+
+		// デコード済みのテクスチャー
+		struct DecodedTexture
+		{
+			std::wstring path;
+			HRESULT result;
+			DirectX::TexMetadata metadata;
+			DirectX::ScratchImage image;
+		};
+
+		// デバイスに触れずに準備できるデータ（ファイルの解釈とテクスチャーのデコード）
+		struct PreparedData
+		{
+			std::wstring filename;
+			PMDCookedModel cookedModel;
+			PMDVertexFormat vertexFormat;
+			std::vector<PackedVertex> packedVertices;	// vertexFormatがPackedの場合の頂点
+			std::vector<std::unique_ptr<DecodedTexture>> textures;
+		};
+
+		PMDModel();
+		virtual ~PMDModel();
+
+		PMDModel(const PMDModel&) = delete;
+		PMDModel& operator=(const PMDModel&) = delete;
+
+		HRESULT LoadFromFile(
+			ID3D12Device* const pD3D12Device,
+			D3D12ResourceCache* const resourceCache,
+			const std::wstring& filename,
+			const std::wstring& toonTexturePath,
+			PMDVertexFormat preferredVertexFormat = PMDVertexFormat::Standard);
+
+		// 読み込みの前半（ワーカースレッドから呼んでよい）
+		// 圧縮頂点を希望してもボーン番号（パレット上の位置）が8ビットに収まらなければ通常の頂点になる
+		static HRESULT Prepare(
+			const D3D12ResourceCache* const pResourceCache,
+			const std::wstring& filename,
+			const std::wstring& toonTexturePath,
+			PMDVertexFormat preferredVertexFormat,
+			PreparedData* const pData);
+
+		// 読み込みの後半（GPUリソースの生成。デバイスを所有するスレッドから呼ぶ）
+		HRESULT CreateFromPreparedData(
+			ID3D12Device* const pD3D12Device,
+			D3D12ResourceCache* const pResourceCache,
+			const PreparedData& data);
+
+		// ジオメトリーとマテリアルを設定してメッシュを描画
+		// pPaletteAddressesはボーンパレットごとの変換行列の定数バッファー（アクターが用意する）。メッシュのパレットが変わるときだけ設定し直す
+		void Draw(
+			ID3D12Device* const pD3D12Device,
+			ID3D12GraphicsCommandList* const pCommandList,
+			const D3D12_GPU_VIRTUAL_ADDRESS* pPaletteAddresses,
+			size_t lodLevel = 0) const;
+
+		// 詳細度の段数（元のメッシュを含む）
+		size_t GetLodCount() const
+		{
+			return _lodErrors.size();
+		}
+
+		// 投影後の誤差が許容値に収まる最も粗い詳細度を選ぶ
+		// pixelsPerUnitはモデルの位置でのモデル空間1単位あたりの画素数
+		size_t SelectLod(float pixelsPerUnit, float maxPixelError) const
+		{
+			return SelectLodLevel(_lodErrors.data(), _lodErrors.size(), pixelsPerUnit, maxPixelError);
+		}
+
+		// 頂点を包含する軸平行箱の中心（モデル空間）
+		const DirectX::XMFLOAT3& GetBoundingCenter() const
+		{
+			return _boundingCenter;
+		}
+
+		// 頂点を包含する軸平行箱の対角線の半分（初期姿勢のモデル全体を包む球の半径）
+		float GetBoundingRadius() const
+		{
+			return _boundingRadius;
+		}
+
+		// ボーンパレット（空なら全ボーンが1つのパレットに番号順で収まる）
+		const std::vector<CookedBonePalette>& GetBonePalettes() const
+		{
+			return _bonePalettes;
+		}
+
+		// パレット上の位置ごとのボーン番号
+		const std::vector<uint16_t>& GetPaletteBones() const
+		{
+			return _paletteBones;
+		}
+
+		// ボーンパレットの数（分けていなければ1）
+		size_t GetPaletteCount() const
+		{
+			return _bonePalettes.empty() ? 1 : _bonePalettes.size();
+		}
+
+		// ヘッダー情報
+		const PMDHeader& GetHeader() const
+		{
+			return _pmdHeader;
+		}
+
+		// ロードしたファイル名
+		const std::wstring& GetLoadedModelPath() const
+		{
+			return m_loadedModelPath;
+		}
+
+		// 頂点バッファーの形式
+		PMDVertexFormat GetVertexFormat() const
+		{
+			return _vertexFormat;
+		}
+
+		// ボーン数
+		size_t GetNumberOfBone() const
+		{
+			return _numberOfBone;
+		}
+
+		// 名前からボーン番号を検索（見つからなければPMDBoneNameTable::NotFound）
+		uint16_t FindBoneIndex(const std::string& boneName) const
+		{
+			return _boneNameTable.Find(boneName);
+		}
+
+		// ボーン名の表（モーションのボーン名の解決用）
+		const PMDBoneNameTable& GetBoneNameTable() const
+		{
+			return _boneNameTable;
+		}
+
+		// 名前からボーンを検索（見つからなければnullptr）
+		const BoneNode* FindBoneNode(const std::string& boneName) const;
+
+		// ボーンの階層
+		const PMDSkeleton& GetSkeleton() const
+		{
+			return _skeleton;
+		}
+
+		// IK
+		const PMDIKSolver& GetIKSolver() const
+		{
+			return _ikSolver;
+		}
+
+		// 表情
+		const PMDMorphSet& GetMorphSet() const
+		{
+			return _morphSet;
+		}
+
+	private:
+		// ロードしたファイル名
+		std::wstring m_loadedModelPath;
+
+		// シグネチャー情報
+		char _pmdSignature[3];
+
+		// ヘッダー情報
+		PMDHeader _pmdHeader;
+
+		// 頂点バッファー
+		Microsoft::WRL::ComPtr<ID3D12Resource> _vertexBuffer;
+		D3D12_VERTEX_BUFFER_VIEW _vertexBufferView;
+		PMDVertexFormat _vertexFormat;
+
+		// インデックスバッファー
+		Microsoft::WRL::ComPtr<ID3D12Resource> _indexBuffer;
+		D3D12_INDEX_BUFFER_VIEW _indexBufferView;
+
+		// 詳細度ごとのインデックスバッファー上の先頭と誤差（0は元のメッシュ）
+		std::vector<UINT> _lodFirstIndices;
+		std::vector<float> _lodErrors;
+		DirectX::XMFLOAT3 _boundingCenter;
+		float _boundingRadius;
+
+		// マテリアルバッファー
+		Microsoft::WRL::ComPtr<ID3D12Resource> _materialBuffer;
+		Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> _materialDescHeap;
+
+		// インデックスとマテリアルを参照して描画の単位となるメッシュ
+		std::vector<PMDMesh> _meshes;
+
+		// ボーンパレット（1回の描画で参照できるボーン数を超えるモデルだけ）
+		std::vector<CookedBonePalette> _bonePalettes;
+		std::vector<uint16_t> _paletteBones;
+
+		// ボーン
+		size_t _numberOfBone;
+		std::vector<BoneNode> _boneNodes;		// ボーン番号順
+		PMDBoneNameTable _boneNameTable;
+		PMDSkeleton _skeleton;
+		PMDIKSolver _ikSolver;
+
+		// 表情
+		PMDMorphSet _morphSet;
+
+	private:
+		HRESULT CreateVertexBuffer(ID3D12Device* const pD3D12Device, const void* pVertices, size_t sizeInBytes, UINT strideInBytes);
+		HRESULT CreateIndexBuffer(
+			ID3D12Device* const pD3D12Device,
+			const ArrayView<unsigned short>& indices,
+			const ArrayView<unsigned short>& lodIndices);
+		HRESULT CreateMaterialBuffers(
+			ID3D12Device* const pD3D12Device,
+			D3D12ResourceCache* const pResourceCache,
+			const ArrayView<unsigned char>& materialConstants,
+			unsigned int numberOfMesh);
+	};
+
+} // namespace pmd
@@ -0,0 +1,188 @@
+﻿#include "PMDModelLibrary.h"
+
+// std
+#include <utility>
+
+namespace pmd
+{
+	// コンストラクター
+	PMDModelLibrary::PMDModelLibrary(
+		ID3D12Device* const pD3D12Device,
+		D3D12ResourceCache* const pResourceCache,
+		size_t numberOfThreads,
+		PMDVertexFormat preferredVertexFormat
+	) :
+		_pDevice(pD3D12Device), _pResourceCache(pResourceCache),
+		_preferredVertexFormat(preferredVertexFormat), _loadedModels(), _pendingLoads(),
+		_completedMutex(), _completedCondition(), _completedLoads(), _threadPool(nullptr)
+	{
+		// WICでのデコードにCOMが必要
+		_threadPool.reset(new ThreadPool(
+			numberOfThreads,
+			[]() { ::CoInitializeEx(nullptr, COINIT_MULTITHREADED); },
+			[]() { ::CoUninitialize(); }));
+	}
+
+	// デストラクター
+	PMDModelLibrary::~PMDModelLibrary()
+	{
+		// 準備中のタスクを終わらせてから破棄する
+		_threadPool.reset();
+	}
+
+	// モデルを取得（読み込みが終わるまで戻らない）
+	HRESULT PMDModelLibrary::Load(
+		const std::wstring& filename,
+		const std::wstring& toonTexturePath,
+		model_ptr_t* const ppModel
+	) {
+		auto loadResult = E_PENDING;
+		LoadAsync(filename, toonTexturePath, [&](HRESULT result, const model_ptr_t& model) {
+			loadResult = result;
+			*ppModel = model;
+		});
+		while (loadResult == E_PENDING) {
+			WaitForCompletedLoads();
+		}
+		return loadResult;
+	}
+
+	// 非同期に読み込みを開始する
+	PMDModelLibrary::future_t PMDModelLibrary::LoadAsync(
+		const std::wstring& filename,
+		const std::wstring& toonTexturePath,
+		callback_t callback
+	) {
+		// トゥーンの検索先が違えばマテリアルも変わるので別のモデルとして扱う
+		auto key = filename + L'|' + toonTexturePath;
+
+		// 読み込み済みならすぐに完了
+		auto loaded = _loadedModels.find(key);
+		if (loaded != _loadedModels.end()) {
+			model_ptr_t model = loaded->second.lock();
+			if (model) {
+				std::promise<model_ptr_t> promise;
+				promise.set_value(model);
+				if (callback) {
+					callback(S_OK, model);
+				}
+				return promise.get_future().share();
+			}
+		}
+
+		// 読み込み中なら完了を待ち合わせる
+		auto pending = _pendingLoads.find(key);
+		if (pending != _pendingLoads.end()) {
+			if (callback) {
+				pending->second->callbacks.emplace_back(std::move(callback));
+			}
+			return pending->second->future;
+		}
+
+		// 解放済みのエントリーを掃除
+		for (auto entry = _loadedModels.begin(); entry != _loadedModels.end();) {
+			if (entry->second.expired()) {
+				entry = _loadedModels.erase(entry);
+			}
+			else {
+				++entry;
+			}
+		}
+
+		auto load = std::make_shared<PendingLoad>();
+		load->key = key;
+		load->filename = filename;
+		load->toonTexturePath = toonTexturePath;
+		load->result = E_PENDING;
+		load->future = load->promise.get_future().share();
+		if (callback) {
+			load->callbacks.emplace_back(std::move(callback));
+		}
+		_pendingLoads.emplace(key, load);
+
+		// ファイルの解釈とテクスチャーのデコードはワーカースレッドで
+		const D3D12ResourceCache* const pResourceCache = _pResourceCache;
+		auto preferredVertexFormat = _preferredVertexFormat;
+		_threadPool->Enqueue([this, load, pResourceCache, preferredVertexFormat]() {
+			load->result = PMDModel::Prepare(
+				pResourceCache, load->filename, load->toonTexturePath, preferredVertexFormat, &load->data);
+			{
+				std::lock_guard<std::mutex> lock(_completedMutex);
+				_completedLoads.emplace_back(load);
+			}
+			_completedCondition.notify_all();
+		});
+
+		return load->future;
+	}
+
+	// 複数のファイルをまとめて非同期に読み込む
+	std::vector<PMDModelLibrary::future_t> PMDModelLibrary::LoadBatch(
+		const std::vector<std::wstring>& filenames,
+		const std::wstring& toonTexturePath,
+		callback_t callback
+	) {
+		std::vector<future_t> futures;
+		futures.reserve(filenames.size());
+		for (const auto& filename : filenames) {
+			futures.emplace_back(LoadAsync(filename, toonTexturePath, callback));
+		}
+		return futures;
+	}
+
+	// 準備の済んだモデルのGPUリソースを生成して完了を通知する
+	size_t PMDModelLibrary::ProcessCompletedLoads()
+	{
+		std::vector<std::shared_ptr<PendingLoad>> completedLoads;
+		{
+			std::lock_guard<std::mutex> lock(_completedMutex);
+			completedLoads.swap(_completedLoads);
+		}
+
+		for (const auto& load : completedLoads) {
+			std::shared_ptr<PMDModel> model;
+			auto result = load->result;
+			if (SUCCEEDED(result)) {
+				model = std::make_shared<PMDModel>();
+				result = model->CreateFromPreparedData(_pDevice, _pResourceCache, load->data);
+			}
+			if (FAILED(result)) {
+				model.reset();
+			}
+			else {
+				_loadedModels[load->key] = model;
+			}
+
+			// デコード済みの画像と圧縮頂点はもう不要
+			load->data.textures.clear();
+			load->data.packedVertices.clear();
+			load->data.packedVertices.shrink_to_fit();
+			_pendingLoads.erase(load->key);
+
+			load->promise.set_value(model);
+			for (const auto& callback : load->callbacks) {
+				callback(result, model);
+			}
+		}
+
+		return completedLoads.size();
+	}
+
+	// 読み込み中のモデルがなくなるまで待つ
+	void PMDModelLibrary::WaitAll()
+	{
+		while (!_pendingLoads.empty()) {
+			WaitForCompletedLoads();
+		}
+	}
+
+	// 準備の済んだモデルが届くまで待ってから処理する
+	void PMDModelLibrary::WaitForCompletedLoads()
+	{
+		{
+			std::unique_lock<std::mutex> lock(_completedMutex);
+			_completedCondition.wait(lock, [this]() { return !_completedLoads.empty(); });
+		}
+		ProcessCompletedLoads();
+	}
+}
@@ -0,0 +1,119 @@
+﻿#pragma once
+
+// std
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Windows
+#include <Windows.h>
+
+// DirectX
+#include <d3d12.h>
+
+#include "D3D12/D3D12ResourceCache.h"
+#include "PMDModel.h"
+#include "ThreadPool.h"
+
+namespace pmd
+{
+	// 読み込み済みモデルの共有テーブル
+	// 同じファイルは一度だけ読み込み、参照するアクターがいなくなれば解放される
+	// ファイルの解釈とテクスチャーのデコードはワーカースレッドで並列に行い、
+	// GPUリソースの生成はライブラリーを所有するスレッドでまとめて行う
+	class PMDModelLibrary
+	{
+	public:
+		using model_ptr_t = std::shared_ptr<const PMDModel>;
+		using future_t = std::shared_future<model_ptr_t>;
+		using callback_t = std::function<void(HRESULT, const model_ptr_t&)>;
+
+		// numberOfThreadsが0ならハードウェアスレッド数に合わせる
+		// preferredVertexFormatがPackedなら、表現できるモデルは圧縮頂点で読み込む
+		PMDModelLibrary(
+			ID3D12Device* const pD3D12Device,
+			D3D12ResourceCache* const pResourceCache,
+			size_t numberOfThreads = 0,
+			PMDVertexFormat preferredVertexFormat = PMDVertexFormat::Standard);
+		virtual ~PMDModelLibrary();
+
+		// モデルを取得（読み込み済みなら共有する。読み込みが終わるまで戻らない）
+		HRESULT Load(
+			const std::wstring& filename,
+			const std::wstring& toonTexturePath,
+			model_ptr_t* const ppModel);
+
+		// 非同期に読み込みを開始する
+		// 完了時（失敗時はnullptr）にfutureが準備され、コールバックは所有スレッドで呼ばれる
+		future_t LoadAsync(
+			const std::wstring& filename,
+			const std::wstring& toonTexturePath,
+			callback_t callback = nullptr);
+
+		// 複数のファイルをまとめて非同期に読み込む
+		std::vector<future_t> LoadBatch(
+			const std::vector<std::wstring>& filenames,
+			const std::wstring& toonTexturePath,
+			callback_t callback = nullptr);
+
+		// 準備の済んだモデルのGPUリソースを生成して完了を通知する（所有スレッドから呼ぶ）
+		// 戻り値は完了した読み込みの数
+		size_t ProcessCompletedLoads();
+
+		// 読み込み中のモデルがなくなるまで待つ
+		void WaitAll();
+
+		// 読み込み中のモデルの数
+		size_t GetNumberOfPendingLoads() const
+		{
+			return _pendingLoads.size();
+		}
+
+	private:
+		// 読み込み中のモデル
+		struct PendingLoad
+		{
+			std::wstring key;
+			std::wstring filename;
+			std::wstring toonTexturePath;
+			HRESULT result;
+			PMDModel::PreparedData data;
+			std::promise<model_ptr_t> promise;
+			future_t future;
+			std::vector<callback_t> callbacks;
+		};
+
+	private:
+		// DirextXグラフィックスデバイスインターフェイス
+		ID3D12Device* const _pDevice;
+
+		// テクスチャーの共有に使うリソースキャッシュ
+		D3D12ResourceCache* const _pResourceCache;
+
+		// 希望する頂点バッファーの形式
+		const PMDVertexFormat _preferredVertexFormat;
+
+		// ロード済みモデル格納テーブル（所有はアクター側）
+		std::unordered_map<std::wstring, std::weak_ptr<const PMDModel>> _loadedModels;
+
+		// 読み込み中のモデル（所有スレッドだけが触る）
+		std::unordered_map<std::wstring, std::shared_ptr<PendingLoad>> _pendingLoads;
+
+		// ワーカースレッドで準備の済んだモデル
+		std::mutex _completedMutex;
+		std::condition_variable _completedCondition;
+		std::vector<std::shared_ptr<PendingLoad>> _completedLoads;
+
+		// 準備用のワーカースレッド（他のメンバーより先に停止させるため最後に置く）
+		std::unique_ptr<ThreadPool> _threadPool;
+
+	private:
+		// 準備の済んだモデルが届くまで待ってから処理する
+		void WaitForCompletedLoads();
+	};
+}
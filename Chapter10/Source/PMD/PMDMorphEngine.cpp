@@ -0,0 +1,132 @@
+﻿#include "PMDMorphEngine.h"
+
+// std
+#include <algorithm>
+#include <cstring>
+
+namespace pmd
+{
+	namespace
+	{
+		// 表情名の長さ（CookedMorph::morphName）
+		constexpr size_t MorphNameLength = sizeof(CookedMorph::morphName);
+	}
+
+	// コンストラクター
+	PMDMorphSet::PMDMorphSet() :
+		_morphs(), _vertices(), _vertexEnd(0)
+	{
+	}
+
+	// デストラクター
+	PMDMorphSet::~PMDMorphSet()
+	{
+	}
+
+	// 調理済みの表情を取り込む
+	void PMDMorphSet::Assign(const ArrayView<CookedMorph>& morphs, const ArrayView<CookedMorphVertex>& vertices)
+	{
+		_morphs.assign(morphs.begin(), morphs.end());
+		_vertices.assign(vertices.begin(), vertices.end());
+		_vertexEnd = 0;
+		for (const auto& morph : _morphs) {
+			_vertexEnd = std::max(_vertexEnd, morph.vertexEnd);
+		}
+	}
+
+	// 名前から表情番号を検索
+	uint16_t PMDMorphSet::Find(const char* name, size_t length) const
+	{
+		if (length > MorphNameLength) {
+			return NotFound;
+		}
+		for (size_t i = 0; i < _morphs.size(); i++) {
+			const auto& morphName = _morphs[i].morphName;
+			if (strnlen(morphName, MorphNameLength) == length && std::memcmp(morphName, name, length) == 0) {
+				return static_cast<uint16_t>(i);
+			}
+		}
+		return NotFound;
+	}
+
+	// モーションの表情トラックごとに表情番号を求める
+	void PMDMorphSet::Bind(const PMDMotion& motion, std::vector<uint16_t>* pBindings) const
+	{
+		const auto& tracks = motion.GetMorphTracks();
+		pBindings->resize(tracks.size());
+		for (size_t i = 0; i < tracks.size(); i++) {
+			const auto& trackName = tracks[i].morphName;
+			(*pBindings)[i] = Find(trackName, strnlen(trackName, sizeof(trackName)));
+		}
+	}
+
+	// コンストラクター
+	PMDMorphEngine::PMDMorphEngine() :
+		_weights(), _appliedWeights(), _deltas(), _dirtyBegin(0), _dirtyEnd(0)
+	{
+	}
+
+	// デストラクター
+	PMDMorphEngine::~PMDMorphEngine()
+	{
+	}
+
+	// 表情の数に合わせて初期化する
+	void PMDMorphEngine::Reset(const PMDMorphSet& morphSet)
+	{
+		_weights.assign(morphSet.size(), 0.0f);
+		_appliedWeights.assign(morphSet.size(), 0.0f);
+		_deltas.assign(morphSet.GetVertexEnd(), DirectX::XMVectorZero());
+		_dirtyBegin = 0;
+		_dirtyEnd = 0;
+	}
+
+	// 重みが変わった範囲のオフセットを求め直す
+	bool PMDMorphEngine::Evaluate(const PMDMorphSet& morphSet)
+	{
+		const auto& morphs = morphSet.GetMorphs();
+		const auto* pVertices = morphSet.GetVertices().data();
+
+		// 重みが変わった表情の頂点範囲をまとめる
+		auto dirtyBegin = morphSet.GetVertexEnd();
+		uint32_t dirtyEnd = 0;
+		for (size_t i = 0; i < morphs.size(); i++) {
+			if (_weights[i] != _appliedWeights[i] && morphs[i].vertexCount > 0) {
+				dirtyBegin = std::min(dirtyBegin, morphs[i].vertexBegin);
+				dirtyEnd = std::max(dirtyEnd, morphs[i].vertexEnd);
+			}
+			_appliedWeights[i] = _weights[i];
+		}
+		if (dirtyBegin >= dirtyEnd) {
+			_dirtyBegin = 0;
+			_dirtyEnd = 0;
+			return false;
+		}
+
+		// 範囲内を0に戻し、重みのある表情を足し込む（変わっていない表情も範囲内の分は足し直す）
+		std::fill(_deltas.begin() + dirtyBegin, _deltas.begin() + dirtyEnd, DirectX::XMVectorZero());
+		auto* pDeltas = _deltas.data();
+		for (size_t i = 0; i < morphs.size(); i++) {
+			const auto& morph = morphs[i];
+			if (_weights[i] == 0.0f || morph.vertexEnd <= dirtyBegin || morph.vertexBegin >= dirtyEnd) {
+				continue;
+			}
+			auto weight = DirectX::XMVectorReplicate(_weights[i]);
+			const auto* pFirst = pVertices + morph.firstVertex;
+			const auto* pLast = pFirst + morph.vertexCount;
+			if (morph.vertexBegin < dirtyBegin) {
+				pFirst = std::lower_bound(pFirst, pLast, dirtyBegin, [](const CookedMorphVertex& vertex, uint32_t vertexIdx) {
+					return vertex.vertexIdx < vertexIdx;
+				});
+			}
+			for (auto* pVertex = pFirst; pVertex != pLast && pVertex->vertexIdx < dirtyEnd; pVertex++) {
+				auto& delta = pDeltas[pVertex->vertexIdx];
+				delta = DirectX::XMVectorMultiplyAdd(DirectX::XMLoadFloat3(&pVertex->offset), weight, delta);
+			}
+		}
+
+		_dirtyBegin = dirtyBegin;
+		_dirtyEnd = dirtyEnd;
+		return true;
+	}
+}
@@ -0,0 +1,117 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// DirectX
+#include <DirectXMath.h>
+
+#include "ArrayView.h"
+#include "PMDCookedModel.h"
+#include "PMDMotion.h"
+
+namespace pmd
+{
+	// モデルの表情（読み込み後は変更しない。アクター間で共有する）
+	class PMDMorphSet
+	{
+	public:
+		// 見つからない
+		static constexpr uint16_t NotFound = 0xffff;
+
+		PMDMorphSet();
+		virtual ~PMDMorphSet();
+
+		// 調理済みの表情を取り込む
+		void Assign(const ArrayView<CookedMorph>& morphs, const ArrayView<CookedMorphVertex>& vertices);
+
+		// 表情の数
+		size_t size() const
+		{
+			return _morphs.size();
+		}
+
+		// 名前から表情番号を検索（見つからなければNotFound）
+		uint16_t Find(const char* name, size_t length) const;
+
+		// モーションの表情トラックごとに表情番号を求める（モデルにない表情はNotFound）
+		void Bind(const PMDMotion& motion, std::vector<uint16_t>* pBindings) const;
+
+		// 表情
+		const std::vector<CookedMorph>& GetMorphs() const
+		{
+			return _morphs;
+		}
+
+		// 表情で動かす頂点
+		const std::vector<CookedMorphVertex>& GetVertices() const
+		{
+			return _vertices;
+		}
+
+		// いずれかの表情で動く頂点番号の上限（これ以降の頂点は動かない）
+		uint32_t GetVertexEnd() const
+		{
+			return _vertexEnd;
+		}
+
+	private:
+		std::vector<CookedMorph> _morphs;
+		std::vector<CookedMorphVertex> _vertices;
+		uint32_t _vertexEnd;
+	};
+
+	// 表情の適用（アクターごとに1つ持つ）
+	// 表情の重みから頂点ごとの座標オフセットを求める。オフセットは頂点シェーダーで足すので、
+	// 頂点バッファー本体は書き換えない。前回から重みが変わった表情の頂点範囲だけ求め直し、
+	// その範囲（GetDirtyBegin()からGetDirtyEnd()）だけを転送すればよいようにする
+	class PMDMorphEngine
+	{
+	public:
+		PMDMorphEngine();
+		virtual ~PMDMorphEngine();
+
+		// 表情の数に合わせて初期化する（重みはすべて0）
+		void Reset(const PMDMorphSet& morphSet);
+
+		// 表情ごとの重み（表情番号順）
+		float* GetWeights()
+		{
+			return _weights.data();
+		}
+
+		const float* GetWeights() const
+		{
+			return _weights.data();
+		}
+
+		// 重みが変わった範囲のオフセットを求め直す（変わっていなければfalse）
+		bool Evaluate(const PMDMorphSet& morphSet);
+
+		// 頂点ごとの座標オフセット（GetVertexEnd()個、wは不定）
+		const DirectX::XMVECTOR* GetDeltas() const
+		{
+			return _deltas.data();
+		}
+
+		// 最後のEvaluateで求め直した頂点の範囲[begin, end)
+		uint32_t GetDirtyBegin() const
+		{
+			return _dirtyBegin;
+		}
+
+		uint32_t GetDirtyEnd() const
+		{
+			return _dirtyEnd;
+		}
+
+	private:
+		std::vector<float> _weights;
+		std::vector<float> _appliedWeights;		// オフセットに反映済みの重み
+		std::vector<DirectX::XMVECTOR> _deltas;
+		uint32_t _dirtyBegin;
+		uint32_t _dirtyEnd;
+	};
+}
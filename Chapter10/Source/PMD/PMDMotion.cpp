@@ -0,0 +1,653 @@
+﻿#include "PMDMotion.h"
+
+// std
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#include "MappedFile.h"
+#include "PMDBoneNameTable.h"
+#include "PMDMotionSampler.h"
+
+namespace pmd
+{
+	// ファイル上のレイアウトとの一致を確認
+	static_assert(sizeof(VMDHeader) == 50, "VMDHeader size mismatch");
+	static_assert(sizeof(VMDBoneKeyFrame) == 111, "VMDBoneKeyFrame size mismatch");
+	static_assert(sizeof(VMDMorphKeyFrame) == 23, "VMDMorphKeyFrame size mismatch");
+
+	namespace
+	{
+		// ファイル先頭のシグネチャー（以降はnull終端と詰め物）
+		constexpr char VMDSignature[] = "Vocaloid Motion Data 0002";
+
+		// 名前の長さ（null以降には不定な値が入っていることがある）
+		size_t GetNameLength(const char* name, size_t capacity)
+		{
+			size_t length = 0;
+			while (length < capacity && name[length] != '\0') {
+				length++;
+			}
+			return length;
+		}
+
+		// null以降を無視して名前を比較
+		int CompareNames(const char* a, const char* b, size_t capacity)
+		{
+			auto lengthA = GetNameLength(a, capacity);
+			auto lengthB = GetNameLength(b, capacity);
+			auto result = std::memcmp(a, b, std::min(lengthA, lengthB));
+			if (result != 0) {
+				return result;
+			}
+			return lengthA < lengthB ? -1 : (lengthA > lengthB ? 1 : 0);
+		}
+
+		// 補間曲線の制御点の最大値
+		constexpr float InterpolationScale = 1.0f / 127.0f;
+
+		// キーの補間曲線（曲線ごとに(x1, y1, x2, y2)を並べた16バイト）
+		struct CurveSignature
+		{
+			uint8_t points[static_cast<size_t>(MotionCurve::Count)][4];
+
+			bool operator<(const CurveSignature& other) const
+			{
+				return std::memcmp(points, other.points, sizeof(points)) < 0;
+			}
+
+			bool operator==(const CurveSignature& other) const
+			{
+				return std::memcmp(points, other.points, sizeof(points)) == 0;
+			}
+
+			// 4曲線とも直線か（制御点が対角線上にある）
+			bool IsLinear() const
+			{
+				for (const auto& curve : points) {
+					if (curve[0] != curve[1] || curve[2] != curve[3]) {
+						return false;
+					}
+				}
+				return true;
+			}
+		};
+
+		// ファイル上は制御点ごとにX、Y、Z、回転が並ぶ
+		CurveSignature GetCurveSignature(const VMDBoneKeyFrame& keyFrame)
+		{
+			CurveSignature signature;
+			for (size_t curve = 0; curve < static_cast<size_t>(MotionCurve::Count); curve++) {
+				for (size_t point = 0; point < 4; point++) {
+					signature.points[curve][point] = keyFrame.interpolation[point * 4 + curve];
+				}
+			}
+			return signature;
+		}
+
+		// 制御点を0〜1に換算して曲線ごとに並べ替える
+		void BakeCurves(const CurveSignature& signature, MotionCurves* pCurves)
+		{
+			float points[4][static_cast<size_t>(MotionCurve::Count)];
+			for (size_t curve = 0; curve < static_cast<size_t>(MotionCurve::Count); curve++) {
+				for (size_t point = 0; point < 4; point++) {
+					points[point][curve] = signature.points[curve][point] * InterpolationScale;
+				}
+			}
+			pCurves->x1 = DirectX::XMFLOAT4(points[0]);
+			pCurves->y1 = DirectX::XMFLOAT4(points[1]);
+			pCurves->x2 = DirectX::XMFLOAT4(points[2]);
+			pCurves->y2 = DirectX::XMFLOAT4(points[3]);
+		}
+
+		// 要素数を先頭に持つ配列をビューとして切り出す
+		template<typename T>
+		bool ReadCountedView(const unsigned char** ppCursor, const unsigned char* pEnd, ArrayView<T>* pView)
+		{
+			uint32_t count = 0;
+			if (static_cast<size_t>(pEnd - *ppCursor) < sizeof(count)) {
+				return false;
+			}
+			std::memcpy(&count, *ppCursor, sizeof(count));
+			*ppCursor += sizeof(count);
+			if (static_cast<size_t>(pEnd - *ppCursor) / sizeof(T) < count) {
+				return false;
+			}
+			*pView = ArrayView<T>(reinterpret_cast<const T*>(*ppCursor), count);
+			*ppCursor += sizeof(T) * count;
+			return true;
+		}
+
+		// 回転を圧縮する（smallest-three）
+		CompressedRotationKey EncodeRotation(uint16_t frameNo, uint16_t curves, const DirectX::XMFLOAT4& rotation)
+		{
+			DirectX::XMFLOAT4 normalized;
+			DirectX::XMStoreFloat4(&normalized, DirectX::XMQuaternionNormalize(DirectX::XMLoadFloat4(&rotation)));
+			const float components[4] = { normalized.x, normalized.y, normalized.z, normalized.w };
+			size_t largest = 0;
+			for (size_t c = 1; c < 4; c++) {
+				if (std::fabs(components[c]) > std::fabs(components[largest])) {
+					largest = c;
+				}
+			}
+
+			// qと-qは同じ回転なので、除く成分が正になる方を詰める
+			auto sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+			auto bits = static_cast<uint64_t>(largest) << 45;
+			size_t dst = 0;
+			for (size_t c = 0; c < 4; c++) {
+				if (c == largest) {
+					continue;
+				}
+				auto ratio = (components[c] * sign + CompressedRotationRange) / (2.0f * CompressedRotationRange);
+				auto quantized = std::min(std::max(std::round(ratio * CompressedRotationSteps), 0.0f), static_cast<float>(CompressedRotationSteps));
+				bits |= static_cast<uint64_t>(quantized) << (30 - 15 * dst);
+				dst++;
+			}
+
+			CompressedRotationKey key;
+			key.frameNo = frameNo;
+			key.curves = curves;
+			key.packed[0] = static_cast<uint16_t>(bits);
+			key.packed[1] = static_cast<uint16_t>(bits >> 16);
+			key.packed[2] = static_cast<uint16_t>(bits >> 32);
+			return key;
+		}
+
+		// 2つの回転の差（ラジアン）
+		// 内積のacosは差が小さいと精度が出ないので、クォータニオンの差の長さ（= 2 * sin(角度 / 4)）から求める
+		float GetRotationError(DirectX::FXMVECTOR a, DirectX::FXMVECTOR b)
+		{
+			auto difference = DirectX::XMVectorGetX(DirectX::XMVector4Length(DirectX::XMVectorSubtract(a, b)));
+			auto sum = DirectX::XMVectorGetX(DirectX::XMVector4Length(DirectX::XMVectorAdd(a, b)));
+			return 4.0f * std::asin(std::min(std::min(difference, sum) * 0.5f, 1.0f));
+		}
+
+		// キーの間の補間の重み（X、Y、Z、回転）
+		DirectX::XMVECTOR GetCurveWeights(const std::vector<MotionCurves>& curves, uint16_t curveIdx, float x)
+		{
+			return curveIdx == CompressedLinearCurves ? DirectX::XMVectorReplicate(x) : PMDMotionSampler::EvaluateCurves(curves[curveIdx], x);
+		}
+
+		// 圧縮する1ボーン分の元のキーと、補間曲線どおりに0.5フレームごとに取り出した値
+		struct BoneSamples
+		{
+			uint32_t firstFrame;
+			std::vector<uint32_t> keyFrames;	// 元のキーのフレーム（firstFrameからの差）
+			std::vector<uint16_t> keyCurves;	// 元のキーの補間曲線（直前のキーからこのキーまで）
+			std::vector<DirectX::XMFLOAT4> rotations;
+			std::vector<DirectX::XMFLOAT3> translations;
+		};
+
+		// 残す元のキーを選ぶ（先頭と最後は必ず残す）
+		// 残したキーの間は後ろのキーの補間曲線で補間するので、キーa、bの間のサンプルjを補間したときの誤差getError(a, b, j)が
+		// 上限に収まる範囲で、残したキーから次に残すキーをできるだけ先に選ぶ（倍々に伸ばしてから二分探索する）
+		// 隣のキーとの間でも上限を超える（量子化の誤差だけで超える）ならfalseを返す
+		template<typename ErrorFunction>
+		bool SelectKeys(const std::vector<uint32_t>& keyFrames, float tolerance, ErrorFunction getError, std::vector<uint32_t>* pKeys)
+		{
+			auto keyCount = static_cast<uint32_t>(keyFrames.size());
+			auto fits = [&](uint32_t a, uint32_t b) {
+				for (auto j = keyFrames[a] * 2 + 1; j < keyFrames[b] * 2; j++) {
+					if (getError(a, b, j) > tolerance) {
+						return false;
+					}
+				}
+				return true;
+			};
+
+			pKeys->assign(1, 0);
+			uint32_t a = 0;
+			while (a + 1 < keyCount) {
+				auto low = a + 1;
+				if (!fits(a, low)) {
+					return false;
+				}
+				uint32_t step = 1;
+				while (low + step < keyCount && fits(a, low + step)) {
+					low += step;
+					step *= 2;
+				}
+				auto high = std::min(low + step, keyCount);
+				while (high - low > 1) {
+					auto middle = low + (high - low) / 2;
+					if (fits(a, middle)) {
+						low = middle;
+					}
+					else {
+						high = middle;
+					}
+				}
+				pKeys->push_back(low);
+				a = low;
+			}
+			return true;
+		}
+
+		// 回転のキーを作る（量子化したキーが誤差の上限に収まらなければfalseを返す）
+		bool CompressRotations(
+			const BoneSamples& samples, const std::vector<MotionCurves>& curves, float tolerance,
+			MotionTrack* pTrack, std::vector<CompressedRotationKey>* pKeys)
+		{
+			pTrack->firstKey = static_cast<uint32_t>(pKeys->size());
+			pTrack->keyCount = 0;
+
+			// 初期姿勢のまま、または変化しなければキーを減らす
+			const auto& values = samples.rotations;
+			auto firstKey = EncodeRotation(static_cast<uint16_t>(samples.firstFrame), CompressedLinearCurves, values.front());
+			auto first = DecodeRotation(firstKey);
+			auto identity = DirectX::XMQuaternionIdentity();
+			auto isIdentity = true;
+			auto isStatic = true;
+			for (const auto& value : values) {
+				auto rotation = DirectX::XMLoadFloat4(&value);
+				isIdentity = isIdentity && GetRotationError(rotation, identity) <= tolerance;
+				isStatic = isStatic && GetRotationError(rotation, first) <= tolerance;
+			}
+			if (isIdentity) {
+				return true;
+			}
+			if (isStatic) {
+				pKeys->push_back(firstKey);
+				pTrack->keyCount = 1;
+				return true;
+			}
+
+			// 量子化した後の値で補間して誤差を測る
+			const auto& keyFrames = samples.keyFrames;
+			std::vector<CompressedRotationKey> encoded(keyFrames.size());
+			std::vector<DirectX::XMFLOAT4> decoded(keyFrames.size());
+			for (size_t i = 0; i < keyFrames.size(); i++) {
+				encoded[i] = EncodeRotation(static_cast<uint16_t>(samples.firstFrame + keyFrames[i]), samples.keyCurves[i], values[keyFrames[i] * 2]);
+				auto rotation = DecodeRotation(encoded[i]);
+				if (GetRotationError(rotation, DirectX::XMLoadFloat4(&values[keyFrames[i] * 2])) > tolerance) {
+					return false;
+				}
+				DirectX::XMStoreFloat4(&decoded[i], rotation);
+			}
+			std::vector<uint32_t> keys;
+			auto fits = SelectKeys(keyFrames, tolerance, [&](uint32_t a, uint32_t b, uint32_t j) {
+				auto x = static_cast<float>(j - keyFrames[a] * 2) / static_cast<float>((keyFrames[b] - keyFrames[a]) * 2);
+				auto weight = DirectX::XMVectorGetW(GetCurveWeights(curves, samples.keyCurves[b], x));
+				auto rotation = DirectX::XMQuaternionSlerp(DirectX::XMLoadFloat4(&decoded[a]), DirectX::XMLoadFloat4(&decoded[b]), weight);
+				return GetRotationError(rotation, DirectX::XMLoadFloat4(&values[j]));
+			}, &keys);
+			if (!fits) {
+				return false;
+			}
+			for (auto key : keys) {
+				pKeys->push_back(encoded[key]);
+			}
+			pTrack->keyCount = static_cast<uint32_t>(keys.size());
+			return true;
+		}
+
+		// 平行移動のキーを作る（量子化したキーが誤差の上限に収まらなければfalseを返す）
+		// 1段階の幅は値の範囲の1/65535なので、範囲の広いトラック（長い距離を歩くセンターなど）では量子化の誤差だけで上限を超えることがある
+		bool CompressTranslations(
+			const BoneSamples& samples, const std::vector<MotionCurves>& curves, float tolerance,
+			CompressedBoneTrack* pTrack, std::vector<CompressedTranslationKey>* pKeys)
+		{
+			auto& track = pTrack->translations;
+			track.firstKey = static_cast<uint32_t>(pKeys->size());
+			track.keyCount = 0;
+
+			// 元のキーの値の範囲で量子化する
+			const auto& values = samples.translations;
+			const auto& keyFrames = samples.keyFrames;
+			auto minimum = DirectX::XMLoadFloat3(&values.front());
+			auto maximum = minimum;
+			for (auto frame : keyFrames) {
+				auto value = DirectX::XMLoadFloat3(&values[frame * 2]);
+				minimum = DirectX::XMVectorMin(minimum, value);
+				maximum = DirectX::XMVectorMax(maximum, value);
+			}
+			auto step = DirectX::XMVectorScale(DirectX::XMVectorSubtract(maximum, minimum), 1.0f / 0xffff);
+			DirectX::XMStoreFloat3(&pTrack->translationMin, minimum);
+			DirectX::XMStoreFloat3(&pTrack->translationStep, step);
+			auto encode = [&](size_t keyIdx, uint16_t curves) {
+				DirectX::XMFLOAT3 ratio;
+				DirectX::XMStoreFloat3(&ratio, DirectX::XMVectorDivide(
+					DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&values[keyFrames[keyIdx] * 2]), minimum),
+					DirectX::XMVectorMax(step, DirectX::XMVectorReplicate(FLT_MIN))));
+				CompressedTranslationKey key;
+				key.frameNo = static_cast<uint16_t>(samples.firstFrame + keyFrames[keyIdx]);
+				key.curves = curves;
+				const float components[3] = { ratio.x, ratio.y, ratio.z };
+				for (size_t c = 0; c < 3; c++) {
+					key.quantized[c] = static_cast<uint16_t>(std::min(std::max(std::round(components[c]), 0.0f), static_cast<float>(0xffff)));
+				}
+				return key;
+			};
+
+			// 初期姿勢のまま、または変化しなければキーを減らす
+			auto firstKey = encode(0, CompressedLinearCurves);
+			auto first = DecodeTranslation(firstKey, *pTrack);
+			auto isZero = true;
+			auto isStatic = true;
+			for (const auto& value : values) {
+				auto translation = DirectX::XMLoadFloat3(&value);
+				isZero = isZero && DirectX::XMVectorGetX(DirectX::XMVector3Length(translation)) <= tolerance;
+				isStatic = isStatic && DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(translation, first))) <= tolerance;
+			}
+			if (isZero) {
+				return true;
+			}
+			if (isStatic) {
+				pKeys->push_back(firstKey);
+				track.keyCount = 1;
+				return true;
+			}
+
+			std::vector<CompressedTranslationKey> encoded(keyFrames.size());
+			std::vector<DirectX::XMFLOAT3> decoded(keyFrames.size());
+			for (size_t i = 0; i < keyFrames.size(); i++) {
+				encoded[i] = encode(i, samples.keyCurves[i]);
+				auto translation = DecodeTranslation(encoded[i], *pTrack);
+				auto error = DirectX::XMVectorGetX(DirectX::XMVector3Length(
+					DirectX::XMVectorSubtract(translation, DirectX::XMLoadFloat3(&values[keyFrames[i] * 2]))));
+				if (error > tolerance) {
+					return false;
+				}
+				DirectX::XMStoreFloat3(&decoded[i], translation);
+			}
+			std::vector<uint32_t> keys;
+			auto fits = SelectKeys(keyFrames, tolerance, [&](uint32_t a, uint32_t b, uint32_t j) {
+				auto x = static_cast<float>(j - keyFrames[a] * 2) / static_cast<float>((keyFrames[b] - keyFrames[a]) * 2);
+				auto translation = DirectX::XMVectorLerpV(
+					DirectX::XMLoadFloat3(&decoded[a]), DirectX::XMLoadFloat3(&decoded[b]), GetCurveWeights(curves, samples.keyCurves[b], x));
+				return DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(translation, DirectX::XMLoadFloat3(&values[j]))));
+			}, &keys);
+			if (!fits) {
+				return false;
+			}
+			for (auto key : keys) {
+				pKeys->push_back(encoded[key]);
+			}
+			track.keyCount = static_cast<uint32_t>(keys.size());
+			return true;
+		}
+	}
+
+	// コンストラクター
+	PMDMotion::PMDMotion() :
+		_boneTracks(), _boneKeys(), _curves(),
+		_compressedTracks(), _compressedRotations(), _compressedTranslations(), _compressed(false),
+		_morphTracks(), _morphKeys(), _lastFrame(0)
+	{
+	}
+
+	// デストラクター
+	PMDMotion::~PMDMotion()
+	{
+	}
+
+	// VMDファイルを読み込む
+	bool PMDMotion::Load(const std::wstring& filename, const PMDBoneNameTable& boneNameTable, size_t numberOfBone)
+	{
+		MappedFile file;
+		if (!file.Open(filename)) {
+			return false;
+		}
+		return Load(file.GetData(), file.GetSize(), boneNameTable, numberOfBone);
+	}
+
+	// メモリー上のVMDイメージを読み込む
+	bool PMDMotion::Load(const unsigned char* pData, size_t size, const PMDBoneNameTable& boneNameTable, size_t numberOfBone)
+	{
+		if (size < sizeof(VMDHeader) || std::memcmp(pData, VMDSignature, sizeof(VMDSignature) - 1) != 0) {
+			return false;
+		}
+
+		// ボーン、表情の順に並んでいる（以降のカメラ、照明などは使わない）
+		auto pCursor = pData + sizeof(VMDHeader);
+		auto pEnd = pData + size;
+		ArrayView<VMDBoneKeyFrame> boneKeyFrames;
+		ArrayView<VMDMorphKeyFrame> morphKeyFrames;
+		if (!ReadCountedView(&pCursor, pEnd, &boneKeyFrames)) {
+			return false;
+		}
+		// 表情のセクションがない古いファイルもある
+		if (pCursor != pEnd && !ReadCountedView(&pCursor, pEnd, &morphKeyFrames)) {
+			return false;
+		}
+
+		_lastFrame = 0;
+		_compressed = false;
+		_compressedTracks.clear();
+		_compressedRotations.clear();
+		_compressedTranslations.clear();
+		LoadBoneKeys(boneKeyFrames, boneNameTable, numberOfBone);
+		LoadMorphKeys(morphKeyFrames);
+		return true;
+	}
+
+	// ボーンのキーをボーン番号ごとのトラックに振り分ける
+	void PMDMotion::LoadBoneKeys(const ArrayView<VMDBoneKeyFrame>& keyFrames, const PMDBoneNameTable& boneNameTable, size_t numberOfBone)
+	{
+		constexpr size_t NameCapacity = sizeof(VMDBoneKeyFrame::boneName);
+
+		// キーごとのボーン番号（同じボーンのキーは続くことが多いので直前の名前と比べてから引く）
+		std::vector<uint16_t> keyBones(keyFrames.size());
+		_boneTracks.assign(numberOfBone, MotionTrack{ 0, 0 });
+		const char* pPreviousName = nullptr;
+		auto previousBone = PMDBoneNameTable::NotFound;
+		for (size_t i = 0; i < keyFrames.size(); i++) {
+			const auto* pName = keyFrames[i].boneName;
+			auto boneIdx = previousBone;
+			if (pPreviousName == nullptr || CompareNames(pName, pPreviousName, NameCapacity) != 0) {
+				boneIdx = boneNameTable.Find(pName, GetNameLength(pName, NameCapacity));
+				if (boneIdx >= numberOfBone) {
+					boneIdx = PMDBoneNameTable::NotFound;
+				}
+				pPreviousName = pName;
+				previousBone = boneIdx;
+			}
+			keyBones[i] = boneIdx;
+			if (boneIdx != PMDBoneNameTable::NotFound) {
+				_boneTracks[boneIdx].keyCount++;
+			}
+		}
+
+		// 補間曲線は同じものが多いので、重複を除いてから展開する（直線だけのキーは展開しない）
+		std::vector<CurveSignature> signatures;
+		signatures.reserve(keyFrames.size());
+		for (size_t i = 0; i < keyFrames.size(); i++) {
+			if (keyBones[i] != PMDBoneNameTable::NotFound) {
+				auto signature = GetCurveSignature(keyFrames[i]);
+				if (!signature.IsLinear()) {
+					signatures.push_back(signature);
+				}
+			}
+		}
+		std::sort(signatures.begin(), signatures.end());
+		signatures.erase(std::unique(signatures.begin(), signatures.end()), signatures.end());
+		_curves.resize(signatures.size());
+		for (size_t i = 0; i < signatures.size(); i++) {
+			BakeCurves(signatures[i], &_curves[i]);
+		}
+
+		// トラックの先頭位置を決めてから、ファイル上の順にキーを詰める
+		uint32_t numberOfKey = 0;
+		for (auto& track : _boneTracks) {
+			track.firstKey = numberOfKey;
+			numberOfKey += track.keyCount;
+			track.keyCount = 0;
+		}
+		_boneKeys.resize(numberOfKey);
+		for (size_t i = 0; i < keyFrames.size(); i++) {
+			if (keyBones[i] == PMDBoneNameTable::NotFound) {
+				continue;
+			}
+			const auto& keyFrame = keyFrames[i];
+			auto& track = _boneTracks[keyBones[i]];
+			auto& key = _boneKeys[track.firstKey + track.keyCount++];
+			key.frameNo = keyFrame.frameNo;
+			key.location = keyFrame.location;
+			key.rotation = keyFrame.rotation;
+			auto signature = GetCurveSignature(keyFrame);
+			key.curves = signature.IsLinear() ? LinearCurves
+				: static_cast<uint32_t>(std::lower_bound(signatures.begin(), signatures.end(), signature) - signatures.begin());
+			_lastFrame = std::max(_lastFrame, key.frameNo);
+		}
+
+		// ファイル上は順不同なので、トラックごとにフレーム番号順にする
+		auto byFrame = [](const MotionBoneKey& a, const MotionBoneKey& b) {
+			return a.frameNo < b.frameNo;
+		};
+		for (const auto& track : _boneTracks) {
+			auto first = _boneKeys.begin() + track.firstKey;
+			auto last = first + track.keyCount;
+			if (!std::is_sorted(first, last, byFrame)) {
+				std::sort(first, last, byFrame);
+			}
+		}
+	}
+
+	// 表情のキーを表情名ごとのトラックにまとめる
+	void PMDMotion::LoadMorphKeys(const ArrayView<VMDMorphKeyFrame>& keyFrames)
+	{
+		constexpr size_t NameCapacity = sizeof(VMDMorphKeyFrame::morphName);
+
+		// 表情名、フレーム番号の順に並べる
+		std::vector<uint32_t> order(keyFrames.size());
+		std::iota(order.begin(), order.end(), 0u);
+		std::sort(order.begin(), order.end(), [&keyFrames](uint32_t a, uint32_t b) {
+			auto result = CompareNames(keyFrames[a].morphName, keyFrames[b].morphName, NameCapacity);
+			if (result != 0) {
+				return result < 0;
+			}
+			return keyFrames[a].frameNo != keyFrames[b].frameNo ? keyFrames[a].frameNo < keyFrames[b].frameNo : a < b;
+		});
+
+		size_t numberOfTrack = 0;
+		for (size_t i = 0; i < order.size(); i++) {
+			if (i == 0 || CompareNames(keyFrames[order[i - 1]].morphName, keyFrames[order[i]].morphName, NameCapacity) != 0) {
+				numberOfTrack++;
+			}
+		}
+
+		_morphTracks.assign(numberOfTrack, MotionMorphTrack{});
+		_morphKeys.resize(order.size());
+		size_t trackIdx = 0;
+		for (size_t i = 0; i < order.size(); i++) {
+			const auto& keyFrame = keyFrames[order[i]];
+			if (i > 0 && CompareNames(keyFrames[order[i - 1]].morphName, keyFrame.morphName, NameCapacity) != 0) {
+				trackIdx++;
+			}
+			auto& track = _morphTracks[trackIdx];
+			if (track.keys.keyCount == 0) {
+				// null以降の不定な値は捨てる
+				std::memset(track.morphName, 0, sizeof(track.morphName));
+				std::memcpy(track.morphName, keyFrame.morphName, GetNameLength(keyFrame.morphName, NameCapacity));
+				track.keys.firstKey = static_cast<uint32_t>(i);
+			}
+			track.keys.keyCount++;
+			_morphKeys[i].frameNo = keyFrame.frameNo;
+			_morphKeys[i].weight = keyFrame.weight;
+			_lastFrame = std::max(_lastFrame, keyFrame.frameNo);
+		}
+	}
+
+	// ボーンのキーを圧縮した形式に置き換える
+	bool PMDMotion::Compress(float rotationTolerance, float translationTolerance)
+	{
+		if (_compressed) {
+			return true;
+		}
+		if (_lastFrame > 0xffff || _curves.size() >= CompressedLinearCurves) {
+			return false;
+		}
+
+		std::vector<CompressedBoneTrack> tracks(_boneTracks.size());
+		std::vector<CompressedRotationKey> rotationKeys;
+		std::vector<CompressedTranslationKey> translationKeys;
+		BoneSamples samples;
+		for (size_t boneIdx = 0; boneIdx < _boneTracks.size(); boneIdx++) {
+			const auto& source = _boneTracks[boneIdx];
+			auto& track = tracks[boneIdx];
+			if (source.keyCount == 0) {
+				track = CompressedBoneTrack{};
+				track.rotations.firstKey = static_cast<uint32_t>(rotationKeys.size());
+				track.translations.firstKey = static_cast<uint32_t>(translationKeys.size());
+				continue;
+			}
+
+			// 最初のキーから最後のキーまでを補間曲線どおりに取り出す（範囲外は端のキーのままなので不要）
+			const auto* pKeys = &_boneKeys[source.firstKey];
+			samples.firstFrame = pKeys[0].frameNo;
+			samples.keyFrames.resize(source.keyCount);
+			samples.keyCurves.resize(source.keyCount);
+			for (uint32_t i = 0; i < source.keyCount; i++) {
+				samples.keyFrames[i] = pKeys[i].frameNo - samples.firstFrame;
+				samples.keyCurves[i] = pKeys[i].curves == LinearCurves ? CompressedLinearCurves : static_cast<uint16_t>(pKeys[i].curves);
+			}
+			auto sampleCount = static_cast<size_t>(samples.keyFrames.back()) * 2 + 1;
+			samples.rotations.resize(sampleCount);
+			samples.translations.resize(sampleCount);
+			uint32_t cursor = 0;
+			for (size_t j = 0; j < sampleCount; j++) {
+				PMDMotionSampler::SampleBone(*this, boneIdx, samples.firstFrame + j * 0.5f, &cursor, &samples.rotations[j], &samples.translations[j]);
+			}
+
+			// 量子化しただけで誤差の上限を超えるトラックがあれば、展開済みのキーのまま使う
+			if (!CompressRotations(samples, _curves, rotationTolerance, &track.rotations, &rotationKeys)
+				|| !CompressTranslations(samples, _curves, translationTolerance, &track, &translationKeys))
+			{
+				return false;
+			}
+		}
+
+		// 展開済みのキーは解放する（補間曲線は圧縮したキーと共有する）
+		_compressedTracks.swap(tracks);
+		_compressedRotations.swap(rotationKeys);
+		_compressedTranslations.swap(translationKeys);
+		std::vector<MotionTrack>().swap(_boneTracks);
+		std::vector<MotionBoneKey>().swap(_boneKeys);
+		_compressed = true;
+		return true;
+	}
+
+	// ボーンの平行移動の大きさの上限
+	float PMDMotion::GetMaxTranslation(size_t boneIdx) const
+	{
+		if (_compressed) {
+			if (boneIdx >= _compressedTracks.size() || _compressedTracks[boneIdx].translations.keyCount == 0) {
+				return 0.0f;
+			}
+
+			// 量子化の範囲の両端のうち絶対値の大きいほうを成分ごとに取る
+			const auto& track = _compressedTracks[boneIdx];
+			auto low = DirectX::XMLoadFloat3(&track.translationMin);
+			auto high = DirectX::XMVectorMultiplyAdd(DirectX::XMVectorReplicate(static_cast<float>(0xffff)), DirectX::XMLoadFloat3(&track.translationStep), low);
+			auto extent = DirectX::XMVectorMax(DirectX::XMVectorAbs(low), DirectX::XMVectorAbs(high));
+			return DirectX::XMVectorGetX(DirectX::XMVector3Length(extent));
+		}
+
+		if (boneIdx >= _boneTracks.size()) {
+			return 0.0f;
+		}
+		const auto& track = _boneTracks[boneIdx];
+		auto maxLength = 0.0f;
+		for (uint32_t i = 0; i < track.keyCount; i++) {
+			auto length = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMLoadFloat3(&_boneKeys[track.firstKey + i].location)));
+			maxLength = std::max(maxLength, length);
+		}
+		return maxLength;
+	}
+
+	// キーとトラックが占めるメモリー
+	size_t PMDMotion::GetKeyDataSize() const
+	{
+		return sizeof(MotionTrack) * _boneTracks.size()
+			+ sizeof(MotionBoneKey) * _boneKeys.size()
+			+ sizeof(MotionCurves) * _curves.size()
+			+ sizeof(CompressedBoneTrack) * _compressedTracks.size()
+			+ sizeof(CompressedRotationKey) * _compressedRotations.size()
+			+ sizeof(CompressedTranslationKey) * _compressedTranslations.size()
+			+ sizeof(MotionMorphTrack) * _morphTracks.size()
+			+ sizeof(MotionMorphKey) * _morphKeys.size();
+	}
+}
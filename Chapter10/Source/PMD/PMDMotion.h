@@ -0,0 +1,253 @@
+﻿#pragma once
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// DirectX
+#include <DirectXMath.h>
+
+#include "ArrayView.h"
+#include "VMDFileFormat.h"
+
+namespace pmd
+{
+	class PMDBoneNameTable;
+
+	// 補間曲線の種類
+	enum class MotionCurve : uint32_t
+	{
+		X,
+		Y,
+		Z,
+		Rotation,
+		Count
+	};
+
+	// キー1つ分の補間曲線（3次ベジェ曲線 (0, 0), (x1, y1), (x2, y2), (1, 1)）
+	// 各要素にX、Y、Z、回転の4曲線の制御点（0〜1に換算済み）を並べ、4曲線をまとめて計算できるようにする
+	struct MotionCurves
+	{
+		DirectX::XMFLOAT4 x1;
+		DirectX::XMFLOAT4 x2;
+		DirectX::XMFLOAT4 y1;
+		DirectX::XMFLOAT4 y2;
+	};
+
+	// 4曲線とも直線で、補間の重みがそのまま経過の割合になる（MotionBoneKey::curves）
+	constexpr uint32_t LinearCurves = 0xffffffff;
+
+	// ボーンのキーフレーム（展開済み）
+	struct MotionBoneKey
+	{
+		uint32_t frameNo;
+		DirectX::XMFLOAT3 location;
+		DirectX::XMFLOAT4 rotation;
+		uint32_t curves;	// 直前のキーからこのキーまでの補間曲線（GetCurves()上の番号かLinearCurves）
+	};
+
+	// 表情のキーフレーム
+	struct MotionMorphKey
+	{
+		uint32_t frameNo;
+		float weight;
+	};
+
+	// キーフレーム列の範囲（フレーム番号順に連続して並ぶ）
+	struct MotionTrack
+	{
+		uint32_t firstKey;
+		uint32_t keyCount;
+	};
+
+	// 表情のトラック（表情名はShift-JISのまま、null終端とは限らない）
+	struct MotionMorphTrack
+	{
+		char morphName[15];
+		MotionTrack keys;
+	};
+
+	// 圧縮したキーの補間曲線が直線（CompressedRotationKey::curvesなど）
+	constexpr uint16_t CompressedLinearCurves = 0xffff;
+
+	// 圧縮した回転のキー（10バイト）
+	// 単位クォータニオンの絶対値が最大の成分を除く3成分（±1/√2の範囲）を15ビットずつ、
+	// 除いた成分の番号を2ビットで48ビットに詰める（smallest-three）。除いた成分は正になるように符号を揃え、残りから復元する
+	struct CompressedRotationKey
+	{
+		uint16_t frameNo;
+		uint16_t curves;		// 直前のキーからこのキーまでの補間曲線（GetCurves()上の番号かCompressedLinearCurves）
+		uint16_t packed[3];		// 下位から順に16ビットずつ
+	};
+
+	// 圧縮した平行移動のキー（10バイト。トラックごとの範囲で16ビットに量子化）
+	struct CompressedTranslationKey
+	{
+		uint16_t frameNo;
+		uint16_t curves;
+		uint16_t quantized[3];
+	};
+
+	// 圧縮したボーンのトラック
+	// 回転と平行移動は別々に間引く。キーがなければ初期姿勢（単位クォータニオン、0）
+	struct CompressedBoneTrack
+	{
+		MotionTrack rotations;				// GetCompressedRotations()上の範囲
+		MotionTrack translations;			// GetCompressedTranslations()上の範囲
+		DirectX::XMFLOAT3 translationMin;	// 量子化した値0に対応する平行移動
+		DirectX::XMFLOAT3 translationStep;	// 量子化の1段階あたりの平行移動
+	};
+
+	// smallest-threeの1成分の範囲と段階数
+	constexpr float CompressedRotationRange = 0.70710678f;
+	constexpr uint32_t CompressedRotationSteps = 0x7fff;
+
+	// 圧縮した回転を復元する
+	inline DirectX::XMVECTOR DecodeRotation(const CompressedRotationKey& key)
+	{
+		auto bits = static_cast<uint64_t>(key.packed[0])
+			| (static_cast<uint64_t>(key.packed[1]) << 16)
+			| (static_cast<uint64_t>(key.packed[2]) << 32);
+		constexpr float Scale = 2.0f * CompressedRotationRange / CompressedRotationSteps;
+		auto a = static_cast<float>((bits >> 30) & CompressedRotationSteps) * Scale - CompressedRotationRange;
+		auto b = static_cast<float>((bits >> 15) & CompressedRotationSteps) * Scale - CompressedRotationRange;
+		auto c = static_cast<float>(bits & CompressedRotationSteps) * Scale - CompressedRotationRange;
+		auto d = std::sqrt(std::max(0.0f, 1.0f - (a * a + b * b + c * c)));
+		switch (bits >> 45) {
+		case 0:
+			return DirectX::XMVectorSet(d, a, b, c);
+		case 1:
+			return DirectX::XMVectorSet(a, d, b, c);
+		case 2:
+			return DirectX::XMVectorSet(a, b, d, c);
+		default:
+			return DirectX::XMVectorSet(a, b, c, d);
+		}
+	}
+
+	// 圧縮した平行移動を復元する
+	inline DirectX::XMVECTOR DecodeTranslation(const CompressedTranslationKey& key, const CompressedBoneTrack& track)
+	{
+		return DirectX::XMVectorMultiplyAdd(
+			DirectX::XMVectorSet(key.quantized[0], key.quantized[1], key.quantized[2], 0.0f),
+			DirectX::XMLoadFloat3(&track.translationStep),
+			DirectX::XMLoadFloat3(&track.translationMin));
+	}
+
+	// モデルに結び付けたモーション
+	// VMDファイルを読み込むときにボーン名をモデルのボーン番号へ解決し、
+	// ボーンごとのキーをフレーム番号順に連続して並べる（読み込み後はCompressのほかは変更しない）
+	// モデルにないボーンのキーは捨てる。表情はモデル側の表情と結び付けるまで名前のまま持つ
+	class PMDMotion
+	{
+	public:
+		// キーフレームのフレーム番号の単位（1秒あたりのフレーム数）
+		static constexpr float FrameRate = 30.0f;
+
+		// 圧縮で省いたキーによる誤差の上限の既定値（回転はラジアン、平行移動はモデル空間の距離）
+		static constexpr float DefaultRotationTolerance = 0.0005f;
+		static constexpr float DefaultTranslationTolerance = 0.001f;
+
+		PMDMotion();
+		virtual ~PMDMotion();
+
+		// VMDファイルを読み込む
+		bool Load(const std::wstring& filename, const PMDBoneNameTable& boneNameTable, size_t numberOfBone);
+
+		// メモリー上のVMDイメージを読み込む
+		bool Load(const unsigned char* pData, size_t size, const PMDBoneNameTable& boneNameTable, size_t numberOfBone);
+
+		// ボーンのキーを圧縮した形式に置き換える（展開済みのキーは解放する）
+		// 回転と平行移動に分けて量子化し、省いても誤差の上限に収まるキーを省く（元の補間曲線どおりに0.5フレームごとに
+		// 取り出した値と、残したキーの間を後ろのキーの補間曲線で補間した値を比べる）。変化しない回転と平行移動は1キーに、
+		// 初期姿勢のまま変化しなければキーなしにする。フレーム番号か補間曲線の番号が16ビットに収まらないか、
+		// 量子化したキーだけで誤差の上限を超えるトラックがあれば（値の範囲が広すぎる平行移動など）何もせずfalseを返す
+		bool Compress(float rotationTolerance = DefaultRotationTolerance, float translationTolerance = DefaultTranslationTolerance);
+
+		// ボーンのキーを圧縮済みか（圧縮済みならGetCompressedTracks()などから取り出す）
+		bool IsCompressed() const
+		{
+			return _compressed;
+		}
+
+		// ボーンごとのトラック（ボーン番号順。キーのないボーンはkeyCountが0）
+		const std::vector<MotionTrack>& GetBoneTracks() const
+		{
+			return _boneTracks;
+		}
+
+		// ボーンのキー（トラックごとに連続）
+		const std::vector<MotionBoneKey>& GetBoneKeys() const
+		{
+			return _boneKeys;
+		}
+
+		// 補間曲線（同じ曲線のキーは1つを共有する。直線だけのキーは含まない。圧縮後も使う）
+		const std::vector<MotionCurves>& GetCurves() const
+		{
+			return _curves;
+		}
+
+		// 表情ごとのトラック（表情名順）
+		const std::vector<MotionMorphTrack>& GetMorphTracks() const
+		{
+			return _morphTracks;
+		}
+
+		// 表情のキー（トラックごとに連続）
+		const std::vector<MotionMorphKey>& GetMorphKeys() const
+		{
+			return _morphKeys;
+		}
+
+		// 圧縮したボーンごとのトラック（ボーン番号順）
+		const std::vector<CompressedBoneTrack>& GetCompressedTracks() const
+		{
+			return _compressedTracks;
+		}
+
+		// 圧縮した回転のキー（トラックごとに連続）
+		const std::vector<CompressedRotationKey>& GetCompressedRotations() const
+		{
+			return _compressedRotations;
+		}
+
+		// 圧縮した平行移動のキー（トラックごとに連続）
+		const std::vector<CompressedTranslationKey>& GetCompressedTranslations() const
+		{
+			return _compressedTranslations;
+		}
+
+		// ボーンの平行移動の大きさの上限（キーの値の最大。圧縮済みなら量子化の範囲から求める。キーがなければ0）
+		float GetMaxTranslation(size_t boneIdx) const;
+
+		// 最後のキーのフレーム番号
+		uint32_t GetLastFrame() const
+		{
+			return _lastFrame;
+		}
+
+		// キーとトラックが占めるメモリー（バイト）
+		size_t GetKeyDataSize() const;
+
+	private:
+		std::vector<MotionTrack> _boneTracks;
+		std::vector<MotionBoneKey> _boneKeys;
+		std::vector<MotionCurves> _curves;
+		std::vector<CompressedBoneTrack> _compressedTracks;
+		std::vector<CompressedRotationKey> _compressedRotations;
+		std::vector<CompressedTranslationKey> _compressedTranslations;
+		bool _compressed;
+		std::vector<MotionMorphTrack> _morphTracks;
+		std::vector<MotionMorphKey> _morphKeys;
+		uint32_t _lastFrame;
+
+	private:
+		void LoadBoneKeys(const ArrayView<VMDBoneKeyFrame>& keyFrames, const PMDBoneNameTable& boneNameTable, size_t numberOfBone);
+		void LoadMorphKeys(const ArrayView<VMDMorphKeyFrame>& keyFrames);
+	};
+}
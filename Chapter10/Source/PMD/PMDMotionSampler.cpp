@@ -0,0 +1,251 @@
+﻿#include "PMDMotionSampler.h"
+
+// std
+#include <algorithm>
+#include <cfloat>
+
+#include "PMDMorphEngine.h"
+
+namespace pmd
+{
+	namespace
+	{
+		// 補間曲線の解を求める二分法の回数
+		// 最後に線形に補ったtも区間内にあるので、重みの誤差は区間の幅2^-BezierIterationsとyの傾きの上限の積3 / 512（約5.9e-3）以下
+		// （制御点が0〜1なら dy/dt = 3((1-t)^2 y1 + 2t(1-t)(y2-y1) + t^2(1-y2)) の各係数の絶対値は1以下で、重みの和は1なので |dy/dt| <= 3）
+		// 線形に補うのは、多くの曲線で誤差をこの上限よりずっと小さくするため（Chapter10ValidationのValidateCurvesで実測値を表示する）
+		constexpr int BezierIterations = 9;
+
+		// 3次ベジェ曲線（始点0、終点1）の値 3 * s^2 * t * p1 + 3 * s * t^2 * p2 + t^3（s = 1 - t）
+		DirectX::XMVECTOR EvaluateBezier(DirectX::FXMVECTOR p1, DirectX::FXMVECTOR p2, DirectX::FXMVECTOR t)
+		{
+			auto s = DirectX::XMVectorSubtract(DirectX::XMVectorReplicate(1.0f), t);
+			auto blend = DirectX::XMVectorMultiplyAdd(s, p1, DirectX::XMVectorMultiply(t, p2));
+			return DirectX::XMVectorMultiply(
+				DirectX::XMVectorMultiplyAdd(blend, DirectX::XMVectorScale(s, 3.0f), DirectX::XMVectorMultiply(t, t)), t);
+		}
+	}
+
+	// 4曲線（X、Y、Z、回転）上でxに対応するyをまとめて求める
+	// x(t)は単調増加なので、回数を固定した二分法で分岐なしにtを挟み込み、最後に区間内を線形に補う
+	DirectX::XMVECTOR PMDMotionSampler::EvaluateCurves(const MotionCurves& curves, float x)
+	{
+		// 終点ではx(t)の傾きが0になる曲線があり、floatではtが1より手前でもx(t)が1に丸まって挟み込めない
+		// どの曲線も(1, 1)を通るので、終点はそのまま返す
+		if (x >= 1.0f) {
+			return DirectX::XMVectorReplicate(1.0f);
+		}
+		auto x1 = DirectX::XMLoadFloat4(&curves.x1);
+		auto x2 = DirectX::XMLoadFloat4(&curves.x2);
+		auto target = DirectX::XMVectorReplicate(x);
+		auto half = DirectX::XMVectorReplicate(0.5f);
+		auto low = DirectX::XMVectorZero();
+		auto high = DirectX::XMVectorReplicate(1.0f);
+		auto lowX = low;
+		auto highX = high;
+		for (int i = 0; i < BezierIterations; i++) {
+			auto middle = DirectX::XMVectorMultiply(DirectX::XMVectorAdd(low, high), half);
+			auto middleX = EvaluateBezier(x1, x2, middle);
+			auto below = DirectX::XMVectorLess(middleX, target);
+			low = DirectX::XMVectorSelect(low, middle, below);
+			lowX = DirectX::XMVectorSelect(lowX, middleX, below);
+			high = DirectX::XMVectorSelect(middle, high, below);
+			highX = DirectX::XMVectorSelect(middleX, highX, below);
+		}
+		auto ratio = DirectX::XMVectorSaturate(DirectX::XMVectorDivide(
+			DirectX::XMVectorSubtract(target, lowX),
+			DirectX::XMVectorMax(DirectX::XMVectorSubtract(highX, lowX), DirectX::XMVectorReplicate(FLT_MIN))));
+		auto t = DirectX::XMVectorMultiplyAdd(DirectX::XMVectorSubtract(high, low), ratio, low);
+		return EvaluateBezier(DirectX::XMLoadFloat4(&curves.y1), DirectX::XMLoadFloat4(&curves.y2), t);
+	}
+
+	// コンストラクター
+	PMDMotionSampler::PMDMotionSampler() :
+		_cursors(), _translationCursors(), _morphCursors()
+	{
+	}
+
+	// デストラクター
+	PMDMotionSampler::~PMDMotionSampler()
+	{
+	}
+
+	// カーソルを先頭に戻す
+	void PMDMotionSampler::Reset(size_t numberOfBone)
+	{
+		_cursors.assign(numberOfBone, 0);
+		_translationCursors.clear();
+		_morphCursors.clear();
+	}
+
+	// カーソルからframeを含むキーの区間を探す
+	template<typename Key>
+	uint32_t PMDMotionSampler::Seek(const Key* pKeys, uint32_t keyCount, uint32_t cursor, float frame)
+	{
+		auto isBefore = [](float frame, const Key& key) {
+			return frame < key.frameNo;
+		};
+
+		// 巻き戻したときは先頭からカーソルまでを探す
+		if (frame < pKeys[cursor].frameNo) {
+			auto it = std::upper_bound(pKeys, pKeys + cursor, frame, isBefore);
+			return it == pKeys ? 0 : static_cast<uint32_t>(it - pKeys - 1);
+		}
+
+		// 順方向は次のキーを数個だけ見る
+		for (uint32_t step = 0; step < MaxForwardSteps; step++) {
+			if (cursor + 1 >= keyCount || frame < pKeys[cursor + 1].frameNo) {
+				return cursor;
+			}
+			cursor++;
+		}
+
+		// 大きく進んだときは残りを探す
+		auto it = std::upper_bound(pKeys + cursor, pKeys + keyCount, frame, isBefore);
+		return static_cast<uint32_t>(it - pKeys - 1);
+	}
+
+	// 全ボーンのポーズを求める
+	void PMDMotionSampler::Sample(const PMDMotion& motion, float frame, PMDPose* pPose)
+	{
+		if (motion.IsCompressed()) {
+			SampleCompressed(motion, frame, pPose);
+			return;
+		}
+
+		const auto& tracks = motion.GetBoneTracks();
+		auto numberOfBone = std::min(pPose->size(), tracks.size());
+		if (_cursors.size() != tracks.size()) {
+			Reset(tracks.size());
+		}
+
+		for (size_t i = 0; i < numberOfBone; i++) {
+			SampleBone(motion, i, frame, &_cursors[i], &pPose->rotations[i], &pPose->translations[i]);
+		}
+	}
+
+	// 圧縮前のキーから1ボーン分のポーズを求める
+	void PMDMotionSampler::SampleBone(
+		const PMDMotion& motion, size_t boneIdx, float frame, uint32_t* pCursor,
+		DirectX::XMFLOAT4* pRotation, DirectX::XMFLOAT3* pTranslation)
+	{
+		auto& rotation = *pRotation;
+		auto& translation = *pTranslation;
+		const auto& track = motion.GetBoneTracks()[boneIdx];
+		if (track.keyCount == 0) {
+			rotation = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+			translation = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+			return;
+		}
+
+		const auto* pKeys = motion.GetBoneKeys().data() + track.firstKey;
+		auto cursor = Seek(pKeys, track.keyCount, *pCursor, frame);
+		*pCursor = cursor;
+
+		// 範囲外と最後のキーは補間しない
+		const auto& key0 = pKeys[cursor];
+		if (frame <= key0.frameNo || cursor + 1 >= track.keyCount) {
+			rotation = key0.rotation;
+			translation = key0.location;
+			return;
+		}
+
+		const auto& key1 = pKeys[cursor + 1];
+		auto x = (frame - key0.frameNo) / (key1.frameNo - key0.frameNo);
+		auto weights = key1.curves == LinearCurves ? DirectX::XMVectorReplicate(x) : EvaluateCurves(motion.GetCurves()[key1.curves], x);
+		DirectX::XMStoreFloat3(&translation, DirectX::XMVectorLerpV(
+			DirectX::XMLoadFloat3(&key0.location), DirectX::XMLoadFloat3(&key1.location), weights));
+		DirectX::XMStoreFloat4(&rotation, DirectX::XMQuaternionSlerp(
+			DirectX::XMLoadFloat4(&key0.rotation), DirectX::XMLoadFloat4(&key1.rotation), DirectX::XMVectorGetW(weights)));
+	}
+
+	// 圧縮済みのモーションから全ボーンのポーズを求める
+	void PMDMotionSampler::SampleCompressed(const PMDMotion& motion, float frame, PMDPose* pPose)
+	{
+		const auto& tracks = motion.GetCompressedTracks();
+		const auto* pAllRotations = motion.GetCompressedRotations().data();
+		const auto* pAllTranslations = motion.GetCompressedTranslations().data();
+		const auto* pCurves = motion.GetCurves().data();
+		auto numberOfBone = std::min(pPose->size(), tracks.size());
+		if (_cursors.size() != tracks.size() || _translationCursors.size() != tracks.size()) {
+			Reset(tracks.size());
+			_translationCursors.assign(tracks.size(), 0);
+		}
+
+		for (size_t i = 0; i < numberOfBone; i++) {
+			const auto& track = tracks[i];
+
+			auto& rotation = pPose->rotations[i];
+			if (track.rotations.keyCount == 0) {
+				rotation = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+			}
+			else {
+				const auto* pKeys = pAllRotations + track.rotations.firstKey;
+				auto cursor = Seek(pKeys, track.rotations.keyCount, _cursors[i], frame);
+				_cursors[i] = cursor;
+				const auto& key0 = pKeys[cursor];
+				if (frame <= key0.frameNo || cursor + 1 >= track.rotations.keyCount) {
+					DirectX::XMStoreFloat4(&rotation, DecodeRotation(key0));
+				}
+				else {
+					const auto& key1 = pKeys[cursor + 1];
+					auto x = (frame - key0.frameNo) / (key1.frameNo - key0.frameNo);
+					auto weight = key1.curves == CompressedLinearCurves ? x : DirectX::XMVectorGetW(EvaluateCurves(pCurves[key1.curves], x));
+					DirectX::XMStoreFloat4(&rotation, DirectX::XMQuaternionSlerp(DecodeRotation(key0), DecodeRotation(key1), weight));
+				}
+			}
+
+			auto& translation = pPose->translations[i];
+			if (track.translations.keyCount == 0) {
+				translation = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+			}
+			else {
+				const auto* pKeys = pAllTranslations + track.translations.firstKey;
+				auto cursor = Seek(pKeys, track.translations.keyCount, _translationCursors[i], frame);
+				_translationCursors[i] = cursor;
+				const auto& key0 = pKeys[cursor];
+				if (frame <= key0.frameNo || cursor + 1 >= track.translations.keyCount) {
+					DirectX::XMStoreFloat3(&translation, DecodeTranslation(key0, track));
+				}
+				else {
+					const auto& key1 = pKeys[cursor + 1];
+					auto x = (frame - key0.frameNo) / (key1.frameNo - key0.frameNo);
+					auto weights = key1.curves == CompressedLinearCurves ? DirectX::XMVectorReplicate(x) : EvaluateCurves(pCurves[key1.curves], x);
+					DirectX::XMStoreFloat3(&translation, DirectX::XMVectorLerpV(
+						DecodeTranslation(key0, track), DecodeTranslation(key1, track), weights));
+				}
+			}
+		}
+	}
+
+	// 表情の重みを求める
+	void PMDMotionSampler::SampleMorphs(const PMDMotion& motion, float frame, const std::vector<uint16_t>& bindings, float* pWeights)
+	{
+		const auto& tracks = motion.GetMorphTracks();
+		const auto* pAllKeys = motion.GetMorphKeys().data();
+		auto numberOfTrack = std::min(bindings.size(), tracks.size());
+		if (_morphCursors.size() != tracks.size()) {
+			_morphCursors.assign(tracks.size(), 0);
+		}
+
+		for (size_t i = 0; i < numberOfTrack; i++) {
+			const auto& track = tracks[i].keys;
+			if (bindings[i] == PMDMorphSet::NotFound || track.keyCount == 0) {
+				continue;
+			}
+			const auto* pKeys = pAllKeys + track.firstKey;
+			auto cursor = Seek(pKeys, track.keyCount, _morphCursors[i], frame);
+			_morphCursors[i] = cursor;
+
+			// 表情は線形に補間する
+			const auto& key0 = pKeys[cursor];
+			if (frame <= key0.frameNo || cursor + 1 >= track.keyCount) {
+				pWeights[bindings[i]] = key0.weight;
+				continue;
+			}
+			const auto& key1 = pKeys[cursor + 1];
+			auto x = (frame - key0.frameNo) / (key1.frameNo - key0.frameNo);
+			pWeights[bindings[i]] = key0.weight + (key1.weight - key0.weight) * x;
+		}
+	}
+}
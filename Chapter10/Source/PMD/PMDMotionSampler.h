@@ -0,0 +1,65 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "PMDMotion.h"
+#include "PMDPose.h"
+
+namespace pmd
+{
+	// モーションからポーズを取り出す
+	// ボーンごとに前回のキーの位置（カーソル）を覚えておき、順方向の再生では次のキーを数個見るだけで済ませる
+	// 巻き戻しや大きな時間の飛びのときだけ二分探索で探し直す
+	// アクターごとに1つ持つ（スレッド間で共有しない）
+	class PMDMotionSampler
+	{
+	public:
+		// カーソルから順に進める最大のキー数（これを超えたら二分探索する）
+		static constexpr uint32_t MaxForwardSteps = 4;
+
+		PMDMotionSampler();
+		virtual ~PMDMotionSampler();
+
+		// カーソルを先頭に戻す
+		void Reset(size_t numberOfBone);
+
+		// frame（30fpsのフレーム番号、小数可）の全ボーンのポーズを求める
+		// 最初のキーより前は最初のキー、最後のキーより後は最後のキーの値になる。キーのないボーンは初期姿勢
+		// 圧縮済みのモーションは復元したキーの間を同じ補間曲線で補間する
+		void Sample(const PMDMotion& motion, float frame, PMDPose* pPose);
+
+		// 補間曲線4つ（X、Y、Z、回転）上で経過の割合xに対応する補間の重みをまとめて求める
+		static DirectX::XMVECTOR EvaluateCurves(const MotionCurves& curves, float x);
+
+		// 圧縮前のキーから1ボーン分のポーズを求める（pCursorはボーンごとの現在のキー）
+		static void SampleBone(
+			const PMDMotion& motion, size_t boneIdx, float frame, uint32_t* pCursor,
+			DirectX::XMFLOAT4* pRotation, DirectX::XMFLOAT3* pTranslation);
+
+		// frameの表情の重みを求める（bindingsはトラックごとの表情番号。PMDMorphSet::Bind参照）
+		// トラックのない表情の重みは変更しない
+		void SampleMorphs(const PMDMotion& motion, float frame, const std::vector<uint16_t>& bindings, float* pWeights);
+
+	private:
+		// ボーンごとの現在のキー（トラック内の番号。frameNo <= frameとなる最後のキー）
+		// 圧縮済みのモーションでは回転のキー
+		std::vector<uint32_t> _cursors;
+
+		// 圧縮済みのモーションの平行移動の現在のキー
+		std::vector<uint32_t> _translationCursors;
+
+		// 表情のトラックごとの現在のキー
+		std::vector<uint32_t> _morphCursors;
+
+	private:
+		// カーソルからframeを含むキーの区間を探す
+		template<typename Key>
+		static uint32_t Seek(const Key* pKeys, uint32_t keyCount, uint32_t cursor, float frame);
+
+		// 圧縮済みのモーションから全ボーンのポーズを求める
+		void SampleCompressed(const PMDMotion& motion, float frame, PMDPose* pPose);
+	};
+}
@@ -0,0 +1,32 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <vector>
+
+// DirectX
+#include <DirectXMath.h>
+
+namespace pmd
+{
+	// ボーンごとのローカルなポーズ（初期位置を中心にした回転と、初期位置からの移動）
+	// モーションのサンプリング、ブレンド、IKはこの形で受け渡し、最後にPMDSkeletonで行列にする
+	struct PMDPose
+	{
+		std::vector<DirectX::XMFLOAT4> rotations;		// クォータニオン
+		std::vector<DirectX::XMFLOAT3> translations;
+
+		// 全ボーンを初期姿勢にする
+		void Reset(size_t numberOfBone)
+		{
+			rotations.assign(numberOfBone, DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+			translations.assign(numberOfBone, DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f));
+		}
+
+		// ボーン数
+		size_t size() const
+		{
+			return rotations.size();
+		}
+	};
+}
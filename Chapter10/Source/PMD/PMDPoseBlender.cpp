@@ -0,0 +1,273 @@
+﻿#include "PMDPoseBlender.h"
+
+// std
+#include <algorithm>
+
+#include "PMDCookedModel.h"
+
+namespace pmd
+{
+	namespace
+	{
+		// 同時に計算するボーン数
+		constexpr size_t BlockSize = 4;
+
+		// 4ボーン分のクォータニオンを成分ごとの並び（r[0]がx、r[3]がw）にする
+		// 端数のボーンは単位クォータニオンで埋める
+		DirectX::XMMATRIX LoadQuaternions(const DirectX::XMFLOAT4* pSrc, size_t count)
+		{
+			DirectX::XMMATRIX block;
+			for (size_t i = 0; i < BlockSize; i++) {
+				block.r[i] = i < count ? DirectX::XMLoadFloat4(&pSrc[i]) : DirectX::XMQuaternionIdentity();
+			}
+			return DirectX::XMMatrixTranspose(block);
+		}
+
+		// 成分ごとの並びから元に戻して書き込む
+		void StoreQuaternions(DirectX::FXMMATRIX block, size_t count, DirectX::XMFLOAT4* pDst)
+		{
+			auto quaternions = DirectX::XMMatrixTranspose(block);
+			for (size_t i = 0; i < count; i++) {
+				DirectX::XMStoreFloat4(&pDst[i], quaternions.r[i]);
+			}
+		}
+
+		// 4ボーン分の重み（重み×マスク）
+		// マスクのボーン数がポーズより少なければ、足りないボーンはマスクの外（重み0）とする
+		DirectX::XMVECTOR LoadWeights(float weight, const PMDBoneMask* pMask, size_t first, size_t count)
+		{
+			float weights[BlockSize] = {};
+			if (!pMask) {
+				std::fill(weights, weights + count, weight);
+			}
+			else {
+				const auto& maskWeights = pMask->GetWeights();
+				auto maskCount = first < maskWeights.size() ? std::min(count, maskWeights.size() - first) : 0;
+				for (size_t i = 0; i < maskCount; i++) {
+					weights[i] = weight * maskWeights[first + i];
+				}
+			}
+			return DirectX::XMLoadFloat4(reinterpret_cast<const DirectX::XMFLOAT4*>(weights));
+		}
+
+		// 4成分の内積
+		DirectX::XMVECTOR Dot(DirectX::FXMMATRIX a, DirectX::CXMMATRIX b)
+		{
+			auto dot = DirectX::XMVectorMultiply(a.r[0], b.r[0]);
+			dot = DirectX::XMVectorMultiplyAdd(a.r[1], b.r[1], dot);
+			dot = DirectX::XMVectorMultiplyAdd(a.r[2], b.r[2], dot);
+			return DirectX::XMVectorMultiplyAdd(a.r[3], b.r[3], dot);
+		}
+
+		// bをaと同じ半球に向けたときのbの係数（内積が負なら符号を反転する）
+		DirectX::XMVECTOR AlignWeights(DirectX::FXMMATRIX a, DirectX::CXMMATRIX b, DirectX::FXMVECTOR weights)
+		{
+			auto opposite = DirectX::XMVectorLess(Dot(a, b), DirectX::XMVectorZero());
+			return DirectX::XMVectorSelect(weights, DirectX::XMVectorNegate(weights), opposite);
+		}
+
+		// 4ボーン分のnlerp（a * (1 - weights) + b * alignedWeights を正規化）
+		DirectX::XMMATRIX Nlerp(DirectX::FXMMATRIX a, DirectX::CXMMATRIX b, DirectX::FXMVECTOR weights)
+		{
+			auto alignedWeights = AlignWeights(a, b, weights);
+			auto remainder = DirectX::XMVectorSubtract(DirectX::XMVectorReplicate(1.0f), weights);
+			DirectX::XMMATRIX result;
+			for (size_t i = 0; i < 4; i++) {
+				result.r[i] = DirectX::XMVectorMultiplyAdd(b.r[i], alignedWeights, DirectX::XMVectorMultiply(a.r[i], remainder));
+			}
+			auto scale = DirectX::XMVectorReciprocalSqrt(Dot(result, result));
+			for (size_t i = 0; i < 4; i++) {
+				result.r[i] = DirectX::XMVectorMultiply(result.r[i], scale);
+			}
+			return result;
+		}
+
+		// 4ボーン分のクォータニオンの積 p * q（qの回転を先に適用する。XMQuaternionMultiply(q, p)と同じ）
+		DirectX::XMMATRIX Multiply(DirectX::FXMMATRIX p, DirectX::CXMMATRIX q)
+		{
+			using namespace DirectX;
+			XMMATRIX result;
+			result.r[0] = XMVectorSubtract(XMVectorAdd(XMVectorAdd(XMVectorMultiply(p.r[3], q.r[0]), XMVectorMultiply(p.r[0], q.r[3])),
+				XMVectorMultiply(p.r[1], q.r[2])), XMVectorMultiply(p.r[2], q.r[1]));
+			result.r[1] = XMVectorAdd(XMVectorAdd(XMVectorSubtract(XMVectorMultiply(p.r[3], q.r[1]), XMVectorMultiply(p.r[0], q.r[2])),
+				XMVectorMultiply(p.r[1], q.r[3])), XMVectorMultiply(p.r[2], q.r[0]));
+			result.r[2] = XMVectorAdd(XMVectorSubtract(XMVectorAdd(XMVectorMultiply(p.r[3], q.r[2]), XMVectorMultiply(p.r[0], q.r[1])),
+				XMVectorMultiply(p.r[1], q.r[0])), XMVectorMultiply(p.r[2], q.r[3]));
+			result.r[3] = XMVectorSubtract(XMVectorSubtract(XMVectorSubtract(XMVectorMultiply(p.r[3], q.r[3]), XMVectorMultiply(p.r[0], q.r[0])),
+				XMVectorMultiply(p.r[1], q.r[1])), XMVectorMultiply(p.r[2], q.r[2]));
+			return result;
+		}
+
+		// 移動量の補間（ボーンごと）
+		void LerpTranslations(
+			const DirectX::XMFLOAT3* pA, const DirectX::XMFLOAT3* pB, DirectX::FXMVECTOR weights, size_t count, DirectX::XMFLOAT3* pDst)
+		{
+			float lanes[BlockSize];
+			DirectX::XMStoreFloat4(reinterpret_cast<DirectX::XMFLOAT4*>(lanes), weights);
+			for (size_t i = 0; i < count; i++) {
+				DirectX::XMStoreFloat3(&pDst[i], DirectX::XMVectorLerp(DirectX::XMLoadFloat3(&pA[i]), DirectX::XMLoadFloat3(&pB[i]), lanes[i]));
+			}
+		}
+	}
+
+	// コンストラクター
+	PMDBoneMask::PMDBoneMask() :
+		_weights()
+	{
+	}
+
+	// デストラクター
+	PMDBoneMask::~PMDBoneMask()
+	{
+	}
+
+	// 全ボーンを同じ重みにする
+	void PMDBoneMask::Reset(size_t numberOfBone, float weight)
+	{
+		_weights.assign(numberOfBone, weight);
+	}
+
+	// rootBoneとその子孫の重みを設定する
+	void PMDBoneMask::SetSubtree(const PMDSkeleton& skeleton, uint16_t rootBone, float weight)
+	{
+		// 親が子より先に並ぶので、root以降を1回たどれば子孫がわかる
+		const auto& parents = skeleton.GetParents();
+		if (rootBone >= parents.size()) {
+			return;
+		}
+		// Resetしていない（ボーン数が違う）マスクは、設定しないボーンの重みを0にして骨格に合わせる
+		if (_weights.size() != parents.size()) {
+			_weights.resize(parents.size(), 0.0f);
+		}
+		std::vector<bool> inside(parents.size(), false);
+		inside[rootBone] = true;
+		_weights[rootBone] = weight;
+		for (size_t i = rootBone + 1; i < parents.size(); i++) {
+			auto parent = parents[i];
+			if (parent != InvalidBoneIndex && inside[parent]) {
+				inside[i] = true;
+				_weights[i] = weight;
+			}
+		}
+	}
+
+	// コンストラクター
+	PMDPoseBlender::PMDPoseBlender() :
+		_sum(), _weights()
+	{
+	}
+
+	// デストラクター
+	PMDPoseBlender::~PMDPoseBlender()
+	{
+	}
+
+	// aからbへ補間する
+	void PMDPoseBlender::Blend(const PMDPose& a, const PMDPose& b, float weight, const PMDBoneMask* pMask, PMDPose* pOut)
+	{
+		auto numberOfBone = std::min(a.size(), b.size());
+		if (pOut->size() != numberOfBone) {
+			pOut->Reset(numberOfBone);
+		}
+		for (size_t first = 0; first < numberOfBone; first += BlockSize) {
+			auto count = std::min(BlockSize, numberOfBone - first);
+			auto weights = LoadWeights(weight, pMask, first, count);
+			auto rotations = Nlerp(
+				LoadQuaternions(&a.rotations[first], count), LoadQuaternions(&b.rotations[first], count), weights);
+			StoreQuaternions(rotations, count, &pOut->rotations[first]);
+			LerpTranslations(&a.translations[first], &b.translations[first], weights, count, &pOut->translations[first]);
+		}
+	}
+
+	// 差分を加算レイヤーにする
+	void PMDPoseBlender::MakeAdditive(const PMDPose& pose, const PMDPose& reference, PMDPose* pAdditive)
+	{
+		auto numberOfBone = std::min(pose.size(), reference.size());
+		pAdditive->Reset(numberOfBone);
+		for (size_t i = 0; i < numberOfBone; i++) {
+			// reference * additive = pose となるように、referenceの逆回転を先に掛ける
+			auto rotation = DirectX::XMQuaternionMultiply(
+				DirectX::XMLoadFloat4(&pose.rotations[i]), DirectX::XMQuaternionConjugate(DirectX::XMLoadFloat4(&reference.rotations[i])));
+			DirectX::XMStoreFloat4(&pAdditive->rotations[i], DirectX::XMQuaternionNormalize(rotation));
+			DirectX::XMStoreFloat3(&pAdditive->translations[i], DirectX::XMVectorSubtract(
+				DirectX::XMLoadFloat3(&pose.translations[i]), DirectX::XMLoadFloat3(&reference.translations[i])));
+		}
+	}
+
+	// 加算レイヤーを重ねる
+	void PMDPoseBlender::AddAdditive(const PMDPose& additive, float weight, const PMDBoneMask* pMask, PMDPose* pPose)
+	{
+		auto numberOfBone = std::min(additive.size(), pPose->size());
+		auto zero = DirectX::XMVectorZero();
+		DirectX::XMMATRIX identity(zero, zero, zero, DirectX::XMVectorReplicate(1.0f));
+		for (size_t first = 0; first < numberOfBone; first += BlockSize) {
+			auto count = std::min(BlockSize, numberOfBone - first);
+			auto weights = LoadWeights(weight, pMask, first, count);
+
+			// 単位クォータニオンから加算分へ補間してから重ねる
+			auto delta = Nlerp(identity, LoadQuaternions(&additive.rotations[first], count), weights);
+			auto rotations = Multiply(LoadQuaternions(&pPose->rotations[first], count), delta);
+			StoreQuaternions(rotations, count, &pPose->rotations[first]);
+
+			float lanes[BlockSize];
+			DirectX::XMStoreFloat4(reinterpret_cast<DirectX::XMFLOAT4*>(lanes), weights);
+			for (size_t i = 0; i < count; i++) {
+				auto& translation = pPose->translations[first + i];
+				DirectX::XMStoreFloat3(&translation, DirectX::XMVectorMultiplyAdd(
+					DirectX::XMLoadFloat3(&additive.translations[first + i]), DirectX::XMVectorReplicate(lanes[i]), DirectX::XMLoadFloat3(&translation)));
+			}
+		}
+	}
+
+	// 重み付き平均を始める
+	void PMDPoseBlender::Begin(size_t numberOfBone)
+	{
+		_sum.rotations.assign(numberOfBone, DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
+		_sum.translations.assign(numberOfBone, DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f));
+		_weights.assign(numberOfBone, 0.0f);
+	}
+
+	// ポーズを重みを付けて足し込む
+	void PMDPoseBlender::Accumulate(const PMDPose& pose, float weight, const PMDBoneMask* pMask)
+	{
+		auto numberOfBone = std::min(pose.size(), _sum.size());
+		for (size_t first = 0; first < numberOfBone; first += BlockSize) {
+			auto count = std::min(BlockSize, numberOfBone - first);
+			auto weights = LoadWeights(weight, pMask, first, count);
+
+			// それまでの和と同じ半球に向けて足す（最初のポーズは和が0なのでそのまま）
+			auto sum = LoadQuaternions(&_sum.rotations[first], count);
+			auto rotations = LoadQuaternions(&pose.rotations[first], count);
+			auto alignedWeights = AlignWeights(sum, rotations, weights);
+			for (size_t i = 0; i < 4; i++) {
+				sum.r[i] = DirectX::XMVectorMultiplyAdd(rotations.r[i], alignedWeights, sum.r[i]);
+			}
+			StoreQuaternions(sum, count, &_sum.rotations[first]);
+
+			float lanes[BlockSize];
+			DirectX::XMStoreFloat4(reinterpret_cast<DirectX::XMFLOAT4*>(lanes), weights);
+			for (size_t i = 0; i < count; i++) {
+				auto& translation = _sum.translations[first + i];
+				DirectX::XMStoreFloat3(&translation, DirectX::XMVectorMultiplyAdd(
+					DirectX::XMLoadFloat3(&pose.translations[first + i]), DirectX::XMVectorReplicate(lanes[i]), DirectX::XMLoadFloat3(&translation)));
+				_weights[first + i] += lanes[i];
+			}
+		}
+	}
+
+	// 重みの合計で正規化して取り出す
+	void PMDPoseBlender::End(PMDPose* pOut)
+	{
+		auto numberOfBone = _sum.size();
+		pOut->Reset(numberOfBone);
+		for (size_t i = 0; i < numberOfBone; i++) {
+			auto rotation = DirectX::XMLoadFloat4(&_sum.rotations[i]);
+			if (_weights[i] <= 0.0f || DirectX::XMVectorGetX(DirectX::XMVector4LengthSq(rotation)) <= 0.0f) {
+				continue;
+			}
+			DirectX::XMStoreFloat4(&pOut->rotations[i], DirectX::XMQuaternionNormalize(rotation));
+			DirectX::XMStoreFloat3(&pOut->translations[i],
+				DirectX::XMVectorScale(DirectX::XMLoadFloat3(&_sum.translations[i]), 1.0f / _weights[i]));
+		}
+	}
+}
@@ -0,0 +1,67 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "PMDPose.h"
+#include "PMDSkeleton.h"
+
+namespace pmd
+{
+	// ボーンごとのブレンドの重み（上半身だけなど、ポーズの一部にだけ重ねるとき用）
+	class PMDBoneMask
+	{
+	public:
+		PMDBoneMask();
+		virtual ~PMDBoneMask();
+
+		// 全ボーンを同じ重みにする
+		void Reset(size_t numberOfBone, float weight);
+
+		// rootBoneとその子孫の重みを設定する（ボーン数が骨格と違えば骨格に合わせ、増えた分は重み0にする）
+		void SetSubtree(const PMDSkeleton& skeleton, uint16_t rootBone, float weight);
+
+		// ボーンごとの重み
+		const std::vector<float>& GetWeights() const
+		{
+			return _weights;
+		}
+
+	private:
+		std::vector<float> _weights;
+	};
+
+	// ポーズのブレンド
+	// 回転はnlerp（線形補間して正規化）で補間し、4ボーンずつ成分ごとの並びに入れ替えてSIMDの各レーンで計算する
+	// マスクを渡さなければ全ボーンの重みを1とする
+	class PMDPoseBlender
+	{
+	public:
+		PMDPoseBlender();
+		virtual ~PMDPoseBlender();
+
+		// aからbへweight（×マスク）の割合で補間する（クロスフェード、部分的な上書き）
+		// pOutはaかbと同じでもよい
+		static void Blend(const PMDPose& a, const PMDPose& b, float weight, const PMDBoneMask* pMask, PMDPose* pOut);
+
+		// referenceからposeへの差分を加算レイヤーにする
+		static void MakeAdditive(const PMDPose& pose, const PMDPose& reference, PMDPose* pAdditive);
+
+		// 加算レイヤーをweight（×マスク）の割合で重ねる
+		static void AddAdditive(const PMDPose& additive, float weight, const PMDBoneMask* pMask, PMDPose* pPose);
+
+		// 複数のポーズの重み付き平均を求める（Begin、Accumulateを繰り返し、Endで取り出す）
+		void Begin(size_t numberOfBone);
+		void Accumulate(const PMDPose& pose, float weight, const PMDBoneMask* pMask);
+
+		// 重みの合計で正規化して取り出す（重みのなかったボーンは初期姿勢）
+		void End(PMDPose* pOut);
+
+	private:
+		// 重み付きの和とボーンごとの重みの合計
+		PMDPose _sum;
+		std::vector<float> _weights;
+	};
+}
@@ -39,11 +39,56 @@ namespace pmd
 			D3D12_APPEND_ALIGNED_ELEMENT,
 			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
 		},
+		{ // 表情による座標オフセット（アクターごとの2本目のストリーム）
+			"MORPH", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1,
+			0,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
+		},
+	};
+
+	// 圧縮頂点レイアウト（PackedVertex）
+	const D3D12_INPUT_ELEMENT_DESC PMDRenderer::PackedInputLayout[] = {
+		{ // 座標
+			"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,
+			D3D12_APPEND_ALIGNED_ELEMENT,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
+		},
+		{ // 法線（八面体写像）
+			"NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0,
+			D3D12_APPEND_ALIGNED_ELEMENT,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
+		},
+		{ // UV
+			"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0,
+			D3D12_APPEND_ALIGNED_ELEMENT,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
+		},
+		{
+			"BONE_NO", 0, DXGI_FORMAT_R8G8_UINT, 0,
+			D3D12_APPEND_ALIGNED_ELEMENT,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
+		},
+		{
+			"WEIGHT", 0, DXGI_FORMAT_R8_UINT, 0,
+			D3D12_APPEND_ALIGNED_ELEMENT,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
+		},
+		{
+			"EDGE_FLAG", 0, DXGI_FORMAT_R8_UINT, 0,
+			D3D12_APPEND_ALIGNED_ELEMENT,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
+		},
+		{ // 表情による座標オフセット（アクターごとの2本目のストリーム）
+			"MORPH", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1,
+			0,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
+		},
 	};
 
 	// コンストラクター
 	PMDRenderer::PMDRenderer(ID3D12Device* pD3D12Device) :
-		_rootSignature(nullptr), _pipelineState(nullptr)
+		_rootSignature(nullptr), _pipelineState(nullptr), _packedPipelineState(nullptr),
+		_dualQuaternionPipelineState(nullptr), _packedDualQuaternionPipelineState(nullptr)
 	{
 		CreateRootSignature(pD3D12Device);
 		CreateGraphicsPiplieState(pD3D12Device);
@@ -59,16 +104,79 @@ namespace pmd
 	{
 		HRESULT result;
 
-		// 頂点シェーダー
-		ComPtr<ID3DBlob> _vsBlob = nullptr;
-		result = CompileShaderFromFile(L"Shader/BasicVertexShader.hlsl", "BasicVS", "vs_5_0", _vsBlob.ReleaseAndGetAddressOf());
+		// ピクセルシェーダー（頂点形式によらず共通）
+		ComPtr<ID3DBlob> _psBlob = nullptr;
+		result = CompileShaderFromFile(L"Shader/BasicPixelShader.hlsl", "BasicPS", "ps_5_0", nullptr, _psBlob.ReleaseAndGetAddressOf());
 		if (FAILED(result)) {
 			return result;
 		}
 
-		// ピクセルシェーダー
-		ComPtr<ID3DBlob> _psBlob = nullptr;
-		result = CompileShaderFromFile(L"Shader/BasicPixelShader.hlsl", "BasicPS", "ps_5_0", _psBlob.ReleaseAndGetAddressOf());
+		// 通常の頂点
+		result = CreateGraphicsPiplieState(
+			pD3D12Device, L"Shader/BasicVertexShader.hlsl", "BasicVS", nullptr,
+			InputLayout, static_cast<UINT>(sizeof(InputLayout) / sizeof(InputLayout[0])),
+			_psBlob.Get(), _pipelineState.ReleaseAndGetAddressOf());
+		if (FAILED(result))
+		{
+			return result;
+		}
+		_pipelineState->SetName(L"PMDPipelineState");
+
+		// 圧縮頂点
+		result = CreateGraphicsPiplieState(
+			pD3D12Device, L"Shader/PackedVertexShader.hlsl", "PackedVS", nullptr,
+			PackedInputLayout, static_cast<UINT>(sizeof(PackedInputLayout) / sizeof(PackedInputLayout[0])),
+			_psBlob.Get(), _packedPipelineState.ReleaseAndGetAddressOf());
+		if (FAILED(result))
+		{
+			return result;
+		}
+		_packedPipelineState->SetName(L"PMDPackedPipelineState");
+
+		// 双対クォータニオンでスキニングする頂点シェーダー（Transformのボーンの並びも変わる）
+		const D3D_SHADER_MACRO dualQuaternionDefines[] = {
+			{ "DUAL_QUATERNION_SKINNING", "1" },
+			{ nullptr, nullptr },
+		};
+		result = CreateGraphicsPiplieState(
+			pD3D12Device, L"Shader/BasicVertexShader.hlsl", "BasicVS", dualQuaternionDefines,
+			InputLayout, static_cast<UINT>(sizeof(InputLayout) / sizeof(InputLayout[0])),
+			_psBlob.Get(), _dualQuaternionPipelineState.ReleaseAndGetAddressOf());
+		if (FAILED(result))
+		{
+			return result;
+		}
+		_dualQuaternionPipelineState->SetName(L"PMDDualQuaternionPipelineState");
+
+		result = CreateGraphicsPiplieState(
+			pD3D12Device, L"Shader/PackedVertexShader.hlsl", "PackedVS", dualQuaternionDefines,
+			PackedInputLayout, static_cast<UINT>(sizeof(PackedInputLayout) / sizeof(PackedInputLayout[0])),
+			_psBlob.Get(), _packedDualQuaternionPipelineState.ReleaseAndGetAddressOf());
+		if (FAILED(result))
+		{
+			return result;
+		}
+		_packedDualQuaternionPipelineState->SetName(L"PMDPackedDualQuaternionPipelineState");
+
+		return S_OK;
+	}
+
+	// 頂点シェーダーと頂点レイアウトを指定してパイプラインステートを作成
+	HRESULT PMDRenderer::CreateGraphicsPiplieState(
+		ID3D12Device* const pD3D12Device,
+		LPCWSTR pVertexShaderFileName,
+		LPCSTR pVertexShaderEntrypoint,
+		const D3D_SHADER_MACRO* pVertexShaderDefines,
+		const D3D12_INPUT_ELEMENT_DESC* pInputLayout,
+		UINT numberOfInputElements,
+		ID3DBlob* const pPixelShader,
+		ID3D12PipelineState** ppPipelineState)
+	{
+		HRESULT result;
+
+		// 頂点シェーダー
+		ComPtr<ID3DBlob> _vsBlob = nullptr;
+		result = CompileShaderFromFile(pVertexShaderFileName, pVertexShaderEntrypoint, "vs_5_0", pVertexShaderDefines, _vsBlob.ReleaseAndGetAddressOf());
 		if (FAILED(result)) {
 			return result;
 		}
@@ -77,7 +185,7 @@ namespace pmd
 		D3D12_GRAPHICS_PIPELINE_STATE_DESC pipelineStateDesc = {};
 		pipelineStateDesc.pRootSignature = _rootSignature.Get();
 		pipelineStateDesc.VS = CD3DX12_SHADER_BYTECODE(_vsBlob.Get());
-		pipelineStateDesc.PS = CD3DX12_SHADER_BYTECODE(_psBlob.Get());
+		pipelineStateDesc.PS = CD3DX12_SHADER_BYTECODE(pPixelShader);
 		pipelineStateDesc.SampleMask = D3D12_DEFAULT_SAMPLE_MASK;
 		pipelineStateDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
 		pipelineStateDesc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
@@ -90,8 +198,8 @@ namespace pmd
 		renderTargetBlendDesc.LogicOpEnable = false;
 		renderTargetBlendDesc.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
 		pipelineStateDesc.BlendState.RenderTarget[0] = renderTargetBlendDesc;
-		pipelineStateDesc.InputLayout.pInputElementDescs = InputLayout;
-		pipelineStateDesc.InputLayout.NumElements = static_cast<UINT>(sizeof(InputLayout) / sizeof(InputLayout[0]));
+		pipelineStateDesc.InputLayout.pInputElementDescs = pInputLayout;
+		pipelineStateDesc.InputLayout.NumElements = numberOfInputElements;
 		pipelineStateDesc.IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_DISABLED;
 		pipelineStateDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
 		pipelineStateDesc.NumRenderTargets = 1;
@@ -99,14 +207,7 @@ namespace pmd
 		pipelineStateDesc.SampleDesc.Count = 1;
 		pipelineStateDesc.SampleDesc.Quality = 0;
 
-		result = pD3D12Device->CreateGraphicsPipelineState(&pipelineStateDesc, IID_PPV_ARGS(_pipelineState.ReleaseAndGetAddressOf()));
-		if (FAILED(result))
-		{
-			return result;
-		}
-		_pipelineState->SetName(L"PMDPipelineState");
-
-		return S_OK;
+		return pD3D12Device->CreateGraphicsPipelineState(&pipelineStateDesc, IID_PPV_ARGS(ppPipelineState));
 	}
 
 	// ルートシグネチャーの作成
@@ -115,19 +216,18 @@ namespace pmd
 		HRESULT result;
 
 		// レンジ: テクスチャーと定数の2つ
-		CD3DX12_DESCRIPTOR_RANGE descTblRanges[4] = {};
+		CD3DX12_DESCRIPTOR_RANGE descTblRanges[3] = {};
 		descTblRanges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0); // 定数[b0]: ビュープロジェクション用
-		descTblRanges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 1); // 定数[b1]: ビュープロジェクション用
-		descTblRanges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 2); // 定数[b2]: マテリアル用
-		descTblRanges[3].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 4, 0); // [t0]～[t4]: テクスチャー4つ（diffuse, sph, spa, toon）
+		descTblRanges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 2); // 定数[b2]: マテリアル用
+		descTblRanges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 4, 0); // [t0]～[t4]: テクスチャー4つ（diffuse, sph, spa, toon）
 
 		CD3DX12_ROOT_PARAMETER rootParams[3] = {};
 		// descTableRanges[0]から連続する1つという意味
 		rootParams[0].InitAsDescriptorTable(1, &descTblRanges[0]);
-		// descTableRanges[1]から連続する1つという意味
-		rootParams[1].InitAsDescriptorTable(1, &descTblRanges[1]);
-		// descTableRanges[2]から連続する2つという意味
-		rootParams[2].InitAsDescriptorTable(2, &descTblRanges[2], D3D12_SHADER_VISIBILITY_PIXEL);
+		// 定数[b1]: ワールド変換とボーンパレット（描画範囲ごとにパレットを切り替えるので、ヒープを介さずアドレスで直接設定する）
+		rootParams[1].InitAsConstantBufferView(1);
+		// descTableRanges[1]から連続する2つという意味
+		rootParams[2].InitAsDescriptorTable(2, &descTblRanges[1], D3D12_SHADER_VISIBILITY_PIXEL);
 
 		// サンプラー設定
 		// slot0:ディフューズ用
@@ -172,12 +272,13 @@ namespace pmd
 	}
 
 	// ファイルから読み込んでシェーダーをコンパイル
-	HRESULT PMDRenderer::CompileShaderFromFile(LPCWSTR pFileName, LPCSTR pEntrypoint, LPCSTR pShaderModel, ID3DBlob** ppByteCode)
+	HRESULT PMDRenderer::CompileShaderFromFile(
+		LPCWSTR pFileName, LPCSTR pEntrypoint, LPCSTR pShaderModel, const D3D_SHADER_MACRO* pDefines, ID3DBlob** ppByteCode)
 	{
 		ComPtr<ID3DBlob> errorBlob = nullptr;
 
 		auto result = D3DCompileFromFile(
-			pFileName, nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE,
+			pFileName, pDefines, D3D_COMPILE_STANDARD_FILE_INCLUDE,
 			pEntrypoint, pShaderModel,
 			D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION, 0,
 			ppByteCode, errorBlob.ReleaseAndGetAddressOf());
@@ -2,6 +2,9 @@
 #include <d3d12.h>
 #include <wrl.h>
 
+#include "PMDSkinning.h"
+#include "PMDVertexPacking.h"
+
 namespace pmd
 {
 	class PMDRenderer
@@ -15,8 +18,20 @@ namespace pmd
 			return _rootSignature.Get();
 		}
 
-		ID3D12PipelineState* GetPipelineState()
+		// 頂点形式とスキニングの方式に合わせたパイプラインステート
+		ID3D12PipelineState* GetPipelineState(
+			PMDVertexFormat vertexFormat = PMDVertexFormat::Standard,
+			PMDSkinningMode skinningMode = PMDSkinningMode::Linear)
 		{
+			if (skinningMode == PMDSkinningMode::DualQuaternion) {
+				if (vertexFormat == PMDVertexFormat::Packed) {
+					return _packedDualQuaternionPipelineState.Get();
+				}
+				return _dualQuaternionPipelineState.Get();
+			}
+			if (vertexFormat == PMDVertexFormat::Packed) {
+				return _packedPipelineState.Get();
+			}
 			return _pipelineState.Get();
 		}
 
@@ -24,12 +39,22 @@ namespace pmd
 		// IAに設定する頂点レイアウト
 		static const D3D12_INPUT_ELEMENT_DESC InputLayout[];
 
+		// 圧縮頂点のレイアウト
+		static const D3D12_INPUT_ELEMENT_DESC PackedInputLayout[];
+
 		// ルートシグネチャー
 		Microsoft::WRL::ComPtr<ID3D12RootSignature> _rootSignature;
 
 		// パイプラインステート
 		Microsoft::WRL::ComPtr<ID3D12PipelineState> _pipelineState;
 
+		// 圧縮頂点用のパイプラインステート
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> _packedPipelineState;
+
+		// 双対クォータニオンでスキニングするパイプラインステート（通常の頂点、圧縮頂点）
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> _dualQuaternionPipelineState;
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> _packedDualQuaternionPipelineState;
+
 	private:
 		// ルートシグネチャーの作成
 		HRESULT CreateRootSignature(ID3D12Device* const pD3D12Device);
@@ -37,7 +62,19 @@ namespace pmd
 		// パイプラインステートの作成
 		HRESULT CreateGraphicsPiplieState(ID3D12Device* const pD3D12Device);
 
+		// 頂点シェーダーと頂点レイアウトを指定してパイプラインステートを作成
+		HRESULT CreateGraphicsPiplieState(
+			ID3D12Device* const pD3D12Device,
+			LPCWSTR pVertexShaderFileName,
+			LPCSTR pVertexShaderEntrypoint,
+			const D3D_SHADER_MACRO* pVertexShaderDefines,
+			const D3D12_INPUT_ELEMENT_DESC* pInputLayout,
+			UINT numberOfInputElements,
+			ID3DBlob* const pPixelShader,
+			ID3D12PipelineState** ppPipelineState);
+
 		// ファイルからのシェーダーコンパイル
-		HRESULT CompileShaderFromFile(LPCWSTR pFileName, LPCSTR pEntrypoint, LPCSTR pShaderModel, ID3DBlob** ppByteCode);
+		HRESULT CompileShaderFromFile(
+			LPCWSTR pFileName, LPCSTR pEntrypoint, LPCSTR pShaderModel, const D3D_SHADER_MACRO* pDefines, ID3DBlob** ppByteCode);
 	};
 }
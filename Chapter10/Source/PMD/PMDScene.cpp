@@ -0,0 +1,111 @@
+﻿#include "PMDScene.h"
+
+// std
+#include <algorithm>
+#include <utility>
+
+namespace pmd
+{
+	// コンストラクター
+	PMDScene::PMDScene(size_t numberOfThreads) :
+		_actors(), _jobPool(new WorkStealingPool(numberOfThreads)), _scheduler(), _updateIntervals()
+	{
+	}
+
+	// デストラクター
+	PMDScene::~PMDScene()
+	{
+	}
+
+	// アクターを追加
+	void PMDScene::AddActor(std::unique_ptr<PMDActor> actor)
+	{
+		_actors.emplace_back(std::move(actor));
+		_updateIntervals.emplace_back(PMDAnimationScheduler::Invisible);
+	}
+
+	// 全アクターのフレーム更新
+	void PMDScene::Update(
+		float elapsedTime,
+		DirectX::FXMMATRIX viewProjection,
+		const DirectX::XMFLOAT3& eye,
+		float projectionScale,
+		float maxPixelError)
+	{
+		_scheduler.BeginFrame(viewProjection, eye, projectionScale);
+		_jobPool->ParallelFor(_actors.size(), ActorsPerJob, [&](size_t begin, size_t end) {
+			UpdateActors(begin, end, elapsedTime, eye, projectionScale, maxPixelError);
+		});
+	}
+
+	// [begin, end)のアクターを更新する
+	void PMDScene::UpdateActors(size_t begin, size_t end, float elapsedTime, const DirectX::XMFLOAT3& eye, float projectionScale, float maxPixelError)
+	{
+		// 作業用の配列はActorsPerJob個分なので、それより大きな範囲は分けて処理する
+		if (end - begin > ActorsPerJob) {
+			for (auto first = begin; first < end; first += ActorsPerJob) {
+				UpdateActors(first, std::min(first + ActorsPerJob, end), elapsedTime, eye, projectionScale, maxPixelError);
+			}
+			return;
+		}
+
+		// 今回のフレームでポーズを更新するアクターを選ぶ
+		// 視錐台の外から入ったアクター（最初のフレームも含む）は古いボーン行列を表示しないように番を待たずに更新する
+		// そのときは古いボーン行列から補間せず、求めたポーズをそのまま表示する（次の間引き更新はそこから補間する）
+		PMDActor* updatedActors[ActorsPerJob];
+		size_t updatedCount = 0;
+		for (auto i = begin; i < end; i++) {
+			auto& actor = *_actors[i];
+			actor.UpdateWorld();
+			auto interval = _scheduler.SelectInterval(actor.GetWorldCenter(), actor.GetModel()->GetBoundingRadius(), actor.GetMotionExtent());
+			auto entering = interval != PMDAnimationScheduler::Invisible && _updateIntervals[i] == PMDAnimationScheduler::Invisible;
+			_updateIntervals[i] = interval;
+			if (_scheduler.IsUpdateFrame(i, interval) || entering) {
+				actor.UpdatePose(elapsedTime, entering ? 1 : interval);
+				updatedActors[updatedCount++] = &actor;
+			}
+			else {
+				actor.SkipUpdate(elapsedTime, interval != PMDAnimationScheduler::Invisible);
+			}
+		}
+
+		// 同じモデルが続く範囲ごとにIKとボーンの伝播をまとめて計算する
+		const DirectX::XMMATRIX* localMatrices[ActorsPerJob];
+		DirectX::XMMATRIX* boneMatrices[ActorsPerJob];
+		size_t first = 0;
+		while (first < updatedCount) {
+			const auto& model = updatedActors[first]->GetModel();
+			size_t count = 0;
+			while (first + count < updatedCount && updatedActors[first + count]->GetModel() == model) {
+				localMatrices[count] = updatedActors[first + count]->GetLocalMatrices();
+				boneMatrices[count] = updatedActors[first + count]->GetBoneMatrices();
+				count++;
+			}
+			PMDActor::SolveIKBatch(&updatedActors[first], count);
+			model->GetSkeleton().ComputeWorldMatricesBatch(localMatrices, boneMatrices, count);
+			first += count;
+		}
+
+		for (size_t i = 0; i < updatedCount; i++) {
+			updatedActors[i]->WriteTransforms();
+		}
+		for (auto i = begin; i < end; i++) {
+			_actors[i]->SelectLod(eye, projectionScale, maxPixelError);
+		}
+	}
+
+	// 全アクターの描画
+	void PMDScene::Draw(ID3D12Device* const pD3D12Device, ID3D12GraphicsCommandList* const pCommandList, PMDRenderer* const pRenderer)
+	{
+		// 頂点形式かスキニングの方式が変わるときだけパイプラインステートを切り替える
+		ID3D12PipelineState* pCurrentState = nullptr;
+		for (const auto& actor : _actors) {
+			auto pState = pRenderer->GetPipelineState(actor->GetModel()->GetVertexFormat(), actor->GetSkinningMode());
+			if (pState != pCurrentState) {
+				pCommandList->SetPipelineState(pState);
+				pCurrentState = pState;
+			}
+			actor->Draw(pD3D12Device, pCommandList);
+		}
+	}
+}
@@ -0,0 +1,71 @@
+﻿#pragma once
+
+// std
+#include <memory>
+#include <vector>
+
+// DirectX
+#include <d3d12.h>
+#include <DirectXMath.h>
+
+#include "PMDActor.h"
+#include "PMDAnimationScheduler.h"
+#include "PMDRenderer.h"
+#include "WorkStealingPool.h"
+
+namespace pmd
+{
+	// 複数のアクターの配置単位
+	// フレーム更新はアクターを一定数ずつのジョブに分けてワークスティーリングで並列に処理し、
+	// 描画コマンドは呼び出し元のスレッドで記録する
+	// ポーズの更新は画面上の大きさと可視性に応じて間引く（PMDAnimationScheduler参照）
+	class PMDScene
+	{
+	public:
+		// 1ジョブで更新するアクター数（スレッド数によらず固定）
+		static constexpr size_t ActorsPerJob = 16;
+
+		// numberOfThreadsは呼び出し元以外のワーカースレッド数（0ならハードウェアスレッド数-1）
+		PMDScene(size_t numberOfThreads = 0);
+		virtual ~PMDScene();
+
+		// アクターを追加（同じモデルのアクターを続けて追加するとIKとボーンの伝播をまとめて計算できる）
+		void AddActor(std::unique_ptr<PMDActor> actor);
+
+		// 全アクターのフレーム更新と詳細度の選択（elapsedTimeは前回の更新からの経過時間（秒））
+		// viewProjectionはビュー変換と射影変換の積（ポーズを更新する間隔を選ぶ可視判定に使う）
+		void Update(
+			float elapsedTime,
+			DirectX::FXMMATRIX viewProjection,
+			const DirectX::XMFLOAT3& eye,
+			float projectionScale,
+			float maxPixelError);
+
+		// 全アクターの描画
+		void Draw(ID3D12Device* const pD3D12Device, ID3D12GraphicsCommandList* const pCommandList, PMDRenderer* const pRenderer);
+
+		// アクター数
+		size_t GetNumberOfActors() const
+		{
+			return _actors.size();
+		}
+
+		// ポーズを更新する間隔の選択（しきい値の設定用）
+		PMDAnimationScheduler& GetAnimationScheduler()
+		{
+			return _scheduler;
+		}
+
+	private:
+		std::vector<std::unique_ptr<PMDActor>> _actors;
+		std::unique_ptr<WorkStealingPool> _jobPool;
+
+		// ポーズを更新する間隔の選択と、アクターごとに前回のフレームで選んだ間隔
+		PMDAnimationScheduler _scheduler;
+		std::vector<uint32_t> _updateIntervals;
+
+	private:
+		// [begin, end)のアクターを更新する（1ジョブ分。ActorsPerJobより多ければ分けて処理する）
+		void UpdateActors(size_t begin, size_t end, float elapsedTime, const DirectX::XMFLOAT3& eye, float projectionScale, float maxPixelError);
+	};
+}
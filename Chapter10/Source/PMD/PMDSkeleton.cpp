@@ -0,0 +1,444 @@
+﻿#include "PMDSkeleton.h"
+
+// std
+#include <cstring>
+
+// PMD_SKELETON_NO_SIMDを定義するとSIMDを使わない版になる（SIMD版と結果を比べる検証用）
+#if defined(PMD_SKELETON_NO_SIMD)
+#elif defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define PMD_SKELETON_SSE2
+#include <emmintrin.h>
+#if defined(__AVX__)
+#define PMD_SKELETON_AVX
+#include <immintrin.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define PMD_SKELETON_NEON
+#include <arm_neon.h>
+#endif
+
+#include "PMDCookedModel.h"
+
+namespace pmd
+{
+	namespace
+	{
+		// 行列の要素（行優先で16個）
+		const float* GetElements(const DirectX::XMMATRIX& matrix)
+		{
+			return reinterpret_cast<const float*>(&matrix);
+		}
+
+		float* GetElements(DirectX::XMMATRIX& matrix)
+		{
+			return reinterpret_cast<float*>(&matrix);
+		}
+
+		// アフィン変換の積（行ベクトル規約なのでworld = local * parent）
+		// 要素ごとに(l0 * p0 + l1 * p1) + l2 * p2（4行目は + p3）の順で計算し、4列目は(0, 0, 0, 1)にする
+		// 融合積和は使わないので、SIMD版のどのレーンで計算してもビット単位で一致する
+#if defined(PMD_SKELETON_SSE2)
+		void MultiplyAffine(const float* pLocal, const float* pParent, float* pWorld)
+		{
+			auto p0 = _mm_loadu_ps(pParent);
+			auto p1 = _mm_loadu_ps(pParent + 4);
+			auto p2 = _mm_loadu_ps(pParent + 8);
+			auto p3 = _mm_loadu_ps(pParent + 12);
+			__m128 rows[4];
+			for (size_t r = 0; r < 4; r++) {
+				rows[r] = _mm_add_ps(
+					_mm_add_ps(
+						_mm_mul_ps(_mm_set1_ps(pLocal[r * 4 + 0]), p0),
+						_mm_mul_ps(_mm_set1_ps(pLocal[r * 4 + 1]), p1)),
+					_mm_mul_ps(_mm_set1_ps(pLocal[r * 4 + 2]), p2));
+			}
+			rows[3] = _mm_add_ps(rows[3], p3);
+
+			auto mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+			for (size_t r = 0; r < 4; r++) {
+				_mm_storeu_ps(pWorld + r * 4, _mm_and_ps(rows[r], mask));
+			}
+			pWorld[15] = 1.0f;
+		}
+#elif defined(PMD_SKELETON_NEON)
+		void MultiplyAffine(const float* pLocal, const float* pParent, float* pWorld)
+		{
+			auto p0 = vld1q_f32(pParent);
+			auto p1 = vld1q_f32(pParent + 4);
+			auto p2 = vld1q_f32(pParent + 8);
+			auto p3 = vld1q_f32(pParent + 12);
+			float32x4_t rows[4];
+			for (size_t r = 0; r < 4; r++) {
+				rows[r] = vaddq_f32(
+					vaddq_f32(
+						vmulq_n_f32(p0, pLocal[r * 4 + 0]),
+						vmulq_n_f32(p1, pLocal[r * 4 + 1])),
+					vmulq_n_f32(p2, pLocal[r * 4 + 2]));
+			}
+			rows[3] = vaddq_f32(rows[3], p3);
+			for (size_t r = 0; r < 4; r++) {
+				vst1q_f32(pWorld + r * 4, vsetq_lane_f32(r == 3 ? 1.0f : 0.0f, rows[r], 3));
+			}
+		}
+#else
+		void MultiplyAffine(const float* pLocal, const float* pParent, float* pWorld)
+		{
+			float result[16];
+			for (size_t r = 0; r < 4; r++) {
+				for (size_t c = 0; c < 3; c++) {
+					auto value = (pLocal[r * 4 + 0] * pParent[0 * 4 + c] + pLocal[r * 4 + 1] * pParent[1 * 4 + c])
+						+ pLocal[r * 4 + 2] * pParent[2 * 4 + c];
+					if (r == 3) {
+						value = value + pParent[3 * 4 + c];
+					}
+					result[r * 4 + c] = value;
+				}
+				result[r * 4 + 3] = r == 3 ? 1.0f : 0.0f;
+			}
+			std::memcpy(pWorld, result, sizeof(result));
+		}
+#endif
+
+		// 親のないボーンはローカル変換の4列目だけを揃える
+		void CopyAffine(const float* pLocal, float* pWorld)
+		{
+			float result[16];
+			std::memcpy(result, pLocal, sizeof(result));
+			result[3] = 0.0f;
+			result[7] = 0.0f;
+			result[11] = 0.0f;
+			result[15] = 1.0f;
+			std::memcpy(pWorld, result, sizeof(result));
+		}
+
+		// 1アクター分を計算する
+		void ComputeWorldMatricesSingle(
+			const std::vector<uint16_t>& parents,
+			const DirectX::XMMATRIX* pLocal,
+			DirectX::XMMATRIX* pWorld)
+		{
+			// 親は必ず先に求まっている
+			auto numberOfBone = parents.size();
+			for (size_t i = 0; i < numberOfBone; i++) {
+				auto parentIdx = parents[i];
+				if (parentIdx == InvalidBoneIndex) {
+					CopyAffine(GetElements(pLocal[i]), GetElements(pWorld[i]));
+				}
+				else {
+					float result[16];
+					MultiplyAffine(GetElements(pLocal[i]), GetElements(pWorld[parentIdx]), result);
+					std::memcpy(GetElements(pWorld[i]), result, sizeof(result));
+				}
+			}
+		}
+
+		// 複数アクターの同じボーンをレーンに並べる演算
+		// GatherRowはBatchWidthアクター分の行列のr行目を転置して列ごとのレーンにし、ScatterRowはその逆を行う
+		// LoadLanes、StoreLanesはfloat配列上のBatchWidth個を読み書きする（境界を揃えなくてよい）
+#if defined(PMD_SKELETON_AVX)
+		constexpr size_t BatchWidth = 8;
+		using Lanes = __m256;
+
+		Lanes AddLanes(Lanes a, Lanes b)
+		{
+			return _mm256_add_ps(a, b);
+		}
+
+		Lanes MultiplyLanes(Lanes a, Lanes b)
+		{
+			return _mm256_mul_ps(a, b);
+		}
+
+		Lanes LoadLanes(const float* p)
+		{
+			return _mm256_loadu_ps(p);
+		}
+
+		void StoreLanes(float* p, Lanes a)
+		{
+			_mm256_storeu_ps(p, a);
+		}
+
+		// アクターaとa + 4のr行目を上下の128ビットに読み込む
+		__m256 LoadRowPair(const DirectX::XMMATRIX* const* ppMatrices, size_t boneIdx, size_t r, size_t a)
+		{
+			auto low = _mm_loadu_ps(GetElements(ppMatrices[a][boneIdx]) + r * 4);
+			auto high = _mm_loadu_ps(GetElements(ppMatrices[a + 4][boneIdx]) + r * 4);
+			return _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+		}
+
+		void GatherRow(const DirectX::XMMATRIX* const* ppMatrices, size_t boneIdx, size_t r, Lanes* pColumns)
+		{
+			// 128ビットごとに4x4を転置する（4列目は捨てる）
+			auto row0 = LoadRowPair(ppMatrices, boneIdx, r, 0);
+			auto row1 = LoadRowPair(ppMatrices, boneIdx, r, 1);
+			auto row2 = LoadRowPair(ppMatrices, boneIdx, r, 2);
+			auto row3 = LoadRowPair(ppMatrices, boneIdx, r, 3);
+			auto xy01 = _mm256_unpacklo_ps(row0, row1);
+			auto zw01 = _mm256_unpackhi_ps(row0, row1);
+			auto xy23 = _mm256_unpacklo_ps(row2, row3);
+			auto zw23 = _mm256_unpackhi_ps(row2, row3);
+			pColumns[0] = _mm256_shuffle_ps(xy01, xy23, _MM_SHUFFLE(1, 0, 1, 0));
+			pColumns[1] = _mm256_shuffle_ps(xy01, xy23, _MM_SHUFFLE(3, 2, 3, 2));
+			pColumns[2] = _mm256_shuffle_ps(zw01, zw23, _MM_SHUFFLE(1, 0, 1, 0));
+		}
+
+		// 上下の128ビットをアクターaとa + 4のr行目へ書き込む
+		void StoreRowPair(__m256 row, size_t r, DirectX::XMMATRIX* const* ppMatrices, size_t boneIdx, size_t a)
+		{
+			_mm_storeu_ps(GetElements(ppMatrices[a][boneIdx]) + r * 4, _mm256_castps256_ps128(row));
+			_mm_storeu_ps(GetElements(ppMatrices[a + 4][boneIdx]) + r * 4, _mm256_extractf128_ps(row, 1));
+		}
+
+		void ScatterRow(const Lanes* pColumns, size_t r, DirectX::XMMATRIX* const* ppMatrices, size_t boneIdx)
+		{
+			auto w = _mm256_set1_ps(r == 3 ? 1.0f : 0.0f);
+			auto xy01 = _mm256_unpacklo_ps(pColumns[0], pColumns[1]);
+			auto xy23 = _mm256_unpackhi_ps(pColumns[0], pColumns[1]);
+			auto zw01 = _mm256_unpacklo_ps(pColumns[2], w);
+			auto zw23 = _mm256_unpackhi_ps(pColumns[2], w);
+			StoreRowPair(_mm256_shuffle_ps(xy01, zw01, _MM_SHUFFLE(1, 0, 1, 0)), r, ppMatrices, boneIdx, 0);
+			StoreRowPair(_mm256_shuffle_ps(xy01, zw01, _MM_SHUFFLE(3, 2, 3, 2)), r, ppMatrices, boneIdx, 1);
+			StoreRowPair(_mm256_shuffle_ps(xy23, zw23, _MM_SHUFFLE(1, 0, 1, 0)), r, ppMatrices, boneIdx, 2);
+			StoreRowPair(_mm256_shuffle_ps(xy23, zw23, _MM_SHUFFLE(3, 2, 3, 2)), r, ppMatrices, boneIdx, 3);
+		}
+#elif defined(PMD_SKELETON_SSE2)
+		constexpr size_t BatchWidth = 4;
+		using Lanes = __m128;
+
+		Lanes AddLanes(Lanes a, Lanes b)
+		{
+			return _mm_add_ps(a, b);
+		}
+
+		Lanes MultiplyLanes(Lanes a, Lanes b)
+		{
+			return _mm_mul_ps(a, b);
+		}
+
+		Lanes LoadLanes(const float* p)
+		{
+			return _mm_loadu_ps(p);
+		}
+
+		void StoreLanes(float* p, Lanes a)
+		{
+			_mm_storeu_ps(p, a);
+		}
+
+		void GatherRow(const DirectX::XMMATRIX* const* ppMatrices, size_t boneIdx, size_t r, Lanes* pColumns)
+		{
+			auto row0 = _mm_loadu_ps(GetElements(ppMatrices[0][boneIdx]) + r * 4);
+			auto row1 = _mm_loadu_ps(GetElements(ppMatrices[1][boneIdx]) + r * 4);
+			auto row2 = _mm_loadu_ps(GetElements(ppMatrices[2][boneIdx]) + r * 4);
+			auto row3 = _mm_loadu_ps(GetElements(ppMatrices[3][boneIdx]) + r * 4);
+			_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+			pColumns[0] = row0;
+			pColumns[1] = row1;
+			pColumns[2] = row2;
+		}
+
+		void ScatterRow(const Lanes* pColumns, size_t r, DirectX::XMMATRIX* const* ppMatrices, size_t boneIdx)
+		{
+			auto row0 = pColumns[0];
+			auto row1 = pColumns[1];
+			auto row2 = pColumns[2];
+			auto row3 = _mm_set1_ps(r == 3 ? 1.0f : 0.0f);
+			_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+			_mm_storeu_ps(GetElements(ppMatrices[0][boneIdx]) + r * 4, row0);
+			_mm_storeu_ps(GetElements(ppMatrices[1][boneIdx]) + r * 4, row1);
+			_mm_storeu_ps(GetElements(ppMatrices[2][boneIdx]) + r * 4, row2);
+			_mm_storeu_ps(GetElements(ppMatrices[3][boneIdx]) + r * 4, row3);
+		}
+#elif defined(PMD_SKELETON_NEON)
+		constexpr size_t BatchWidth = 4;
+		using Lanes = float32x4_t;
+
+		Lanes AddLanes(Lanes a, Lanes b)
+		{
+			return vaddq_f32(a, b);
+		}
+
+		Lanes MultiplyLanes(Lanes a, Lanes b)
+		{
+			return vmulq_f32(a, b);
+		}
+
+		Lanes LoadLanes(const float* p)
+		{
+			return vld1q_f32(p);
+		}
+
+		void StoreLanes(float* p, Lanes a)
+		{
+			vst1q_f32(p, a);
+		}
+
+		// 4x4の転置
+		void Transpose(float32x4_t* pRows)
+		{
+			auto t01 = vtrnq_f32(pRows[0], pRows[1]);
+			auto t23 = vtrnq_f32(pRows[2], pRows[3]);
+			pRows[0] = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+			pRows[1] = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+			pRows[2] = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+			pRows[3] = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+		}
+
+		void GatherRow(const DirectX::XMMATRIX* const* ppMatrices, size_t boneIdx, size_t r, Lanes* pColumns)
+		{
+			float32x4_t rows[4];
+			for (size_t a = 0; a < 4; a++) {
+				rows[a] = vld1q_f32(GetElements(ppMatrices[a][boneIdx]) + r * 4);
+			}
+			Transpose(rows);
+			for (size_t c = 0; c < 3; c++) {
+				pColumns[c] = rows[c];
+			}
+		}
+
+		void ScatterRow(const Lanes* pColumns, size_t r, DirectX::XMMATRIX* const* ppMatrices, size_t boneIdx)
+		{
+			float32x4_t rows[4] = { pColumns[0], pColumns[1], pColumns[2], vdupq_n_f32(r == 3 ? 1.0f : 0.0f) };
+			Transpose(rows);
+			for (size_t a = 0; a < 4; a++) {
+				vst1q_f32(GetElements(ppMatrices[a][boneIdx]) + r * 4, rows[a]);
+			}
+		}
+#endif
+
+#if defined(PMD_SKELETON_SSE2) || defined(PMD_SKELETON_NEON)
+#define PMD_SKELETON_BATCH
+		// アフィン変換で計算する要素（1〜3列目の4行分）
+		constexpr size_t AffineElementCount = 12;
+
+		// BatchWidthアクター分をまとめて計算する
+		// pScratchはボーン数 * AffineElementCount * BatchWidth個の作業領域で、
+		// ワールド変換をボーンごと、要素ごとにアクターをレーンに並べた形で持つ
+		// std::vectorの確保は__m256の境界に揃うとは限らないので、Lanesの配列にせずfloatの配列として読み書きする
+		void ComputeWorldMatricesLanes(
+			const std::vector<uint16_t>& parents,
+			const DirectX::XMMATRIX* const* ppLocal,
+			DirectX::XMMATRIX* const* ppWorld,
+			float* pScratch)
+		{
+			auto numberOfBone = parents.size();
+			for (size_t i = 0; i < numberOfBone; i++) {
+				// 各アクターのローカル変換を要素ごとのレーンへ並べ替える
+				Lanes local[AffineElementCount];
+				for (size_t r = 0; r < 4; r++) {
+					GatherRow(ppLocal, i, r, local + r * 3);
+				}
+
+				Lanes world[AffineElementCount];
+				auto parentIdx = parents[i];
+				if (parentIdx == InvalidBoneIndex) {
+					for (size_t e = 0; e < AffineElementCount; e++) {
+						world[e] = local[e];
+					}
+				}
+				else {
+					// MultiplyAffineと同じ順序で計算する
+					const auto* pParent = pScratch + parentIdx * AffineElementCount * BatchWidth;
+					Lanes parent[AffineElementCount];
+					for (size_t e = 0; e < AffineElementCount; e++) {
+						parent[e] = LoadLanes(pParent + e * BatchWidth);
+					}
+					for (size_t r = 0; r < 4; r++) {
+						for (size_t c = 0; c < 3; c++) {
+							auto value = AddLanes(
+								AddLanes(
+									MultiplyLanes(local[r * 3 + 0], parent[0 * 3 + c]),
+									MultiplyLanes(local[r * 3 + 1], parent[1 * 3 + c])),
+								MultiplyLanes(local[r * 3 + 2], parent[2 * 3 + c]));
+							if (r == 3) {
+								value = AddLanes(value, parent[3 * 3 + c]);
+							}
+							world[r * 3 + c] = value;
+						}
+					}
+				}
+
+				// 子ボーンのために残し、各アクターの行列へ戻す
+				auto pWorld = pScratch + i * AffineElementCount * BatchWidth;
+				for (size_t e = 0; e < AffineElementCount; e++) {
+					StoreLanes(pWorld + e * BatchWidth, world[e]);
+				}
+				for (size_t r = 0; r < 4; r++) {
+					ScatterRow(world + r * 3, r, ppWorld, i);
+				}
+			}
+		}
+#endif
+	}
+
+	// コンストラクター
+	PMDSkeleton::PMDSkeleton() :
+		_parents(), _bindPositions()
+	{
+	}
+
+	// デストラクター
+	PMDSkeleton::~PMDSkeleton()
+	{
+	}
+
+	// 調理済みのボーンから作る
+	void PMDSkeleton::Assign(const ArrayView<CookedBone>& bones)
+	{
+		_parents.resize(bones.size());
+		_bindPositions.resize(bones.size());
+		for (size_t i = 0; i < bones.size(); i++) {
+			_parents[i] = bones[i].parentIdx;
+			_bindPositions[i] = bones[i].pos;
+		}
+	}
+
+	// ポーズからローカル変換を求める
+	void PMDSkeleton::ComputeLocalMatrices(const PMDPose& pose, DirectX::XMMATRIX* pLocal) const
+	{
+		auto numberOfBone = _parents.size();
+		for (size_t i = 0; i < numberOfBone; i++) {
+			pLocal[i] = ComputeLocalMatrix(pose, i);
+		}
+	}
+
+	// 1ボーン分のローカル変換
+	DirectX::XMMATRIX PMDSkeleton::ComputeLocalMatrix(const PMDPose& pose, size_t boneIdx) const
+	{
+		// 初期位置pへ戻して回転し、元の位置に移動量tを足す: T(-p) * R * T(p + t)
+		auto bindPosition = DirectX::XMLoadFloat3(&_bindPositions[boneIdx]);
+		auto matrix = DirectX::XMMatrixRotationQuaternion(DirectX::XMLoadFloat4(&pose.rotations[boneIdx]));
+		auto offset = DirectX::XMVectorSubtract(
+			DirectX::XMVectorAdd(bindPosition, DirectX::XMLoadFloat3(&pose.translations[boneIdx])),
+			DirectX::XMVector3TransformNormal(bindPosition, matrix));
+		matrix.r[3] = DirectX::XMVectorSetW(offset, 1.0f);
+		return matrix;
+	}
+
+	// ローカル変換からワールド変換を求める
+	void PMDSkeleton::ComputeWorldMatrices(const DirectX::XMMATRIX* pLocal, DirectX::XMMATRIX* pWorld) const
+	{
+		ComputeWorldMatricesSingle(_parents, pLocal, pWorld);
+	}
+
+	// 複数アクターのワールド変換をまとめて求める
+	void PMDSkeleton::ComputeWorldMatricesBatch(
+		const DirectX::XMMATRIX* const* ppLocal,
+		DirectX::XMMATRIX* const* ppWorld,
+		size_t actorCount) const
+	{
+		size_t a = 0;
+#ifdef PMD_SKELETON_BATCH
+		if (actorCount >= BatchWidth) {
+			std::vector<float> scratch(_parents.size() * AffineElementCount * BatchWidth);
+			for (; a + BatchWidth <= actorCount; a += BatchWidth) {
+				ComputeWorldMatricesLanes(_parents, ppLocal + a, ppWorld + a, scratch.data());
+			}
+		}
+#endif // PMD_SKELETON_BATCH
+		for (; a < actorCount; a++) {
+			ComputeWorldMatricesSingle(_parents, ppLocal[a], ppWorld[a]);
+		}
+	}
+}
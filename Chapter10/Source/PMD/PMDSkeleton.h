@@ -0,0 +1,71 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// DirectX
+#include <DirectXMath.h>
+
+#include "ArrayView.h"
+#include "PMDPose.h"
+
+namespace pmd
+{
+	struct CookedBone;
+
+	// ボーンの階層
+	// 親が子より先に並ぶ番号順で、親番号と初期位置を配列ごとに持つ（読み込み後は変更しない）
+	// ワールド変換（モデル空間）は番号順に1回たどるだけで求まる
+	class PMDSkeleton
+	{
+	public:
+		PMDSkeleton();
+		virtual ~PMDSkeleton();
+
+		// 調理済みのボーンから作る（親が子より先に並んでいること）
+		void Assign(const ArrayView<CookedBone>& bones);
+
+		// ボーン数
+		size_t size() const
+		{
+			return _parents.size();
+		}
+
+		// 親ボーン番号（親がなければInvalidBoneIndex）
+		const std::vector<uint16_t>& GetParents() const
+		{
+			return _parents;
+		}
+
+		// ボーンの初期位置
+		const std::vector<DirectX::XMFLOAT3>& GetBindPositions() const
+		{
+			return _bindPositions;
+		}
+
+		// ポーズからボーンごとのローカル変換を求める（初期位置を中心に回転してから移動する）
+		void ComputeLocalMatrices(const PMDPose& pose, DirectX::XMMATRIX* pLocal) const;
+
+		// 1ボーン分のローカル変換
+		DirectX::XMMATRIX ComputeLocalMatrix(const PMDPose& pose, size_t boneIdx) const;
+
+		// ボーンごとのローカル変換（親に対する変換）からワールド変換を求める
+		// 変換はアフィン（4列目が(0, 0, 0, 1)）として扱う。pLocalとpWorldは同じ配列でもよい
+		void ComputeWorldMatrices(const DirectX::XMMATRIX* pLocal, DirectX::XMMATRIX* pWorld) const;
+
+		// このスケルトンを共有する複数アクターのワールド変換をまとめて求める
+		// 同じボーン番号を数アクター分SIMDの各レーンに並べて計算し、端数のアクターは1アクターずつ計算する
+		// どちらで計算しても結果はビット単位で一致し、ComputeWorldMatricesとも一致する
+		// ppLocal[a]、ppWorld[a]はアクターaのボーン数分の配列（同じ配列でもよい）
+		void ComputeWorldMatricesBatch(
+			const DirectX::XMMATRIX* const* ppLocal,
+			DirectX::XMMATRIX* const* ppWorld,
+			size_t actorCount) const;
+
+	private:
+		std::vector<uint16_t> _parents;
+		std::vector<DirectX::XMFLOAT3> _bindPositions;
+	};
+}
@@ -0,0 +1,346 @@
+﻿#include "PMDSkinning.h"
+
+// std
+#include <cmath>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define PMD_SKINNING_SSE2
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#define PMD_SKINNING_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+namespace pmd
+{
+	namespace
+	{
+		// 範囲外のボーン番号に使う単位行列
+		const float IdentityElements[16] = {
+			1.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f,
+		};
+
+		// ボーン行列の要素（行優先で16個）
+		const float* GetBoneElements(const SkinningSource& source, unsigned short boneNo)
+		{
+			return boneNo < source.boneCount ? reinterpret_cast<const float*>(&source.pBones[boneNo]) : IdentityElements;
+		}
+
+		// 表情のオフセットを足した座標
+		void GetPosition(const SkinningSource& source, size_t vertexIdx, float* pPosition)
+		{
+			const auto& pos = source.pVertices[vertexIdx].pos;
+			pPosition[0] = pos.x;
+			pPosition[1] = pos.y;
+			pPosition[2] = pos.z;
+			if (source.pMorphDeltas && vertexIdx < source.morphedCount) {
+				const auto* pDelta = reinterpret_cast<const float*>(&source.pMorphDeltas[vertexIdx]);
+				pPosition[0] += pDelta[0];
+				pPosition[1] += pDelta[1];
+				pPosition[2] += pDelta[2];
+			}
+		}
+
+#if defined(PMD_SKINNING_SSE2)
+		// 2つのボーンのr行目をブレンドする（row0 * w + row1 * (1 - w)）
+		__m128 BlendRow(const float* pBone0, const float* pBone1, size_t r, __m128 weight0, __m128 weight1)
+		{
+			return _mm_add_ps(
+				_mm_mul_ps(_mm_loadu_ps(pBone0 + r * 4), weight0),
+				_mm_mul_ps(_mm_loadu_ps(pBone1 + r * 4), weight1));
+		}
+
+		// 3要素の内積を全レーンに
+		__m128 Dot3(__m128 a, __m128 b)
+		{
+			auto product = _mm_mul_ps(a, b);
+			auto x = _mm_shuffle_ps(product, product, _MM_SHUFFLE(0, 0, 0, 0));
+			auto y = _mm_shuffle_ps(product, product, _MM_SHUFFLE(1, 1, 1, 1));
+			auto z = _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 2, 2, 2));
+			return _mm_add_ps(_mm_add_ps(x, y), z);
+		}
+
+		// 正規化（長さ0ならそのまま）
+		__m128 Normalize3(__m128 v)
+		{
+			auto lengthSq = Dot3(v, v);
+			auto normalized = _mm_div_ps(v, _mm_sqrt_ps(lengthSq));
+			auto nonZero = _mm_cmpgt_ps(lengthSq, _mm_setzero_ps());
+			return _mm_or_ps(_mm_and_ps(nonZero, normalized), _mm_andnot_ps(nonZero, v));
+		}
+
+		// 3要素を書き込む
+		void Store3(float* pDst, __m128 v)
+		{
+			_mm_storel_pi(reinterpret_cast<__m64*>(pDst), v);
+			_mm_store_ss(pDst + 2, _mm_movehl_ps(v, v));
+		}
+#endif
+
+#if defined(PMD_SKINNING_AVX2)
+		// 頂点aとbの値を上下の128ビットに並べる
+		__m256 Pair(__m128 a, __m128 b)
+		{
+			return _mm256_insertf128_ps(_mm256_castps128_ps256(a), b, 1);
+		}
+
+		// 3要素の内積を上下の128ビットごとに全レーンへ
+		__m256 Dot3(__m256 a, __m256 b)
+		{
+			auto product = _mm256_mul_ps(a, b);
+			auto x = _mm256_shuffle_ps(product, product, _MM_SHUFFLE(0, 0, 0, 0));
+			auto y = _mm256_shuffle_ps(product, product, _MM_SHUFFLE(1, 1, 1, 1));
+			auto z = _mm256_shuffle_ps(product, product, _MM_SHUFFLE(2, 2, 2, 2));
+			return _mm256_add_ps(_mm256_add_ps(x, y), z);
+		}
+
+		__m256 Normalize3(__m256 v)
+		{
+			auto lengthSq = Dot3(v, v);
+			auto normalized = _mm256_div_ps(v, _mm256_sqrt_ps(lengthSq));
+			return _mm256_blendv_ps(v, normalized, _mm256_cmp_ps(lengthSq, _mm256_setzero_ps(), _CMP_GT_OQ));
+		}
+
+		// 2頂点を処理する（各頂点の行列、座標、法線を上下の128ビットに置いて同じ演算で求める）
+		void SkinVertexPair(const SkinningSource& source, size_t vertexIdx, SkinnedVertex* pDst)
+		{
+			const auto& vertex0 = source.pVertices[vertexIdx];
+			const auto& vertex1 = source.pVertices[vertexIdx + 1];
+			const auto* pBone00 = GetBoneElements(source, vertex0.boneNo[0]);
+			const auto* pBone01 = GetBoneElements(source, vertex0.boneNo[1]);
+			const auto* pBone10 = GetBoneElements(source, vertex1.boneNo[0]);
+			const auto* pBone11 = GetBoneElements(source, vertex1.boneNo[1]);
+			auto weight0 = vertex0.boneWeight / 100.0f;
+			auto weight1 = vertex1.boneWeight / 100.0f;
+			auto w0 = Pair(_mm_set1_ps(weight0), _mm_set1_ps(weight1));
+			auto w1 = Pair(_mm_set1_ps(1.0f - weight0), _mm_set1_ps(1.0f - weight1));
+
+			__m256 rows[4];
+			for (size_t r = 0; r < 4; r++) {
+				auto row0 = Pair(_mm_loadu_ps(pBone00 + r * 4), _mm_loadu_ps(pBone10 + r * 4));
+				auto row1 = Pair(_mm_loadu_ps(pBone01 + r * 4), _mm_loadu_ps(pBone11 + r * 4));
+				rows[r] = _mm256_add_ps(_mm256_mul_ps(row0, w0), _mm256_mul_ps(row1, w1));
+			}
+
+			float position0[3];
+			float position1[3];
+			GetPosition(source, vertexIdx, position0);
+			GetPosition(source, vertexIdx + 1, position1);
+			auto position = _mm256_add_ps(
+				_mm256_add_ps(
+					_mm256_mul_ps(Pair(_mm_set1_ps(position0[0]), _mm_set1_ps(position1[0])), rows[0]),
+					_mm256_mul_ps(Pair(_mm_set1_ps(position0[1]), _mm_set1_ps(position1[1])), rows[1])),
+				_mm256_add_ps(
+					_mm256_mul_ps(Pair(_mm_set1_ps(position0[2]), _mm_set1_ps(position1[2])), rows[2]),
+					rows[3]));
+			auto normal = _mm256_add_ps(
+				_mm256_add_ps(
+					_mm256_mul_ps(Pair(_mm_set1_ps(vertex0.normal.x), _mm_set1_ps(vertex1.normal.x)), rows[0]),
+					_mm256_mul_ps(Pair(_mm_set1_ps(vertex0.normal.y), _mm_set1_ps(vertex1.normal.y)), rows[1])),
+				_mm256_mul_ps(Pair(_mm_set1_ps(vertex0.normal.z), _mm_set1_ps(vertex1.normal.z)), rows[2]));
+			normal = Normalize3(normal);
+
+			Store3(&pDst[vertexIdx].pos.x, _mm256_castps256_ps128(position));
+			Store3(&pDst[vertexIdx].normal.x, _mm256_castps256_ps128(normal));
+			Store3(&pDst[vertexIdx + 1].pos.x, _mm256_extractf128_ps(position, 1));
+			Store3(&pDst[vertexIdx + 1].normal.x, _mm256_extractf128_ps(normal, 1));
+		}
+#endif
+
+#if defined(PMD_SKINNING_SSE2)
+		// 1頂点を処理する
+		void SkinVertex(const SkinningSource& source, size_t vertexIdx, SkinnedVertex* pDst)
+		{
+			const auto& vertex = source.pVertices[vertexIdx];
+			const auto* pBone0 = GetBoneElements(source, vertex.boneNo[0]);
+			const auto* pBone1 = GetBoneElements(source, vertex.boneNo[1]);
+			auto weight = vertex.boneWeight / 100.0f;
+			auto w0 = _mm_set1_ps(weight);
+			auto w1 = _mm_set1_ps(1.0f - weight);
+			auto row0 = BlendRow(pBone0, pBone1, 0, w0, w1);
+			auto row1 = BlendRow(pBone0, pBone1, 1, w0, w1);
+			auto row2 = BlendRow(pBone0, pBone1, 2, w0, w1);
+			auto row3 = BlendRow(pBone0, pBone1, 3, w0, w1);
+
+			float position[3];
+			GetPosition(source, vertexIdx, position);
+			auto skinnedPosition = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(position[0]), row0), _mm_mul_ps(_mm_set1_ps(position[1]), row1)),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(position[2]), row2), row3));
+			auto skinnedNormal = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(vertex.normal.x), row0), _mm_mul_ps(_mm_set1_ps(vertex.normal.y), row1)),
+				_mm_mul_ps(_mm_set1_ps(vertex.normal.z), row2));
+
+			Store3(&pDst[vertexIdx].pos.x, skinnedPosition);
+			Store3(&pDst[vertexIdx].normal.x, Normalize3(skinnedNormal));
+		}
+#endif
+	}
+
+	// CPUでスキニングする
+	void SkinVertices(const SkinningSource& source, size_t begin, size_t end, SkinnedVertex* pDst)
+	{
+#if defined(PMD_SKINNING_SSE2)
+		auto vertexIdx = begin;
+#if defined(PMD_SKINNING_AVX2)
+		for (; vertexIdx + 2 <= end; vertexIdx += 2) {
+			SkinVertexPair(source, vertexIdx, pDst);
+		}
+#endif
+		for (; vertexIdx < end; vertexIdx++) {
+			SkinVertex(source, vertexIdx, pDst);
+		}
+#else
+		SkinVerticesScalar(source, begin, end, pDst);
+#endif
+	}
+
+	// CPUでスキニングする（スカラー版）
+	void SkinVerticesScalar(const SkinningSource& source, size_t begin, size_t end, SkinnedVertex* pDst)
+	{
+		for (auto vertexIdx = begin; vertexIdx < end; vertexIdx++) {
+			const auto& vertex = source.pVertices[vertexIdx];
+			const auto* pBone0 = GetBoneElements(source, vertex.boneNo[0]);
+			const auto* pBone1 = GetBoneElements(source, vertex.boneNo[1]);
+			auto w0 = vertex.boneWeight / 100.0f;
+			auto w1 = 1.0f - w0;
+			float matrix[16];
+			for (size_t e = 0; e < 16; e++) {
+				matrix[e] = pBone0[e] * w0 + pBone1[e] * w1;
+			}
+
+			float position[3];
+			GetPosition(source, vertexIdx, position);
+			const float normal[3] = { vertex.normal.x, vertex.normal.y, vertex.normal.z };
+			float skinnedPosition[3];
+			float skinnedNormal[3];
+			for (size_t c = 0; c < 3; c++) {
+				skinnedPosition[c] = (position[0] * matrix[c] + position[1] * matrix[4 + c]) + (position[2] * matrix[8 + c] + matrix[12 + c]);
+				skinnedNormal[c] = (normal[0] * matrix[c] + normal[1] * matrix[4 + c]) + normal[2] * matrix[8 + c];
+			}
+			auto lengthSq = (skinnedNormal[0] * skinnedNormal[0] + skinnedNormal[1] * skinnedNormal[1]) + skinnedNormal[2] * skinnedNormal[2];
+			if (lengthSq > 0.0f) {
+				auto length = std::sqrt(lengthSq);
+				for (auto& n : skinnedNormal) {
+					n /= length;
+				}
+			}
+
+			auto& dst = pDst[vertexIdx];
+			dst.pos = DirectX::XMFLOAT3(skinnedPosition[0], skinnedPosition[1], skinnedPosition[2]);
+			dst.normal = DirectX::XMFLOAT3(skinnedNormal[0], skinnedNormal[1], skinnedNormal[2]);
+		}
+	}
+
+	// 並列にスキニングする
+	void SkinVerticesParallel(WorkStealingPool* pPool, const SkinningSource& source, SkinnedVertex* pDst)
+	{
+		pPool->ParallelFor(source.vertexCount, SkinningChunkSize, [&](size_t begin, size_t end) {
+			SkinVertices(source, begin, end, pDst);
+		});
+	}
+
+	// ボーンのワールド変換を双対クォータニオンへ変換する
+	void ConvertToDualQuaternions(const DirectX::XMMATRIX* pBones, size_t count, DualQuaternion* pDst)
+	{
+		for (size_t i = 0; i < count; i++) {
+			auto real = DirectX::XMQuaternionRotationMatrix(pBones[i]);
+			auto translation = pBones[i].r[3];
+
+			// dual = 0.5 * (t, 0) * real
+			auto dual = DirectX::XMVectorScale(
+				DirectX::XMVectorAdd(
+					DirectX::XMVectorScale(translation, DirectX::XMVectorGetW(real)),
+					DirectX::XMVector3Cross(translation, real)),
+				0.5f);
+			dual = DirectX::XMVectorSetW(dual, -0.5f * DirectX::XMVectorGetX(DirectX::XMVector3Dot(translation, real)));
+
+			DirectX::XMStoreFloat4(&pDst[i].real, real);
+			DirectX::XMStoreFloat4(&pDst[i].dual, dual);
+		}
+	}
+
+	// 双対クォータニオンでスキニングする（スカラー版）
+	void SkinVerticesDualQuaternionScalar(const SkinningSource& source, const DualQuaternion* pBones, size_t begin, size_t end, SkinnedVertex* pDst)
+	{
+		static const DualQuaternion Identity = { DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f), DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f) };
+		auto cross = [](const float* a, const float* b, float* pResult) {
+			pResult[0] = a[1] * b[2] - a[2] * b[1];
+			pResult[1] = a[2] * b[0] - a[0] * b[2];
+			pResult[2] = a[0] * b[1] - a[1] * b[0];
+		};
+
+		for (auto vertexIdx = begin; vertexIdx < end; vertexIdx++) {
+			const auto& vertex = source.pVertices[vertexIdx];
+			const auto& bone0 = vertex.boneNo[0] < source.boneCount ? pBones[vertex.boneNo[0]] : Identity;
+			const auto& bone1 = vertex.boneNo[1] < source.boneCount ? pBones[vertex.boneNo[1]] : Identity;
+			const auto* pReal0 = &bone0.real.x;
+			const auto* pReal1 = &bone1.real.x;
+			const auto* pDual0 = &bone0.dual.x;
+			const auto* pDual1 = &bone1.dual.x;
+
+			// 同じ向きの回転が逆符号で表されていることがあるので、短い方の回転で補間するように揃える
+			auto w0 = vertex.boneWeight / 100.0f;
+			auto w1 = 1.0f - w0;
+			auto dot = (pReal0[0] * pReal1[0] + pReal0[1] * pReal1[1]) + (pReal0[2] * pReal1[2] + pReal0[3] * pReal1[3]);
+			if (dot < 0.0f) {
+				w1 = -w1;
+			}
+			float real[4];
+			float dual[4];
+			for (size_t c = 0; c < 4; c++) {
+				real[c] = pReal0[c] * w0 + pReal1[c] * w1;
+				dual[c] = pDual0[c] * w0 + pDual1[c] * w1;
+			}
+			auto length = std::sqrt((real[0] * real[0] + real[1] * real[1]) + (real[2] * real[2] + real[3] * real[3]));
+			if (length > 0.0f) {
+				for (size_t c = 0; c < 4; c++) {
+					real[c] /= length;
+					dual[c] /= length;
+				}
+			}
+			else {
+				real[3] = 1.0f;
+			}
+
+			// 回転: v + 2 * real.xyz x (real.xyz x v + real.w * v)
+			auto rotate = [&](const float* v, float* pResult) {
+				float t[3];
+				cross(real, v, t);
+				for (size_t c = 0; c < 3; c++) {
+					t[c] += real[3] * v[c];
+				}
+				cross(real, t, pResult);
+				for (size_t c = 0; c < 3; c++) {
+					pResult[c] = v[c] + 2.0f * pResult[c];
+				}
+			};
+
+			// 平行移動: 2 * (real.w * dual.xyz - dual.w * real.xyz + real.xyz x dual.xyz)
+			float translation[3];
+			cross(real, dual, translation);
+			for (size_t c = 0; c < 3; c++) {
+				translation[c] = 2.0f * (real[3] * dual[c] - dual[3] * real[c] + translation[c]);
+			}
+
+			float position[3];
+			GetPosition(source, vertexIdx, position);
+			const float normal[3] = { vertex.normal.x, vertex.normal.y, vertex.normal.z };
+			float skinnedPosition[3];
+			float skinnedNormal[3];
+			rotate(position, skinnedPosition);
+			rotate(normal, skinnedNormal);
+			for (size_t c = 0; c < 3; c++) {
+				skinnedPosition[c] += translation[c];
+			}
+
+			auto& dst = pDst[vertexIdx];
+			dst.pos = DirectX::XMFLOAT3(skinnedPosition[0], skinnedPosition[1], skinnedPosition[2]);
+			dst.normal = DirectX::XMFLOAT3(skinnedNormal[0], skinnedNormal[1], skinnedNormal[2]);
+		}
+	}
+}
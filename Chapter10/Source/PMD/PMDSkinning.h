@@ -0,0 +1,70 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+
+// DirectX
+#include <DirectXMath.h>
+
+#include "PMDFileFormat.h"
+#include "WorkStealingPool.h"
+
+namespace pmd
+{
+	// ボーンの変換をシェーダーへ渡す形式
+	enum class PMDSkinningMode
+	{
+		Linear,			// 4x4行列（64バイト）を線形にブレンドする
+		DualQuaternion,	// 双対クォータニオン（32バイト）をブレンドする。ねじれた関節でも体積が痩せない
+	};
+
+	// 回転と平行移動だけの変換を表す双対クォータニオン（ボーン1つ分）
+	// realは回転、dualは0.5 * t * real（tは平行移動を虚部に持つクォータニオン、ハミルトン積）
+	struct DualQuaternion
+	{
+		DirectX::XMFLOAT4 real;
+		DirectX::XMFLOAT4 dual;
+	};
+
+	// スキニング結果の頂点（モデル空間）
+	struct SkinnedVertex
+	{
+		DirectX::XMFLOAT3 pos;
+		DirectX::XMFLOAT3 normal;	// 正規化済み
+	};
+
+	// スキニングの入力
+	struct SkinningSource
+	{
+		const SerializedVertex* pVertices;
+		size_t vertexCount;
+		const DirectX::XMMATRIX* pBones;		// ボーンのワールド変換（モデル空間。PMDSkeletonで求めたもの。頂点のボーン番号で直接引くので、ボーンパレットに分けたモデルには使えない）
+		size_t boneCount;
+		const DirectX::XMVECTOR* pMorphDeltas;	// 先頭からmorphedCount個の頂点の表情オフセット（なければnullptr）
+		size_t morphedCount;
+	};
+
+	// 並列に処理するときの1ジョブあたりの頂点数
+	constexpr size_t SkinningChunkSize = 2048;
+
+	// CPUでスキニングする（BasicVertexShaderと同じ2ボーンのブレンド）
+	// 行列は bones[boneNo[0]] * w + bones[boneNo[1]] * (1 - w)（w = boneWeight / 100）で、
+	// 表情のオフセットを足した座標と法線をこの行列で変換する（法線は変換後に正規化する）
+	// 範囲外のボーン番号は単位行列として扱う。pDstは頂点番号で参照し、[begin, end)だけ書き込む
+	// AVX2が使えれば2頂点ずつ、SSE2が使えれば1頂点ずつ128ビット演算で処理する
+	void SkinVertices(const SkinningSource& source, size_t begin, size_t end, SkinnedVertex* pDst);
+
+	// CPUでスキニングする（スカラー版。検証用の基準）
+	void SkinVerticesScalar(const SkinningSource& source, size_t begin, size_t end, SkinnedVertex* pDst);
+
+	// 頂点をSkinningChunkSize個ずつに分けて並列にスキニングする
+	void SkinVerticesParallel(WorkStealingPool* pPool, const SkinningSource& source, SkinnedVertex* pDst);
+
+	// ボーンのワールド変換（拡大縮小を含まないこと）を双対クォータニオンへ変換する
+	void ConvertToDualQuaternions(const DirectX::XMMATRIX* pBones, size_t count, DualQuaternion* pDst);
+
+	// 双対クォータニオンでスキニングする（スカラー版。シェーダーのDUAL_QUATERNION_SKINNINGと同じ計算）
+	// ボーンはsource.pBonesの代わりにpBones（source.boneCount個）を使う
+	// 2つの回転の内積が負なら片方の符号を反転して短い方の回転で補間し、ブレンド結果を正規化してから変換する
+	void SkinVerticesDualQuaternionScalar(const SkinningSource& source, const DualQuaternion* pBones, size_t begin, size_t end, SkinnedVertex* pDst);
+}
@@ -0,0 +1,217 @@
+﻿#include "PMDVertexPacking.h"
+
+// std
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define PMD_VERTEX_PACKING_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace pmd
+{
+	namespace
+	{
+		// floatのビット列
+		uint32_t AsUInt(float value)
+		{
+			uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			return bits;
+		}
+
+		float AsFloat(uint32_t bits)
+		{
+			float value;
+			std::memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		// floatからhalfへの変換（SIMD版と同じ手順で丸める）
+		uint16_t FloatToHalf(float value)
+		{
+			constexpr uint32_t F32Infinity = 255u << 23;
+			constexpr uint32_t F16Infinity = 31u << 23;
+			constexpr uint32_t Magic = 15u << 23;
+			constexpr uint32_t RoundMask = ~0xfffu;
+
+			auto bits = AsUInt(value);
+			auto sign = bits & 0x80000000u;
+			bits ^= sign;
+
+			uint32_t half;
+			if (bits >= F32Infinity) {
+				// NaNとInf
+				half = bits > F32Infinity ? 0x7e00 : 0x7c00;
+			}
+			else {
+				// 指数を付け替えて仮数の上位を取り出す（オーバーフローはInfに飽和）
+				auto scaled = AsUInt(AsFloat(bits & RoundMask) * AsFloat(Magic)) - RoundMask;
+				if (scaled > F16Infinity) {
+					scaled = F16Infinity;
+				}
+				half = scaled >> 13;
+			}
+			return static_cast<uint16_t>(half | (sign >> 16));
+		}
+
+		// 八面体写像で法線を2成分へ（snorm16）
+		void EncodeOctahedron(const DirectX::XMFLOAT3& normal, int16_t* pEncoded)
+		{
+			auto l1 = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+			auto invL1 = l1 > 0.0f ? 1.0f / l1 : 0.0f;
+			auto x = normal.x * invL1;
+			auto y = normal.y * invL1;
+
+			// 下半球は対角線で折り返す
+			if (normal.z < 0.0f) {
+				auto foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+				auto foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+				x = foldedX;
+				y = foldedY;
+			}
+
+			// 最近接偶数丸め（_mm_cvtps_epi32と同じ）
+			pEncoded[0] = static_cast<int16_t>(std::nearbyint(std::fmin(std::fmax(x, -1.0f), 1.0f) * 32767.0f));
+			pEncoded[1] = static_cast<int16_t>(std::nearbyint(std::fmin(std::fmax(y, -1.0f), 1.0f) * 32767.0f));
+		}
+
+		// 1頂点分の圧縮
+		void PackVertex(const SerializedVertex& src, PackedVertex* pDst)
+		{
+			pDst->pos = src.pos;
+			EncodeOctahedron(src.normal, pDst->normal);
+			pDst->uv[0] = FloatToHalf(src.uv.x);
+			pDst->uv[1] = FloatToHalf(src.uv.y);
+			pDst->boneNo[0] = static_cast<uint8_t>(src.boneNo[0]);
+			pDst->boneNo[1] = static_cast<uint8_t>(src.boneNo[1]);
+			pDst->boneWeight = src.boneWeight;
+			pDst->edgeFlg = src.endflg;
+		}
+
+#ifdef PMD_VERTEX_PACKING_SSE2
+		// floatからhalfへの変換（4要素）
+		__m128i FloatToHalf4(__m128 value)
+		{
+			const auto signMask = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(0x80000000u)));
+			const auto roundMask = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(~0xfffu)));
+			const auto f32Infinity = _mm_set1_epi32(255 << 23);
+			const auto magic = _mm_castsi128_ps(_mm_set1_epi32(15 << 23));
+			const auto nanBit = _mm_set1_epi32(0x200);
+			const auto f16Infinity = _mm_set1_epi32(0x7c00);
+			// 丸め後にF16のInfへ飽和する値
+			const auto clampValue = _mm_castsi128_ps(_mm_set1_epi32((31 << 23) - 0x1000));
+
+			auto sign = _mm_and_ps(signMask, value);
+			auto absValue = _mm_xor_ps(value, sign);
+			auto absBits = _mm_castps_si128(absValue);
+			auto isNaN = _mm_cmpgt_epi32(absBits, f32Infinity);
+			auto isFinite = _mm_cmpgt_epi32(f32Infinity, absBits);
+			auto infOrNaN = _mm_or_si128(_mm_and_si128(isNaN, nanBit), f16Infinity);
+
+			auto scaled = _mm_mul_ps(_mm_and_ps(absValue, roundMask), magic);
+			auto clamped = _mm_min_ps(scaled, clampValue);
+			auto biased = _mm_sub_epi32(_mm_castps_si128(clamped), _mm_castps_si128(roundMask));
+			auto finite = _mm_and_si128(_mm_srli_epi32(biased, 13), isFinite);
+			auto joined = _mm_or_si128(finite, _mm_andnot_si128(isFinite, infOrNaN));
+			return _mm_or_si128(joined, _mm_srli_epi32(_mm_castps_si128(sign), 16));
+		}
+
+		// 八面体写像（4要素）
+		void EncodeOctahedron4(__m128 x, __m128 y, __m128 z, __m128i* pEncodedX, __m128i* pEncodedY)
+		{
+			const auto absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+			const auto signMask = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(0x80000000u)));
+			const auto zero = _mm_setzero_ps();
+			const auto one = _mm_set1_ps(1.0f);
+
+			auto l1 = _mm_add_ps(_mm_add_ps(_mm_and_ps(x, absMask), _mm_and_ps(y, absMask)), _mm_and_ps(z, absMask));
+			auto invL1 = _mm_and_ps(_mm_div_ps(one, l1), _mm_cmpgt_ps(l1, zero));
+			x = _mm_mul_ps(x, invL1);
+			y = _mm_mul_ps(y, invL1);
+
+			// 下半球は対角線で折り返す（x >= 0なら+1、それ以外は-1）
+			auto signX = _mm_or_ps(one, _mm_andnot_ps(_mm_cmpge_ps(x, zero), signMask));
+			auto signY = _mm_or_ps(one, _mm_andnot_ps(_mm_cmpge_ps(y, zero), signMask));
+			auto foldedX = _mm_mul_ps(_mm_sub_ps(one, _mm_and_ps(y, absMask)), signX);
+			auto foldedY = _mm_mul_ps(_mm_sub_ps(one, _mm_and_ps(x, absMask)), signY);
+			auto lower = _mm_cmplt_ps(z, zero);
+			x = _mm_or_ps(_mm_and_ps(lower, foldedX), _mm_andnot_ps(lower, x));
+			y = _mm_or_ps(_mm_and_ps(lower, foldedY), _mm_andnot_ps(lower, y));
+
+			const auto minusOne = _mm_set1_ps(-1.0f);
+			const auto scale = _mm_set1_ps(32767.0f);
+			*pEncodedX = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(x, minusOne), one), scale));
+			*pEncodedY = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(y, minusOne), one), scale));
+		}
+#endif // PMD_VERTEX_PACKING_SSE2
+	}
+
+	// 圧縮頂点で表現できるか
+	bool CanPackVertices(const ArrayView<SerializedVertex>& vertices, size_t numberOfBone)
+	{
+		constexpr size_t MaxPackedBones = 256;
+		if (numberOfBone > MaxPackedBones) {
+			return false;
+		}
+		for (const auto& vertex : vertices) {
+			if (vertex.boneNo[0] >= MaxPackedBones || vertex.boneNo[1] >= MaxPackedBones) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// 頂点を圧縮する
+	void PackVertices(const SerializedVertex* pSrc, size_t count, PackedVertex* pDst)
+	{
+		size_t i = 0;
+#ifdef PMD_VERTEX_PACKING_SSE2
+		// 38バイト間隔で並んでいるため、4頂点分の法線とUVを転置してから計算する
+		for (; i + 4 <= count; i += 4) {
+			const auto* v = pSrc + i;
+			auto nx = _mm_setr_ps(v[0].normal.x, v[1].normal.x, v[2].normal.x, v[3].normal.x);
+			auto ny = _mm_setr_ps(v[0].normal.y, v[1].normal.y, v[2].normal.y, v[3].normal.y);
+			auto nz = _mm_setr_ps(v[0].normal.z, v[1].normal.z, v[2].normal.z, v[3].normal.z);
+			auto u = _mm_setr_ps(v[0].uv.x, v[1].uv.x, v[2].uv.x, v[3].uv.x);
+			auto w = _mm_setr_ps(v[0].uv.y, v[1].uv.y, v[2].uv.y, v[3].uv.y);
+
+			__m128i encodedX, encodedY;
+			EncodeOctahedron4(nx, ny, nz, &encodedX, &encodedY);
+			// 法線(x, y)とUV(u, v)をそれぞれ16ビットずつ組にする
+			auto normals = _mm_or_si128(
+				_mm_and_si128(encodedX, _mm_set1_epi32(0xffff)),
+				_mm_slli_epi32(encodedY, 16));
+			auto uvs = _mm_or_si128(FloatToHalf4(u), _mm_slli_epi32(FloatToHalf4(w), 16));
+
+			alignas(16) uint32_t packedNormals[4];
+			alignas(16) uint32_t packedUVs[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(packedNormals), normals);
+			_mm_store_si128(reinterpret_cast<__m128i*>(packedUVs), uvs);
+
+			for (size_t k = 0; k < 4; k++) {
+				auto& dst = pDst[i + k];
+				dst.pos = v[k].pos;
+				std::memcpy(dst.normal, &packedNormals[k], sizeof(dst.normal));
+				std::memcpy(dst.uv, &packedUVs[k], sizeof(dst.uv));
+				dst.boneNo[0] = static_cast<uint8_t>(v[k].boneNo[0]);
+				dst.boneNo[1] = static_cast<uint8_t>(v[k].boneNo[1]);
+				dst.boneWeight = v[k].boneWeight;
+				dst.edgeFlg = v[k].endflg;
+			}
+		}
+#endif // PMD_VERTEX_PACKING_SSE2
+		for (; i < count; i++) {
+			PackVertex(pSrc[i], &pDst[i]);
+		}
+	}
+
+	// 頂点を圧縮する（スカラー版）
+	void PackVerticesScalar(const SerializedVertex* pSrc, size_t count, PackedVertex* pDst)
+	{
+		for (size_t i = 0; i < count; i++) {
+			PackVertex(pSrc[i], &pDst[i]);
+		}
+	}
+}
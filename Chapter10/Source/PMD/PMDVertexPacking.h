@@ -0,0 +1,43 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+// DirectX
+#include <DirectXMath.h>
+
+#include "ArrayView.h"
+#include "PMDFileFormat.h"
+
+namespace pmd
+{
+	// 頂点バッファーの形式
+	enum class PMDVertexFormat
+	{
+		Standard,	// SerializedVertexそのまま（38バイト）
+		Packed,		// PackedVertex（24バイト）
+	};
+
+	// 圧縮頂点構造体
+	// 法線は八面体写像でsnorm16x2、UVはhalf、ボーン番号・ウェイト・エッジを4バイトに詰める
+	struct PackedVertex
+	{
+		DirectX::XMFLOAT3 pos;
+		int16_t normal[2];
+		uint16_t uv[2];
+		uint8_t boneNo[2];
+		uint8_t boneWeight;
+		uint8_t edgeFlg;
+	};
+	static_assert(sizeof(PackedVertex) == 24, "PackedVertex must be 24 bytes");
+
+	// 圧縮頂点で表現できるか（ボーン番号が8ビットに収まること）
+	bool CanPackVertices(const ArrayView<SerializedVertex>& vertices, size_t numberOfBone);
+
+	// 頂点を圧縮する（SSE2が使えれば4頂点ずつ処理する）
+	void PackVertices(const SerializedVertex* pSrc, size_t count, PackedVertex* pDst);
+
+	// 頂点を圧縮する（スカラー版。PackVerticesと同じ結果になる）
+	void PackVerticesScalar(const SerializedVertex* pSrc, size_t count, PackedVertex* pDst);
+}
@@ -0,0 +1,41 @@
+﻿#pragma once
+
+// std
+#include <cstdint>
+
+// DirectX
+#include <DirectXMath.h>
+
+namespace pmd
+{
+	// VMDヘッダー構造体
+#pragma pack(1)
+	struct VMDHeader
+	{
+		char signature[30];		// "Vocaloid Motion Data 0002"
+		char modelName[20];		// 対象のモデル名
+	};
+#pragma pack()
+
+	// ボーンのキーフレーム
+#pragma pack(1)
+	struct VMDBoneKeyFrame
+	{
+		char boneName[15];
+		uint32_t frameNo;
+		DirectX::XMFLOAT3 location;
+		DirectX::XMFLOAT4 rotation;		// クォータニオン
+		uint8_t interpolation[64];		// 補間曲線。先頭16バイトにX、Y、Z、回転の順で(x1, y1, x2, y2)が4バイトおきに並ぶ
+	};
+#pragma pack()
+
+	// 表情のキーフレーム
+#pragma pack(1)
+	struct VMDMorphKeyFrame
+	{
+		char morphName[15];
+		uint32_t frameNo;
+		float weight;
+	};
+#pragma pack()
+}
@@ -0,0 +1,162 @@
+﻿#include "ShiftJIS.h"
+
+// std
+#include <cstdint>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define SHIFT_JIS_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "ShiftJISTable.h"
+
+namespace
+{
+	// 変換できないバイト列の代わりに出力する文字
+	constexpr uint16_t ReplacementCharacter = 0xfffd;
+
+	// ASCIIを判定する単位
+	constexpr size_t ASCIIBlockSize = 16;
+
+	// 先行バイトに対応する変換表の行（先行バイトでなければ-1）
+	int GetLeadRow(unsigned char c)
+	{
+		if (c >= 0x81 && c <= 0x9f) {
+			return c - 0x81;
+		}
+		if (c >= 0xe0 && c <= 0xfc) {
+			return c - 0xe0 + (0x9f - 0x81 + 1);
+		}
+		return -1;
+	}
+
+	// ASCII以外の1文字を変換して読み込み位置を進める
+	uint16_t DecodeCharacter(const unsigned char* pSrc, size_t length, size_t* pPosition)
+	{
+		auto& i = *pPosition;
+		auto c = pSrc[i++];
+		auto row = GetLeadRow(c);
+		if (row < 0) {
+			return ShiftJISSingleByteTable[c];
+		}
+
+		// 後続バイトになれない値なら先行バイトだけを捨て、続きは次の文字として読む
+		if (i >= length) {
+			return ReplacementCharacter;
+		}
+		auto trail = pSrc[i];
+		if (trail < ShiftJISTrailFirst || trail >= ShiftJISTrailFirst + ShiftJISTrailCount || trail == 0x7f) {
+			return ReplacementCharacter;
+		}
+		i++;
+		return ShiftJISDoubleByteTable[row * ShiftJISTrailCount + (trail - ShiftJISTrailFirst)];
+	}
+
+	// UTF-8で書き込み、書き込んだバイト数を返す（基本多言語面のみ）
+	size_t EncodeUTF8(uint16_t code, char* pDst)
+	{
+		if (code < 0x80) {
+			pDst[0] = static_cast<char>(code);
+			return 1;
+		}
+		if (code < 0x800) {
+			pDst[0] = static_cast<char>(0xc0 | (code >> 6));
+			pDst[1] = static_cast<char>(0x80 | (code & 0x3f));
+			return 2;
+		}
+		pDst[0] = static_cast<char>(0xe0 | (code >> 12));
+		pDst[1] = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+		pDst[2] = static_cast<char>(0x80 | (code & 0x3f));
+		return 3;
+	}
+
+#ifdef SHIFT_JIS_SSE2
+	// 16バイトがすべてASCIIならレジスターに読み込む
+	bool LoadASCIIBlock(const unsigned char* pSrc, __m128i* pBlock)
+	{
+		*pBlock = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc));
+		return _mm_movemask_epi8(*pBlock) == 0;
+	}
+
+	// ASCII 16文字をwchar_tに広げて書き込む
+	void StoreWideASCIIBlock(__m128i block, wchar_t* pDst)
+	{
+		auto zero = _mm_setzero_si128();
+		auto low = _mm_unpacklo_epi8(block, zero);
+		auto high = _mm_unpackhi_epi8(block, zero);
+		auto pOut = reinterpret_cast<__m128i*>(pDst);
+		if (sizeof(wchar_t) == 2) {
+			_mm_storeu_si128(pOut, low);
+			_mm_storeu_si128(pOut + 1, high);
+		}
+		else {
+			_mm_storeu_si128(pOut, _mm_unpacklo_epi16(low, zero));
+			_mm_storeu_si128(pOut + 1, _mm_unpackhi_epi16(low, zero));
+			_mm_storeu_si128(pOut + 2, _mm_unpacklo_epi16(high, zero));
+			_mm_storeu_si128(pOut + 3, _mm_unpackhi_epi16(high, zero));
+		}
+	}
+#endif // SHIFT_JIS_SSE2
+}
+
+/**
+ * Shift-JISをwchar_t列へ変換
+ */
+size_t DecodeShiftJIS(const char* const pSrc, size_t length, wchar_t* const pDst)
+{
+	auto src = reinterpret_cast<const unsigned char*>(pSrc);
+	size_t i = 0;
+	size_t n = 0;
+	while (i < length) {
+		if (src[i] >= 0x80) {
+			pDst[n++] = static_cast<wchar_t>(DecodeCharacter(src, length, &i));
+			continue;
+		}
+
+#ifdef SHIFT_JIS_SSE2
+		// ASCIIの連続は16バイトずつ広げる
+		__m128i block;
+		while (i + ASCIIBlockSize <= length && LoadASCIIBlock(src + i, &block)) {
+			StoreWideASCIIBlock(block, pDst + n);
+			i += ASCIIBlockSize;
+			n += ASCIIBlockSize;
+		}
+#endif // SHIFT_JIS_SSE2
+
+		while (i < length && src[i] < 0x80) {
+			pDst[n++] = static_cast<wchar_t>(src[i++]);
+		}
+	}
+	return n;
+}
+
+/**
+ * Shift-JISをUTF-8へ変換
+ */
+size_t DecodeShiftJISToUTF8(const char* const pSrc, size_t length, char* const pDst)
+{
+	auto src = reinterpret_cast<const unsigned char*>(pSrc);
+	size_t i = 0;
+	size_t n = 0;
+	while (i < length) {
+		if (src[i] >= 0x80) {
+			n += EncodeUTF8(DecodeCharacter(src, length, &i), pDst + n);
+			continue;
+		}
+
+#ifdef SHIFT_JIS_SSE2
+		// ASCIIの連続はそのまま16バイトずつ写す
+		__m128i block;
+		while (i + ASCIIBlockSize <= length && LoadASCIIBlock(src + i, &block)) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + n), block);
+			i += ASCIIBlockSize;
+			n += ASCIIBlockSize;
+		}
+#endif // SHIFT_JIS_SSE2
+
+		while (i < length && src[i] < 0x80) {
+			pDst[n++] = static_cast<char>(src[i++]);
+		}
+	}
+	return n;
+}
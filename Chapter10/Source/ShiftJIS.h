@@ -0,0 +1,26 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+
+// Shift-JIS（CP932）の変換
+// ロケールに依存せず変換表で引く。ASCIIが続く部分はSSE2が使えれば16バイトずつ処理する
+// CP932の文字は全て基本多言語面に収まるので、出力の長さは入力から見積もれる
+
+// wchar_t列へ変換したときの最大文字数
+constexpr size_t GetMaxShiftJISWideLength(size_t length)
+{
+	return length;
+}
+
+// UTF-8へ変換したときの最大バイト数
+constexpr size_t GetMaxShiftJISUTF8Length(size_t length)
+{
+	return length * 3;
+}
+
+// wchar_t列へ変換し、書き込んだ文字数を返す（pDstにはGetMaxShiftJISWideLength文字の領域が必要）
+size_t DecodeShiftJIS(const char* const pSrc, size_t length, wchar_t* const pDst);
+
+// UTF-8へ変換し、書き込んだバイト数を返す（pDstにはGetMaxShiftJISUTF8Lengthバイトの領域が必要）
+size_t DecodeShiftJISToUTF8(const char* const pSrc, size_t length, char* const pDst);
@@ -0,0 +1,18 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+// 2バイト文字の先行バイトの数（0x81～0x9F、0xE0～0xFC）
+constexpr size_t ShiftJISLeadCount = 60;
+
+// 2バイト文字の後続バイトの範囲（0x40～0xFC）
+constexpr unsigned int ShiftJISTrailFirst = 0x40;
+constexpr size_t ShiftJISTrailCount = 189;
+
+// 1バイト文字からUnicodeへの対応（先行バイトは0）
+extern const uint16_t ShiftJISSingleByteTable[256];
+
+// 2バイト文字からUnicodeへの対応
+extern const uint16_t ShiftJISDoubleByteTable[ShiftJISLeadCount * ShiftJISTrailCount];
@@ -0,0 +1,72 @@
+﻿#include "ThreadPool.h"
+
+// std
+#include <algorithm>
+#include <utility>
+
+// コンストラクター
+ThreadPool::ThreadPool(size_t numberOfThreads, task_t threadInit, task_t threadExit) :
+	_threads(), _tasks(), _mutex(), _condition(), _stopping(false)
+{
+	if (numberOfThreads == 0) {
+		// 呼び出し元のスレッドの分を残す
+		auto hardwareThreads = static_cast<size_t>(std::thread::hardware_concurrency());
+		numberOfThreads = std::max<size_t>(hardwareThreads, 2) - 1;
+	}
+
+	_threads.reserve(numberOfThreads);
+	for (size_t i = 0; i < numberOfThreads; i++) {
+		_threads.emplace_back([this, threadInit, threadExit]() {
+			WorkerMain(threadInit, threadExit);
+		});
+	}
+}
+
+// デストラクター（残っているタスクを処理し終えてから終了する）
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_condition.notify_all();
+	for (auto& thread : _threads) {
+		thread.join();
+	}
+}
+
+// タスクを追加
+void ThreadPool::Enqueue(task_t task)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_tasks.push_back(std::move(task));
+	}
+	_condition.notify_one();
+}
+
+// ワーカースレッドの本体
+void ThreadPool::WorkerMain(const task_t& threadInit, const task_t& threadExit)
+{
+	if (threadInit) {
+		threadInit();
+	}
+
+	for (;;) {
+		task_t task;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+			if (_tasks.empty()) {
+				break;
+			}
+			task = std::move(_tasks.front());
+			_tasks.pop_front();
+		}
+		task();
+	}
+
+	if (threadExit) {
+		threadExit();
+	}
+}
@@ -0,0 +1,44 @@
+﻿#pragma once
+
+// std
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 固定数のワーカースレッドでタスクを順に処理するスレッドプール
+class ThreadPool
+{
+public:
+	using task_t = std::function<void()>;
+
+	// numberOfThreadsが0ならハードウェアスレッド数-1（最低1）
+	// threadInit/threadExitは各ワーカースレッドの開始時と終了時に呼ばれる（COMの初期化など）
+	ThreadPool(size_t numberOfThreads = 0, task_t threadInit = nullptr, task_t threadExit = nullptr);
+	virtual ~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// タスクを追加
+	void Enqueue(task_t task);
+
+	// ワーカースレッド数
+	size_t GetNumberOfThreads() const
+	{
+		return _threads.size();
+	}
+
+private:
+	std::vector<std::thread> _threads;
+	std::deque<task_t> _tasks;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	bool _stopping;
+
+private:
+	void WorkerMain(const task_t& threadInit, const task_t& threadExit);
+};
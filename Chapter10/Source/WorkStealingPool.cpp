@@ -0,0 +1,146 @@
+﻿#include "WorkStealingPool.h"
+
+// std
+#include <algorithm>
+
+// コンストラクター
+WorkStealingPool::WorkStealingPool(size_t numberOfThreads) :
+	_threads(), _queues(), _mutex(), _workCondition(), _doneCondition(), _generation(0), _stopping(false)
+{
+	if (numberOfThreads == 0) {
+		// 呼び出し元のスレッドの分を残す
+		auto hardwareThreads = static_cast<size_t>(std::thread::hardware_concurrency());
+		numberOfThreads = std::max<size_t>(hardwareThreads, 2) - 1;
+	}
+
+	_queues.reserve(numberOfThreads + 1);
+	for (size_t i = 0; i < numberOfThreads + 1; i++) {
+		_queues.emplace_back(new JobQueue());
+	}
+
+	_threads.reserve(numberOfThreads);
+	for (size_t i = 0; i < numberOfThreads; i++) {
+		_threads.emplace_back([this, i]() {
+			WorkerMain(i + 1);
+		});
+	}
+}
+
+// デストラクター
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_workCondition.notify_all();
+	for (auto& thread : _threads) {
+		thread.join();
+	}
+}
+
+// 範囲を分けて並列に処理する
+void WorkStealingPool::ParallelFor(size_t count, size_t grainSize, const range_task_t& task)
+{
+	if (count == 0) {
+		return;
+	}
+	grainSize = std::max<size_t>(grainSize, 1);
+	auto numberOfJobs = (count + grainSize - 1) / grainSize;
+
+	// ジョブが1つなら他のスレッドを起こさない
+	// ワーカースレッドがなくても、以下で呼び出し元がgrainSize個ずつのジョブを順に処理する
+	if (numberOfJobs == 1) {
+		task(0, count);
+		return;
+	}
+
+	Batch batch;
+	batch.pTask = &task;
+	batch.remaining = numberOfJobs;
+
+	// 各キューに連続したジョブを配る
+	auto numberOfQueues = _queues.size();
+	for (size_t q = 0; q < numberOfQueues; q++) {
+		auto firstJob = numberOfJobs * q / numberOfQueues;
+		auto lastJob = numberOfJobs * (q + 1) / numberOfQueues;
+		std::lock_guard<std::mutex> lock(_queues[q]->mutex);
+		for (auto j = firstJob; j < lastJob; j++) {
+			_queues[q]->jobs.push_back(Job{ &batch, j * grainSize, std::min((j + 1) * grainSize, count) });
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_generation++;
+	}
+	_workCondition.notify_all();
+
+	// 呼び出し元も処理に加わり、取れるジョブがなくなったら残りを待つ
+	Job job;
+	while (PopJob(0, &job)) {
+		RunJob(job);
+	}
+	std::unique_lock<std::mutex> lock(_mutex);
+	_doneCondition.wait(lock, [&batch]() { return batch.remaining.load() == 0; });
+}
+
+// ワーカースレッドの本体
+void WorkStealingPool::WorkerMain(size_t queueIdx)
+{
+	uint64_t generation = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_workCondition.wait(lock, [&]() { return _stopping || _generation != generation; });
+			if (_stopping) {
+				break;
+			}
+			generation = _generation;
+		}
+
+		Job job;
+		while (PopJob(queueIdx, &job)) {
+			RunJob(job);
+		}
+	}
+}
+
+// ジョブを取る
+bool WorkStealingPool::PopJob(size_t queueIdx, Job* pJob)
+{
+	{
+		auto& queue = *_queues[queueIdx];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			*pJob = queue.jobs.front();
+			queue.jobs.pop_front();
+			return true;
+		}
+	}
+
+	// 隣のキューから順に末尾を奪う
+	auto numberOfQueues = _queues.size();
+	for (size_t i = 1; i < numberOfQueues; i++) {
+		auto& victim = *_queues[(queueIdx + i) % numberOfQueues];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.jobs.empty()) {
+			*pJob = victim.jobs.back();
+			victim.jobs.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+// ジョブを処理する
+void WorkStealingPool::RunJob(const Job& job)
+{
+	auto pBatch = job.pBatch;
+	(*pBatch->pTask)(job.begin, job.end);
+
+	// 減らした後はバッチに触れない（呼び出し元が破棄してよい）
+	if (--pBatch->remaining == 0) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_doneCondition.notify_all();
+	}
+}
@@ -0,0 +1,81 @@
+﻿#pragma once
+
+// std
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 範囲を小さなジョブに分けて並列に処理するスレッドプール
+// ジョブは参加するスレッドごとのキューに連続した範囲で配り、自分のキューが空になったスレッドは
+// 他のスレッドのキューの末尾から奪って処理する（ワークスティーリング）
+// 呼び出し元のスレッドも処理に加わる
+class WorkStealingPool
+{
+public:
+	using range_task_t = std::function<void(size_t begin, size_t end)>;
+
+	// numberOfThreadsは呼び出し元以外のワーカースレッド数。0ならハードウェアスレッド数-1
+	WorkStealingPool(size_t numberOfThreads = 0);
+	virtual ~WorkStealingPool();
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	// [0, count)をgrainSize個ずつのジョブに分けて処理し、すべて終わるまで待つ
+	// 分け方はスレッド数によらないので、ジョブの中身が他のジョブに依存しなければ結果も変わらない
+	// 同時に呼べるのは1スレッドだけで、taskの中から呼んではいけない
+	void ParallelFor(size_t count, size_t grainSize, const range_task_t& task);
+
+	// ワーカースレッド数（呼び出し元を除く）
+	size_t GetNumberOfThreads() const
+	{
+		return _threads.size();
+	}
+
+private:
+	// 1回のParallelForの状態
+	struct Batch
+	{
+		const range_task_t* pTask;
+		std::atomic<size_t> remaining;
+	};
+
+	// ジョブ（[begin, end)）
+	struct Job
+	{
+		Batch* pBatch;
+		size_t begin;
+		size_t end;
+	};
+
+	// スレッドごとのジョブキュー（先頭から自分で取り、末尾から奪われる）
+	struct JobQueue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<std::thread> _threads;
+	std::vector<std::unique_ptr<JobQueue>> _queues;	// 0は呼び出し元
+	std::mutex _mutex;
+	std::condition_variable _workCondition;
+	std::condition_variable _doneCondition;
+	uint64_t _generation;
+	bool _stopping;
+
+private:
+	void WorkerMain(size_t queueIdx);
+
+	// 自分のキューか他のキューからジョブを取る
+	bool PopJob(size_t queueIdx, Job* pJob);
+
+	// ジョブを処理して、最後のジョブなら待っている呼び出し元を起こす
+	void RunJob(const Job& job);
+};
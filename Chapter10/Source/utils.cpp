@@ -1,34 +1,162 @@
 ﻿#include "utils.h"
 
+#ifdef _WIN32
+// Windows
+#include <Windows.h>
+#else
+// POSIX
+#include <sys/stat.h>
+#endif // _WIN32
+
+#include "ShiftJIS.h"
+
 /**
  * std::stringをstd::wstringに変換
  */
 std::wstring GetWString(const std::string& srcString)
 {
-	std::wstring dstString;
-	for (size_t i = 0; i < srcString.length(); i++)
-	{
-		wchar_t w;
-		mbtowc(&w, &srcString.at(i), 1);
-		dstString.push_back(w);
-	}
-	return dstString;
+	return GetWString(srcString.data(), srcString.size());
 }
 
 /**
  * null終端文字列をstd::wstringに変換
  */
 std::wstring GetWString(const char* const rawString, size_t length)
+{
+	std::wstring dstString(GetMaxShiftJISWideLength(length), L'\0');
+	dstString.resize(DecodeShiftJIS(rawString, length, &dstString[0]));
+	return dstString;
+}
+
+/**
+ * Shift-JIS文字列をUTF-8文字列に変換
+ */
+std::string GetUTF8StringFromShiftJIS(const char* const rawString, size_t length)
+{
+	std::string dstString(GetMaxShiftJISUTF8Length(length), '\0');
+	dstString.resize(DecodeShiftJISToUTF8(rawString, length, &dstString[0]));
+	return dstString;
+}
+
+/**
+ * UTF-8文字列をstd::wstringに変換
+ */
+std::wstring GetWStringFromUTF8(const char* const utf8String, size_t length)
 {
 	std::wstring dstString;
-	for (size_t i = 0; i < length; i++) {
-		wchar_t w;
-		mbtowc(&w, &rawString[i], 1);
-		dstString.push_back(w);
+	dstString.reserve(length);
+	size_t i = 0;
+	while (i < length) {
+		auto c = static_cast<unsigned char>(utf8String[i]);
+		unsigned int code;
+		size_t trailing;
+		if (c < 0x80) {
+			code = c;
+			trailing = 0;
+		}
+		else if ((c & 0xe0) == 0xc0) {
+			code = c & 0x1f;
+			trailing = 1;
+		}
+		else if ((c & 0xf0) == 0xe0) {
+			code = c & 0x0f;
+			trailing = 2;
+		}
+		else {
+			code = c & 0x07;
+			trailing = 3;
+		}
+		i++;
+		for (size_t k = 0; k < trailing && i < length; k++, i++) {
+			code = (code << 6) | (static_cast<unsigned char>(utf8String[i]) & 0x3f);
+		}
+		if (sizeof(wchar_t) == 2 && code >= 0x10000) {
+			// UTF-16ではサロゲートペアにする
+			code -= 0x10000;
+			dstString.push_back(static_cast<wchar_t>(0xd800 | (code >> 10)));
+			dstString.push_back(static_cast<wchar_t>(0xdc00 | (code & 0x3ff)));
+		}
+		else {
+			dstString.push_back(static_cast<wchar_t>(code));
+		}
 	}
 	return dstString;
 }
 
+/**
+ * std::wstringをUTF-8文字列に変換
+ */
+std::string GetUTF8String(const std::wstring& srcString)
+{
+	std::string dstString;
+	dstString.reserve(srcString.size());
+	for (size_t i = 0; i < srcString.size(); i++) {
+		auto code = static_cast<unsigned int>(srcString[i]);
+		if (sizeof(wchar_t) == 2 && (code & 0xfc00) == 0xd800 && i + 1 < srcString.size()) {
+			// サロゲートペア
+			auto low = static_cast<unsigned int>(srcString[++i]);
+			code = 0x10000 + ((code & 0x3ff) << 10) + (low & 0x3ff);
+		}
+		if (code < 0x80) {
+			dstString.push_back(static_cast<char>(code));
+		}
+		else if (code < 0x800) {
+			dstString.push_back(static_cast<char>(0xc0 | (code >> 6)));
+			dstString.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+		}
+		else if (code < 0x10000) {
+			dstString.push_back(static_cast<char>(0xe0 | (code >> 12)));
+			dstString.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+			dstString.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+		}
+		else {
+			dstString.push_back(static_cast<char>(0xf0 | (code >> 18)));
+			dstString.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3f)));
+			dstString.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+			dstString.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+		}
+	}
+	return dstString;
+}
+
+/**
+ * ファイルが存在するか
+ */
+bool FileExists(const std::wstring& path)
+{
+#ifdef _WIN32
+	auto attributes = ::GetFileAttributesW(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0;
+#else
+	struct stat st = {};
+	return ::stat(GetUTF8String(path).c_str(), &st) == 0 && S_ISREG(st.st_mode);
+#endif // _WIN32
+}
+
+/**
+ * ファイルのサイズと最終更新時刻
+ */
+bool GetFileStamp(const std::wstring& path, uint64_t* pSize, uint64_t* pWriteTime)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data = {};
+	if (!::GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data)) {
+		return false;
+	}
+	*pSize = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+	*pWriteTime = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+	return true;
+#else
+	struct stat st = {};
+	if (::stat(GetUTF8String(path).c_str(), &st) != 0) {
+		return false;
+	}
+	*pSize = static_cast<uint64_t>(st.st_size);
+	*pWriteTime = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ull + static_cast<uint64_t>(st.st_mtim.tv_nsec);
+	return true;
+#endif // _WIN32
+}
+
 /**
  * 入力ファイル名から拡張子を取得
  */
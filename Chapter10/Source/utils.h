@@ -1,6 +1,7 @@
 ﻿#pragma once;
 
 // std
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -21,12 +22,27 @@ std::vector<std::basic_string<T>> Split(std::basic_string<T> str, T separator)
 	return result;
 }
 
-// std::stringをstd::wstringに変換
+// std::string（Shift-JIS）をstd::wstringに変換
 std::wstring GetWString(const std::string& srcString);
 
-// null終端文字列をstd::wstringに変換
+// null終端文字列（Shift-JIS）をstd::wstringに変換
 std::wstring GetWString(const char* const rawString, size_t length);
 
+// Shift-JIS文字列をUTF-8文字列に変換
+std::string GetUTF8StringFromShiftJIS(const char* const rawString, size_t length);
+
+// UTF-8文字列をstd::wstringに変換
+std::wstring GetWStringFromUTF8(const char* const utf8String, size_t length);
+
+// std::wstringをUTF-8文字列に変換
+std::string GetUTF8String(const std::wstring& srcString);
+
+// ファイルが存在するか
+bool FileExists(const std::wstring& path);
+
+// ファイルのサイズと最終更新時刻（比較にだけ使う。単位は環境による）
+bool GetFileStamp(const std::wstring& path, uint64_t* pSize, uint64_t* pWriteTime);
+
 // 入力ファイル名から拡張子を取得(std::string)
 std::string GetExtension(const std::string& path);
 
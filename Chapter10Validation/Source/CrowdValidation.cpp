@@ -0,0 +1,235 @@
+﻿// std
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "PMD/PMDBoneNameTable.h"
+#include "PMD/PMDCookedModel.h"
+#include "PMD/PMDIKSolver.h"
+#include "PMD/PMDMotion.h"
+#include "PMD/PMDMotionSampler.h"
+#include "PMD/PMDSkeleton.h"
+#include "PMD/VMDFileFormat.h"
+#include "Validation.h"
+#include "WorkStealingPool.h"
+
+namespace
+{
+	// 群衆のアクター数（1,000体のテストシーン）と1ジョブで更新するアクター数（PMDScene::ActorsPerJobと同じ）
+	constexpr size_t CrowdSize = 1000;
+	constexpr size_t ActorsPerJob = 16;
+
+	// 全ボーンに一定間隔でキーを打ったVMDイメージ（回転は小さく、センターなど親のないボーンは少し動かす）
+	std::vector<unsigned char> CreateTestMotion(const ArrayView<pmd::CookedBone>& bones, std::mt19937* pRandom)
+	{
+		constexpr uint32_t KeyInterval = 5;
+		constexpr uint32_t LastFrame = 120;
+		std::uniform_real_distribution<float> angle(-0.5f, 0.5f);
+		std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+
+		std::vector<pmd::VMDBoneKeyFrame> keys;
+		for (const auto& bone : bones) {
+			// VMDのボーン名は15バイトまで
+			auto length = strnlen(bone.boneName, sizeof(bone.boneName));
+			if (length > sizeof(pmd::VMDBoneKeyFrame::boneName)) {
+				continue;
+			}
+			for (uint32_t frame = 0; frame <= LastFrame; frame += KeyInterval) {
+				pmd::VMDBoneKeyFrame key = {};
+				std::memcpy(key.boneName, bone.boneName, length);
+				key.frameNo = frame;
+				if (bone.parentIdx == pmd::InvalidBoneIndex) {
+					key.location = DirectX::XMFLOAT3(offset(*pRandom), offset(*pRandom), offset(*pRandom));
+				}
+				auto rotation = DirectX::XMQuaternionRotationRollPitchYaw(angle(*pRandom), angle(*pRandom), angle(*pRandom));
+				DirectX::XMStoreFloat4(&key.rotation, rotation);
+				for (size_t i = 0; i < 16; i++) {
+					key.interpolation[i] = static_cast<uint8_t>((i & 8) ? 107 : 20);
+				}
+				keys.push_back(key);
+			}
+		}
+
+		pmd::VMDHeader header = {};
+		std::memcpy(header.signature, "Vocaloid Motion Data 0002", 25);
+		auto keyCount = static_cast<uint32_t>(keys.size());
+		uint32_t morphCount = 0;
+		std::vector<unsigned char> image(sizeof(header) + sizeof(keyCount) + sizeof(pmd::VMDBoneKeyFrame) * keys.size() + sizeof(morphCount));
+		auto* pCursor = image.data();
+		std::memcpy(pCursor, &header, sizeof(header));
+		pCursor += sizeof(header);
+		std::memcpy(pCursor, &keyCount, sizeof(keyCount));
+		pCursor += sizeof(keyCount);
+		std::memcpy(pCursor, keys.data(), sizeof(pmd::VMDBoneKeyFrame) * keys.size());
+		pCursor += sizeof(pmd::VMDBoneKeyFrame) * keys.size();
+		std::memcpy(pCursor, &morphCount, sizeof(morphCount));
+		return image;
+	}
+
+	// モデルとモーション（アクター間で共有する部分）
+	struct CrowdModel
+	{
+		pmd::PMDCookedModel cookedModel;
+		pmd::PMDSkeleton skeleton;
+		pmd::PMDIKSolver ikSolver;
+		pmd::PMDMotion motion;
+	};
+
+	// D3D12のリソースを持たないアクター（PMDActorのUpdatePose、SolveIKBatch、ボーンの伝播、WriteTransformsと同じ処理を行う）
+	struct CrowdActor
+	{
+		pmd::PMDMotionSampler sampler;
+		pmd::PMDPose pose;
+		float frame;
+		std::vector<DirectX::XMMATRIX> localMatrices;
+		std::vector<DirectX::XMMATRIX> boneMatrices;
+		std::vector<DirectX::XMMATRIX> palette;		// 定数バッファーの代わり
+	};
+
+	// 再生位置をずらした群衆
+	std::vector<std::unique_ptr<CrowdActor>> CreateCrowd(const CrowdModel& model)
+	{
+		auto numberOfBone = model.skeleton.size();
+		std::vector<std::unique_ptr<CrowdActor>> actors(CrowdSize);
+		for (size_t i = 0; i < CrowdSize; i++) {
+			actors[i].reset(new CrowdActor());
+			auto& actor = *actors[i];
+			actor.sampler.Reset(numberOfBone);
+			actor.pose.Reset(numberOfBone);
+			actor.frame = static_cast<float>((i * 7) % (model.motion.GetLastFrame() + 1));
+			actor.localMatrices.resize(numberOfBone);
+			actor.boneMatrices.resize(numberOfBone);
+			actor.palette.resize(numberOfBone);
+		}
+		return actors;
+	}
+
+	// [begin, end)のアクターを1フレーム進める（PMDScene::UpdateActorsの1ジョブ分）
+	void UpdateCrowd(const CrowdModel& model, std::vector<std::unique_ptr<CrowdActor>>& actors, size_t begin, size_t end, float elapsedTime)
+	{
+		pmd::PMDPose* poses[ActorsPerJob] = {};
+		DirectX::XMMATRIX* localMatrices[ActorsPerJob] = {};
+		DirectX::XMMATRIX* boneMatrices[ActorsPerJob] = {};
+		const DirectX::XMMATRIX* constLocalMatrices[ActorsPerJob] = {};
+		size_t count = 0;
+		auto lastFrame = static_cast<float>(model.motion.GetLastFrame());
+		for (auto i = begin; i < end; i++) {
+			auto& actor = *actors[i];
+			actor.frame += elapsedTime * pmd::PMDMotion::FrameRate;
+			if (actor.frame > lastFrame) {
+				actor.frame = std::fmod(actor.frame, lastFrame);
+			}
+			actor.sampler.Sample(model.motion, actor.frame, &actor.pose);
+			model.skeleton.ComputeLocalMatrices(actor.pose, actor.localMatrices.data());
+			poses[count] = &actor.pose;
+			localMatrices[count] = actor.localMatrices.data();
+			constLocalMatrices[count] = actor.localMatrices.data();
+			boneMatrices[count] = actor.boneMatrices.data();
+			count++;
+		}
+		model.ikSolver.SolveBatch(model.skeleton, poses, localMatrices, boneMatrices, count);
+		model.skeleton.ComputeWorldMatricesBatch(constLocalMatrices, boneMatrices, count);
+		for (auto i = begin; i < end; i++) {
+			auto& actor = *actors[i];
+			std::copy(actor.boneMatrices.begin(), actor.boneMatrices.end(), actor.palette.begin());
+		}
+	}
+
+	// threadCount（呼び出し元を含む）のスレッドで群衆をframeCountフレーム進め、1フレームあたりの時間（マイクロ秒）を返す
+	// ジョブの分け方はスレッド数によらない（1スレッドならプールを使わずに同じジョブを順に処理する）
+	double RunCrowd(const CrowdModel& model, std::vector<std::unique_ptr<CrowdActor>>& actors, size_t threadCount, size_t frameCount)
+	{
+		constexpr float FrameTime = 1.0f / 60.0f;
+		std::unique_ptr<WorkStealingPool> pool(threadCount > 1 ? new WorkStealingPool(threadCount - 1) : nullptr);
+		return MeasureMicroseconds(frameCount, [&]() {
+			auto task = [&](size_t begin, size_t end) {
+				UpdateCrowd(model, actors, begin, end, FrameTime);
+			};
+			if (pool) {
+				pool->ParallelFor(actors.size(), ActorsPerJob, task);
+			}
+			else {
+				for (size_t begin = 0; begin < actors.size(); begin += ActorsPerJob) {
+					task(begin, std::min(begin + ActorsPerJob, actors.size()));
+				}
+			}
+		});
+	}
+
+	// 全アクターのパレットがバイト単位で一致するか
+	bool IsSameCrowd(const std::vector<std::unique_ptr<CrowdActor>>& a, const std::vector<std::unique_ptr<CrowdActor>>& b)
+	{
+		for (size_t i = 0; i < a.size(); i++) {
+			if (a[i]->frame != b[i]->frame
+				|| std::memcmp(a[i]->palette.data(), b[i]->palette.data(), sizeof(DirectX::XMMATRIX) * a[i]->palette.size()) != 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+// 群衆のフレーム更新（モーションのサンプリング、IK、ボーンの伝播、パレットの書き込み）をワークスティーリングで並列に行う検証
+// スレッド数を変えても全アクターのパレットがビット単位で一致すること
+// ベンチマークは1,000体の1フレームあたりの時間を1スレッドからハードウェアスレッド数まで2倍ずつ測り、1スレッドに対する速度比を表示する
+bool ValidateCrowd(bool benchmark)
+{
+	printf("PMDScene crowd update\n");
+
+	CrowdModel model;
+	auto filename = std::wstring(ModelFolder) + L"/初音ミク.pmd";
+	if (!Expect(model.cookedModel.LoadOrCook(filename, ModelFolder), "cannot load the model (run from the Chapter10Validation folder)")) {
+		return false;
+	}
+	const auto& bones = model.cookedModel.GetBones();
+	model.skeleton.Assign(bones);
+	model.ikSolver.Assign(model.skeleton, model.cookedModel.GetIKChains(), model.cookedModel.GetIKNodes());
+	pmd::PMDBoneNameTable boneNameTable;
+	boneNameTable.Assign(bones, model.cookedModel.GetBoneNameSlots());
+	std::mt19937 random(1);
+	auto image = CreateTestMotion(bones, &random);
+	if (!Expect(model.motion.Load(image.data(), image.size(), boneNameTable, bones.size()), "cannot load the test motion")) {
+		return false;
+	}
+	model.motion.Compress();
+
+	// 1スレッドと、コア数が少なくても並列に動くように4スレッド以上で比べる
+	constexpr size_t FrameCount = 4;
+	auto hardwareThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	auto serial = CreateCrowd(model);
+	RunCrowd(model, serial, 1, FrameCount);
+	auto parallel = CreateCrowd(model);
+	RunCrowd(model, parallel, std::max<size_t>(hardwareThreads, 4), FrameCount);
+	printf("  %zu actors, %zu bones, %zu IK chains, %u frames of motion\n",
+		CrowdSize, bones.size(), model.cookedModel.GetIKChains().size(), model.motion.GetLastFrame());
+	auto passed = Expect(IsSameCrowd(serial, parallel), "the crowd update depends on the number of threads");
+
+	if (benchmark) {
+		constexpr size_t BenchmarkFrames = 60;
+		std::vector<size_t> threadCounts;
+		for (size_t threadCount = 1; threadCount < hardwareThreads; threadCount *= 2) {
+			threadCounts.push_back(threadCount);
+		}
+		threadCounts.push_back(hardwareThreads);
+		printf("  threads  us per frame  speedup  efficiency\n");
+		double serialTime = 0.0;
+		for (auto threadCount : threadCounts) {
+			auto actors = CreateCrowd(model);
+			RunCrowd(model, actors, threadCount, 1);
+			auto time = RunCrowd(model, actors, threadCount, BenchmarkFrames);
+			if (threadCount == 1) {
+				serialTime = time;
+			}
+			auto speedup = serialTime / time;
+			printf("  %7zu %13.1f %8.2f %10.0f%%\n", threadCount, time, speedup, speedup / threadCount * 100.0);
+		}
+	}
+
+	return passed;
+}
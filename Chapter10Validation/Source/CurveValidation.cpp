@@ -0,0 +1,170 @@
+﻿// std
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "PMD/PMDMotionSampler.h"
+#include "Validation.h"
+
+namespace
+{
+	// 補間曲線の重みの正確な解に対する誤差の上限（PMDMotionSampler.cppのBezierIterationsの説明の通り、区間の幅2^-9と傾きdy/dt <= 3の積）
+	constexpr double MaxCurveError = 3.0 / 512.0;
+
+	// 3次ベジェ曲線（始点0、終点1）の値
+	double EvaluateBezier(double p1, double p2, double t)
+	{
+		auto s = 1.0 - t;
+		return 3.0 * s * s * t * p1 + 3.0 * s * t * t * p2 + t * t * t;
+	}
+
+	// 倍精度の二分法を収束するまで続けた、xに対応するyの正確な解
+	double SolveExact(double x1, double y1, double x2, double y2, double x)
+	{
+		auto low = 0.0;
+		auto high = 1.0;
+		for (int i = 0; i < 60; i++) {
+			auto middle = (low + high) * 0.5;
+			if (EvaluateBezier(x1, x2, middle) < x) {
+				low = middle;
+			}
+			else {
+				high = middle;
+			}
+		}
+		return EvaluateBezier(y1, y2, (low + high) * 0.5);
+	}
+
+	// 以前の方式（曲線ごとにニュートン法で解き、収束しないときは二分法に切り替える）
+	float SolveNewton(float x1, float y1, float x2, float y2, float x)
+	{
+		constexpr int Iterations = 16;
+		constexpr float Epsilon = 1.0e-5f;
+		auto bezier = [](float p1, float p2, float t) {
+			auto s = 1.0f - t;
+			return 3.0f * s * s * t * p1 + 3.0f * s * t * t * p2 + t * t * t;
+		};
+		auto t = x;
+		auto low = 0.0f;
+		auto high = 1.0f;
+		for (int i = 0; i < Iterations; i++) {
+			auto error = bezier(x1, x2, t) - x;
+			if (std::fabs(error) < Epsilon) {
+				break;
+			}
+			if (error > 0.0f) {
+				high = t;
+			}
+			else {
+				low = t;
+			}
+			auto s = 1.0f - t;
+			auto slope = 3.0f * s * s * x1 + 6.0f * s * t * (x2 - x1) + 3.0f * t * t * (1.0f - x2);
+			auto next = slope > Epsilon ? t - error / slope : low - 1.0f;
+			t = (next > low && next < high) ? next : (low + high) * 0.5f;
+		}
+		return bezier(y1, y2, t);
+	}
+
+	// VMDと同じく制御点を0〜127の整数で与えた4曲線
+	// 先頭の16組は4曲線とも制御点を0か127に寄せた極端な形にする（傾きが0になる端や急な立ち上がりを含む）
+	std::vector<pmd::MotionCurves> CreateTestCurves(size_t count, std::mt19937* pRandom)
+	{
+		std::vector<pmd::MotionCurves> curves(count);
+		for (size_t i = 0; i < count; i++) {
+			float p[16];
+			for (int c = 0; c < 4; c++) {
+				for (int e = 0; e < 4; e++) {
+					auto value = (i < 16) ? (((i >> e) & 1) ? 0 : 127) : static_cast<int>((*pRandom)() % 128);
+					p[c * 4 + e] = value / 127.0f;
+				}
+			}
+			curves[i].x1 = DirectX::XMFLOAT4(p[0], p[4], p[8], p[12]);
+			curves[i].y1 = DirectX::XMFLOAT4(p[1], p[5], p[9], p[13]);
+			curves[i].x2 = DirectX::XMFLOAT4(p[2], p[6], p[10], p[14]);
+			curves[i].y2 = DirectX::XMFLOAT4(p[3], p[7], p[11], p[15]);
+		}
+		return curves;
+	}
+
+	// 経過の割合の格子（0〜1の400等分と、両端のすぐ内側）
+	std::vector<float> CreateTestRatios()
+	{
+		std::vector<float> ratios;
+		for (int k = 0; k <= 400; k++) {
+			ratios.push_back(k / 400.0f);
+		}
+		ratios.push_back(1.0e-4f);
+		ratios.push_back(1.0f - 1.0e-4f);
+		return ratios;
+	}
+}
+
+// 補間曲線の重みを正確な解と比べ、誤差が上限に収まることを確かめる
+bool ValidateCurves(bool benchmark)
+{
+	printf("PMDMotionSampler::EvaluateCurves\n");
+
+	constexpr size_t CurveCount = 4096;
+	std::mt19937 random(1);
+	auto curves = CreateTestCurves(CurveCount, &random);
+	auto ratios = CreateTestRatios();
+
+	std::vector<double> errors;
+	errors.reserve(curves.size() * ratios.size() * 4);
+	for (const auto& curve : curves) {
+		const float* x1 = &curve.x1.x;
+		const float* y1 = &curve.y1.x;
+		const float* x2 = &curve.x2.x;
+		const float* y2 = &curve.y2.x;
+		for (auto x : ratios) {
+			DirectX::XMFLOAT4 weights;
+			DirectX::XMStoreFloat4(&weights, pmd::PMDMotionSampler::EvaluateCurves(curve, x));
+			const float* weight = &weights.x;
+			for (int c = 0; c < 4; c++) {
+				auto exact = SolveExact(x1[c], y1[c], x2[c], y2[c], x);
+				errors.push_back(std::fabs(weight[c] - exact));
+			}
+		}
+	}
+	std::sort(errors.begin(), errors.end());
+	auto median = errors[errors.size() / 2];
+	auto maxError = errors.back();
+	printf("  %zu samples, median error %.2e, max error %.2e (bound %.1e)\n", errors.size(), median, maxError, MaxCurveError);
+
+	auto passed = true;
+	passed = Expect(maxError <= MaxCurveError, "EvaluateCurves exceeds the bisection bracket bound") && passed;
+
+	if (benchmark) {
+		// キー1つ分（4曲線）の重みを求める時間
+		constexpr size_t SampleCount = 2000000;
+		std::uniform_real_distribution<float> ratio(0.0f, 1.0f);
+		std::vector<float> samples(SampleCount);
+		for (auto& x : samples) {
+			x = ratio(random);
+		}
+		auto sink = 0.0f;
+		auto newtonTime = MeasureMicroseconds(1, [&]() {
+			for (size_t i = 0; i < SampleCount; i++) {
+				const auto& curve = curves[i % CurveCount];
+				auto x = samples[i];
+				sink += SolveNewton(curve.x1.x, curve.y1.x, curve.x2.x, curve.y2.x, x);
+				sink += SolveNewton(curve.x1.y, curve.y1.y, curve.x2.y, curve.y2.y, x);
+				sink += SolveNewton(curve.x1.z, curve.y1.z, curve.x2.z, curve.y2.z, x);
+				sink += SolveNewton(curve.x1.w, curve.y1.w, curve.x2.w, curve.y2.w, x);
+			}
+		});
+		auto bisectionTime = MeasureMicroseconds(1, [&]() {
+			for (size_t i = 0; i < SampleCount; i++) {
+				sink += DirectX::XMVectorGetX(DirectX::XMVector4Dot(
+					pmd::PMDMotionSampler::EvaluateCurves(curves[i % CurveCount], samples[i]), DirectX::XMVectorReplicate(1.0f)));
+			}
+		});
+		printf("  newton per curve %.1f ns, bisection 4 curves %.1f ns (per key, checksum %.1f)\n",
+			newtonTime * 1000.0 / SampleCount, bisectionTime * 1000.0 / SampleCount, sink);
+	}
+
+	return passed;
+}
@@ -0,0 +1,228 @@
+﻿// std
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "PMD/PMDCookedModel.h"
+#include "PMD/PMDMeshletBuilder.h"
+#include "Validation.h"
+
+namespace
+{
+	using namespace DirectX;
+
+	// 検証するモデル（ModelFolderにあるもの）と表示名
+	struct MeshletTestModel
+	{
+		const wchar_t* filename;
+		const char* name;
+	};
+	constexpr MeshletTestModel TestModels[] = {
+		{ L"初音ミク.pmd", "Miku" },
+		{ L"初音ミクVer2.pmd", "Miku Ver2" },
+		{ L"初音ミクmetal.pmd", "Miku metal" },
+		{ L"鏡音リン.pmd", "Rin" },
+		{ L"鏡音リン_act2.pmd", "Rin act2" },
+		{ L"鏡音レン.pmd", "Len" },
+		{ L"巡音ルカ.pmd", "Luka" },
+		{ L"MEIKO.pmd", "MEIKO" },
+		{ L"咲音メイコ.pmd", "Sakine Meiko" },
+		{ L"カイト.pmd", "KAITO" },
+		{ L"亞北ネル.pmd", "Akita Neru" },
+		{ L"弱音ハク.pmd", "Yowane Haku" },
+		{ L"ダミーボーン.pmd", "Dummy bone" },
+	};
+
+	// 裏面判定を試す視点の数（メッシュレットごと）
+	constexpr size_t ViewsPerMeshlet = 32;
+
+	// 三角形の比較用キー（向きを保ったまま最小の頂点番号が先頭になるように回す）
+	uint64_t MakeTriangleKey(uint16_t a, uint16_t b, uint16_t c)
+	{
+		if (b < a && b <= c) {
+			std::swap(a, b);
+			std::swap(b, c);
+		}
+		else if (c < a && c < b) {
+			std::swap(a, c);
+			std::swap(b, c);
+		}
+		return (static_cast<uint64_t>(a) << 32) | (static_cast<uint64_t>(b) << 16) | c;
+	}
+
+	// メッシュレットの面法線（縮退していればfalse）
+	bool ComputeFaceNormal(XMVECTOR p0, XMVECTOR p1, XMVECTOR p2, XMVECTOR* pNormal)
+	{
+		auto normal = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+		auto length = XMVectorGetX(XMVector3Length(normal));
+		if (length <= 0.0f) {
+			return false;
+		}
+		*pNormal = XMVectorScale(normal, 1.0f / length);
+		return true;
+	}
+
+	// 1つのモデルのメッシュレットを検証し、裏面と判定した視点の数を数える
+	bool ValidateModelMeshlets(const pmd::PMDCookedModel& model, std::mt19937* pRandom, size_t* pCulledViews, size_t* pTestedViews)
+	{
+		const auto& vertices = model.GetVertices();
+		const auto& indices = model.GetIndices();
+		const auto& meshlets = model.GetMeshlets();
+		const auto& meshletVertices = model.GetMeshletVertices();
+		const auto& meshletTriangles = model.GetMeshletTriangles();
+		std::normal_distribution<float> gaussian;
+		std::uniform_real_distribution<float> scale(1.1f, 20.0f);
+
+		auto passed = true;
+		size_t indexOffset = 0;
+		std::vector<uint64_t> expected;
+		std::vector<uint64_t> actual;
+		for (const auto& material : model.GetMaterials()) {
+			// マテリアルのインデックス範囲の三角形が、メッシュレットにちょうど1回ずつ現れる
+			expected.clear();
+			for (size_t i = indexOffset; i + 3 <= indexOffset + material.indicesNum; i += 3) {
+				expected.push_back(MakeTriangleKey(indices[i], indices[i + 1], indices[i + 2]));
+			}
+			indexOffset += material.indicesNum;
+
+			actual.clear();
+			for (size_t m = material.firstMeshlet; m < material.firstMeshlet + material.meshletCount; m++) {
+				const auto& meshlet = meshlets[m];
+				passed = Expect(meshlet.vertexCount <= pmd::MaxMeshletVertices && meshlet.triangleCount <= pmd::MaxMeshletTriangles,
+					"a meshlet exceeds the vertex or triangle limit") && passed;
+				const auto* localVertices = meshletVertices.data() + meshlet.vertexOffset;
+				const auto* triangles = meshletTriangles.data() + meshlet.triangleOffset;
+				for (size_t t = 0; t < meshlet.triangleCount * 3u; t += 3) {
+					if (!Expect(triangles[t] < meshlet.vertexCount && triangles[t + 1] < meshlet.vertexCount && triangles[t + 2] < meshlet.vertexCount,
+						"a meshlet triangle refers outside the meshlet"))
+					{
+						return false;
+					}
+					actual.push_back(MakeTriangleKey(localVertices[triangles[t]], localVertices[triangles[t + 1]], localVertices[triangles[t + 2]]));
+				}
+
+				// 包含球はすべての頂点を含む
+				auto center = XMLoadFloat3(&meshlet.center);
+				auto tolerance = 1.0e-5f * (1.0f + meshlet.radius);
+				for (size_t i = 0; i < meshlet.vertexCount; i++) {
+					auto position = XMLoadFloat3(&vertices[localVertices[i]].pos);
+					if (XMVectorGetX(XMVector3Length(XMVectorSubtract(position, center))) > meshlet.radius + tolerance) {
+						passed = Expect(false, "a meshlet vertex lies outside its bounding sphere") && passed;
+						break;
+					}
+				}
+
+				// 法線コーンは保守的: 裏面と判定した視点からは、どの三角形も表を向いていない
+				if (meshlet.coneCutoff >= 1.0f) {
+					continue;
+				}
+				auto axis = XMLoadFloat3(&meshlet.coneAxis);
+				for (size_t v = 0; v < ViewsPerMeshlet; v++) {
+					// 半分は周囲の任意の方向、半分は裏面と判定されやすい軸の後ろ側から見る
+					auto direction = XMVector3Normalize(XMVectorSet(gaussian(*pRandom), gaussian(*pRandom), gaussian(*pRandom), 0.0f));
+					if (v % 2 != 0) {
+						direction = XMVector3Normalize(XMVectorSubtract(XMVectorScale(direction, 0.3f), axis));
+					}
+					auto camera = XMVectorAdd(center, XMVectorScale(direction, std::max(meshlet.radius, 1.0e-3f) * scale(*pRandom)));
+					XMFLOAT3 cameraPosition;
+					XMStoreFloat3(&cameraPosition, camera);
+					(*pTestedViews)++;
+					if (!pmd::IsMeshletBackfacing(meshlet, cameraPosition)) {
+						continue;
+					}
+					(*pCulledViews)++;
+					for (size_t t = 0; t < meshlet.triangleCount * 3u; t += 3) {
+						auto p0 = XMLoadFloat3(&vertices[localVertices[triangles[t]]].pos);
+						auto p1 = XMLoadFloat3(&vertices[localVertices[triangles[t + 1]]].pos);
+						auto p2 = XMLoadFloat3(&vertices[localVertices[triangles[t + 2]]].pos);
+						XMVECTOR normal;
+						if (!ComputeFaceNormal(p0, p1, p2, &normal)) {
+							continue;
+						}
+						auto toCamera = XMVectorSubtract(camera, p0);
+						auto distance = XMVectorGetX(XMVector3Dot(toCamera, normal));
+						if (distance > 1.0e-4f * (1.0f + XMVectorGetX(XMVector3Length(toCamera)))) {
+							return Expect(false, "a meshlet culled by its normal cone has a front-facing triangle");
+						}
+					}
+				}
+			}
+
+			std::sort(expected.begin(), expected.end());
+			std::sort(actual.begin(), actual.end());
+			passed = Expect(expected == actual, "meshlets do not cover the material's triangles exactly once") && passed;
+		}
+		return passed;
+	}
+}
+
+// Chapter07/Modelの全モデルのメッシュレットを検証し、充填率を表示する
+// マテリアルの三角形がちょうど1回ずつ含まれること、包含球が頂点を含むこと、法線コーンによる裏面判定が表向きの三角形を捨てないこと
+bool ValidateMeshlets(bool benchmark)
+{
+	printf("PMDMeshletBuilder\n");
+
+	auto passed = true;
+	std::mt19937 random(1);
+	size_t totalMeshlets = 0;
+	size_t totalVertices = 0;
+	size_t totalTriangles = 0;
+	size_t culledViews = 0;
+	size_t testedViews = 0;
+	for (const auto& testModel : TestModels) {
+		pmd::PMDCookedModel model;
+		auto filename = std::wstring(ModelFolder) + L"/" + testModel.filename;
+		if (!Expect(model.LoadOrCook(filename, ModelFolder), "cannot load the model (run from the Chapter10Validation folder)")) {
+			passed = false;
+			continue;
+		}
+		if (!ValidateModelMeshlets(model, &random, &culledViews, &testedViews)) {
+			printf("  NG: %s\n", testModel.name);
+			passed = false;
+		}
+
+		const auto& meshlets = model.GetMeshlets();
+		if (benchmark) {
+			// 全マテリアルのメッシュレットを作り直す時間
+			std::vector<pmd::CookedMeshlet> rebuiltMeshlets;
+			std::vector<uint16_t> rebuiltVertices;
+			std::vector<uint8_t> rebuiltTriangles;
+			const auto& vertices = model.GetVertices();
+			const auto& indices = model.GetIndices();
+			auto time = MeasureMicroseconds(10, [&]() {
+				rebuiltMeshlets.clear();
+				rebuiltVertices.clear();
+				rebuiltTriangles.clear();
+				size_t indexOffset = 0;
+				for (const auto& material : model.GetMaterials()) {
+					pmd::BuildMeshlets(vertices.data(), vertices.size(), indices.data() + indexOffset, material.indicesNum,
+						&rebuiltMeshlets, &rebuiltVertices, &rebuiltTriangles);
+					indexOffset += material.indicesNum;
+				}
+			});
+			printf("  %-14s build %.1f us\n", testModel.name, time);
+		}
+		auto statistics = pmd::AnalyzeMeshlets(meshlets.data(), meshlets.size());
+		printf("  %-14s %5zu meshlets, vertex fill %5.1f%%, triangle fill %5.1f%%\n",
+			testModel.name, statistics.meshletCount, statistics.vertexFill * 100.0f, statistics.triangleFill * 100.0f);
+		for (const auto& meshlet : meshlets) {
+			totalVertices += meshlet.vertexCount;
+			totalTriangles += meshlet.triangleCount;
+		}
+		totalMeshlets += meshlets.size();
+	}
+
+	if (totalMeshlets > 0) {
+		printf("  %-14s %5zu meshlets, vertex fill %5.1f%%, triangle fill %5.1f%%\n", "total", totalMeshlets,
+			100.0 * totalVertices / (pmd::MaxMeshletVertices * totalMeshlets),
+			100.0 * totalTriangles / (pmd::MaxMeshletTriangles * totalMeshlets));
+	}
+	if (testedViews > 0) {
+		printf("  normal cone culled %zu of %zu views (%.1f%%)\n", culledViews, testedViews, 100.0 * culledViews / testedViews);
+	}
+	// 裏面判定が一度も成立しなければ、コーンの検証が意味を持たない
+	passed = Expect(culledViews > 0, "the normal cone never culled a meshlet") && passed;
+	return passed;
+}
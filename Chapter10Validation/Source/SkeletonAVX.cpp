@@ -0,0 +1,26 @@
+﻿// PMDSkeleton.cppをAVXでコンパイルした版（名前空間を変えて通常版と並べる。プロジェクトでこのファイルだけ/arch:AVXにする）
+#define pmd pmd_avx
+#include "PMD/PMDSkeleton.cpp"
+#undef pmd
+
+#include "SkeletonVariants.h"
+
+namespace
+{
+	pmd_avx::PMDSkeleton skeleton;
+}
+
+void AssignSkeletonAVX(const uint16_t* pParents, size_t numberOfBone)
+{
+	std::vector<pmd_avx::CookedBone> bones(numberOfBone);
+	for (size_t i = 0; i < numberOfBone; i++) {
+		bones[i].parentIdx = pParents[i];
+	}
+	skeleton.Assign(ArrayView<pmd_avx::CookedBone>(bones.data(), bones.size()));
+}
+
+void ComputeWorldMatricesBatchAVX(
+	const DirectX::XMMATRIX* const* ppLocal, DirectX::XMMATRIX* const* ppWorld, size_t actorCount)
+{
+	skeleton.ComputeWorldMatricesBatch(ppLocal, ppWorld, actorCount);
+}
@@ -0,0 +1,27 @@
+﻿// PMDSkeleton.cppをSIMDを使わずにコンパイルした版（名前空間を変えて通常版と並べる）
+#define PMD_SKELETON_NO_SIMD
+#define pmd pmd_scalar
+#include "PMD/PMDSkeleton.cpp"
+#undef pmd
+
+#include "SkeletonVariants.h"
+
+namespace
+{
+	pmd_scalar::PMDSkeleton skeleton;
+}
+
+void AssignSkeletonScalar(const uint16_t* pParents, size_t numberOfBone)
+{
+	std::vector<pmd_scalar::CookedBone> bones(numberOfBone);
+	for (size_t i = 0; i < numberOfBone; i++) {
+		bones[i].parentIdx = pParents[i];
+	}
+	skeleton.Assign(ArrayView<pmd_scalar::CookedBone>(bones.data(), bones.size()));
+}
+
+void ComputeWorldMatricesBatchScalar(
+	const DirectX::XMMATRIX* const* ppLocal, DirectX::XMMATRIX* const* ppWorld, size_t actorCount)
+{
+	skeleton.ComputeWorldMatricesBatch(ppLocal, ppWorld, actorCount);
+}
@@ -0,0 +1,244 @@
+﻿// std
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "PMD/PMDCookedModel.h"
+#include "PMD/PMDSkeleton.h"
+#include "SkeletonVariants.h"
+#include "Validation.h"
+
+namespace
+{
+	// 検証に使う骨格（モデルと同じくらいのボーン数で、親は必ず子より前の番号）
+	struct TestSkeleton
+	{
+		std::vector<uint16_t> parents;
+		std::vector<DirectX::XMFLOAT3> bindPositions;
+		std::vector<std::vector<uint16_t>> children;
+	};
+
+	TestSkeleton CreateTestSkeleton(size_t numberOfBone, std::mt19937* pRandom)
+	{
+		std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+		TestSkeleton skeleton;
+		skeleton.parents.resize(numberOfBone);
+		skeleton.bindPositions.resize(numberOfBone);
+		skeleton.children.resize(numberOfBone);
+		for (size_t i = 0; i < numberOfBone; i++) {
+			// 数十本に1本は親のないボーンにする
+			auto parentIdx = (i % 40 == 0) ? pmd::InvalidBoneIndex : static_cast<uint16_t>((*pRandom)() % i);
+			skeleton.parents[i] = parentIdx;
+			skeleton.bindPositions[i] = DirectX::XMFLOAT3(position(*pRandom), position(*pRandom), position(*pRandom));
+			if (parentIdx != pmd::InvalidBoneIndex) {
+				skeleton.children[parentIdx].push_back(static_cast<uint16_t>(i));
+			}
+		}
+		return skeleton;
+	}
+
+	// 初期位置を中心に回転して少し移動するローカル変換（PMDSkeleton::ComputeLocalMatrixと同じ形）
+	void CreateLocalMatrices(const TestSkeleton& skeleton, std::mt19937* pRandom, std::vector<DirectX::XMMATRIX>* pLocal)
+	{
+		std::uniform_real_distribution<float> angle(-1.0f, 1.0f);
+		pLocal->resize(skeleton.parents.size());
+		for (size_t i = 0; i < skeleton.parents.size(); i++) {
+			const auto& p = skeleton.bindPositions[i];
+			auto rotation = DirectX::XMMatrixRotationZ(angle(*pRandom)) * DirectX::XMMatrixRotationX(angle(*pRandom))
+				* DirectX::XMMatrixRotationY(angle(*pRandom));
+			(*pLocal)[i] = DirectX::XMMatrixTranslation(-p.x, -p.y, -p.z) * rotation
+				* DirectX::XMMatrixTranslation(p.x + angle(*pRandom), p.y + angle(*pRandom), p.z + angle(*pRandom));
+		}
+	}
+
+	// 以前の方式（子をたどる再帰とXMMatrixMultiply）。pMatricesにローカル変換を入れて呼ぶと、その場でワールド変換になる
+	void MultiplyRecursive(const TestSkeleton& skeleton, size_t boneIdx, const DirectX::XMMATRIX& parent, DirectX::XMMATRIX* pMatrices)
+	{
+		pMatrices[boneIdx] = DirectX::XMMatrixMultiply(pMatrices[boneIdx], parent);
+		for (auto childIdx : skeleton.children[boneIdx]) {
+			MultiplyRecursive(skeleton, childIdx, pMatrices[boneIdx], pMatrices);
+		}
+	}
+
+	void ComputeWorldMatricesRecursive(const TestSkeleton& skeleton, const DirectX::XMMATRIX* pLocal, DirectX::XMMATRIX* pWorld)
+	{
+		std::copy(pLocal, pLocal + skeleton.parents.size(), pWorld);
+		for (size_t i = 0; i < skeleton.parents.size(); i++) {
+			if (skeleton.parents[i] == pmd::InvalidBoneIndex) {
+				MultiplyRecursive(skeleton, i, DirectX::XMMatrixIdentity(), pWorld);
+			}
+		}
+	}
+
+	// アクターごとのローカル変換とワールド変換
+	struct ActorMatrices
+	{
+		std::vector<std::vector<DirectX::XMMATRIX>> local;
+		std::vector<std::vector<DirectX::XMMATRIX>> world;
+		std::vector<const DirectX::XMMATRIX*> pLocal;
+		std::vector<DirectX::XMMATRIX*> pWorld;
+
+		ActorMatrices(const TestSkeleton& skeleton, size_t actorCount, std::mt19937* pRandom) :
+			local(actorCount), world(actorCount), pLocal(actorCount), pWorld(actorCount)
+		{
+			for (size_t a = 0; a < actorCount; a++) {
+				CreateLocalMatrices(skeleton, pRandom, &local[a]);
+				world[a].resize(skeleton.parents.size());
+			}
+			Bind();
+		}
+
+		// 同じローカル変換で別に計算するための複製
+		ActorMatrices(const ActorMatrices& other) :
+			local(other.local), world(other.world), pLocal(other.pLocal.size()), pWorld(other.pWorld.size())
+		{
+			Bind();
+		}
+
+		ActorMatrices& operator=(const ActorMatrices&) = delete;
+
+		// ローカル変換をワールド変換の配列へ写し、同じ配列で計算する
+		void BindInPlace()
+		{
+			for (size_t a = 0; a < world.size(); a++) {
+				world[a] = local[a];
+				pLocal[a] = world[a].data();
+			}
+		}
+
+		// 全アクターのワールド変換がバイト単位で一致するか
+		bool IsSame(const ActorMatrices& other) const
+		{
+			for (size_t a = 0; a < world.size(); a++) {
+				if (std::memcmp(world[a].data(), other.world[a].data(), sizeof(DirectX::XMMATRIX) * world[a].size()) != 0) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+	private:
+		void Bind()
+		{
+			for (size_t a = 0; a < world.size(); a++) {
+				pLocal[a] = local[a].data();
+				pWorld[a] = world[a].data();
+			}
+		}
+	};
+
+	// 2つの行列の要素の差の最大値
+	float GetMaxDifference(const DirectX::XMMATRIX& a, const DirectX::XMMATRIX& b)
+	{
+		const auto* pA = reinterpret_cast<const float*>(&a);
+		const auto* pB = reinterpret_cast<const float*>(&b);
+		float difference = 0.0f;
+		for (size_t e = 0; e < 16; e++) {
+			difference = std::max(difference, std::fabs(pA[e] - pB[e]));
+		}
+		return difference;
+	}
+}
+
+// PMDSkeletonのワールド変換の検証
+// SIMDを使わない版、SSE2（既定）版、AVX版のComputeWorldMatricesBatchと1アクターずつのComputeWorldMatricesが
+// ビット単位で一致し、以前の再帰による計算と誤差の範囲で一致すること
+// ベンチマークは以前の再帰、1アクターずつ、各版のまとめての計算を1、100、1000アクターで比べる
+bool ValidateSkeleton(bool benchmark)
+{
+	printf("PMDSkeleton\n");
+
+	// ボーン数はmiku.pmdと同じ122本。アクター数は4でも8でも割り切れない数にして端数の処理も通す
+	constexpr size_t NumberOfBone = 122;
+	constexpr size_t ActorCount = 37;
+	std::mt19937 random(1);
+	auto testSkeleton = CreateTestSkeleton(NumberOfBone, &random);
+	std::vector<pmd::CookedBone> bones(NumberOfBone);
+	for (size_t i = 0; i < NumberOfBone; i++) {
+		bones[i].parentIdx = testSkeleton.parents[i];
+		bones[i].pos = testSkeleton.bindPositions[i];
+	}
+	pmd::PMDSkeleton skeleton;
+	skeleton.Assign(ArrayView<pmd::CookedBone>(bones.data(), bones.size()));
+	AssignSkeletonScalar(testSkeleton.parents.data(), NumberOfBone);
+	auto avx = IsAVXSupported();
+	if (avx) {
+		AssignSkeletonAVX(testSkeleton.parents.data(), NumberOfBone);
+	}
+
+	auto passed = true;
+	ActorMatrices reference(testSkeleton, ActorCount, &random);
+	ComputeWorldMatricesBatchScalar(reference.pLocal.data(), reference.pWorld.data(), ActorCount);
+
+	ActorMatrices single(reference);
+	for (size_t a = 0; a < ActorCount; a++) {
+		skeleton.ComputeWorldMatrices(single.pLocal[a], single.pWorld[a]);
+	}
+	passed = Expect(single.IsSame(reference), "ComputeWorldMatrices differs from the scalar build") && passed;
+
+	ActorMatrices batch(reference);
+	skeleton.ComputeWorldMatricesBatch(batch.pLocal.data(), batch.pWorld.data(), ActorCount);
+	passed = Expect(batch.IsSame(reference), "ComputeWorldMatricesBatch differs from the scalar build") && passed;
+
+	if (avx) {
+		ActorMatrices batchAVX(reference);
+		ComputeWorldMatricesBatchAVX(batchAVX.pLocal.data(), batchAVX.pWorld.data(), ActorCount);
+		passed = Expect(batchAVX.IsSame(reference), "ComputeWorldMatricesBatch (AVX) differs from the scalar build") && passed;
+	}
+	else {
+		printf("  AVX is not supported. skipped\n");
+	}
+
+	// ローカル変換とワールド変換が同じ配列でもよい
+	ActorMatrices inPlace(reference);
+	inPlace.BindInPlace();
+	skeleton.ComputeWorldMatricesBatch(inPlace.pLocal.data(), inPlace.pWorld.data(), ActorCount);
+	passed = Expect(inPlace.IsSame(reference), "in-place ComputeWorldMatricesBatch differs from the scalar build") && passed;
+
+	// 以前の計算とは加算の順序が違うので誤差の範囲で比べる
+	float maxDifference = 0.0f;
+	std::vector<DirectX::XMMATRIX> recursive(NumberOfBone);
+	for (size_t a = 0; a < ActorCount; a++) {
+		ComputeWorldMatricesRecursive(testSkeleton, reference.local[a].data(), recursive.data());
+		for (size_t i = 0; i < NumberOfBone; i++) {
+			maxDifference = std::max(maxDifference, GetMaxDifference(recursive[i], reference.world[a][i]));
+		}
+	}
+	printf("  max difference from the recursive multiply: %g\n", maxDifference);
+	passed = Expect(maxDifference < 1.0e-3f, "too far from the recursive multiply") && passed;
+
+	if (benchmark) {
+		printf("  actors  recursive  flat single  batch scalar  batch SSE2  batch AVX  (us per update of all actors)\n");
+		const size_t actorCounts[] = { 1, 100, 1000 };
+		for (auto actorCount : actorCounts) {
+			ActorMatrices matrices(testSkeleton, actorCount, &random);
+			auto repeat = std::max<size_t>(20000 / actorCount, 10);
+			auto recursiveTime = MeasureMicroseconds(repeat, [&]() {
+				for (size_t a = 0; a < actorCount; a++) {
+					ComputeWorldMatricesRecursive(testSkeleton, matrices.pLocal[a], matrices.pWorld[a]);
+				}
+			});
+			auto singleTime = MeasureMicroseconds(repeat, [&]() {
+				for (size_t a = 0; a < actorCount; a++) {
+					skeleton.ComputeWorldMatrices(matrices.pLocal[a], matrices.pWorld[a]);
+				}
+			});
+			auto scalarTime = MeasureMicroseconds(repeat, [&]() {
+				ComputeWorldMatricesBatchScalar(matrices.pLocal.data(), matrices.pWorld.data(), actorCount);
+			});
+			auto batchTime = MeasureMicroseconds(repeat, [&]() {
+				skeleton.ComputeWorldMatricesBatch(matrices.pLocal.data(), matrices.pWorld.data(), actorCount);
+			});
+			auto avxTime = avx ? MeasureMicroseconds(repeat, [&]() {
+				ComputeWorldMatricesBatchAVX(matrices.pLocal.data(), matrices.pWorld.data(), actorCount);
+			}) : 0.0;
+			printf("  %6zu %10.1f %12.1f %13.1f %11.1f %10.1f\n",
+				actorCount, recursiveTime, singleTime, scalarTime, batchTime, avxTime);
+		}
+	}
+
+	return passed;
+}
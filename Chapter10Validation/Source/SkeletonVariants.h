@@ -0,0 +1,18 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+// DirectX
+#include <DirectXMath.h>
+
+// PMDSkeleton.cppを別の設定でコンパイルした版（SkeletonScalar.cpp、SkeletonAVX.cpp）
+// Assign～でボーンの親番号を設定してから、PMDSkeleton::ComputeWorldMatricesBatchと同じ引数で呼ぶ
+void AssignSkeletonScalar(const uint16_t* pParents, size_t numberOfBone);
+void ComputeWorldMatricesBatchScalar(
+	const DirectX::XMMATRIX* const* ppLocal, DirectX::XMMATRIX* const* ppWorld, size_t actorCount);
+
+void AssignSkeletonAVX(const uint16_t* pParents, size_t numberOfBone);
+void ComputeWorldMatricesBatchAVX(
+	const DirectX::XMMATRIX* const* ppLocal, DirectX::XMMATRIX* const* ppWorld, size_t actorCount);
@@ -0,0 +1,8 @@
+﻿// PMDSkinning.cppをAVX2でコンパイルした版（プロジェクトでこのファイルだけ/arch:AVX2にする）
+// 頂点の型（SerializedVertexなど）を通常版と共有できるように、名前空間ではなく関数名を付け替えて並べる
+#define SkinVertices SkinVerticesAVX2
+#define SkinVerticesScalar SkinVerticesScalarAVX2
+#define SkinVerticesParallel SkinVerticesParallelAVX2
+#define ConvertToDualQuaternions ConvertToDualQuaternionsAVX2
+#define SkinVerticesDualQuaternionScalar SkinVerticesDualQuaternionScalarAVX2
+#include "PMD/PMDSkinning.cpp"
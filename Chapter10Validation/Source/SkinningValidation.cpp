@@ -0,0 +1,246 @@
+﻿// std
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "PMD/PMDSkinning.h"
+#include "SkinningVariants.h"
+#include "Validation.h"
+#include "WorkStealingPool.h"
+
+namespace
+{
+	// SIMD版とスカラー版の差の上限（座標はモデル空間の大きさ1あたり）
+	constexpr float MaxSimdDifference = 2.0e-6f;
+
+	// 1ボーンだけの頂点での、双対クォータニオンと行列の線形ブレンドの差の上限（クォータニオンへの変換の丸め誤差の分）
+	constexpr float MaxSingleBoneDifference = 1.0e-5f;
+
+	// 検証に使う頂点とボーン
+	struct TestMesh
+	{
+		std::vector<pmd::SerializedVertex> vertices;
+		std::vector<DirectX::XMMATRIX> bones;
+		std::vector<DirectX::XMVECTOR> morphDeltas;
+
+		pmd::SkinningSource GetSource() const
+		{
+			pmd::SkinningSource source = {};
+			source.pVertices = vertices.data();
+			source.vertexCount = vertices.size();
+			source.pBones = bones.data();
+			source.boneCount = bones.size();
+			source.pMorphDeltas = morphDeltas.data();
+			source.morphedCount = morphDeltas.size();
+			return source;
+		}
+	};
+
+	// モデルと同じくらいの大きさの頂点を作る
+	// ボーン番号にはボーン数以上の番号も混ぜて単位行列として扱う経路を通し、4頂点に1つは1ボーンだけの頂点にする
+	// 表情のオフセットは先頭の3分の1の頂点にだけ付ける
+	TestMesh CreateTestMesh(size_t vertexCount, size_t boneCount, std::mt19937* pRandom)
+	{
+		std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		TestMesh mesh;
+		mesh.vertices.resize(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++) {
+			auto& vertex = mesh.vertices[i];
+			vertex.pos = DirectX::XMFLOAT3(position(*pRandom), position(*pRandom) + 10.0f, position(*pRandom));
+			DirectX::XMStoreFloat3(&vertex.normal, DirectX::XMVector3Normalize(DirectX::XMVectorSet(unit(*pRandom), unit(*pRandom), unit(*pRandom), 0.0f)));
+			vertex.uv = DirectX::XMFLOAT2(0.0f, 0.0f);
+			vertex.boneNo[0] = static_cast<unsigned short>((*pRandom)() % (boneCount + 2));
+			vertex.boneNo[1] = static_cast<unsigned short>((*pRandom)() % (boneCount + 2));
+			vertex.boneWeight = static_cast<unsigned char>(i % 4 == 0 ? 100 : (*pRandom)() % 101);
+			vertex.endflg = 0;
+		}
+		mesh.bones.resize(boneCount);
+		for (auto& bone : mesh.bones) {
+			bone = DirectX::XMMatrixRotationZ(unit(*pRandom) * DirectX::XM_PI) * DirectX::XMMatrixRotationX(unit(*pRandom) * DirectX::XM_PI)
+				* DirectX::XMMatrixRotationY(unit(*pRandom) * DirectX::XM_PI) * DirectX::XMMatrixTranslation(unit(*pRandom), unit(*pRandom), unit(*pRandom));
+		}
+		mesh.morphDeltas.resize(vertexCount / 3);
+		for (auto& delta : mesh.morphDeltas) {
+			delta = DirectX::XMVectorScale(DirectX::XMVectorSet(unit(*pRandom), unit(*pRandom), unit(*pRandom), 0.0f), 0.5f);
+		}
+		return mesh;
+	}
+
+	// 座標と法線の差の最大値（座標は大きさ1を下回らない範囲で相対的に比べる）
+	float GetMaxDifference(const std::vector<pmd::SkinnedVertex>& a, const std::vector<pmd::SkinnedVertex>& b)
+	{
+		float difference = 0.0f;
+		for (size_t i = 0; i < a.size(); i++) {
+			const auto* pA = &a[i].pos.x;
+			const auto* pB = &b[i].pos.x;
+			for (size_t c = 0; c < 3; c++) {
+				difference = std::max(difference, std::fabs(pA[c] - pB[c]) / std::max(std::fabs(pA[c]), 1.0f));
+			}
+			pA = &a[i].normal.x;
+			pB = &b[i].normal.x;
+			for (size_t c = 0; c < 3; c++) {
+				difference = std::max(difference, std::fabs(pA[c] - pB[c]));
+			}
+		}
+		return difference;
+	}
+
+	bool IsSame(const std::vector<pmd::SkinnedVertex>& a, const std::vector<pmd::SkinnedVertex>& b)
+	{
+		return std::memcmp(a.data(), b.data(), sizeof(pmd::SkinnedVertex) * a.size()) == 0;
+	}
+}
+
+// CPUスキニングの検証
+// SSE2（既定）版とAVX2版のSkinVerticesがスカラー版とMaxSimdDifferenceの範囲で一致し、
+// 並列版が1スレッドで処理したのとビット単位で一致すること（AVX2版はAVX2対応のCPUでだけ比べる）
+// ベンチマークは各版と並列版を比べる
+bool ValidateSkinning(bool benchmark)
+{
+	printf("PMDSkinning\n");
+
+	// 頂点数はmiku.pmdより少し多く、2でもSkinningChunkSizeでも割り切れない数にして端数の処理も通す
+	constexpr size_t VertexCount = 9037;
+	constexpr size_t BoneCount = 122;
+	std::mt19937 random(1);
+	auto mesh = CreateTestMesh(VertexCount, BoneCount, &random);
+	auto source = mesh.GetSource();
+	auto avx2 = IsAVX2Supported();
+
+	std::vector<pmd::SkinnedVertex> reference(VertexCount);
+	pmd::SkinVerticesScalar(source, 0, VertexCount, reference.data());
+
+	auto passed = true;
+	std::vector<pmd::SkinnedVertex> simd(VertexCount);
+	pmd::SkinVertices(source, 0, VertexCount, simd.data());
+	auto simdDifference = GetMaxDifference(simd, reference);
+	printf("  max difference from scalar: SSE2 %.2e", simdDifference);
+	passed = Expect(simdDifference <= MaxSimdDifference, "SkinVertices differs from SkinVerticesScalar") && passed;
+
+	std::vector<pmd::SkinnedVertex> simdAVX2(VertexCount);
+	if (avx2) {
+		pmd::SkinVerticesAVX2(source, 0, VertexCount, simdAVX2.data());
+		auto avx2Difference = GetMaxDifference(simdAVX2, reference);
+		printf(", AVX2 %.2e", avx2Difference);
+		passed = Expect(avx2Difference <= MaxSimdDifference, "SkinVerticesAVX2 differs from SkinVerticesScalar") && passed;
+	}
+	printf(" (bound %.1e)\n", MaxSimdDifference);
+
+	// ジョブごとに頂点の範囲が分かれているだけなので、並列に処理しても結果は変わらない
+	WorkStealingPool pool;
+	std::vector<pmd::SkinnedVertex> parallel(VertexCount);
+	pmd::SkinVerticesParallel(&pool, source, parallel.data());
+	passed = Expect(IsSame(parallel, simd), "SkinVerticesParallel differs from SkinVertices") && passed;
+
+	if (benchmark) {
+		auto repeat = 200;
+		auto scalarTime = MeasureMicroseconds(repeat, [&]() {
+			pmd::SkinVerticesScalar(source, 0, VertexCount, reference.data());
+		});
+		auto simdTime = MeasureMicroseconds(repeat, [&]() {
+			pmd::SkinVertices(source, 0, VertexCount, simd.data());
+		});
+		auto avx2Time = avx2 ? MeasureMicroseconds(repeat, [&]() {
+			pmd::SkinVerticesAVX2(source, 0, VertexCount, simdAVX2.data());
+		}) : 0.0;
+		auto parallelTime = MeasureMicroseconds(repeat, [&]() {
+			pmd::SkinVerticesParallel(&pool, source, parallel.data());
+		});
+		printf("  %zu vertices: scalar %.1f us, SSE2 %.1f us, AVX2 %.1f us, parallel %.1f us\n",
+			VertexCount, scalarTime, simdTime, avx2Time, parallelTime);
+	}
+
+	return passed;
+}
+
+// 双対クォータニオンによるスキニングの検証
+// 1ボーンだけの頂点は線形ブレンドと一致し、パレットの半分の符号を反転しても結果が変わらず、
+// 大きくねじった2ボーンの中間でも半径が保たれること（線形ブレンドでは潰れる）
+bool ValidateDualQuaternions(bool benchmark)
+{
+	printf("PMDSkinning (dual quaternion)\n");
+
+	constexpr size_t VertexCount = 9037;
+	constexpr size_t BoneCount = 122;
+	std::mt19937 random(2);
+	auto mesh = CreateTestMesh(VertexCount, BoneCount, &random);
+	auto source = mesh.GetSource();
+	std::vector<pmd::DualQuaternion> dualQuaternions(BoneCount);
+	pmd::ConvertToDualQuaternions(mesh.bones.data(), BoneCount, dualQuaternions.data());
+
+	std::vector<pmd::SkinnedVertex> linear(VertexCount);
+	std::vector<pmd::SkinnedVertex> dual(VertexCount);
+	pmd::SkinVerticesScalar(source, 0, VertexCount, linear.data());
+	pmd::SkinVerticesDualQuaternionScalar(source, dualQuaternions.data(), 0, VertexCount, dual.data());
+
+	// 1ボーンだけの頂点（重みが0か100、または同じボーン2つ）
+	std::vector<pmd::SkinnedVertex> singleLinear;
+	std::vector<pmd::SkinnedVertex> singleDual;
+	for (size_t i = 0; i < VertexCount; i++) {
+		const auto& vertex = mesh.vertices[i];
+		if (vertex.boneWeight == 0 || vertex.boneWeight == 100 || vertex.boneNo[0] == vertex.boneNo[1]) {
+			singleLinear.push_back(linear[i]);
+			singleDual.push_back(dual[i]);
+		}
+	}
+	auto singleDifference = GetMaxDifference(singleDual, singleLinear);
+	printf("  single-bone vertices: %zu, max difference from linear %.2e (bound %.1e)\n",
+		singleLinear.size(), singleDifference, MaxSingleBoneDifference);
+
+	auto passed = true;
+	passed = Expect(singleDifference <= MaxSingleBoneDifference, "single-bone dual quaternion skinning differs from linear") && passed;
+
+	// qと-qは同じ変換を表すので、半分のボーンの符号を反転しても結果は変わらない
+	auto negated = dualQuaternions;
+	for (size_t i = 0; i < BoneCount; i += 2) {
+		DirectX::XMStoreFloat4(&negated[i].real, DirectX::XMVectorNegate(DirectX::XMLoadFloat4(&negated[i].real)));
+		DirectX::XMStoreFloat4(&negated[i].dual, DirectX::XMVectorNegate(DirectX::XMLoadFloat4(&negated[i].dual)));
+	}
+	std::vector<pmd::SkinnedVertex> negatedDual(VertexCount);
+	pmd::SkinVerticesDualQuaternionScalar(source, negated.data(), 0, VertexCount, negatedDual.data());
+	auto negatedDifference = GetMaxDifference(negatedDual, dual);
+	printf("  half of the palette negated: max difference %.2e\n", negatedDifference);
+	passed = Expect(negatedDifference <= MaxSimdDifference, "negating dual quaternions changes the result") && passed;
+
+	// X軸周りに172°ねじった2ボーンの中間（重み50）にある、軸から距離1の頂点
+	DirectX::XMMATRIX twistBones[] = { DirectX::XMMatrixIdentity(), DirectX::XMMatrixRotationX(3.0f) };
+	pmd::DualQuaternion twistDualQuaternions[2];
+	pmd::ConvertToDualQuaternions(twistBones, 2, twistDualQuaternions);
+	pmd::SerializedVertex twistVertex = {};
+	twistVertex.pos = DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f);
+	twistVertex.normal = DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f);
+	twistVertex.boneNo[0] = 0;
+	twistVertex.boneNo[1] = 1;
+	twistVertex.boneWeight = 50;
+	pmd::SkinningSource twistSource = {};
+	twistSource.pVertices = &twistVertex;
+	twistSource.vertexCount = 1;
+	twistSource.pBones = twistBones;
+	twistSource.boneCount = 2;
+	pmd::SkinnedVertex twistLinear;
+	pmd::SkinnedVertex twistDual;
+	pmd::SkinVerticesScalar(twistSource, 0, 1, &twistLinear);
+	pmd::SkinVerticesDualQuaternionScalar(twistSource, twistDualQuaternions, 0, 1, &twistDual);
+	auto linearRadius = std::hypot(twistLinear.pos.y, twistLinear.pos.z);
+	auto dualRadius = std::hypot(twistDual.pos.y, twistDual.pos.z);
+	printf("  172 degree twist at 50/50: radius linear %.3f, dual quaternion %.6f\n", linearRadius, dualRadius);
+	passed = Expect(std::fabs(dualRadius - 1.0f) <= 1.0e-5f, "dual quaternion skinning does not keep the twist radius") && passed;
+	passed = Expect(linearRadius < 0.1f, "linear skinning was expected to collapse under the twist") && passed;
+
+	if (benchmark) {
+		auto repeat = 200;
+		auto linearTime = MeasureMicroseconds(repeat, [&]() {
+			pmd::SkinVerticesScalar(source, 0, VertexCount, linear.data());
+		});
+		auto dualTime = MeasureMicroseconds(repeat, [&]() {
+			pmd::SkinVerticesDualQuaternionScalar(source, dualQuaternions.data(), 0, VertexCount, dual.data());
+		});
+		printf("  %zu vertices: linear scalar %.1f us, dual quaternion scalar %.1f us\n", VertexCount, linearTime, dualTime);
+	}
+
+	return passed;
+}
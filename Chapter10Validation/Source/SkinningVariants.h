@@ -0,0 +1,12 @@
+﻿#pragma once
+
+// std
+#include <cstddef>
+
+#include "PMD/PMDSkinning.h"
+
+// PMDSkinning.cppをAVX2でコンパイルした版（SkinningAVX2.cpp）。引数はpmd::SkinVerticesと同じ
+namespace pmd
+{
+	void SkinVerticesAVX2(const SkinningSource& source, size_t begin, size_t end, SkinnedVertex* pDst);
+}
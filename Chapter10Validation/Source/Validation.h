@@ -0,0 +1,37 @@
+﻿#pragma once
+
+// std
+#include <chrono>
+#include <cstddef>
+
+// 各検証（失敗したらfalse）。benchmarkならベンチマークも行って結果を表示する
+bool ValidateSkeleton(bool benchmark);
+bool ValidateCurves(bool benchmark);
+bool ValidateSkinning(bool benchmark);
+bool ValidateDualQuaternions(bool benchmark);
+bool ValidateCrowd(bool benchmark);
+bool ValidateMeshlets(bool benchmark);
+
+// 検証に使うモデルのフォルダー（Chapter10Validationのフォルダーから実行する）
+constexpr wchar_t ModelFolder[] = L"../Chapter07/Model";
+
+// 条件を満たさなければメッセージを表示してfalseを返す
+bool Expect(bool condition, const char* message);
+
+// CPUがAVXを使えるか（OSが256ビットのレジスターを保存することも含む）
+bool IsAVXSupported();
+
+// CPUがAVX2を使えるか
+bool IsAVX2Supported();
+
+// taskをrepeat回実行した1回あたりの時間（マイクロ秒）
+template<typename Task>
+double MeasureMicroseconds(size_t repeat, Task task)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < repeat; i++) {
+		task();
+	}
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::micro>(end - start).count() / repeat;
+}
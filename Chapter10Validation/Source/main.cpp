@@ -0,0 +1,71 @@
+﻿// std
+#include <cstdio>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "Validation.h"
+
+// 条件を満たさなければメッセージを表示してfalseを返す
+bool Expect(bool condition, const char* message)
+{
+	if (!condition) {
+		printf("  NG: %s\n", message);
+	}
+	return condition;
+}
+
+// CPUがAVXを使えるか
+bool IsAVXSupported()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	int info[4];
+	__cpuid(info, 1);
+	auto osxsave = (info[2] & (1 << 27)) != 0;
+	auto avx = (info[2] & (1 << 28)) != 0;
+	return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	return __builtin_cpu_supports("avx");
+#else
+	return false;
+#endif
+}
+
+// CPUがAVX2を使えるか
+bool IsAVX2Supported()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return IsAVXSupported() && (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+// Chapter10のCPU側の計算（SIMD版と基準版の一致、誤差の上限）を検証する
+// 引数に"bench"を付けるとベンチマークも行う
+// SIMD版は命令セットごとに別の翻訳単位でコンパイルしたものを並べて比べる（AVX版、AVX2版はそれぞれに対応したCPUでだけ比べる）
+int main(int argc, char* argv[])
+{
+	auto benchmark = argc > 1 && std::strcmp(argv[1], "bench") == 0;
+
+	auto passed = true;
+	passed = ValidateSkeleton(benchmark) && passed;
+	passed = ValidateCurves(benchmark) && passed;
+	passed = ValidateSkinning(benchmark) && passed;
+	passed = ValidateDualQuaternions(benchmark) && passed;
+	passed = ValidateCrowd(benchmark) && passed;
+	passed = ValidateMeshlets(benchmark) && passed;
+
+	printf(passed ? "all passed\n" : "FAILED\n");
+	return passed ? 0 : 1;
+}